@@ -0,0 +1,536 @@
+﻿#include "batch.h"
+#include "dir_scan.h"
+#include "platform.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "telemetry.h"
+#include "wad_trie.h"
+#include "job.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <stdio.h>
+
+// ------------------------------------------------------------
+// Split a job list line into words; "..." keeps spaces
+// ------------------------------------------------------------
+static bool SplitListLine(const std::string& line, std::vector<std::string>& words)
+{
+    words.clear();
+    size_t i = 0;
+    while (i < line.size()) {
+        if (line[i] == ' ' || line[i] == '\t') {
+            ++i;
+            continue;
+        }
+        std::string word;
+        if (line[i] == '"') {
+            size_t end = line.find('"', i + 1);
+            if (end == std::string::npos)
+                return false;
+            word = line.substr(i + 1, end - i - 1);
+            i = end + 1;
+        }
+        else {
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t')
+                word += line[i++];
+        }
+        words.push_back(std::move(word));
+    }
+    return true;
+}
+
+bool ReadBatchList(const std::filesystem::path& listPath, std::vector<BatchItem>& items,
+    std::wstring& error)
+{
+    std::ifstream in(listPath, std::ios::binary);
+    if (!in) {
+        error = L"Cannot read job list: " + PathToDisplay(listPath);
+        return false;
+    }
+
+    std::filesystem::path base = listPath.parent_path();
+    auto resolve = [&base](const std::string& s) {
+        std::filesystem::path p = PathFromUtf8(s);
+        return p.is_absolute() ? p : base / p;
+    };
+
+    std::string line;
+    std::vector<std::string> words;
+    size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (lineNo == 1 && line.size() >= 3 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            line.erase(0, 3);
+
+        std::string_view trimmed(line);
+        while (!trimmed.empty() && (trimmed[0] == ' ' || trimmed[0] == '\t'))
+            trimmed.remove_prefix(1);
+        if (trimmed.empty() || trimmed[0] == '#')
+            continue;
+
+        BatchItem item;
+        bool ok = SplitListLine(line, words) && words.size() >= 2;
+        if (ok) {
+            if (words[0] == "pack") item.op = BatchOp::Pack;
+            else if (words[0] == "extract") item.op = BatchOp::Extract;
+            else if (words[0] == "verify") item.op = BatchOp::Verify;
+            else ok = false;
+        }
+        if (ok)
+            ok = words.size() <= (item.op == BatchOp::Verify ? 2u : 3u);
+        if (!ok) {
+            error = PathToDisplay(listPath) + L"(" + std::to_wstring(lineNo) + L"): expected "
+                L"'pack <folder> [<output.wad>]', 'extract <file.wad> [<output dir>]' or 'verify <file.wad>'";
+            return false;
+        }
+
+        item.input = resolve(words[1]);
+        if (words.size() > 2)
+            item.output = resolve(words[2]);
+        items.push_back(std::move(item));
+    }
+    return true;
+}
+
+size_t ExpandBatchPattern(const std::filesystem::path& pattern, BatchOp wadOp,
+    std::vector<BatchItem>& items)
+{
+    auto folded = [](const std::filesystem::path& p) {
+        std::filesystem::path::string_type s = p.native();
+        FoldPathCase(s);
+        return ToUtf8(std::filesystem::path(s).wstring());
+    };
+    auto isWad = [&folded](const std::filesystem::path& p) {
+        return folded(p.extension()) == ".wad";
+    };
+
+    // ------------------------------------------------------------
+    // 1. Collect the matching names of the pattern's folder
+    //    (a pattern without wildcards names a single item)
+    // ------------------------------------------------------------
+    std::string namePattern = folded(pattern.filename());
+    std::vector<std::filesystem::path> matches;
+    std::error_code ec;
+
+    if (namePattern.find_first_of("*?") == std::string::npos) {
+        if (std::filesystem::exists(pattern, ec))
+            matches.push_back(pattern);
+    }
+    else {
+        std::filesystem::path dir = pattern.parent_path();
+        if (dir.empty())
+            dir = ".";
+        for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            if (GlobMatch(namePattern, folded(it->path().filename())))
+                matches.push_back(it->path());
+        }
+        std::sort(matches.begin(), matches.end());
+    }
+
+    // ------------------------------------------------------------
+    // 2. Folders are packed, WAD files extracted / verified,
+    //    anything else is ignored
+    // ------------------------------------------------------------
+    size_t added = 0;
+    for (const std::filesystem::path& p : matches) {
+        BatchItem item;
+        if (std::filesystem::is_directory(p, ec))
+            item.op = BatchOp::Pack;
+        else if (isWad(p) && std::filesystem::is_regular_file(p, ec))
+            item.op = wadOp;
+        else
+            continue;
+        item.input = p;
+        items.push_back(std::move(item));
+        added++;
+    }
+    return added;
+}
+
+static const wchar_t* BatchOpName(BatchOp op)
+{
+    switch (op) {
+    case BatchOp::Pack:    return L"pack";
+    case BatchOp::Extract: return L"extract";
+    default:               return L"verify";
+    }
+}
+
+// ------------------------------------------------------------
+// Input size used for ordering and progress: the bytes below a
+// folder, or the WAD file size
+// ------------------------------------------------------------
+static uint64_t MeasureItem(const BatchItem& item, unsigned threads)
+{
+    std::error_code ec;
+    if (item.op != BatchOp::Pack) {
+        uint64_t size = std::filesystem::file_size(item.input, ec);
+        return ec ? 0 : size;
+    }
+
+    std::atomic<uint64_t> bytes{ 0 };
+    ScanResult scan;
+    ScanFolder(item.input, threads,
+        [&bytes](const ScannedFile& f) { bytes.fetch_add(f.size, std::memory_order_relaxed); }, scan);
+    return bytes.load();
+}
+
+// ------------------------------------------------------------
+// Storage devices an item reads or writes (one or two ids;
+// paths whose device is unknown are not capped)
+// ------------------------------------------------------------
+static std::vector<uint64_t> ItemDevices(const BatchItem& item)
+{
+    std::vector<uint64_t> devices;
+    auto add = [&devices](const std::filesystem::path& p) {
+        uint64_t id;
+        if (GetDeviceId(p, id) && std::find(devices.begin(), devices.end(), id) == devices.end())
+            devices.push_back(id);
+    };
+
+    add(item.input);
+    if (item.op != BatchOp::Verify)
+        add(item.output.empty() ? item.input.parent_path() : item.output);
+    return devices;
+}
+
+// ------------------------------------------------------------
+// Where an item writes, defaulted the way PackFolder and
+// ExtractWad do it (empty for verify)
+// ------------------------------------------------------------
+static std::filesystem::path ItemOutput(const BatchItem& item)
+{
+    if (item.op == BatchOp::Verify || !item.output.empty())
+        return item.output;
+    if (item.op == BatchOp::Extract)
+        return item.input.parent_path() / item.input.stem();
+
+    std::filesystem::path out = item.input;
+    if (!out.has_filename())
+        out = out.parent_path();
+    out.replace_extension(L".wad");
+    return out;
+}
+
+// ------------------------------------------------------------
+// Absolute, normalised, case-folded form of a path for
+// comparing the paths of two items
+// ------------------------------------------------------------
+static std::filesystem::path::string_type ComparablePath(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    std::filesystem::path p = std::filesystem::weakly_canonical(path, ec);
+    if (ec)
+        p = std::filesystem::absolute(path, ec).lexically_normal();
+    if (!p.has_filename() && p.has_relative_path())
+        p = p.parent_path();   // No trailing separator
+
+    std::filesystem::path::string_type s = p.make_preferred().native();
+    FoldPathCase(s);
+    return s;
+}
+
+// ------------------------------------------------------------
+// True when two paths are the same or one lies below the other
+// ------------------------------------------------------------
+static bool PathsOverlap(const std::filesystem::path::string_type& a, const std::filesystem::path::string_type& b)
+{
+    if (a.empty() || b.empty())
+        return false;
+    const auto& shorter = a.size() <= b.size() ? a : b;
+    const auto& longer = a.size() <= b.size() ? b : a;
+    if (longer.compare(0, shorter.size(), shorter) != 0)
+        return false;
+    return longer.size() == shorter.size() ||
+        shorter.back() == std::filesystem::path::preferred_separator ||
+        longer[shorter.size()] == std::filesystem::path::preferred_separator;
+}
+
+bool RunBatch(const std::vector<BatchItem>& items, const BatchOptions& options, BatchReport& report)
+{
+    Stopwatch timer;
+
+    report = BatchReport{};
+    report.items.resize(items.size());
+    if (items.empty())
+        return true;
+
+    ThreadPool workers(options.threads);
+
+    // ------------------------------------------------------------
+    // 1. Size every item and find its devices; start order is
+    //    largest first
+    // ------------------------------------------------------------
+    Log(L"Sizing " + std::to_wstring(items.size()) + L" items...");
+
+    std::vector<std::vector<uint64_t>> devices(items.size());
+    uint64_t totalBytes = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        report.items[i].item = items[i];
+        report.items[i].bytes = MeasureItem(items[i], workers.size());
+        devices[i] = ItemDevices(items[i]);
+        totalBytes += report.items[i].bytes;
+    }
+
+    // ------------------------------------------------------------
+    // Items that write what another one reads or writes (a
+    // pattern matching both folder X and X.wad packs one and
+    // extracts the other) run one after the other, in list order
+    // ------------------------------------------------------------
+    std::vector<std::filesystem::path::string_type> inPaths(items.size()), outPaths(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        inPaths[i] = ComparablePath(items[i].input);
+        std::filesystem::path out = ItemOutput(items[i]);
+        if (!out.empty())
+            outPaths[i] = ComparablePath(out);
+    }
+
+    std::vector<std::vector<size_t>> after(items.size());   // Earlier items that must finish first
+    for (size_t j = 1; j < items.size(); ++j) {
+        for (size_t i = 0; i < j; ++i) {
+            if (PathsOverlap(outPaths[i], inPaths[j]) || PathsOverlap(outPaths[j], inPaths[i]) ||
+                PathsOverlap(outPaths[i], outPaths[j])) {
+                after[j].push_back(i);
+                Log(L"[" + std::to_wstring(j + 1) + L"] waits for [" + std::to_wstring(i + 1) +
+                    L"]: one writes the other's input or output");
+            }
+        }
+    }
+
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&report](size_t a, size_t b) {
+        return report.items[a].bytes > report.items[b].bytes;
+    });
+
+    unsigned jobs = options.jobs ? options.jobs : ThreadPool::DefaultThreadCount();
+    jobs = (unsigned)std::min<size_t>(jobs, items.size());
+    unsigned perDevice = std::max(options.perDevice, 1u);
+    unsigned packThreads = std::max(workers.size() / jobs, 1u);
+
+    Log(L"Running " + std::to_wstring(items.size()) + L" items, " + FormatBytes(totalBytes) +
+        L", up to " + std::to_wstring(jobs) + L" at once (" + std::to_wstring(perDevice) +
+        L" per device), " + std::to_wstring(workers.size()) + L" shared workers");
+
+    // ------------------------------------------------------------
+    // 2. Run one item on a runner thread with a copy of the
+    //    matching template options
+    // ------------------------------------------------------------
+    auto runItem = [&](size_t i) {
+        TelemetryThreadName("batch");
+        SetThreadLogPrefix(L"[" + std::to_wstring(i + 1) + L"] ");
+
+        const BatchItem& item = items[i];
+        Log(std::wstring(BatchOpName(item.op)) + L": " + PathToDisplay(item.input));
+
+        Stopwatch itemTimer;
+        bool ok = false;
+        switch (item.op) {
+        case BatchOp::Pack: {
+            PackOptions o = options.pack;
+            o.outPath = item.output;
+            o.threads = packThreads;
+            o.cancel = options.cancel;
+            ok = PackFolder(item.input, o);
+            break;
+        }
+        case BatchOp::Extract: {
+            ExtractOptions o = options.extract;
+            o.outDir = item.output;
+            o.pool = &workers;
+            o.cancel = options.cancel;
+            ok = ExtractWad(item.input, o);
+            break;
+        }
+        case BatchOp::Verify: {
+            VerifyOptions o = options.verify;
+            o.pool = &workers;
+            o.cancel = options.cancel;
+            ok = VerifyWad(item.input, o);
+            break;
+        }
+        }
+
+        report.items[i].ok = ok;
+        report.items[i].seconds = itemTimer.seconds();
+        SetThreadLogPrefix(L"");
+    };
+
+    // ------------------------------------------------------------
+    // 3. Start items while there is room: the largest waiting
+    //    item whose devices are all below the cap and whose
+    //    earlier conflicting items are done. This thread reports
+    //    progress between starts.
+    // ------------------------------------------------------------
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::unordered_map<uint64_t, unsigned> busy;   // Running items per device
+    std::vector<uint8_t> ended(items.size(), 0);  // Items that have finished
+    unsigned running = 0;
+    size_t waiting = items.size();
+
+    BeginProgress(totalBytes);
+    {
+        ThreadPool runners(jobs);
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;) {
+            bool cancelled = IsCancelled(options.cancel);
+            while (!cancelled && running < jobs && waiting > 0) {
+                auto fits = [&](size_t i) {
+                    for (size_t k : after[i]) {
+                        if (!ended[k])
+                            return false;
+                    }
+                    for (uint64_t d : devices[i]) {
+                        auto it = busy.find(d);
+                        if (it != busy.end() && it->second >= perDevice)
+                            return false;
+                    }
+                    return true;
+                };
+                auto next = std::find_if(order.begin(), order.end(),
+                    [&](size_t i) { return !report.items[i].started && fits(i); });
+                if (next == order.end())
+                    break;
+
+                size_t i = *next;
+                report.items[i].started = true;
+                for (uint64_t d : devices[i])
+                    busy[d]++;
+                running++;
+                waiting--;
+
+                runners.submit([&, i] {
+                    runItem(i);
+                    std::lock_guard<std::mutex> done(mutex);
+                    for (uint64_t d : devices[i])
+                        busy[d]--;
+                    ended[i] = 1;
+                    running--;
+                    finished.notify_all();
+                });
+            }
+
+            if (running == 0 && (waiting == 0 || cancelled))
+                break;
+
+            finished.wait_for(lock, std::chrono::milliseconds(kLogPumpMs));
+            lock.unlock();
+            PumpProgress();
+            lock.lock();
+        }
+    }
+    EndProgress();
+
+    // ------------------------------------------------------------
+    // 4. Totals
+    // ------------------------------------------------------------
+    report.seconds = timer.seconds();
+    for (const BatchItemResult& r : report.items) {
+        if (!r.started)
+            report.skipped++;
+        else if (!r.ok)
+            report.failed++;
+    }
+    return report.failed == 0 && report.skipped == 0;
+}
+
+void LogBatchReport(const BatchReport& report)
+{
+    uint64_t bytes = 0;
+    double busySeconds = 0.0;
+    size_t done = 0;
+
+    for (size_t i = 0; i < report.items.size(); ++i) {
+        const BatchItemResult& r = report.items[i];
+        const wchar_t* state = !r.started ? L"skipped" : r.ok ? L"ok" : L"FAILED";
+
+        wchar_t buf[96];
+        swprintf(buf, 96, L"[%zu] %-7ls %10.2f MB %9.3f s  ", i + 1, state,
+            double(r.bytes) / (1024.0 * 1024.0), r.seconds);
+        Log(buf + std::wstring(BatchOpName(r.item.op)) + L" " + PathToDisplay(r.item.input));
+
+        if (r.started) {
+            bytes += r.bytes;
+            busySeconds += r.seconds;
+            done++;
+        }
+    }
+
+    Log(L"Batch: " + std::to_wstring(done - report.failed) + L" of " +
+        std::to_wstring(report.items.size()) + L" items succeeded, " +
+        std::to_wstring(report.failed) + L" failed, " + std::to_wstring(report.skipped) + L" not started");
+
+    double s = report.seconds > 0.0 ? report.seconds : 1e-9;
+    wchar_t buf[160];
+    swprintf(buf, 160, L"%.2f MB/s aggregate, %.2f items/s, %.1f items running on average",
+        double(bytes) / (1024.0 * 1024.0) / s, double(done) / s, busySeconds / s);
+    Log(L"Batch total: " + FormatBytes(bytes) + L" in " + FormatSeconds(report.seconds) + L" (" + buf + L")");
+}
+
+// ------------------------------------------------------------
+// JSON string literal of a path (UTF-8, escaped)
+// ------------------------------------------------------------
+static std::string JsonPath(const std::filesystem::path& path)
+{
+    std::string out = "\"";
+    for (char c : ToUtf8(PathToDisplay(path))) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)c);
+            out += esc;
+        }
+        else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+bool WriteBatchReportJson(const BatchReport& report, const std::filesystem::path& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    uint64_t bytes = 0;
+    for (const BatchItemResult& r : report.items) {
+        if (r.started)
+            bytes += r.bytes;
+    }
+
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "{\n  \"elapsed_s\": %.6f,\n  \"bytes\": %llu,\n  \"mb_per_s\": %.2f,\n"
+        "  \"failed\": %zu,\n  \"skipped\": %zu,\n  \"items\": [\n",
+        report.seconds, (unsigned long long)bytes,
+        report.seconds > 0.0 ? double(bytes) / (1024.0 * 1024.0) / report.seconds : 0.0,
+        report.failed, report.skipped);
+    out << buf;
+
+    for (size_t i = 0; i < report.items.size(); ++i) {
+        const BatchItemResult& r = report.items[i];
+        out << "    {\"op\": \"" << ToUtf8(BatchOpName(r.item.op)) << "\", \"input\": " << JsonPath(r.item.input);
+        if (!r.item.output.empty())
+            out << ", \"output\": " << JsonPath(r.item.output);
+        snprintf(buf, sizeof(buf), ", \"bytes\": %llu, \"seconds\": %.6f, \"status\": \"%s\"}%s\n",
+            (unsigned long long)r.bytes, r.seconds, !r.started ? "skipped" : r.ok ? "ok" : "failed",
+            i + 1 < report.items.size() ? "," : "");
+        out << buf;
+    }
+
+    out << "  ]\n}\n";
+    return (bool)out.flush();
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+#include "wad_pack.h"
+#include "wad_extract.h"
+#include "wad_verify.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// What one batch item does
+// ------------------------------------------------------------
+enum class BatchOp {
+    Pack,       // input: folder, output: WAD (empty = <folder>.wad)
+    Extract,    // input: WAD, output: directory (empty = <wad dir>/<wad stem>)
+    Verify,     // input: WAD
+};
+
+struct BatchItem {
+    BatchOp op = BatchOp::Extract;
+    std::filesystem::path input;
+    std::filesystem::path output;
+};
+
+// ------------------------------------------------------------
+// Batch settings. The per-operation options are templates:
+// every item gets a copy with its own paths, the shared worker
+// pool and the cancel flag filled in.
+// ------------------------------------------------------------
+struct BatchOptions {
+    unsigned jobs = 0;            // Items running at once (0 = one per core)
+    unsigned perDevice = 2;       // Items running at once on one storage device
+    unsigned threads = 0;         // Shared worker pool (0 = one per core)
+    PackOptions pack;
+    ExtractOptions extract;
+    VerifyOptions verify;
+    const std::atomic<bool>* cancel = nullptr;  // Set by the front end to stop (no new items start)
+};
+
+// ------------------------------------------------------------
+// Outcome of one item and of the whole batch
+// ------------------------------------------------------------
+struct BatchItemResult {
+    BatchItem item;
+    uint64_t bytes = 0;           // Input size (folder contents / WAD file)
+    bool started = false;
+    bool ok = false;
+    double seconds = 0.0;
+};
+
+struct BatchReport {
+    std::vector<BatchItemResult> items;   // In schedule order (largest first)
+    double seconds = 0.0;                 // Wall time of the batch
+    size_t failed = 0;                    // Items that ran and failed
+    size_t skipped = 0;                   // Items never started (cancelled)
+};
+
+// ------------------------------------------------------------
+// Read a job list: one item per line, UTF-8, blank lines and
+// lines starting with '#' ignored. Paths containing spaces are
+// quoted; relative paths are relative to the list's folder.
+//   pack    <folder>   [<output.wad>]
+//   extract <file.wad> [<output dir>]
+//   verify  <file.wad>
+// Returns false (with a message in 'error') if the list cannot
+// be read or a line is malformed.
+// ------------------------------------------------------------
+bool ReadBatchList(const std::filesystem::path& listPath, std::vector<BatchItem>& items,
+    std::wstring& error);
+
+// ------------------------------------------------------------
+// Expand a pattern such as "D:/mods/*.wad" or "work/*": '*' and
+// '?' match within the last path component only. Matching
+// folders are packed, matching .wad files extracted ('wadOp'
+// chooses Verify instead). Returns the number of items added.
+// ------------------------------------------------------------
+size_t ExpandBatchPattern(const std::filesystem::path& pattern, BatchOp wadOp,
+    std::vector<BatchItem>& items);
+
+// ------------------------------------------------------------
+// Run a batch:
+//  - every item is sized first (folder contents / WAD size) and
+//    the items start largest first, so a long tail item does
+//    not start last
+//  - at most 'jobs' items run at once, and at most 'perDevice'
+//    of them read or write any one storage device (an item
+//    that would exceed the cap waits, smaller items on other
+//    devices go ahead)
+//  - an item that writes another item's input or output (or
+//    reads its output) waits until the earlier one in list
+//    order has finished, so "mods/*" matching both X and X.wad
+//    never packs X while extracting X.wad into it
+//  - extract and verify run their per-entry work on one worker
+//    pool shared by all items; pack pipelines get an even
+//    share of the threads
+//  - the calling thread reports the combined byte progress;
+//    each item's log lines are tagged "[n] "
+// The report is filled in also when the batch is cancelled.
+// Returns true when every item succeeded.
+// ------------------------------------------------------------
+bool RunBatch(const std::vector<BatchItem>& items, const BatchOptions& options, BatchReport& report);
+
+// ------------------------------------------------------------
+// Log the per-item results and the aggregate throughput
+// ------------------------------------------------------------
+void LogBatchReport(const BatchReport& report);
+
+// ------------------------------------------------------------
+// Write the report as JSON. Returns false on I/O errors.
+// ------------------------------------------------------------
+bool WriteBatchReportJson(const BatchReport& report, const std::filesystem::path& path);
@@ -0,0 +1,411 @@
+﻿#include "batch_io.h"
+
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#define OPENWAD_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <mutex>
+
+static const unsigned kBatchIoDrainTries = 16;   // Failed waits before a broken ring is closed regardless
+#endif
+
+bool ParseIoBackend(std::string_view name, IoBackend& out)
+{
+    if (name == "auto") out = IoBackend::Auto;
+    else if (name == "sync") out = IoBackend::Sync;
+    else if (name == "uring") out = IoBackend::Uring;
+    else return false;
+    return true;
+}
+
+const wchar_t* IoBackendName(IoBackend backend)
+{
+    switch (backend) {
+    case IoBackend::Auto:  return L"auto";
+    case IoBackend::Sync:  return L"sync";
+    case IoBackend::Uring: return L"uring";
+    }
+    return L"?";
+}
+
+#ifdef OPENWAD_URING
+
+// ------------------------------------------------------------
+// The three shared mappings of an io_uring instance and the
+// ring indices inside them. Only the owning thread submits, so
+// the submission tail is tracked locally and published once per
+// batch; the kernel's indices are read with acquire loads.
+// ------------------------------------------------------------
+struct BatchIo::Ring {
+    void* sqMap = MAP_FAILED;           // Submission ring mapping
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;           // Completion ring mapping (may alias sqMap)
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;  // Submission entries
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned tail = 0;                  // Local submission tail
+    unsigned queued = 0;                // Entries prepared since the last submit
+    unsigned inflight = 0;              // Submitted entries not reaped yet
+
+    io_uring_sqe* nextSqe()
+    {
+        unsigned idx = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[idx] = idx;
+        tail++;
+        queued++;
+        return sqe;
+    }
+
+    // --------------------------------------------------------
+    // Hand every completion to 'onDone(index, result)'
+    // --------------------------------------------------------
+    template <class F>
+    unsigned reap(F&& onDone)
+    {
+        unsigned head = *cqHead;
+        unsigned end = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned n = 0;
+        for (; head != end; ++head, ++n) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            onDone((size_t)cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        inflight -= std::min(inflight, n);
+        return n;
+    }
+};
+
+static int UringSetup(unsigned entries, io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int UringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+bool IsUringAvailable()
+{
+    static std::once_flag once;
+    static bool available = false;
+    std::call_once(once, [] {
+        BatchIo probe;
+        available = probe.open(IoBackend::Uring);
+    });
+    return available;
+}
+
+bool BatchIo::open(IoBackend backend)
+{
+    close();
+    if (backend == IoBackend::Sync)
+        return false;
+
+    // ------------------------------------------------------------
+    // 1. Create the instance. IORING_FEAT_RW_CUR_POS arrived with
+    //    the open / close operations (Linux 5.6), so its absence
+    //    means the kernel is too old for this backend.
+    // ------------------------------------------------------------
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = UringSetup(kBatchIoDepth, &p);
+    if (fd < 0)
+        return false;
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        ::close(fd);
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 2. Map the rings (one mapping for both on kernels with
+    //    IORING_FEAT_SINGLE_MMAP) and the submission entries
+    // ------------------------------------------------------------
+    Ring* r = new Ring;
+    r->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        r->sqMapSize = r->cqMapSize = std::max(r->sqMapSize, r->cqMapSize);
+
+    r->sqMap = mmap(nullptr, r->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sqMap != MAP_FAILED) {
+        r->cqMap = single ? r->sqMap
+            : mmap(nullptr, r->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    r->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    if (r->cqMap != MAP_FAILED) {
+        r->sqes = (io_uring_sqe*)mmap(nullptr, r->sqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    }
+
+    m_ringFd = fd;
+    m_ring = r;
+    if (r->sqes == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(r->sqMap);
+    uint8_t* cq = static_cast<uint8_t*>(r->cqMap);
+    r->sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    r->sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    r->sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    r->cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    r->cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    r->cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    r->cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    r->tail = *r->sqTail;
+    return true;
+}
+
+void BatchIo::close()
+{
+    if (m_ring) {
+        if (m_ring->sqes != MAP_FAILED)
+            munmap(m_ring->sqes, m_ring->sqesSize);
+        if (m_ring->cqMap != MAP_FAILED && m_ring->cqMap != m_ring->sqMap)
+            munmap(m_ring->cqMap, m_ring->cqMapSize);
+        if (m_ring->sqMap != MAP_FAILED)
+            munmap(m_ring->sqMap, m_ring->sqMapSize);
+        delete m_ring;
+        m_ring = nullptr;
+    }
+    if (m_ringFd >= 0) {
+        ::close(m_ringFd);
+        m_ringFd = -1;
+    }
+}
+
+// ------------------------------------------------------------
+// Publish the prepared entries, submit them and wait until all
+// of them have completed
+// ------------------------------------------------------------
+bool BatchIo::submitAndWait(unsigned count)
+{
+    __atomic_store_n(m_ring->sqTail, m_ring->tail, __ATOMIC_RELEASE);
+    m_ring->queued = 0;
+
+    unsigned submitted = 0;
+    while (submitted < count) {
+        int r = UringEnter(m_ringFd, count - submitted, count - submitted, IORING_ENTER_GETEVENTS);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        submitted += (unsigned)r;
+        m_ring->inflight += (unsigned)r;
+    }
+    return true;
+}
+
+void BatchIo::run(BatchFileOp* ops, size_t count, bool write)
+{
+    std::vector<int> fds(kBatchIoDepth, -1);
+    std::vector<uint8_t> failed(kBatchIoDepth, 0);
+
+    for (size_t first = 0; first < count; first += kBatchIoDepth) {
+        BatchFileOp* batch = ops + first;
+        unsigned n = (unsigned)std::min<size_t>(count - first, kBatchIoDepth);
+        std::fill(fds.begin(), fds.end(), -1);
+        std::fill(failed.begin(), failed.end(), 0);
+
+        // --------------------------------------------------------
+        // Collect completions until all 'expected' have arrived;
+        // entries of a submission complete in any order
+        // --------------------------------------------------------
+        auto complete = [this](unsigned expected, auto&& onDone) {
+            unsigned got = m_ring->reap(onDone);
+            while (got < expected) {
+                if (UringEnter(m_ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                    return false;
+                got += m_ring->reap(onDone);
+            }
+            return true;
+        };
+
+        // --------------------------------------------------------
+        // After a failed submission or wait: collect what the
+        // kernel still owns (opens that may hand out descriptors,
+        // transfers into the caller's buffers) before the ring
+        // goes away. Unsubmitted entries die with the ring.
+        // --------------------------------------------------------
+        auto drain = [this](auto&& onDone) {
+            for (unsigned errors = 0; m_ring->inflight > 0 && errors < kBatchIoDrainTries;) {
+                if (m_ring->reap(onDone) > 0)
+                    continue;
+                if (UringEnter(m_ringFd, 0, m_ring->inflight, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                    errors++;
+            }
+        };
+
+        // --------------------------------------------------------
+        // 1. Open every file of the batch
+        // --------------------------------------------------------
+        int flags = write ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC);
+        for (unsigned i = 0; i < n; ++i) {
+            io_uring_sqe* sqe = m_ring->nextSqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = batch[i].dir && batch[i].dir->isOpen() ? batch[i].dir->fd : AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)batch[i].path;
+            sqe->len = 0666;
+            sqe->open_flags = (uint32_t)flags;
+            sqe->user_data = i;
+        }
+        auto onOpen = [&](size_t i, int res) { fds[i] = res >= 0 ? res : -1; };
+        bool ringOk = submitAndWait(n) && complete(n, onOpen);
+        if (!ringOk)
+            drain(onOpen);
+
+        // --------------------------------------------------------
+        // 2. Read or write each opened file in one operation
+        // --------------------------------------------------------
+        unsigned io = 0;
+        for (unsigned i = 0; ringOk && i < n; ++i) {
+            batch[i].done = 0;
+            if (fds[i] < 0 || batch[i].size == 0)
+                continue;
+            io_uring_sqe* sqe = m_ring->nextSqe();
+            sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = fds[i];
+            sqe->addr = write ? (uint64_t)(uintptr_t)batch[i].src : (uint64_t)(uintptr_t)batch[i].dst;
+            sqe->len = (uint32_t)batch[i].size;
+            sqe->off = 0;
+            sqe->user_data = i;
+            io++;
+        }
+        auto onTransfer = [&](size_t i, int res) {
+            if (res < 0)
+                failed[i] = 1;
+            else
+                batch[i].done = (size_t)res;
+        };
+        if (ringOk && io > 0) {
+            ringOk = submitAndWait(io) && complete(io, onTransfer);
+            if (!ringOk)
+                drain(onTransfer);
+        }
+
+        // --------------------------------------------------------
+        // 3. Finish short transfers with plain calls (a read
+        //    stops at the end of the file)
+        // --------------------------------------------------------
+        for (unsigned i = 0; i < n; ++i) {
+            BatchFileOp& op = batch[i];
+            if (fds[i] < 0 || !ringOk) {
+                failed[i] = 1;
+                continue;
+            }
+            while (!failed[i] && op.done < op.size) {
+                ssize_t r = write
+                    ? ::pwrite(fds[i], op.src + op.done, op.size - op.done, (off_t)op.done)
+                    : ::pread(fds[i], op.dst + op.done, op.size - op.done, (off_t)op.done);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r < 0 || (r == 0 && write))
+                    failed[i] = 1;
+                if (r <= 0)
+                    break;
+                op.done += (size_t)r;
+            }
+        }
+
+        // --------------------------------------------------------
+        // 4. Close every opened file. A failed close after a write
+        //    can report a lost write-back, so it fails the file.
+        // --------------------------------------------------------
+        unsigned closes = 0;
+        for (unsigned i = 0; ringOk && i < n; ++i) {
+            if (fds[i] < 0)
+                continue;
+            io_uring_sqe* sqe = m_ring->nextSqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = fds[i];
+            sqe->user_data = i;
+            fds[i] = -1;
+            closes++;
+        }
+        auto onClose = [&](size_t i, int res) {
+            if (res < 0 && write)
+                failed[i] = 1;
+        };
+        if (closes > 0) {
+            ringOk = submitAndWait(closes) && complete(closes, onClose);
+            if (!ringOk)
+                drain(onClose);
+        }
+        for (unsigned i = 0; i < n; ++i) {
+            if (fds[i] >= 0)
+                ::close(fds[i]);
+            batch[i].ok = !failed[i];
+            batch[i].retry = false;
+        }
+
+        // --------------------------------------------------------
+        // 5. A failed ring is not used again: its completions
+        //    could be taken for the next batch's. This batch and
+        //    the rest go to the caller's synchronous path.
+        // --------------------------------------------------------
+        if (!ringOk) {
+            close();
+            for (size_t k = first; k < count; ++k) {
+                ops[k].ok = false;
+                ops[k].retry = true;
+            }
+            return;
+        }
+    }
+}
+
+#else
+
+bool IsUringAvailable() { return false; }
+
+struct BatchIo::Ring {};
+
+bool BatchIo::open(IoBackend) { return false; }
+void BatchIo::close() {}
+bool BatchIo::submitAndWait(unsigned) { return false; }
+
+void BatchIo::run(BatchFileOp* ops, size_t count, bool)
+{
+    for (size_t i = 0; i < count; ++i) {
+        ops[i].ok = false;
+        ops[i].retry = true;
+    }
+}
+
+#endif
+
+void BatchIo::writeFiles(BatchFileOp* ops, size_t count)
+{
+    run(ops, count, true);
+}
+
+void BatchIo::readFiles(BatchFileOp* ops, size_t count)
+{
+    run(ops, count, false);
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+#include "platform.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string_view>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// I/O backend for whole-file operations on many small files
+// ------------------------------------------------------------
+enum class IoBackend {
+    Auto,    // io_uring where the kernel allows it, else synchronous calls
+    Sync,    // One open / read or write / close call sequence per file
+    Uring,   // Batched submissions through io_uring (Linux)
+};
+
+static const unsigned kBatchIoDepth = 64;   // Files per submission (also bounds open descriptors per ring)
+
+// ------------------------------------------------------------
+// Backend names for the front ends: auto, sync, uring
+// ------------------------------------------------------------
+bool ParseIoBackend(std::string_view name, IoBackend& out);
+const wchar_t* IoBackendName(IoBackend backend);
+
+// ------------------------------------------------------------
+// One whole-file operation of a batch
+//  - write: create (or truncate) 'path' and write 'size' bytes
+//  - read:  open 'path' and read up to 'size' bytes; ask for
+//    one byte more than expected to detect a file that grew
+// ------------------------------------------------------------
+struct BatchFileOp {
+    const NativeChar* path = nullptr;             // File to create / read ...
+    const DirHandle* dir = nullptr;               // ... relative to this directory when it is open
+    const uint8_t* src = nullptr;                 // Bytes to write
+    uint8_t* dst = nullptr;                       // Read buffer
+    size_t size = 0;                              // Bytes to write / buffer capacity to read
+    size_t done = 0;                              // Bytes written / read
+    bool ok = false;                              // Every step succeeded (read: up to end of file)
+    bool retry = false;                           // Not run: the ring failed, use the synchronous path
+};
+
+// ------------------------------------------------------------
+// A submission ring owned by one thread. Each batch is run as
+// three submissions (all opens, all reads or writes, all
+// closes) instead of three or four system calls per file.
+// Short transfers are finished with plain calls before the
+// close. open() fails where io_uring is not available (other
+// platforms, old kernels, disabled by policy); callers then
+// keep their synchronous per-file path. When a submission or
+// wait fails partway, the ring waits for what the kernel still
+// owns, closes itself and marks that batch and every later
+// operation 'retry' for the caller's synchronous path.
+// ------------------------------------------------------------
+class BatchIo {
+public:
+    BatchIo() = default;
+    BatchIo(const BatchIo&) = delete;
+    BatchIo& operator=(const BatchIo&) = delete;
+    ~BatchIo() { close(); }
+
+    // --------------------------------------------------------
+    // Set up a ring for the backend. Auto and Uring try
+    // io_uring, Sync always fails.
+    // --------------------------------------------------------
+    bool open(IoBackend backend);
+    bool isOpen() const { return m_ringFd >= 0; }
+    void close();
+
+    // --------------------------------------------------------
+    // Run the operations, kBatchIoDepth files per submission
+    // --------------------------------------------------------
+    void writeFiles(BatchFileOp* ops, size_t count);
+    void readFiles(BatchFileOp* ops, size_t count);
+
+private:
+    struct Ring;
+
+    void run(BatchFileOp* ops, size_t count, bool write);
+    bool submitAndWait(unsigned count);
+
+    int m_ringFd = -1;           // io_uring descriptor
+    Ring* m_ring = nullptr;      // Mapped submission / completion rings
+};
+
+// ------------------------------------------------------------
+// True when this process can use io_uring (checked once)
+// ------------------------------------------------------------
+bool IsUringAvailable();
@@ -0,0 +1,94 @@
+﻿#pragma once
+#include <stddef.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+// ------------------------------------------------------------
+// Blocking multi-producer / multi-consumer queue with a fixed
+// capacity. push() waits while the queue is full (back-pressure
+// on the producer), pop() waits while it is empty. close() ends
+// the stream: pending items can still be popped, after that
+// pop() returns false.
+// ------------------------------------------------------------
+template <class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // --------------------------------------------------------
+    // Add an item, waiting for free space. Returns false if the
+    // queue was closed (the item is dropped).
+    // --------------------------------------------------------
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+            return false;
+
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // --------------------------------------------------------
+    // Take the oldest item, waiting for one to arrive. Returns
+    // false once the queue is closed and drained.
+    // --------------------------------------------------------
+    bool pop(T& out)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+            return false;
+
+        out = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // --------------------------------------------------------
+    // Take the oldest item if one is queued, without waiting
+    // --------------------------------------------------------
+    bool tryPop(T& out)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_items.empty())
+            return false;
+
+        out = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // --------------------------------------------------------
+    // Mark the end of the stream and wake every waiter
+    // --------------------------------------------------------
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;                   // Guards every member below
+    std::condition_variable m_notEmpty;   // Signalled when an item is added
+    std::condition_variable m_notFull;    // Signalled when an item is removed
+    std::deque<T> m_items;                // Queued items, oldest first
+    size_t m_capacity;                    // Maximum number of queued items
+    bool m_closed = false;                // No more items will be pushed
+};
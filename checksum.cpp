@@ -0,0 +1,147 @@
+﻿#include "checksum.h"
+
+#include <string.h>
+
+static const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+static const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t Rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Read64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);   // Little-endian hosts only (x86 / ARM)
+    return v;
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t input)
+{
+    acc += input * kPrime2;
+    acc = Rotl64(acc, 31);
+    return acc * kPrime1;
+}
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= Round(0, val);
+    return acc * kPrime1 + kPrime4;
+}
+
+void Xxh64::reset(uint64_t seed)
+{
+    m_seed = seed;
+    m_acc[0] = seed + kPrime1 + kPrime2;
+    m_acc[1] = seed + kPrime2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - kPrime1;
+    m_total = 0;
+    m_bufLen = 0;
+}
+
+void Xxh64::update(const void* data, size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_total += size;
+
+    // ------------------------------------------------------------
+    // 1. Complete a buffered partial stripe first
+    // ------------------------------------------------------------
+    if (m_bufLen > 0) {
+        size_t take = 32 - m_bufLen;
+        if (take > size) take = size;
+        memcpy(m_buf + m_bufLen, p, take);
+        m_bufLen += take;
+        p += take;
+        size -= take;
+        if (m_bufLen < 32)
+            return;
+
+        for (int lane = 0; lane < 4; ++lane)
+            m_acc[lane] = Round(m_acc[lane], Read64(m_buf + lane * 8));
+        m_bufLen = 0;
+    }
+
+    // ------------------------------------------------------------
+    // 2. Whole 32-byte stripes straight from the input
+    // ------------------------------------------------------------
+    uint64_t a0 = m_acc[0], a1 = m_acc[1], a2 = m_acc[2], a3 = m_acc[3];
+    while (size >= 32) {
+        a0 = Round(a0, Read64(p));
+        a1 = Round(a1, Read64(p + 8));
+        a2 = Round(a2, Read64(p + 16));
+        a3 = Round(a3, Read64(p + 24));
+        p += 32;
+        size -= 32;
+    }
+    m_acc[0] = a0; m_acc[1] = a1; m_acc[2] = a2; m_acc[3] = a3;
+
+    // ------------------------------------------------------------
+    // 3. Keep the tail for the next call / digest
+    // ------------------------------------------------------------
+    if (size > 0) {
+        memcpy(m_buf, p, size);
+        m_bufLen = size;
+    }
+}
+
+uint64_t Xxh64::digest() const
+{
+    uint64_t h;
+    if (m_total >= 32) {
+        h = Rotl64(m_acc[0], 1) + Rotl64(m_acc[1], 7) + Rotl64(m_acc[2], 12) + Rotl64(m_acc[3], 18);
+        for (int lane = 0; lane < 4; ++lane)
+            h = MergeRound(h, m_acc[lane]);
+    }
+    else {
+        h = m_seed + kPrime5;
+    }
+    h += m_total;
+
+    const uint8_t* p = m_buf;
+    size_t left = m_bufLen;
+    while (left >= 8) {
+        h ^= Round(0, Read64(p));
+        h = Rotl64(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+        left -= 8;
+    }
+    if (left >= 4) {
+        h ^= (uint64_t)Read32(p) * kPrime1;
+        h = Rotl64(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        left -= 4;
+    }
+    while (left > 0) {
+        h ^= (*p) * kPrime5;
+        h = Rotl64(h, 11) * kPrime1;
+        ++p;
+        --left;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t HashXxh64(const void* data, size_t size, uint64_t seed)
+{
+    Xxh64 h(seed);
+    h.update(data, size);
+    return h.digest();
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ------------------------------------------------------------
+// Streaming XXH64 (xxHash, 64-bit variant) for content hashes.
+// Feed the data in any number of update() calls; digest() does
+// not change the state.
+// ------------------------------------------------------------
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0);
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t m_acc[4];      // Lane accumulators
+    uint64_t m_seed = 0;    // Seed, for inputs shorter than a stripe
+    uint64_t m_total = 0;   // Bytes fed so far
+    uint8_t m_buf[32];      // Partial stripe
+    size_t m_bufLen = 0;    // Bytes in m_buf
+};
+
+// ------------------------------------------------------------
+// One-shot XXH64 of a buffer
+// ------------------------------------------------------------
+uint64_t HashXxh64(const void* data, size_t size, uint64_t seed = 0);
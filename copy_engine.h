@@ -0,0 +1,94 @@
+﻿#pragma once
+#include "mapped_file.h"
+#include "platform.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string_view>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// How bytes get from a mapped WAD (or pool buffer) to disk
+// ------------------------------------------------------------
+enum class CopyStrategy {
+    Auto,          // Pick per copy from its size and the memory benchmark
+    Write,         // Plain positioned write from the mapped view
+    KernelCopy,    // copy_file_range / sendfile from the WAD descriptor (Linux)
+    Preallocate,   // Reserve the full size, then large aligned positioned writes
+    NonTemporal,   // Map the output and copy with streaming (cache-bypassing) stores
+};
+
+static const uint64_t kCopySmallBytes = 256 * 1024;            // Below: plain write is cheapest
+static const uint64_t kCopyHugeBytes = 64ull * 1024 * 1024;    // From here: streaming stores / preallocation
+static const size_t   kCopyChunkBytes = 4 * 1024 * 1024;       // Aligned chunk for preallocated writes
+
+// ------------------------------------------------------------
+// Outcome of the one-time memory copy micro-benchmark
+// ------------------------------------------------------------
+struct CopyEngineInfo {
+    double memcpyGBs = 0;          // memcpy throughput, GB/s
+    double streamGBs = 0;          // Streaming store throughput, GB/s
+    bool streamAvailable = false;  // Built with streaming store support (SSE2)
+    bool preferStream = false;     // Streaming stores keep up with memcpy
+};
+
+// ------------------------------------------------------------
+// Benchmark results; the benchmark (a few milliseconds over
+// two 16 MB buffers) runs on the first call, thread-safe
+// ------------------------------------------------------------
+const CopyEngineInfo& GetCopyEngineInfo();
+
+// ------------------------------------------------------------
+// Strategy names for the front ends:
+// auto, write, kernel, prealloc, stream
+// ------------------------------------------------------------
+bool ParseCopyStrategy(std::string_view name, CopyStrategy& out);
+const wchar_t* CopyStrategyName(CopyStrategy strategy);
+
+// ------------------------------------------------------------
+// Concrete strategy for a copy of 'size' bytes. Auto chooses:
+//  - below kCopySmallBytes: Write
+//  - Linux: KernelCopy (the data never enters user space)
+//  - elsewhere, kCopyHugeBytes and up: NonTemporal when the
+//    benchmark favours it, else Preallocate
+//  - elsewhere, in between: Preallocate
+// ------------------------------------------------------------
+CopyStrategy ResolveCopyStrategy(CopyStrategy requested, uint64_t size);
+
+// ------------------------------------------------------------
+// memcpy, or streaming stores that bypass the CPU caches for
+// data that will not be read again (falls back to memcpy
+// where streaming stores are not available)
+// ------------------------------------------------------------
+void StreamCopy(void* dst, const void* src, size_t size);
+
+inline void CopyBytes(void* dst, const void* src, size_t size, bool stream)
+{
+    if (stream)
+        StreamCopy(dst, src, size);
+    else
+        memcpy(dst, src, size);
+}
+
+// ------------------------------------------------------------
+// Create 'outPath' holding 'size' bytes at 'offset' of the
+// mapped file, read through 'src' one window at a time.
+// Strategies that are unavailable fall back to Write.
+// ------------------------------------------------------------
+bool CopyRangeToNewFile(const NativeChar* outPath, MappedWindow& src,
+    uint64_t offset, uint64_t size, CopyStrategy strategy);
+
+// ------------------------------------------------------------
+// Same, with 'outPath' relative to 'dir' when that is open
+// ------------------------------------------------------------
+bool CopyRangeToNewFile(const DirHandle& dir, const NativeChar* outPath, MappedWindow& src,
+    uint64_t offset, uint64_t size, CopyStrategy strategy);
+
+// ------------------------------------------------------------
+// Copy a range of the mapped file into an open output file at
+// 'dstOffset' (kernel copy where chosen and available,
+// positioned writes through 'src' otherwise)
+// ------------------------------------------------------------
+bool CopyRangeToFile(FileHandle& dst, uint64_t dstOffset, MappedWindow& src,
+    uint64_t srcOffset, uint64_t size, CopyStrategy strategy);
@@ -0,0 +1,213 @@
+﻿#include "dir_scan.h"
+#include "platform.h"
+#include "thread_pool.h"
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+
+// ------------------------------------------------------------
+// One listed directory. Each node is filled by exactly one
+// worker; the tree is only read back after the pool is idle.
+// ------------------------------------------------------------
+struct ScanNode {
+    // --------------------------------------------------------
+    // A directory entry in listing order: either a file or a
+    // sub-directory node
+    // --------------------------------------------------------
+    struct Entry {
+        std::unique_ptr<ScanNode> dir;   // Set for sub-directories
+        ScannedFile file;                // Valid when dir is null
+    };
+
+    std::filesystem::path fullPath;      // Directory on disk
+    std::wstring relPrefix;              // Relative name incl. trailing '\' ("" for the base)
+    std::vector<Entry> entries;          // Files and sub-directories in listing order
+    std::vector<std::wstring> skipped;   // Entries that could not be used
+    bool incomplete = false;             // Listing stopped on an error
+};
+
+// ------------------------------------------------------------
+// Shared state of one folder scan
+// ------------------------------------------------------------
+struct ScanContext {
+    ThreadPool* pool = nullptr;
+    const ScanCallback* onFile = nullptr;
+    std::atomic<size_t> nextId{ 0 };
+};
+
+// ------------------------------------------------------------
+// List one directory: record its files (reporting each one
+// right away) and queue every sub-directory as its own task
+// ------------------------------------------------------------
+static void ScanDirectory(ScanContext& ctx, ScanNode* node)
+{
+    std::error_code ec;
+    std::filesystem::directory_iterator it(node->fullPath,
+        std::filesystem::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        node->incomplete = true;
+        return;
+    }
+
+    for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        const std::filesystem::directory_entry& entry = *it;
+
+        std::wstring nameW;
+        try {
+            nameW = entry.path().filename().wstring();
+        }
+        catch (...) {
+            node->skipped.push_back(PathToDisplay(entry.path()));
+            continue;
+        }
+
+        // --------------------------------------------------------
+        // Match recursive_directory_iterator: do not descend into
+        // directory symlinks, but accept symlinks to files
+        // --------------------------------------------------------
+        std::error_code typeEc;
+        bool isLink = entry.is_symlink(typeEc);
+        if (!isLink && entry.is_directory(typeEc)) {
+            auto child = std::make_unique<ScanNode>();
+            child->fullPath = entry.path();
+            child->relPrefix = node->relPrefix + nameW + L'\\';
+
+            ScanNode* raw = child.get();
+            node->entries.push_back(ScanNode::Entry{ std::move(child), {} });
+            ctx.pool->submit([&ctx, raw] { ScanDirectory(ctx, raw); });
+            continue;
+        }
+        if (!entry.is_regular_file(typeEc))
+            continue;
+
+        ScannedFile f;
+        if (!GetFileInfo(entry, f.size, f.mtime)) {
+            node->skipped.push_back(PathToDisplay(entry.path()));
+            continue;
+        }
+        f.fullPath = entry.path();
+        f.relPathW = node->relPrefix + nameW;
+        f.id = ctx.nextId.fetch_add(1, std::memory_order_relaxed);
+
+        if (*ctx.onFile)
+            (*ctx.onFile)(f);
+
+        node->entries.push_back(ScanNode::Entry{ nullptr, std::move(f) });
+    }
+
+    if (ec)
+        node->incomplete = true;
+}
+
+// ------------------------------------------------------------
+// Flatten the tree in pre-order (files and directories in
+// listing order, descending into a directory where it appears)
+// ------------------------------------------------------------
+static void FlattenTree(ScanNode& node, ScanResult& result)
+{
+    for (auto& s : node.skipped)
+        result.skipped.push_back(std::move(s));
+    if (node.incomplete)
+        result.incomplete = true;
+
+    for (auto& e : node.entries) {
+        if (e.dir)
+            FlattenTree(*e.dir, result);
+        else
+            result.files.push_back(std::move(e.file));
+    }
+}
+
+void ScanFolder(const std::filesystem::path& base, unsigned threads,
+    const ScanCallback& onFile, ScanResult& result)
+{
+    ScanNode root;
+    root.fullPath = base;
+
+    {
+        ThreadPool pool(threads);
+
+        ScanContext ctx;
+        ctx.pool = &pool;
+        ctx.onFile = &onFile;
+
+        pool.submit([&ctx, &root] { ScanDirectory(ctx, &root); });
+        pool.wait();
+    }
+
+    FlattenTree(root, result);
+}
+
+bool ScanManifest(const std::filesystem::path& manifest, const std::filesystem::path& base,
+    unsigned threads, const ScanCallback& onFile, ScanResult& result)
+{
+    std::ifstream in(manifest, std::ios::binary);
+    if (!in)
+        return false;
+
+    // ------------------------------------------------------------
+    // 1. Read the list: one relative path per line
+    // ------------------------------------------------------------
+    std::vector<std::wstring> names;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (names.empty() && line.size() >= 3 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            line.erase(0, 3);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::wstring relW = FromUtf8(line);
+        std::replace(relW.begin(), relW.end(), L'/', L'\\');
+        names.push_back(std::move(relW));
+    }
+
+    // ------------------------------------------------------------
+    // 2. Query sizes in parallel, in slices of the list
+    // ------------------------------------------------------------
+    std::vector<ScannedFile> files(names.size());
+    std::vector<uint8_t> ok(names.size(), 0);
+    std::atomic<size_t> nextId{ 0 };
+    const size_t kSlice = 256;
+
+    {
+        ThreadPool pool(threads);
+        for (size_t first = 0; first < names.size(); first += kSlice) {
+            size_t last = std::min(names.size(), first + kSlice);
+            pool.submit([&, first, last] {
+                for (size_t i = first; i < last; ++i) {
+                    ScannedFile& f = files[i];
+                    f.fullPath = base / WadNameToPath(names[i]);
+                    f.relPathW = names[i];
+
+                    std::error_code ec;
+                    if (!std::filesystem::is_regular_file(f.fullPath, ec))
+                        continue;
+                    if (!GetFileInfo(f.fullPath, f.size, f.mtime))
+                        continue;
+
+                    f.id = nextId.fetch_add(1, std::memory_order_relaxed);
+                    ok[i] = 1;
+                    if (onFile)
+                        onFile(f);
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    // ------------------------------------------------------------
+    // 3. Keep manifest order; report entries that do not exist
+    // ------------------------------------------------------------
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (ok[i])
+            result.files.push_back(std::move(files[i]));
+        else
+            result.skipped.push_back(names[i]);
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// A source file found by the scanner
+// ------------------------------------------------------------
+struct ScannedFile {
+    std::filesystem::path fullPath;  // Full path to the file on disk
+    std::wstring relPathW;           // Path relative to the base folder, '\' separated
+    uint64_t size = 0;               // File size from directory metadata
+    int64_t mtime = 0;               // Last write time (GetFileInfo ticks)
+    size_t id = 0;                   // Dense discovery id (0..N-1) in callback order
+};
+
+// ------------------------------------------------------------
+// Outcome of a scan
+// ------------------------------------------------------------
+struct ScanResult {
+    std::vector<ScannedFile> files;      // Accepted files in final WAD order
+    std::vector<std::wstring> skipped;   // Paths that could not be used
+    bool incomplete = false;             // A directory could not be listed
+};
+
+// ------------------------------------------------------------
+// Called once per accepted file as soon as it is found, from
+// scanner worker threads (concurrently, in no particular order)
+// ------------------------------------------------------------
+using ScanCallback = std::function<void(const ScannedFile&)>;
+
+// ------------------------------------------------------------
+// Walk 'base' in a single pass with 'threads' workers (0 = one
+// per core), one directory per task. Relative names are built
+// by appending each entry name to its parent's name.
+// result.files comes back in the same order a
+// recursive_directory_iterator would produce (pre-order, each
+// directory in listing order), independent of thread timing.
+// ------------------------------------------------------------
+void ScanFolder(const std::filesystem::path& base, unsigned threads,
+    const ScanCallback& onFile, ScanResult& result);
+
+// ------------------------------------------------------------
+// Take the file list from a manifest instead of walking the
+// folder: one path per line relative to 'base' ('\' or '/'
+// separators, UTF-8, blank lines and lines starting with '#'
+// ignored). Sizes are queried in parallel; result.files keeps
+// manifest order. Returns false if the manifest cannot be read.
+// ------------------------------------------------------------
+bool ScanManifest(const std::filesystem::path& manifest, const std::filesystem::path& base,
+    unsigned threads, const ScanCallback& onFile, ScanResult& result);
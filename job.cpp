@@ -0,0 +1,192 @@
+﻿#include "job.h"
+#include "logger.h"
+
+#include <utility>
+
+std::shared_ptr<Job> Job::Start(Work work, std::function<void()> notify)
+{
+    std::shared_ptr<Job> job(new Job());
+    job->m_notify = std::move(notify);
+    job->m_thread = std::thread(&Job::run, job.get(), std::move(work));
+    return job;
+}
+
+Job::~Job()
+{
+    if (m_thread.joinable()) {
+        cancel();
+        m_thread.join();
+    }
+}
+
+void Job::cancel()
+{
+    m_cancel.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cv.notify_all();
+}
+
+bool Job::isDone() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_done;
+}
+
+bool Job::succeeded() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_done && m_ok;
+}
+
+bool Job::waitEvents(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_cv.wait_for(lock, timeout, [this] { return !m_events.empty(); });
+}
+
+// ------------------------------------------------------------
+// Job thread: route the log sink into the event queue, run the
+// work, flush what the engine left queued, then report the
+// result. The sink is cleared before the thread ends.
+// ------------------------------------------------------------
+void Job::run(Work work)
+{
+    LogSink sink;
+    sink.append = [this](const std::wstring& text) { post({ JobEventKind::Log, text, 0 }); };
+    sink.progress = [this](int percent) { post({ JobEventKind::Progress, L"", percent }); };
+    sink.status = [this](const std::wstring& text) { post({ JobEventKind::Status, text, 0 }); };
+    sink.error = [this](const std::wstring& msg) { post({ JobEventKind::Error, msg, 0 }); };
+    sink.confirmOverwrite = [this](const std::wstring& target) { return confirm(target); };
+    SetLogSink(std::move(sink));
+
+    bool ok = work(m_cancel);
+
+    AppendBufferedLog();
+    SetLogSink(LogSink{});
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+        m_ok = ok;
+    }
+    post({ JobEventKind::Finished, L"", ok ? 1 : 0 });
+}
+
+void Job::post(JobEvent e)
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        wake = m_events.empty();
+
+        bool coalesce = !m_events.empty() && m_events.back().kind == e.kind &&
+            (e.kind == JobEventKind::Progress || e.kind == JobEventKind::Status);
+        if (coalesce)
+            m_events.back() = std::move(e);
+        else
+            m_events.push_back(std::move(e));
+        m_cv.notify_all();
+    }
+    if (wake && m_notify)
+        m_notify();
+}
+
+// ------------------------------------------------------------
+// Ask the front end and wait for its answer (a cancel refuses)
+// ------------------------------------------------------------
+bool Job::confirm(const std::wstring& target)
+{
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = ++m_confirmId;
+        m_confirmPending = true;
+        m_answer = -1;
+    }
+    post({ JobEventKind::Confirm, target, id });
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_answer >= 0 || cancelRequested(); });
+    bool yes = m_answer == 1 && !cancelRequested();
+    m_confirmPending = false;
+    m_answer = -1;
+    return yes;
+}
+
+void Job::answer(bool yes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_confirmPending && m_answer < 0) {
+        m_answer = yes ? 1 : 0;
+        m_cv.notify_all();
+    }
+}
+
+void Job::refuseUnanswered(int id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_confirmPending && m_confirmId == id && m_answer < 0) {
+        m_answer = 0;
+        m_cv.notify_all();
+    }
+}
+
+void Job::dispatch(const std::function<void(const JobEvent&)>& handler)
+{
+    // --------------------------------------------------------
+    // A handler may run a modal loop (message box) that calls
+    // dispatch() again: the outer call keeps draining, so the
+    // nested one returns at once and the order is kept
+    // --------------------------------------------------------
+    if (m_dispatching)
+        return;
+    m_dispatching = true;
+
+    auto self = shared_from_this();   // A resumed coroutine may drop the last reference
+    bool finished = false;
+
+    for (;;) {
+        std::deque<JobEvent> events;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            events.swap(m_events);
+        }
+        if (events.empty())
+            break;
+
+        for (const JobEvent& e : events) {
+            handler(e);
+            if (e.kind == JobEventKind::Confirm)
+                refuseUnanswered(e.value);
+            else if (e.kind == JobEventKind::Finished)
+                finished = true;
+        }
+    }
+    m_dispatching = false;
+
+    if (finished) {
+        std::coroutine_handle<> waiter;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finishedSeen = true;
+            waiter = std::exchange(m_waiter, {});
+        }
+        if (waiter)
+            waiter.resume();
+    }
+}
+
+bool Job::Awaiter::await_ready() const
+{
+    std::lock_guard<std::mutex> lock(m_job.m_mutex);
+    return m_job.m_finishedSeen;
+}
+
+bool Job::Awaiter::await_suspend(std::coroutine_handle<> h)
+{
+    std::lock_guard<std::mutex> lock(m_job.m_mutex);
+    if (m_job.m_finishedSeen)
+        return false;
+    m_job.m_waiter = h;
+    return true;
+}
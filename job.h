@@ -0,0 +1,149 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// ------------------------------------------------------------
+// Cooperative cancellation: the front end sets the flag, the
+// engines poll it (options.cancel) and clean up after
+// themselves
+// ------------------------------------------------------------
+using CancelFlag = std::atomic<bool>;
+
+inline bool IsCancelled(const CancelFlag* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+// ------------------------------------------------------------
+// What a job reports back to the front end
+// ------------------------------------------------------------
+enum class JobEventKind {
+    Log,        // text: log lines ("\r\n" separated)
+    Progress,   // value: progress bar position 0–100
+    Status,     // text: progress text, "" = done
+    Error,      // text: error for the user
+    Confirm,    // text: target to overwrite; reply with Job::answer (value: prompt id)
+    Finished,   // value: 1 = success, 0 = failure / cancelled
+};
+
+struct JobEvent {
+    JobEventKind kind = JobEventKind::Log;
+    std::wstring text;
+    int value = 0;
+};
+
+// ------------------------------------------------------------
+// One engine operation on its own thread. While it runs, the
+// job thread owns the log sink: log lines, progress, errors and
+// overwrite prompts become events in the job's queue, which the
+// front end drains on its own thread with dispatch() (woken by
+// the notify callback, or polling waitEvents). Progress and
+// status events are coalesced, so a slow front end only sees
+// the latest position.
+//
+// A coroutine can 'co_await *job' for the result; it resumes
+// inside dispatch(), after the Finished event was handled, on
+// the front end thread.
+// ------------------------------------------------------------
+class Job : public std::enable_shared_from_this<Job> {
+public:
+    using Work = std::function<bool(const CancelFlag& cancel)>;
+
+    // --------------------------------------------------------
+    // Run 'work' on a new thread. 'notify' is called on the job
+    // thread whenever the event queue stops being empty (e.g.
+    // PostMessage to the front end window).
+    // --------------------------------------------------------
+    static std::shared_ptr<Job> Start(Work work, std::function<void()> notify = {});
+
+    // --------------------------------------------------------
+    // Cancels a job that is still running and waits for it
+    // --------------------------------------------------------
+    ~Job();
+
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+
+    void cancel();
+    bool cancelRequested() const { return m_cancel.load(std::memory_order_relaxed); }
+
+    bool isDone() const;
+    bool succeeded() const;
+
+    // --------------------------------------------------------
+    // Wait up to 'timeout' for queued events. Returns true when
+    // there are events to dispatch.
+    // --------------------------------------------------------
+    bool waitEvents(std::chrono::milliseconds timeout);
+
+    // --------------------------------------------------------
+    // Hand every queued event to 'handler' (front end thread).
+    // A Confirm left unanswered by the handler is refused.
+    // --------------------------------------------------------
+    void dispatch(const std::function<void(const JobEvent&)>& handler);
+
+    // --------------------------------------------------------
+    // Reply to a Confirm event
+    // --------------------------------------------------------
+    void answer(bool yes);
+
+    class Awaiter {
+    public:
+        explicit Awaiter(Job& job) : m_job(job) {}
+        bool await_ready() const;
+        bool await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const { return m_job.succeeded(); }
+
+    private:
+        Job& m_job;
+    };
+
+    Awaiter operator co_await() { return Awaiter(*this); }
+
+private:
+    Job() = default;
+
+    void run(Work work);
+    void post(JobEvent e);
+    bool confirm(const std::wstring& target);
+    void refuseUnanswered(int id);
+
+    std::thread m_thread;
+    CancelFlag m_cancel{ false };
+    std::function<void()> m_notify;
+
+    mutable std::mutex m_mutex;          // Guards everything below
+    std::condition_variable m_cv;        // Events queued / answer given
+    std::deque<JobEvent> m_events;       // Not yet dispatched
+    bool m_done = false;                 // Work returned
+    bool m_ok = false;                   // ... with success
+    bool m_finishedSeen = false;         // Finished went through dispatch()
+    bool m_confirmPending = false;       // Job thread waits for answer()
+    int m_confirmId = 0;                 // Id of the latest prompt
+    int m_answer = -1;                   // -1 = none yet, 0 = no, 1 = yes
+    bool m_dispatching = false;          // dispatch() is on the stack
+    std::coroutine_handle<> m_waiter;    // Coroutine awaiting the result
+};
+
+// ------------------------------------------------------------
+// Fire-and-forget coroutine type for front end sequences that
+// co_await jobs (starts at once, frees itself at the end)
+// ------------------------------------------------------------
+struct JobTask {
+    struct promise_type {
+        JobTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
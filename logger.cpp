@@ -0,0 +1,315 @@
+﻿#include "logger.h"
+#include "platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <wchar.h>
+
+static const size_t kLogRingSlots = 8192;   // Queued lines before the front end must drain (power of two)
+
+// ------------------------------------------------------------
+// Bounded multi-producer ring of log lines (sequence-numbered
+// slots): producers claim a slot with one CAS and publish it
+// with a release store; the front end thread is the only
+// consumer
+// ------------------------------------------------------------
+class LogRing {
+public:
+    LogRing()
+    {
+        for (size_t i = 0; i < kLogRingSlots; ++i)
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(std::wstring&& text)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &m_slots[pos & (kLogRingSlots - 1)];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (seq < pos) {
+                return false;   // Full
+            }
+            else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->text = std::move(text);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // --------------------------------------------------------
+    // Append every published line to 'out' ("\r\n" separated)
+    // --------------------------------------------------------
+    void drain(std::wstring& out)
+    {
+        for (;;) {
+            Slot& slot = m_slots[m_tail & (kLogRingSlots - 1)];
+            if (slot.seq.load(std::memory_order_acquire) != m_tail + 1)
+                return;
+            out += slot.text;
+            out += L"\r\n";
+            slot.text.clear();
+            slot.seq.store(m_tail + kLogRingSlots, std::memory_order_release);
+            ++m_tail;
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq{ 0 };
+        std::wstring text;
+    };
+
+    Slot m_slots[kLogRingSlots];
+    std::atomic<size_t> m_head{ 0 };   // Next slot to claim (producers)
+    size_t m_tail = 0;                 // Next slot to read (consumer)
+};
+
+static LogSink g_Sink;                                   // Hooks installed by the front end
+static std::thread::id g_SinkThread;                     // Front end thread
+static LogRing g_LogRing;                                // Queued log lines
+static std::atomic<uint64_t> g_LogDropped{ 0 };          // Lines workers dropped on a full ring
+static std::atomic<LogLevel> g_LogLevel{ LogLevel::Files };
+static std::mutex g_ConfirmMutex;                        // One overwrite prompt at a time
+static thread_local std::wstring t_LogPrefix;            // Tag of the calling thread's lines
+
+static int g_LastPercent = -1;                           // Last position sent to the front end
+static std::atomic<uint64_t> g_ProgressDone{ 0 };        // Bytes done (AddProgress)
+static uint64_t g_ProgressTotal = 0;                     // Bytes of the whole operation
+static std::chrono::steady_clock::time_point g_ProgressStart;
+static std::chrono::steady_clock::time_point g_LastPump;
+
+static bool OnSinkThread()
+{
+    return std::this_thread::get_id() == g_SinkThread;
+}
+
+void SetLogSink(LogSink sink)
+{
+    g_Sink = std::move(sink);
+    g_SinkThread = std::this_thread::get_id();
+}
+
+void SetLogLevel(LogLevel level)
+{
+    g_LogLevel.store(level, std::memory_order_relaxed);
+}
+
+LogLevel GetLogLevel()
+{
+    return g_LogLevel.load(std::memory_order_relaxed);
+}
+
+void SetThreadLogPrefix(const std::wstring& prefix)
+{
+    t_LogPrefix = prefix;
+}
+
+bool ParseLogLevel(const std::string& name, LogLevel& level)
+{
+    if (name == "errors") level = LogLevel::Errors;
+    else if (name == "summary") level = LogLevel::Summary;
+    else if (name == "files") level = LogLevel::Files;
+    else return false;
+    return true;
+}
+
+// ------------------------------------------------------------
+// Queue a line (any thread, no level check)
+// ------------------------------------------------------------
+static void QueueLine(const std::wstring& text)
+{
+    std::wstring line = t_LogPrefix + text;
+    while (!g_LogRing.push(std::move(line))) {
+        if (!OnSinkThread()) {
+            g_LogDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        AppendBufferedLog();
+    }
+}
+
+// ------------------------------------------------------------
+// Append a line now (front end thread) or queue it
+// ------------------------------------------------------------
+static void AppendLine(const std::wstring& text)
+{
+    if (!OnSinkThread()) {
+        QueueLine(text);
+        return;
+    }
+    AppendBufferedLog();
+    g_Sink.append(t_LogPrefix + text + L"\r\n");
+}
+
+void LogBuffered(const std::wstring& text)
+{
+    if (g_Sink.append && LogLevelEnabled(LogLevel::Summary))
+        QueueLine(text);
+}
+
+void AppendBufferedLog()
+{
+    if (!g_Sink.append || !OnSinkThread())
+        return;
+
+    std::wstring text;
+    g_LogRing.drain(text);
+
+    uint64_t dropped = g_LogDropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+        text += std::to_wstring(dropped) + L" log lines dropped (log queue full)\r\n";
+
+    if (!text.empty())
+        g_Sink.append(text);
+}
+
+void Log(const std::wstring& text)
+{
+    if (g_Sink.append && LogLevelEnabled(LogLevel::Summary))
+        AppendLine(text);
+}
+
+void SetProgress(int percent)
+{
+    if (percent == g_LastPercent || !OnSinkThread())
+        return;
+    g_LastPercent = percent;
+    if (g_Sink.progress)
+        g_Sink.progress(percent);
+}
+
+void BeginProgress(uint64_t totalBytes)
+{
+    if (!OnSinkThread())
+        return;
+    g_ProgressTotal = totalBytes;
+    g_ProgressDone.store(0, std::memory_order_relaxed);
+    g_ProgressStart = std::chrono::steady_clock::now();
+    g_LastPump = g_ProgressStart;
+    SetProgress(0);
+}
+
+void AddProgress(uint64_t bytes)
+{
+    g_ProgressDone.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// ------------------------------------------------------------
+// "12.34 MB of 56.78 MB, 123.45 MB/s, ETA 0:07"
+// ------------------------------------------------------------
+static std::wstring FormatProgressStatus(uint64_t done, uint64_t total, double elapsed)
+{
+    double rate = elapsed > 0.0 ? double(done) / elapsed : 0.0;
+
+    wchar_t eta[32] = L"--:--";
+    if (done >= total) {
+        swprintf(eta, 32, L"0:00");
+    }
+    else if (rate > 0.0) {
+        uint64_t left = (uint64_t)(double(total - done) / rate + 0.5);
+        if (left >= 3600)
+            swprintf(eta, 32, L"%u:%02u:%02u", (unsigned)(left / 3600), (unsigned)(left / 60 % 60), (unsigned)(left % 60));
+        else
+            swprintf(eta, 32, L"%u:%02u", (unsigned)(left / 60), (unsigned)(left % 60));
+    }
+
+    wchar_t buf[160];
+    swprintf(buf, 160, L"%ls of %ls, %.2f MB/s, ETA %ls",
+        FormatBytes(done).c_str(), FormatBytes(total).c_str(), rate / (1024.0 * 1024.0), eta);
+    return buf;
+}
+
+void PumpProgress()
+{
+    if (!OnSinkThread())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - g_LastPump < std::chrono::milliseconds(kLogPumpMs))
+        return;
+    g_LastPump = now;
+
+    AppendBufferedLog();
+
+    uint64_t done = std::min(g_ProgressDone.load(std::memory_order_relaxed), g_ProgressTotal);
+    if (g_ProgressTotal > 0)
+        SetProgress((int)((done * 100) / g_ProgressTotal));
+
+    if (g_Sink.status) {
+        double elapsed = std::chrono::duration<double>(now - g_ProgressStart).count();
+        g_Sink.status(FormatProgressStatus(done, g_ProgressTotal, elapsed));
+    }
+}
+
+void EndProgress()
+{
+    AppendBufferedLog();
+    if (g_Sink.status && OnSinkThread())
+        g_Sink.status(L"");
+}
+
+void ShowError(const wchar_t* msg)
+{
+    if (g_Sink.error && OnSinkThread())
+        g_Sink.error(msg);
+    if (g_Sink.append)
+        AppendLine(L"ERROR: " + std::wstring(msg));
+}
+
+bool ConfirmOverwrite(const std::wstring& target)
+{
+    std::lock_guard<std::mutex> lock(g_ConfirmMutex);
+    return g_Sink.confirmOverwrite && g_Sink.confirmOverwrite(target);
+}
+
+std::wstring FormatSeconds(double s)
+{
+    wchar_t buf[64];
+    swprintf(buf, 64, L"%.3f seconds", s);
+    return buf;
+}
+
+std::wstring FormatBytes(uint64_t bytes)
+{
+    wchar_t buf[48];
+    swprintf(buf, 48, L"%.2f MB", double(bytes) / (1024.0 * 1024.0));
+    return buf;
+}
+
+std::wstring FormatThroughput(uint64_t bytes, size_t files, double s)
+{
+    if (s <= 0.0) s = 1e-9;
+
+    wchar_t buf[96];
+    swprintf(buf, 96, L"%.2f MB/s, %.0f files/s",
+        double(bytes) / (1024.0 * 1024.0) / s, double(files) / s);
+    return buf;
+}
+
+std::wstring FormatPeakMemory()
+{
+    MemoryStats ms = GetMemoryStats();
+
+    wchar_t buf[128];
+#ifdef _WIN32
+    swprintf(buf, 128, L"peak working set %.1f MB, peak private %.1f MB",
+        double(ms.peakResident) / (1024.0 * 1024.0),
+        double(ms.peakPrivate) / (1024.0 * 1024.0));
+#else
+    swprintf(buf, 128, L"peak RSS %.1f MB",
+        double(ms.peakResident) / (1024.0 * 1024.0));
+#endif
+    return buf;
+}
@@ -0,0 +1,138 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <functional>
+
+// ------------------------------------------------------------
+// Front end hooks used by the WAD engine. The GUI routes them
+// to the log EDIT control / progress bar / message boxes, the
+// command line driver to stdout / stderr. All hooks are called
+// on the front end thread (the one that installed them), except
+// confirmOverwrite: operations running side by side (a batch)
+// ask from their own threads, one prompt at a time.
+// ------------------------------------------------------------
+struct LogSink {
+    std::function<void(const std::wstring&)> append;            // Append text ("\r\n" separated lines)
+    std::function<void(int)> progress;                          // Progress bar position 0–100
+    std::function<void(const std::wstring&)> status;            // Progress text (throughput, ETA), "" = done
+    std::function<void(const std::wstring&)> error;             // Report an error to the user
+    std::function<bool(const std::wstring&)> confirmOverwrite;  // Ask before overwriting a target
+};
+
+// ------------------------------------------------------------
+// Install the front end hooks (unset hooks are ignored, an
+// unset confirmOverwrite hook refuses to overwrite). The
+// calling thread becomes the front end thread.
+// ------------------------------------------------------------
+void SetLogSink(LogSink sink);
+
+// ------------------------------------------------------------
+// Verbosity: what reaches the log
+// ------------------------------------------------------------
+enum class LogLevel {
+    Errors,   // Errors only
+    Summary,  // + steps, per-file problems and totals (fast mode)
+    Files,    // + one line per packed / extracted file (default)
+};
+
+void SetLogLevel(LogLevel level);
+LogLevel GetLogLevel();
+
+inline bool LogLevelEnabled(LogLevel level)
+{
+    return GetLogLevel() >= level;
+}
+
+// ------------------------------------------------------------
+// Parse "errors", "summary" or "files"
+// ------------------------------------------------------------
+bool ParseLogLevel(const std::string& name, LogLevel& level);
+
+// ------------------------------------------------------------
+// Prefix every line the calling thread logs from now on (e.g.
+// "[3] " for one item of a batch; "" = none)
+// ------------------------------------------------------------
+void SetThreadLogPrefix(const std::wstring& prefix);
+
+// ------------------------------------------------------------
+// Queue a line for the log. Any thread may call this: lines go
+// to a lock-free ring and reach the front end in batches, on
+// its thread, at most every kLogPumpMs (or when the ring is
+// full and the caller is the front end thread; a worker never
+// waits, it drops the line and the drop is counted in the log).
+// ------------------------------------------------------------
+void LogBuffered(const std::wstring& text);
+
+// ------------------------------------------------------------
+// Flush queued log lines to the front end in one batch
+// (front end thread)
+// ------------------------------------------------------------
+void AppendBufferedLog();
+
+// ------------------------------------------------------------
+// Append a single line of text to the log (Summary level):
+// at once after the queued lines on the front end thread,
+// through the queue on any other thread
+// ------------------------------------------------------------
+void Log(const std::wstring& text);
+
+// ------------------------------------------------------------
+// Set the progress position in the range 0–100 (the front end
+// only hears about changes)
+// ------------------------------------------------------------
+void SetProgress(int percent);
+
+// ------------------------------------------------------------
+// Byte-based progress of one operation:
+//  - BeginProgress: total bytes of the work, resets the clock
+//  - AddProgress:   any thread, one relaxed atomic add
+//  - PumpProgress:  front end thread, from the waiting loop;
+//    at most every kLogPumpMs it flushes queued log lines and
+//    reports percent, throughput and ETA
+//  - EndProgress:   final flush, clears the status
+// Begin / Pump / End do nothing on other threads: operations a
+// batch runs side by side only add to the batch's progress.
+// ------------------------------------------------------------
+static const unsigned kLogPumpMs = 100;
+
+void BeginProgress(uint64_t totalBytes);
+void AddProgress(uint64_t bytes);
+void PumpProgress();
+void EndProgress();
+
+// ------------------------------------------------------------
+// Report an error to the user and log the error text (only
+// logged when called off the front end thread)
+// ------------------------------------------------------------
+void ShowError(const wchar_t* msg);
+
+// ------------------------------------------------------------
+// Ask the front end to confirm overwriting an existing
+// directory or WAD file
+// ------------------------------------------------------------
+bool ConfirmOverwrite(const std::wstring& target);
+
+// ------------------------------------------------------------
+// Format a duration in seconds with three decimal places
+// (e.g. "0.123 seconds")
+// ------------------------------------------------------------
+std::wstring FormatSeconds(double s);
+
+// ------------------------------------------------------------
+// Format a byte count in MB with two decimal places
+// (e.g. "12.34 MB")
+// ------------------------------------------------------------
+std::wstring FormatBytes(uint64_t bytes);
+
+// ------------------------------------------------------------
+// Format a transfer rate from a byte/file count and a duration
+// (e.g. "512.34 MB/s, 1234 files/s")
+// ------------------------------------------------------------
+std::wstring FormatThroughput(uint64_t bytes, size_t files, double s);
+
+// ------------------------------------------------------------
+// Format the process peak memory use
+// (e.g. "peak working set 12.3 MB, peak private 4.5 MB")
+// ------------------------------------------------------------
+std::wstring FormatPeakMemory();
@@ -0,0 +1,195 @@
+﻿#include "lz_codec.h"
+
+#include <string.h>
+#include <vector>
+
+static const size_t kMinMatch = 4;        // Shortest back-reference
+static const size_t kLastLiterals = 5;    // The block ends with at least this many literals
+static const size_t kMatchSafety = 12;    // No match starts this close to the end
+static const size_t kMaxOffset = 65535;   // Furthest back-reference
+static const unsigned kHashLog = 14;      // Match finder: 16K positions
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t HashSequence(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - kHashLog);
+}
+
+// ------------------------------------------------------------
+// A length of 15 or more continues in bytes of 255, ended by a
+// byte below 255
+// ------------------------------------------------------------
+static inline void WriteLength(uint8_t*& op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+}
+
+// ------------------------------------------------------------
+// One sequence: token, literal run, then (unless this is the
+// last sequence) the offset and match length. Returns false
+// when it does not fit.
+// ------------------------------------------------------------
+static bool EmitSequence(uint8_t*& op, const uint8_t* oend, const uint8_t* literals, size_t literalLength,
+    size_t offset, size_t matchLength, bool last)
+{
+    size_t need = 1 + literalLength / 255 + 1 + literalLength + (last ? 0 : 2 + matchLength / 255 + 1);
+    if (need > (size_t)(oend - op))
+        return false;
+
+    size_t matchCode = last ? 0 : matchLength - kMinMatch;
+    uint8_t* token = op++;
+    *token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15)
+        WriteLength(op, literalLength - 15);
+    if (literalLength > 0)
+        memcpy(op, literals, literalLength);
+    op += literalLength;
+    if (last)
+        return true;
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    *token |= (uint8_t)(matchCode >= 15 ? 15 : matchCode);
+    if (matchCode >= 15)
+        WriteLength(op, matchCode - 15);
+    return true;
+}
+
+// ------------------------------------------------------------
+// Greedy single-pass match finder over a hash of 4-byte
+// sequences; the search step grows while no match is found, so
+// incompressible input passes quickly
+// ------------------------------------------------------------
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+{
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + capacity;
+    size_t anchor = 0;
+
+    if (size > kMatchSafety) {
+        std::vector<uint32_t> table((size_t)1 << kHashLog, 0);
+        const size_t matchStartLimit = size - kMatchSafety;
+        const size_t matchEndLimit = size - kLastLiterals;
+
+        size_t ip = 1;
+        while (ip < matchStartLimit) {
+            uint32_t seq = Read32(src + ip);
+            uint32_t h = HashSequence(seq);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+
+            if (ip - ref > kMaxOffset || Read32(src + ref) != seq) {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // --------------------------------------------------------
+            // Extend the match backwards into the pending literals,
+            // then forwards up to the end limit
+            // --------------------------------------------------------
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t length = kMinMatch;
+            while (ip + length < matchEndLimit && src[ip + length] == src[ref + length])
+                length++;
+
+            if (!EmitSequence(op, oend, src + anchor, ip - anchor, ip - ref, length, false))
+                return 0;
+
+            ip += length;
+            anchor = ip;
+            if (ip - 2 < matchStartLimit)
+                table[HashSequence(Read32(src + ip - 2))] = (uint32_t)(ip - 2);
+        }
+    }
+
+    if (!EmitSequence(op, oend, src + anchor, size - anchor, 0, 0, true))
+        return 0;
+    return (size_t)(op - dst);
+}
+
+bool LzDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + srcSize;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dstSize;
+
+    auto readLength = [&](size_t& length) {
+        unsigned b;
+        do {
+            if (ip >= iend)
+                return false;
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+
+    for (;;) {
+        if (ip >= iend)
+            return false;
+        unsigned token = *ip++;
+
+        // ------------------------------------------------------------
+        // 1. Literal run; the last sequence ends with it
+        // ------------------------------------------------------------
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(literalLength))
+            return false;
+        if (literalLength > (size_t)(iend - ip) || literalLength > (size_t)(oend - op))
+            return false;
+        if (literalLength > 0)
+            memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+        if (ip == iend)
+            return op == oend;
+
+        // ------------------------------------------------------------
+        // 2. Back-reference into the decoded output
+        // ------------------------------------------------------------
+        if (iend - ip < 2)
+            return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(matchLength))
+            return false;
+        matchLength += kMinMatch;
+        if (matchLength > (size_t)(oend - op))
+            return false;
+
+        // ------------------------------------------------------------
+        // 3. Copy; an offset shorter than the match repeats the
+        //    bytes just written (copy in steps of the offset)
+        // ------------------------------------------------------------
+        const uint8_t* match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, matchLength);
+        }
+        else {
+            for (size_t done = 0; done < matchLength;) {
+                size_t n = matchLength - done < offset ? matchLength - done : offset;
+                memcpy(op + done, match + done, n);
+                done += n;
+            }
+        }
+        op += matchLength;
+    }
+}
@@ -0,0 +1,33 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ------------------------------------------------------------
+// LZ block codec (the LZ4 block format: literal runs and
+// back-references of at most 64 KB, no entropy stage), used for
+// the blocks of compressed WADs. Fast enough to run on every
+// core during a pack and to decode faster than storage reads.
+// ------------------------------------------------------------
+
+// ------------------------------------------------------------
+// Largest compressed size of 'size' input bytes
+// ------------------------------------------------------------
+inline size_t LzCompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// ------------------------------------------------------------
+// Compress 'size' bytes into 'dst' ('capacity' bytes). Returns
+// the compressed size, or 0 when it does not fit (callers store
+// such data raw; give LzCompressBound bytes to always fit).
+// ------------------------------------------------------------
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+// ------------------------------------------------------------
+// Decompress a block that must decode to exactly 'dstSize'
+// bytes. Every read and write is bounds-checked, so a corrupt
+// block returns false instead of touching memory outside the
+// buffers.
+// ------------------------------------------------------------
+bool LzDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
@@ -0,0 +1,491 @@
+﻿#include "mapped_file.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+size_t MapGranularity()
+{
+    static const size_t granularity = [] {
+        SYSTEM_INFO si{};
+        GetSystemInfo(&si);
+        return (size_t)si.dwAllocationGranularity;
+    }();
+    return granularity;
+}
+
+// ------------------------------------------------------------
+// Map 'length' bytes at 'offset' (granularity aligned) of the
+// file (0 = to the end)
+// ------------------------------------------------------------
+static const uint8_t* MapRange(const MappedFile& file, uint64_t offset, size_t length)
+{
+    return static_cast<const uint8_t*>(MapViewOfFile(file.hMap, FILE_MAP_READ,
+        (DWORD)(offset >> 32), (DWORD)offset, length));
+}
+
+static void UnmapRange(const uint8_t* view, size_t)
+{
+    UnmapViewOfFile(view);
+}
+
+// ------------------------------------------------------------
+// Read a mapped range in with one request (Windows 8 and up)
+// ------------------------------------------------------------
+static void PrefetchMapped(const uint8_t* p, size_t length)
+{
+    WIN32_MEMORY_RANGE_ENTRY range{ const_cast<uint8_t*>(p), length };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+// ------------------------------------------------------------
+// Unmapped ranges are left to the cache manager's read-ahead
+// (FILE_FLAG_SEQUENTIAL_SCAN)
+// ------------------------------------------------------------
+static void PrefetchFile(const MappedFile&, uint64_t, uint64_t)
+{
+}
+
+// ------------------------------------------------------------
+// VirtualUnlock on pages that are not locked removes them from
+// the working set without discarding their contents
+// ------------------------------------------------------------
+static void EvictMapped(const uint8_t* p, size_t length)
+{
+    VirtualUnlock(const_cast<uint8_t*>(p), length);
+}
+
+bool MappedFile::open(const std::filesystem::path& path, const MapOptions& mapOptions)
+{
+    options = mapOptions;
+
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (options.access == MapAccess::Sequential) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if (options.access == MapAccess::Random) flags |= FILE_FLAG_RANDOM_ACCESS;
+
+    hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, flags, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER li{};
+    if (!GetFileSizeEx(hFile, &li)) return false;
+    size = static_cast<size_t>(li.QuadPart);
+
+    hMap = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!hMap) return false;
+
+    // ------------------------------------------------------------
+    // Windowed: map the head only, the rest goes through windows
+    // ------------------------------------------------------------
+    size_t head = size;
+    if (options.window && options.window < size)
+        head = options.window;
+
+    base = MapRange(*this, 0, head == size ? 0 : head);
+    if (!base) return false;
+    mapped = head;
+    return true;
+}
+
+bool MappedFile::mapHead(size_t bytes)
+{
+    if (bytes <= mapped) return true;
+    if (bytes > size || !hMap) return false;
+
+    UnmapRange(base, mapped);
+    base = MapRange(*this, 0, bytes == size ? 0 : bytes);
+    mapped = base ? bytes : 0;
+    return base != nullptr;
+}
+
+void MappedFile::close()
+{
+    if (base) UnmapViewOfFile(base);
+    if (hMap) CloseHandle(hMap);
+    if (hFile && hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+    base = nullptr;
+    hMap = nullptr;
+    hFile = nullptr;
+    size = 0;
+    mapped = 0;
+}
+
+// ------------------------------------------------------------
+// Large pages cannot back file mappings on Windows, and writes
+// need no read-ahead: the map options are not used here
+// ------------------------------------------------------------
+bool MappedOutput::createAt(const DirHandle&, const NativeChar* path, size_t totalSize, const MapOptions& options)
+{
+    return create(path, totalSize, options);
+}
+
+bool MappedOutput::create(const std::filesystem::path& path, size_t totalSize, const MapOptions&)
+{
+    size = totalSize;
+
+    hFile = CreateFileW(
+        path.c_str(),
+        GENERIC_WRITE | GENERIC_READ,
+        0,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (hFile == INVALID_HANDLE_VALUE) {
+        hFile = nullptr;
+        return false;
+    }
+
+    // ----------------------------------------------------
+    // Pre-allocate the file to the requested total size by
+    // moving the file pointer and setting the end of file
+    // ----------------------------------------------------
+    LARGE_INTEGER li;
+    li.QuadPart = totalSize;
+    if (!SetFilePointerEx(hFile, li, nullptr, FILE_BEGIN))
+    {
+        CloseHandle(hFile);
+        hFile = nullptr;
+        return false;
+    }
+
+    if (!SetEndOfFile(hFile))
+    {
+        CloseHandle(hFile);
+        hFile = nullptr;
+        return false;
+    }
+
+    // ----------------------------------------------------
+    // Create a read/write file mapping object for the file
+    // ----------------------------------------------------
+    hMap = CreateFileMappingW(hFile, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (!hMap) {
+        CloseHandle(hFile);
+        hFile = nullptr;
+        return false;
+    }
+
+    base = static_cast<uint8_t*>(
+        MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, 0)
+        );
+    if (!base) {
+        CloseHandle(hMap);
+        CloseHandle(hFile);
+        hMap = nullptr;
+        hFile = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void MappedOutput::release(size_t offset, size_t length)
+{
+    if (!base || length == 0) return;
+    FlushViewOfFile(base + offset, length);
+    EvictMapped(base + offset, length);
+}
+
+void MappedOutput::close()
+{
+    if (base) UnmapViewOfFile(base);
+    if (hMap) CloseHandle(hMap);
+    if (hFile && hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+    base = nullptr;
+    hMap = nullptr;
+    hFile = nullptr;
+    size = 0;
+}
+
+#else // POSIX
+
+size_t MapGranularity()
+{
+    static const size_t granularity = (size_t)sysconf(_SC_PAGESIZE);
+    return granularity;
+}
+
+static const uint8_t* MapRange(const MappedFile& file, uint64_t offset, size_t length)
+{
+    void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, file.fd, (off_t)offset);
+    return p == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(p);
+}
+
+static void UnmapRange(const uint8_t* view, size_t length)
+{
+    munmap(const_cast<uint8_t*>(view), length);
+}
+
+// ------------------------------------------------------------
+// Page-aligned madvise over [p, p + length)
+// ------------------------------------------------------------
+static void Advise(const uint8_t* p, size_t length, int advice)
+{
+    size_t page = MapGranularity();
+    uintptr_t start = (uintptr_t)p & ~(uintptr_t)(page - 1);
+    madvise(reinterpret_cast<void*>(start), (uintptr_t)p + length - start, advice);
+}
+
+// ------------------------------------------------------------
+// Access pattern and huge page hints for a fresh mapping
+// ------------------------------------------------------------
+static void AdviseMapping(const uint8_t* p, size_t length, const MapOptions& options)
+{
+    if (options.access == MapAccess::Sequential)
+        Advise(p, length, MADV_SEQUENTIAL);
+    else if (options.access == MapAccess::Random)
+        Advise(p, length, MADV_RANDOM);
+#ifdef MADV_HUGEPAGE
+    if (options.hugePages)
+        Advise(p, length, MADV_HUGEPAGE);
+#endif
+}
+
+static void PrefetchMapped(const uint8_t* p, size_t length)
+{
+    Advise(p, length, MADV_WILLNEED);
+}
+
+// ------------------------------------------------------------
+// Queue read-ahead of a range that is not mapped yet
+// ------------------------------------------------------------
+static void PrefetchFile(const MappedFile& file, uint64_t offset, uint64_t length)
+{
+    posix_fadvise(file.fd, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+}
+
+// ------------------------------------------------------------
+// MADV_DONTNEED on a shared file mapping only drops the pages
+// from this process; the data stays in the page cache
+// ------------------------------------------------------------
+static void EvictMapped(const uint8_t* p, size_t length)
+{
+    Advise(p, length, MADV_DONTNEED);
+}
+
+bool MappedFile::open(const std::filesystem::path& path, const MapOptions& mapOptions)
+{
+    options = mapOptions;
+
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st {};
+    if (fstat(fd, &st) != 0) return false;
+    size = static_cast<size_t>(st.st_size);
+
+    // ----------------------------------------------------
+    // mmap cannot map an empty file; match the Win32 path,
+    // where CreateFileMapping fails for zero-length files
+    // ----------------------------------------------------
+    if (size == 0) return false;
+
+    if (options.access == MapAccess::Sequential)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    else if (options.access == MapAccess::Random)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    // ----------------------------------------------------
+    // Windowed: map the head only, the rest goes through
+    // windows
+    // ----------------------------------------------------
+    size_t head = size;
+    if (options.window && options.window < size)
+        head = options.window;
+
+    base = MapRange(*this, 0, head);
+    if (!base) return false;
+    mapped = head;
+    AdviseMapping(base, mapped, options);
+    return true;
+}
+
+bool MappedFile::mapHead(size_t bytes)
+{
+    if (bytes <= mapped) return true;
+    if (bytes > size || fd < 0) return false;
+
+    UnmapRange(base, mapped);
+    base = MapRange(*this, 0, bytes);
+    mapped = base ? bytes : 0;
+    if (base)
+        AdviseMapping(base, mapped, options);
+    return base != nullptr;
+}
+
+void MappedFile::close()
+{
+    if (base) munmap(const_cast<uint8_t*>(base), mapped);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+    size = 0;
+    mapped = 0;
+}
+
+bool MappedOutput::create(const std::filesystem::path& path, size_t totalSize, const MapOptions& options)
+{
+    return createAt(DirHandle(), path.c_str(), totalSize, options);
+}
+
+bool MappedOutput::createAt(const DirHandle& dir, const NativeChar* path, size_t totalSize, const MapOptions& options)
+{
+    size = totalSize;
+
+    fd = ::openat(dir.isOpen() ? dir.fd : AT_FDCWD, path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return false;
+
+    // ----------------------------------------------------
+    // Size the file up front, then map it shared so stores
+    // land in the page cache of the output file
+    // ----------------------------------------------------
+    if (ftruncate(fd, (off_t)totalSize) != 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    void* p = mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    base = static_cast<uint8_t*>(p);
+    AdviseMapping(base, size, options);
+    return true;
+}
+
+// ------------------------------------------------------------
+// Schedule write-back and drop the range from this process;
+// MADV_DONTNEED on a shared file mapping keeps the data in the
+// page cache / on disk
+// ------------------------------------------------------------
+void MappedOutput::release(size_t offset, size_t length)
+{
+    if (!base || length == 0) return;
+
+    size_t page = MapGranularity();
+    size_t start = offset & ~(page - 1);
+    size_t end = offset + length;
+
+    msync(base + start, end - start, MS_ASYNC);
+    madvise(base + start, end - start, MADV_DONTNEED);
+}
+
+void MappedOutput::close()
+{
+    if (base) munmap(base, size);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+    size = 0;
+}
+
+#endif
+
+// ------------------------------------------------------------
+// MappedWindow (both platforms)
+// ------------------------------------------------------------
+MappedWindow::MappedWindow(const MappedFile& file)
+    : m_file(file)
+{
+    size_t granularity = MapGranularity();
+    size_t window = file.options.window ? file.options.window : kMapWindowBytes;
+    m_window = (window + granularity - 1) / granularity * granularity;
+}
+
+bool MappedWindow::covers(uint64_t offset, size_t length) const
+{
+    if (m_file.isWhole())
+        return true;
+    return m_view && offset >= m_start && offset + length <= m_end;
+}
+
+const uint8_t* MappedWindow::view(uint64_t offset, size_t length)
+{
+    if (!m_file.base || offset > m_file.size || length > m_file.size - offset)
+        return nullptr;
+
+    if (offset < m_start || offset + length > m_end || (!m_file.isWhole() && !m_view))
+        enter(offset, offset + length);
+
+    if (m_file.isWhole())
+        return m_file.base + offset;
+    return m_view ? m_view + (offset - m_start) : nullptr;
+}
+
+// ------------------------------------------------------------
+// Leave the current window and start one at the granularity
+// boundary below 'start', at least 'm_window' long
+// ------------------------------------------------------------
+void MappedWindow::enter(uint64_t start, uint64_t end)
+{
+    release();
+
+    uint64_t granularity = MapGranularity();
+    uint64_t lo = start / granularity * granularity;
+    uint64_t hi = std::min<uint64_t>(std::max<uint64_t>(end, lo + m_window), m_file.size);
+
+    if (!m_file.isWhole()) {
+        m_view = MapRange(m_file, lo, (size_t)(hi - lo));
+        if (!m_view)
+            return;
+#ifndef _WIN32
+        AdviseMapping(m_view, (size_t)(hi - lo), m_file.options);
+#endif
+    }
+    m_start = lo;
+    m_end = hi;
+
+    // ------------------------------------------------------------
+    // The requested range is about to be read: fetch it in one go
+    // ------------------------------------------------------------
+    prefetch(start, end - start);
+}
+
+void MappedWindow::prefetch(uint64_t offset, uint64_t length)
+{
+    if (offset >= m_file.size || length == 0)
+        return;
+
+    // ------------------------------------------------------------
+    // Never more than a window ahead, so read-ahead stays bounded
+    // ------------------------------------------------------------
+    length = std::min<uint64_t>({ length, m_file.size - offset, m_window });
+
+    if (m_file.isWhole())
+        PrefetchMapped(m_file.base + offset, (size_t)length);
+    else if (m_view && offset >= m_start && offset + length <= m_end)
+        PrefetchMapped(m_view + (offset - m_start), (size_t)length);
+    else
+        PrefetchFile(m_file, offset, length);
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+    if (base && offset < mapped && length > 0)
+        PrefetchMapped(base + offset, std::min(length, mapped - offset));
+}
+
+void MappedWindow::release()
+{
+    if (m_view)
+        UnmapRange(m_view, (size_t)(m_end - m_start));
+    else if (m_end > m_start && m_file.base && m_file.isWhole())
+        EvictMapped(m_file.base + m_start, (size_t)(m_end - m_start));
+    m_view = nullptr;
+    m_start = 0;
+    m_end = 0;
+}
@@ -0,0 +1,194 @@
+﻿#pragma once
+#include "platform.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// How a mapping will be read; passed to the OS as a read-ahead
+// hint (madvise / FILE_FLAG_SEQUENTIAL_SCAN)
+// ------------------------------------------------------------
+enum class MapAccess {
+    Normal,       // No hint
+    Sequential,   // Mostly front to back: read ahead aggressively
+    Random,       // Scattered small reads: no read-ahead
+};
+
+static const size_t kMapWindowBytes = 64ull * 1024 * 1024;   // Default window of the engines
+
+// ------------------------------------------------------------
+// Mapping settings:
+//  - window 0 maps the whole file (random access, as the reader
+//    needs); otherwise only the header region stays mapped and
+//    data is read through MappedWindow, 'window' bytes at a time,
+//    so the address space and resident pages of a huge file stay
+//    bounded
+//  - hugePages asks for transparent huge pages (Linux, best
+//    effort; fewer TLB misses and page faults on big copies)
+// ------------------------------------------------------------
+struct MapOptions {
+    size_t window = 0;
+    MapAccess access = MapAccess::Normal;
+    bool hugePages = false;
+};
+
+// ------------------------------------------------------------
+// Granularity mapping offsets are aligned to (page size, the
+// 64 KB allocation granularity on Windows)
+// ------------------------------------------------------------
+size_t MapGranularity();
+
+// ------------------------------------------------------------
+// RAII wrapper for a read-only memory-mapped input file
+// ------------------------------------------------------------
+struct MappedFile {
+#ifdef _WIN32
+    void* hFile = nullptr;          // Underlying file handle
+    void* hMap = nullptr;           // File mapping handle
+#else
+    int fd = -1;                    // Underlying file descriptor
+#endif
+    const uint8_t* base = nullptr;  // Base address of mapped view
+    size_t size = 0;                // Total size of the mapped file
+    size_t mapped = 0;              // Bytes mapped at 'base' (less than 'size' in windowed mode)
+    MapOptions options;             // Settings the file was opened with
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // --------------------------------------------------------
+    // Open the file read-only and map it into memory: all of
+    // it, or with a window only the first 'window' bytes.
+    // Returns true on success.
+    // --------------------------------------------------------
+    bool open(const std::filesystem::path& path, const MapOptions& options = {});
+
+    // --------------------------------------------------------
+    // Windowed mode: make sure the first 'bytes' of the file
+    // are mapped at 'base' (e.g. a table larger than the
+    // window); 'base' may move. Returns false on failure.
+    // --------------------------------------------------------
+    bool mapHead(size_t bytes);
+
+    // --------------------------------------------------------
+    // Read a range of the mapping at 'base' in with one request
+    // (e.g. a table about to be walked)
+    // --------------------------------------------------------
+    void prefetch(size_t offset, size_t length) const;
+
+    // --------------------------------------------------------
+    // Whether the whole file is mapped at 'base'
+    // --------------------------------------------------------
+    bool isWhole() const { return mapped == size; }
+
+    // --------------------------------------------------------
+    // Unmap the view and close any open handles associated with
+    // this mapped file
+    // --------------------------------------------------------
+    void close();
+
+    ~MappedFile() { close(); }
+};
+
+// ------------------------------------------------------------
+// RAII wrapper for a read/write memory-mapped output file
+// ------------------------------------------------------------
+struct MappedOutput {
+#ifdef _WIN32
+    void* hFile = nullptr;    // Underlying file handle
+    void* hMap = nullptr;     // File mapping handle
+#else
+    int fd = -1;              // Underlying file descriptor
+#endif
+    uint8_t* base = nullptr;  // Base address of mapped writable view
+    size_t size = 0;          // Total size of the mapped file
+
+    MappedOutput() = default;
+    MappedOutput(const MappedOutput&) = delete;
+    MappedOutput& operator=(const MappedOutput&) = delete;
+
+    // --------------------------------------------------------
+    // Create a new file of the specified size and map it with
+    // read/write access ('options.window' is ignored: writers
+    // bound their resident pages with release()). Returns true
+    // on success.
+    // --------------------------------------------------------
+    bool create(const std::filesystem::path& path, size_t totalSize, const MapOptions& options = {});
+    bool createAt(const DirHandle& dir, const NativeChar* path, size_t totalSize, const MapOptions& options = {});
+
+    // --------------------------------------------------------
+    // Start writing back a written range and drop its pages
+    // from the process working set (contents are kept)
+    // --------------------------------------------------------
+    void release(size_t offset, size_t length);
+
+    // --------------------------------------------------------
+    // Unmap the view and close any open handles associated with
+    // this mapped output file
+    // --------------------------------------------------------
+    void close();
+
+    ~MappedOutput() { close(); }
+};
+
+// ------------------------------------------------------------
+// One read cursor over a MappedFile (one per thread):
+//  - whole-file mapping: view() points into it, and the pages of
+//    the last window are dropped from the process once the
+//    cursor leaves it
+//  - windowed mapping: view() maps a window of the file's size
+//    around the requested range (larger when the range needs
+//    it) and unmaps the previous one
+// Entering a window prefetches the requested range in one
+// request instead of page fault by page fault; prefetch() reads
+// ahead of the cursor. A pointer from view() stays valid until
+// a later view() of a range that covers() rejects.
+// ------------------------------------------------------------
+class MappedWindow {
+public:
+    explicit MappedWindow(const MappedFile& file);
+    ~MappedWindow() { release(); }
+    MappedWindow(const MappedWindow&) = delete;
+    MappedWindow& operator=(const MappedWindow&) = delete;
+
+    // --------------------------------------------------------
+    // Pointer to 'length' bytes at 'offset' of the file, or
+    // nullptr when they cannot be mapped
+    // --------------------------------------------------------
+    const uint8_t* view(uint64_t offset, size_t length);
+
+    // --------------------------------------------------------
+    // Whether view(offset, length) keeps earlier pointers valid
+    // --------------------------------------------------------
+    bool covers(uint64_t offset, size_t length) const;
+
+    // --------------------------------------------------------
+    // Ask the OS to start reading a range that will be needed
+    // soon (ahead of the cursor; at most one window)
+    // --------------------------------------------------------
+    void prefetch(uint64_t offset, uint64_t length);
+
+    // --------------------------------------------------------
+    // Bytes a single view() maps at a time; copies and hashes
+    // of larger ranges go in chunks of this size
+    // --------------------------------------------------------
+    size_t windowBytes() const { return m_window; }
+
+    // --------------------------------------------------------
+    // Unmap the current window / drop its pages
+    // --------------------------------------------------------
+    void release();
+
+    const MappedFile& file() const { return m_file; }
+
+private:
+    void enter(uint64_t start, uint64_t end);
+
+    const MappedFile& m_file;
+    size_t m_window = 0;          // Window size (rounded to the map granularity)
+    const uint8_t* m_view = nullptr;  // Own mapping (windowed mode)
+    uint64_t m_start = 0;         // File range of the current window
+    uint64_t m_end = 0;
+};
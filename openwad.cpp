@@ -3,29 +3,22 @@
 2026 - OPENWAD v1.0 - node91 - Grand Prix 4
 ===========================================
 TO DO:
-- a refactored version with modules
 - an optimized version using parallel I/O
 
-example:
-src/
+layout:
 │
-├── main.cpp
-├── openwad.h
-├── openwad.cpp
+├── openwad.cpp        Win32 drag & drop front end
+├── openwad_cli.cpp    command line front end
 │
-├── wad_extract.h
-├── wad_extract.cpp
+├── wad_format.h/.cpp  on-disk structures, validation
+├── wad_extract.h/.cpp extraction engine
+├── wad_pack.h/.cpp    packing engine
 │
-├── wad_pack.h
-├── wad_pack.cpp
+├── mapped_file.h/.cpp memory-mapped input/output
+├── platform.h/.cpp    Win32 / POSIX platform layer
+├── logger.h/.cpp      log / progress hooks
 │
-├── mapped_file.h
-├── mapped_file.cpp
-│
-├── logger.h
-├── logger.cpp
-│
-└── ui_state.h
+└── thread_pool.h      work-stealing thread pool
 
 Feel free to use and modify this code as
 you see fit.
@@ -36,54 +29,54 @@ you see fit.
 #include <commctrl.h>
 #include <stdint.h>
 #include <string>
-#include <vector>
-#include <fstream>
 #include <filesystem>
-#include <algorithm>
-#include <unordered_set>
+
+#include "wad_extract.h"
+#include "wad_pack.h"
+#include "wad_verify.h"
+#include "platform.h"
+#include "logger.h"
+#include "telemetry.h"
+#include "job.h"
+#include "batch.h"
 
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "comctl32.lib")
 
-#pragma pack(push, 1)
-struct WadHeader {
-    uint32_t fileCount;   // Number of entries in the WAD table
-};
-
-struct WadItem {
-    char     name[128];   // ANSI file name (relative path inside WAD)
-    uint32_t dataOffset;  // Offset of file data from start of WAD
-    uint32_t dataSize;    // Size of file data in bytes
-};
-#pragma pack(pop)
-
 static HWND g_hProgress = nullptr;              // Handle to the progress bar control
 static HWND g_hLog = nullptr;                   // Handle to the log EDIT control
 static HWND g_hMainWnd = nullptr;               // Handle to the main application window
 static HHOOK g_hMsgBoxHook = nullptr;           // Hook handle for centering MessageBox
 static HWND g_hChkDisableOverwrite = nullptr;   // Handle to "Disable overwrite warning" checkbox
 static bool g_DisableOverwriteWarning = false;  // Global flag to skip overwrite confirmations
-static std::wstring g_LogBuffer;                // Buffered log text before flushing to UI
 static HWND g_hChkOnTop = nullptr;              // Handle to "Keep on top" checkbox
 static bool g_KeepOnTop = false;                // Global flag for topmost window state
+static unsigned g_WorkerThreads = 0;            // Worker threads for extraction (0 = one per core)
+static bool g_PackUseMapping = true;            // Pack into a mapped view (false = positioned writes)
+static bool g_PackIncremental = false;          // Reuse unchanged entries of the previous WAD
+static bool g_PackDedup = false;                // Store identical file contents once
+static bool g_ExtractHardLinks = false;         // Hard-link entries sharing their data on extraction
+static CopyStrategy g_CopyStrategy = CopyStrategy::Auto;  // Copy engine strategy for pack and extract
+static bool g_PackChecksums = false;            // Read packed WADs back and store checksums
+static bool g_VerifyDrops = false;              // Verify dropped WADs instead of extracting them
+static std::filesystem::path g_PackLayout;      // Access trace / hot-list ordering packed data
+static uint32_t g_PackAlignment = 0;            // Payload alignment for packing (0 = packed)
+static WadFormat g_PackFormat = WadFormat::Classic;  // Format of packed WADs
+static MapOptions g_MapOptions{ kMapWindowBytes, MapAccess::Sequential };  // How WADs are mapped
+static std::filesystem::path g_TelemetryPath;   // Telemetry summary of the last dropped item
+static std::filesystem::path g_ChromeTracePath; // Chrome trace of the last dropped item
+static HWND g_hBtnCancel = nullptr;             // Handle to the "Cancel" button
+static std::shared_ptr<Job> g_Job;              // Running pack / extract / verify job
+
+static const UINT WM_APP_JOB = WM_APP + 1;      // Job events are queued (drain with dispatch)
 
 // ------------------------------------------------------------
-// Append a line to the in-memory log buffer
-// (actual UI update is deferred to AppendBufferedLog)
+// Append text to the log EDIT control in one batch and scroll
+// the caret to the bottom
 // ------------------------------------------------------------
-static void LogBuffered(const std::wstring& text)
+static void AppendLogText(const std::wstring& text)
 {
-    g_LogBuffer += text;
-    g_LogBuffer += L"\r\n";
-}
-
-// ------------------------------------------------------------
-// Flush buffered log content to the EDIT control in one batch
-// and scroll the caret to the bottom
-// ------------------------------------------------------------
-static void AppendBufferedLog()
-{
-    if (!g_hLog || g_LogBuffer.empty())
+    if (!g_hLog || text.empty())
         return;
 
     // --------------------------------------------------------
@@ -93,26 +86,14 @@ static void AppendBufferedLog()
     SendMessageW(g_hLog, EM_SETSEL, len, len);
 
     // --------------------------------------------------------
-    // Append buffered text to the log control
+    // Append text to the log control
     // --------------------------------------------------------
-    SendMessageW(g_hLog, EM_REPLACESEL, FALSE, (LPARAM)g_LogBuffer.c_str());
+    SendMessageW(g_hLog, EM_REPLACESEL, FALSE, (LPARAM)text.c_str());
 
     // --------------------------------------------------------
     // Scroll the caret into view (auto-scroll to bottom)
     // --------------------------------------------------------
     SendMessageW(g_hLog, EM_SCROLLCARET, 0, 0);
-
-    g_LogBuffer.clear();
-}
-
-// ------------------------------------------------------------
-// Directly append a single line of text to the log EDIT control
-// ------------------------------------------------------------
-static void Log(const std::wstring& text) {
-    if (!g_hLog) return;
-    int len = GetWindowTextLengthW(g_hLog);
-    SendMessageW(g_hLog, EM_SETSEL, len, len);
-    SendMessageW(g_hLog, EM_REPLACESEL, FALSE, (LPARAM)(text + L"\r\n").c_str());
 }
 
 // ------------------------------------------------------------
@@ -125,17 +106,6 @@ static void ClearLog() {
     }
 }
 
-// ------------------------------------------------------------
-// Format a duration in seconds with three decimal places
-// (e.g. "0.123 seconds")
-// ------------------------------------------------------------
-static std::wstring FormatSeconds(double s)
-{
-    wchar_t buf[64];
-    swprintf(buf, 64, L"%.3f seconds", s);
-    return buf;
-}
-
 // ------------------------------------------------------------
 // CBT hook procedure to center a MessageBox relative to the
 // main application window when it is activated
@@ -163,7 +133,7 @@ static LRESULT CALLBACK MsgBoxHookProc(int code, WPARAM wParam, LPARAM lParam)
 // Ask the user to confirm overwriting an existing directory or
 // WAD file, unless overwrite warnings are disabled globally
 // ------------------------------------------------------------
-static bool ConfirmOverwrite(const std::wstring& target)
+static bool ConfirmOverwriteDialog(const std::wstring& target)
 {
     if (g_DisableOverwriteWarning)
         return true; // Skip dialog entirely when disabled
@@ -189,16 +159,22 @@ static bool ConfirmOverwrite(const std::wstring& target)
 // ------------------------------------------------------------
 // Set the progress bar position in the range 0–100
 // ------------------------------------------------------------
-static void SetProgress(int percent) {
+static void SetProgressBar(int percent) {
     if (g_hProgress) SendMessageW(g_hProgress, PBM_SETPOS, percent, 0);
 }
 
 // ------------------------------------------------------------
-// Display an error message box and log the error text
+// Show the progress status (throughput, ETA) in the title bar
 // ------------------------------------------------------------
-static void ShowError(const wchar_t* msg) {
-    MessageBoxW(nullptr, msg, L"WAD Tool Error", MB_ICONERROR | MB_OK);
-    Log(L"ERROR: " + std::wstring(msg));
+static void SetStatusText(const std::wstring& text) {
+    if (g_hMainWnd) SetWindowTextW(g_hMainWnd, text.empty() ? L"OpenWAD" : (L"OpenWAD - " + text).c_str());
+}
+
+// ------------------------------------------------------------
+// Display an error message box (the engine logs the text)
+// ------------------------------------------------------------
+static void ShowErrorBox(const std::wstring& msg) {
+    MessageBoxW(nullptr, msg.c_str(), L"WAD Tool Error", MB_ICONERROR | MB_OK);
 }
 
 // ------------------------------------------------------------
@@ -211,511 +187,185 @@ static bool IsDirectory(const std::wstring& path) {
 }
 
 // ------------------------------------------------------------
-// Convert an ANSI (CP_ACP) string view to a UTF-16 std::wstring
+// Engine options from the command line switches
 // ------------------------------------------------------------
-static std::wstring ToWideFromAnsi(std::string_view s)
+static PackOptions DropPackOptions()
 {
-    if (s.empty()) return L"";
+    PackOptions options;
+    options.useMapping = g_PackUseMapping;
+    options.incremental = g_PackIncremental;
+    options.dedup = g_PackDedup;
+    options.copyStrategy = g_CopyStrategy;
+    options.checksums = g_PackChecksums;
+    options.layoutPath = g_PackLayout;
+    options.alignment = g_PackAlignment;
+    options.format = g_PackFormat;
+    options.map = g_MapOptions;
+    return options;
+}
 
-    int needed = MultiByteToWideChar(CP_ACP, 0, s.data(), (int)s.size(), nullptr, 0);
-    std::wstring out(needed, L'\0');
-    MultiByteToWideChar(CP_ACP, 0, s.data(), (int)s.size(), out.data(), needed);
-    return out;
+static ExtractOptions DropExtractOptions()
+{
+    ExtractOptions options;
+    options.threads = g_WorkerThreads;
+    options.hardLinkDuplicates = g_ExtractHardLinks;
+    options.copyStrategy = g_CopyStrategy;
+    options.map = g_MapOptions;
+    return options;
 }
 
-// ------------------------------------------------------------
-// Convert a UTF-16 std::wstring to an ANSI (CP_ACP) std::string
-// ------------------------------------------------------------
-static std::string ToAnsiFromWide(const std::wstring& s) {
-    if (s.empty()) return "";
-    int len = WideCharToMultiByte(CP_ACP, 0, s.c_str(), (int)s.size(), nullptr, 0, nullptr, nullptr);
-    std::string out(len, '\0');
-    WideCharToMultiByte(CP_ACP, 0, s.c_str(), (int)s.size(), out.data(), len, nullptr, nullptr);
-    return out;
+static VerifyOptions DropVerifyOptions()
+{
+    VerifyOptions options;
+    options.threads = g_WorkerThreads;
+    options.map = g_MapOptions;
+    return options;
 }
 
 // ------------------------------------------------------------
-// RAII wrapper for a read-only memory-mapped input file
+// What a dropped item becomes:
+//  - directory: pack into a WAD
+//  - .wad file: extract (or verify, with -verify)
+// Returns false for anything else
 // ------------------------------------------------------------
-struct MappedFile {
-    HANDLE hFile = nullptr;         // Underlying file handle
-    HANDLE hMap = nullptr;          // File mapping handle
-    const uint8_t* base = nullptr;  // Base address of mapped view
-    size_t size = 0;                // Total size of the mapped file
-
-    // --------------------------------------------------------
-    // Open the file read-only and map its entire contents into
-    // memory. Returns true on success.
-    // --------------------------------------------------------
-    bool open(const std::wstring& path) {
-        hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
-            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-        if (hFile == INVALID_HANDLE_VALUE) return false;
-
-        LARGE_INTEGER li{};
-        if (!GetFileSizeEx(hFile, &li)) return false;
-        size = static_cast<size_t>(li.QuadPart);
-
-        hMap = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
-        if (!hMap) return false;
-
-        base = static_cast<const uint8_t*>(
-            MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0)
-            );
-        return base != nullptr;
+static bool DropItem(const std::wstring& p, BatchItem& item)
+{
+    item.input = p;
+    if (IsDirectory(p)) {
+        item.op = BatchOp::Pack;
+        return true;
     }
 
-    // --------------------------------------------------------
-    // Unmap the view and close any open handles associated with
-    // this mapped file
-    // --------------------------------------------------------
-    void close() {
-        if (base) UnmapViewOfFile(base);
-        if (hMap) CloseHandle(hMap);
-        if (hFile && hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
-        base = nullptr;
-        hMap = nullptr;
-        hFile = nullptr;
-        size = 0;
-    }
+    std::filesystem::path ext = std::filesystem::path(p).extension();
+    if (_wcsicmp(ext.c_str(), L".wad") != 0)
+        return false;
 
-    ~MappedFile() { close(); }
-};
+    item.op = g_VerifyDrops ? BatchOp::Verify : BatchOp::Extract;
+    return true;
+}
 
 // ------------------------------------------------------------
-// RAII wrapper for a read/write memory-mapped output file
+// Build the job for a drop: a single item runs on its own, a
+// multi-item drop runs as a batch (items side by side, largest
+// first). Returns an empty job when nothing can be processed.
 // ------------------------------------------------------------
-struct MappedOutput {
-    HANDLE hFile = nullptr;   // Underlying file handle
-    HANDLE hMap = nullptr;    // File mapping handle
-    uint8_t* base = nullptr;  // Base address of mapped writable view
-    size_t size = 0;          // Total size of the mapped file
-
-    // --------------------------------------------------------
-    // Create a new file of the specified size and map it with
-    // read/write access. Returns true on success.
-    // --------------------------------------------------------
-    bool create(const std::wstring& path, size_t totalSize) {
-        size = totalSize;
-
-        hFile = CreateFileW(
-            path.c_str(),
-            GENERIC_WRITE | GENERIC_READ,
-            0,
-            nullptr,
-            CREATE_ALWAYS,
-            FILE_ATTRIBUTE_NORMAL,
-            nullptr
-        );
-        if (hFile == INVALID_HANDLE_VALUE)
-            return false;
-
-        // ----------------------------------------------------
-        // Pre-allocate the file to the requested total size by
-        // moving the file pointer and setting the end of file
-        // ----------------------------------------------------
-        LARGE_INTEGER li;
-        li.QuadPart = totalSize;
-        if (!SetFilePointerEx(hFile, li, nullptr, FILE_BEGIN))
-        {
-            CloseHandle(hFile);
-            hFile = nullptr;
-            return false;
-        }
-
-        if (!SetEndOfFile(hFile))
-        {
-            CloseHandle(hFile);
-            hFile = nullptr;
-            return false;
-        }
-
-        // ----------------------------------------------------
-        // Create a read/write file mapping object for the file
-        // ----------------------------------------------------
-        hMap = CreateFileMappingW(hFile, nullptr, PAGE_READWRITE, 0, 0, nullptr);
-        if (!hMap) {
-            CloseHandle(hFile);
-            hFile = nullptr;
-            return false;
-        }
-
-        base = static_cast<uint8_t*>(
-            MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, 0)
-            );
-        if (!base) {
-            CloseHandle(hMap);
-            CloseHandle(hFile);
-            hMap = nullptr;
-            hFile = nullptr;
-            return false;
-        }
-        return true;
-    }
-
-    // --------------------------------------------------------
-    // Unmap the view and close any open handles associated with
-    // this mapped output file
-    // --------------------------------------------------------
-    void close() {
-        if (base) UnmapViewOfFile(base);
-        if (hMap) CloseHandle(hMap);
-        if (hFile && hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
-        base = nullptr;
-        hMap = nullptr;
-        hFile = nullptr;
-        size = 0;
-    }
-
-    ~MappedOutput() { close(); }
-};
-
-static void ExtractWad(const std::wstring& wadPath)
+static Job::Work MakeDropWork(const std::vector<std::wstring>& paths)
 {
-    LARGE_INTEGER t0, t1, freq;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&t0);
-
-    Log(L"Reading WAD header");
-    SetProgress(0);
-
-    // ------------------------------------------------------------
-    // 1. Open and memory-map the WAD file for read-only access
-    // ------------------------------------------------------------
-    MappedFile mf;
-    if (!mf.open(wadPath)) {
-        ShowError(L"Failed to memory-map WAD file.");
-        return;
+    std::vector<BatchItem> items;
+    for (const std::wstring& p : paths) {
+        BatchItem item;
+        if (DropItem(p, item))
+            items.push_back(std::move(item));
+        else
+            AppendLogText(L"Not a WAD file: " + p + L"\r\n");
     }
 
-    // ------------------------------------------------------------
-    // 2. Basic header size check to ensure a valid WAD header is present
-    // ------------------------------------------------------------
-    if (mf.size < sizeof(WadHeader)) {
-        ShowError(L"Invalid WAD file.");
-        return;
-    }
-
-    const uint8_t* ptr = mf.base;
-
-    const WadHeader* header = reinterpret_cast<const WadHeader*>(ptr);
-    const WadItem* table = reinterpret_cast<const WadItem*>(ptr + sizeof(WadHeader));
-
-    // ------------------------------------------------------------
-    // 3. Validate that the header + table region fits inside the file
-    // ------------------------------------------------------------
-    size_t tableBytes = sizeof(WadHeader) + header->fileCount * sizeof(WadItem);
-    if (tableBytes > mf.size) {
-        ShowError(L"Invalid WAD: header/table exceeds file size.");
-        return;
+    if (items.empty())
+        return {};
+
+    if (items.size() > 1) {
+        BatchOptions options;
+        options.threads = g_WorkerThreads;
+        options.pack = DropPackOptions();
+        options.extract = DropExtractOptions();
+        options.verify = DropVerifyOptions();
+        return [items, options](const CancelFlag& cancel) mutable {
+            options.cancel = &cancel;
+            BatchReport report;
+            bool ok = RunBatch(items, options, report);
+            LogBatchReport(report);
+            return ok;
+        };
     }
 
-    // ------------------------------------------------------------
-    // 4. Validate each entry's data range before extraction
-    //    - data must lie within the file
-    //    - data must be located after the header + table region
-    // ------------------------------------------------------------
-    for (size_t i = 0; i < header->fileCount; ++i) {
-        const WadItem& wi = table[i];
-        uint64_t start = wi.dataOffset;
-        uint64_t end = wi.dataOffset + wi.dataSize;
-        if (end > mf.size || start < tableBytes) {
-            ShowError(L"Invalid WAD: corrupt offsets or sizes.");
-            return;
-        }
-    }
-
-    Log(std::to_wstring(header->fileCount) + L" files found");
-
-    // ------------------------------------------------------------
-    // 5. Determine and prepare the output directory:
-    //    <wad directory>\<wad file name without extension>
-    // ------------------------------------------------------------
-    std::filesystem::path wadP(wadPath);
-    std::filesystem::path outDir = wadP.parent_path() / wadP.stem();
-
-    if (std::filesystem::exists(outDir)) {
-        if (!ConfirmOverwrite(outDir.wstring())) {
-            Log(L"Extraction cancelled");
-            return;
-        }
-    }
-    else {
-        std::error_code ec;
-        std::filesystem::create_directory(outDir, ec);
-        if (ec) {
-            ShowError(L"Failed to create output directory.");
-            return;
-        }
-    }
-
-    Log(L"Extracting...");
-
-    // ------------------------------------------------------------
-    // 6. Track directories already created to avoid redundant
-    //    create_directories calls during extraction
-    // ------------------------------------------------------------
-    std::unordered_set<std::wstring> createdDirs;
-    createdDirs.reserve(header->fileCount);
-
-    // ------------------------------------------------------------
-    // 7. Extract each WAD entry to its corresponding file on disk
-    // ------------------------------------------------------------
-    for (size_t i = 0; i < header->fileCount; ++i) {
-        const WadItem& wi = table[i];
-
-        size_t len = strnlen(wi.name, sizeof(wi.name));
-        std::string_view nameAnsi(wi.name, len);
-        std::wstring nameW = ToWideFromAnsi(nameAnsi);
-
-        std::filesystem::path outPath = outDir / nameW;
-        std::wstring parent = outPath.parent_path().wstring();
-
-        // --------------------------------------------------------
-        // Create the parent directory tree once per unique path
-        // --------------------------------------------------------
-        if (createdDirs.insert(parent).second) {
-            std::error_code ec;
-            std::filesystem::create_directories(parent, ec);
-            if (ec) {
-                LogBuffered(L"Failed to create directory: " + parent);
-                continue; // Skip file instead of crashing
-            }
-        }
-
-        // --------------------------------------------------------
-        // Copy the file data from the mapped WAD into a new file
-        // --------------------------------------------------------
-        const uint8_t* src = ptr + wi.dataOffset;
-
-        std::ofstream out(outPath, std::ios::binary);
-        out.write(reinterpret_cast<const char*>(src), wi.dataSize);
-
-        LogBuffered(L"Extracting: " + nameW);
-
-        SetProgress((int)(((i + 1) * 100) / header->fileCount));
+    std::filesystem::path p = items[0].input;
+    AppendLogText(L"Loading: " + p.wstring() + L"\r\n");
+
+    switch (items[0].op) {
+    case BatchOp::Pack:
+        return [p, options = DropPackOptions()](const CancelFlag& cancel) mutable {
+            options.cancel = &cancel;
+            return PackFolder(p, options);
+        };
+    case BatchOp::Verify:
+        return [p, options = DropVerifyOptions()](const CancelFlag& cancel) mutable {
+            options.cancel = &cancel;
+            return VerifyWad(p, options);
+        };
+    default:
+        return [p, options = DropExtractOptions()](const CancelFlag& cancel) mutable {
+            options.cancel = &cancel;
+            return ExtractWad(p, options);
+        };
     }
-    AppendBufferedLog();
-
-    SetProgress(100);
-    Log(L"Extraction complete");
-
-    // ------------------------------------------------------------
-    // 8. Measure and log total extraction time
-    // ------------------------------------------------------------
-    QueryPerformanceCounter(&t1);
-    double elapsed = double(t1.QuadPart - t0.QuadPart) / double(freq.QuadPart);
-
-    Log(L"Time taken: " + FormatSeconds(elapsed));
-
-    Log(L"Drop the next WAD or folder");
-    SetProgress(0);
 }
 
-struct SourceItem {
-    std::filesystem::path fullPath;  // Full path to the source file on disk
-    std::wstring relPathW;           // Relative path (UTF-16) inside the base folder
-    std::string wadName;             // Relative path encoded as ANSI for WAD storage
-    std::vector<char> data;          // File contents loaded into memory
-};
-
-static void PackFolder(const std::wstring& folderPath)
+// ------------------------------------------------------------
+// Show one event of the running job
+// ------------------------------------------------------------
+static void HandleJobEvent(const JobEvent& e)
 {
-    LARGE_INTEGER t0, t1, freq;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&t0);
-
-    Log(L"Reading folder contents...");
-    SetProgress(0);
-
-    std::filesystem::path base(folderPath);
-    if (!std::filesystem::is_directory(base)) {
-        ShowError(L"Path is not a directory.");
-        return;
-    }
-
-    // ------------------------------------------------------------
-    // 1. Count files first (for progress bar)
-    // ------------------------------------------------------------
-    size_t totalFiles = 0;
-    for (auto const& entry : std::filesystem::recursive_directory_iterator(base))
-        if (entry.is_regular_file())
-            totalFiles++;
-
-    if (totalFiles == 0) {
-        Log(L"Folder contains no files.");
-        return;
-    }
-    else
-        Log(std::to_wstring(totalFiles) + L" files found");
-
-    // ------------------------------------------------------------
-    // 2. Collect files with full 0–100% progress
-    //    - build SourceItem list
-    //    - load file contents into memory
-    // ------------------------------------------------------------
-    std::vector<SourceItem> items;
-    items.reserve(totalFiles);
-
-    size_t scanned = 0;
-
-    for (auto const& entry : std::filesystem::recursive_directory_iterator(base)) {
-        if (!entry.is_regular_file()) continue;
-
-        scanned++;
-        SetProgress((int)((scanned * 100) / totalFiles));   // FULL 0–100%
-
-        SourceItem si;
-        si.fullPath = entry.path();
-
-        std::filesystem::path rel = std::filesystem::relative(entry.path(), base);
-        std::wstring relW;
-        try {
-            relW = rel.native();
-        }
-        catch (...) {
-            Log(L"Skipping unreadable path: " + entry.path().wstring());
-            continue;
-        }
-
-        // --------------------------------------------------------
-        // Normalize separators to backslashes for WAD internal names
-        // --------------------------------------------------------
-        std::replace(relW.begin(), relW.end(), L'/', L'\\');
-        si.wadName = ToAnsiFromWide(relW);
-
-        si.relPathW = relW;
-
-        // --------------------------------------------------------
-        // Read the entire file content into the data buffer
-        // --------------------------------------------------------
-        std::ifstream in(entry.path(), std::ios::binary | std::ios::ate);
-        std::streamsize size = in.tellg();
-        in.seekg(0, std::ios::beg);
-
-        si.data.resize((size_t)size);
-        if (size > 0)
-            in.read(si.data.data(), size);
-
-        items.push_back(std::move(si));
+    switch (e.kind) {
+    case JobEventKind::Log:      AppendLogText(e.text); break;
+    case JobEventKind::Progress: SetProgressBar(e.value); break;
+    case JobEventKind::Status:   SetStatusText(e.text); break;
+    case JobEventKind::Error:    ShowErrorBox(e.text); break;
+    case JobEventKind::Confirm:  g_Job->answer(ConfirmOverwriteDialog(e.text)); break;
+    default: break;
     }
+}
 
-    SetProgress(100);
-    Log(L"Collecting files completed");
-
-    // ------------------------------------------------------------
-    // 3. Determine output path
-    //    - use the base folder name with a .wad extension
-    // ------------------------------------------------------------
-    std::filesystem::path outPath = base;
-    outPath.replace_extension(L".wad");
-
-    if (std::filesystem::exists(outPath)) {
-        if (!ConfirmOverwrite(outPath.wstring())) {
-            Log(L"Cancelled creating WAD");
-            return;
-        }
-    }
-
-    // ------------------------------------------------------------
-    // 4. Compute total WAD size
-    //    - header
-    //    - item table
-    //    - all file data
-    // ------------------------------------------------------------
-    size_t totalSize =
-        sizeof(WadHeader) +
-        items.size() * sizeof(WadItem);
-
-    for (auto& si : items)
-        totalSize += si.data.size();
-
-    // ------------------------------------------------------------
-    // 5. Create memory-mapped output file
-    // ------------------------------------------------------------
-    MappedOutput mout;
-    if (!mout.create(outPath.wstring(), totalSize)) {
-        ShowError(L"Failed to create memory-mapped WAD file.");
-        return;
-    }
-
-    uint8_t* ptr = mout.base;
-
-    // ------------------------------------------------------------
-    // 6. Write header + table
-    //    - fill WadHeader
-    //    - build WadItem table with names, offsets, sizes
-    // ------------------------------------------------------------
-    WadHeader* header = reinterpret_cast<WadHeader*>(ptr);
-    header->fileCount = (uint32_t)items.size();
-
-    WadItem* table = reinterpret_cast<WadItem*>(ptr + sizeof(WadHeader));
-
-    uint32_t offset = sizeof(WadHeader) + (uint32_t)(items.size() * sizeof(WadItem));
-
-    for (size_t i = 0; i < items.size(); ++i) {
-        WadItem& wi = table[i];
-        memset(&wi, 0, sizeof(WadItem));
-
-        size_t len = items[i].wadName.size();
-        if (len >= sizeof(wi.name)) len = sizeof(wi.name) - 1;
-        memcpy(wi.name, items[i].wadName.data(), len);
-
-        wi.dataOffset = offset;
-        wi.dataSize = (uint32_t)items[i].data.size();
-
-        offset += wi.dataSize;
+// ------------------------------------------------------------
+// Process a drop as one job on a worker thread. While it runs
+// the UI thread is back in its message loop; the coroutine
+// resumes when the job has finished.
+// ------------------------------------------------------------
+static JobTask ProcessDrops(std::vector<std::wstring> paths)
+{
+    SetProgressBar(0);
+
+    Job::Work work = MakeDropWork(paths);
+    if (!work)
+        co_return;
+
+    bool telemetry = !g_TelemetryPath.empty() || !g_ChromeTracePath.empty();
+    if (telemetry)
+        StartTelemetry(!g_ChromeTracePath.empty());
+
+    EnableWindow(g_hBtnCancel, TRUE);
+    g_Job = Job::Start([work](const CancelFlag& cancel) {
+        TelemetryThreadName("job");
+        return work(cancel);
+    }, [] { PostMessageW(g_hMainWnd, WM_APP_JOB, 0, 0); });
+
+    bool done = co_await *g_Job;
+    g_Job.reset();
+    EnableWindow(g_hBtnCancel, FALSE);
+
+    if (telemetry) {
+        StopTelemetry();
+        if (!g_TelemetryPath.empty() && !WriteTelemetryJson(g_TelemetryPath))
+            AppendLogText(L"Failed to write telemetry summary\r\n");
+        if (!g_ChromeTracePath.empty() && !WriteChromeTrace(g_ChromeTracePath))
+            AppendLogText(L"Failed to write Chrome trace\r\n");
     }
 
-    // ------------------------------------------------------------
-    // 7. Reset progress bar for writing phase
-    // ------------------------------------------------------------
-    SetProgress(0);
-    Log(L"Packing...");
-
-    // ------------------------------------------------------------
-    // 8. Write file data with full 0–100% progress
-    // ------------------------------------------------------------
-    for (size_t i = 0; i < items.size(); ++i) {
-        const auto& si = items[i];
-
-        LogBuffered(L"Packing: " + si.relPathW);
-        SetProgress((int)(((i + 1) * 100) / items.size()));   // FULL 0–100%
-
-        uint8_t* dst = ptr + table[i].dataOffset;
-
-        if (!si.data.empty())
-            memcpy(dst, si.data.data(), si.data.size());
+    SetStatusText(L"");
+    if (done) {
+        AppendLogText(L"Drop the next WAD or folder\r\n");
+        SetProgressBar(0);
     }
-
-    // ------------------------------------------------------------
-    // 9. Done
-    //    - unmap file
-    //    - flush buffered log
-    //    - log elapsed time
-    // ------------------------------------------------------------
-    mout.close();
-
-    AppendBufferedLog();
-
-    SetProgress(100);
-    Log(L"Packing complete.");
-
-    QueryPerformanceCounter(&t1);
-    double elapsed = double(t1.QuadPart - t0.QuadPart) / double(freq.QuadPart);
-
-    Log(L"Time taken: " + FormatSeconds(elapsed));
-
-    Log(L"Drop the next WAD or folder");
-    SetProgress(0);
 }
 
 static void HandleDrop(HDROP hDrop) {
     // ------------------------------------------------------------
-    // 1. Determine how many files/folders were dropped
+    // 1. Determine how many files/folders were dropped; refuse
+    //    the drop while a job runs
     // ------------------------------------------------------------
     UINT count = DragQueryFileW(hDrop, 0xFFFFFFFF, nullptr, 0);
-    if (count == 0) {
+    if (count == 0 || g_Job) {
+        if (g_Job)
+            AppendLogText(L"Busy: wait for the current job or cancel it\r\n");
         DragFinish(hDrop);
         return;
     }
@@ -726,37 +376,21 @@ static void HandleDrop(HDROP hDrop) {
     ClearLog();
 
     // ------------------------------------------------------------
-    // 3. Process each dropped item:
-    //    - if directory: pack into WAD
-    //    - if .wad file: extract
-    //    - otherwise: log unsupported item
+    // 3. Collect the dropped paths and release the HDROP handle
+    //    provided by the shell
     // ------------------------------------------------------------
+    std::vector<std::wstring> paths;
     for (UINT i = 0; i < count; ++i) {
         wchar_t path[MAX_PATH];
         DragQueryFileW(hDrop, i, path, MAX_PATH);
-
-        std::wstring p(path);
-        Log(L"Loading: " + p);
-        SetProgress(0);
-
-        if (IsDirectory(p)) {
-            PackFolder(p);
-        }
-        else {
-            std::filesystem::path ext = std::filesystem::path(p).extension();
-            if (_wcsicmp(ext.c_str(), L".wad") == 0) {
-                ExtractWad(p);
-            }
-            else {
-                Log(L"Not a WAD file: " + p);
-            }
-        }
+        paths.push_back(path);
     }
+    DragFinish(hDrop);
 
     // ------------------------------------------------------------
-    // 4. Release HDROP handle provided by the shell
+    // 4. Start processing; returns at the first job's start
     // ------------------------------------------------------------
-    DragFinish(hDrop);
+    ProcessDrops(std::move(paths));
 }
 
 static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
@@ -810,6 +444,20 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
             nullptr
         );
 
+        // --------------------------------------------------------
+        // 4b. Create the 'Cancel' button (enabled while a job runs)
+        // --------------------------------------------------------
+        g_hBtnCancel = CreateWindowW(
+            L"BUTTON",
+            L"Cancel",
+            WS_CHILD | WS_VISIBLE | WS_DISABLED | BS_PUSHBUTTON,
+            390, 267, 80, 24,
+            hwnd,
+            (HMENU)1003,
+            nullptr,
+            nullptr
+        );
+
         {
             // ----------------------------------------------------
             // 5. Create a Consolas fixed-width font and apply it
@@ -829,6 +477,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
             SendMessageW(g_hLog, WM_SETFONT, (WPARAM)hFontLocal, TRUE);
             SendMessageW(g_hChkDisableOverwrite, WM_SETFONT, (WPARAM)hFontLocal, TRUE);
             SendMessageW(g_hChkOnTop, WM_SETFONT, (WPARAM)hFontLocal, TRUE);
+            SendMessageW(g_hBtnCancel, WM_SETFONT, (WPARAM)hFontLocal, TRUE);
         }
 
         // --------------------------------------------------------
@@ -857,6 +506,14 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
         HandleDrop((HDROP)wParam);
         return 0;
 
+    case WM_APP_JOB:
+        // --------------------------------------------------------
+        // Show the queued events of the running job
+        // --------------------------------------------------------
+        if (g_Job)
+            g_Job->dispatch(HandleJobEvent);
+        return 0;
+
     case WM_COMMAND:
         // --------------------------------------------------------
         // 1. Toggle 'Disable overwrite warning' option
@@ -883,12 +540,27 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
                 SWP_NOMOVE | SWP_NOSIZE
             );
         }
+        // --------------------------------------------------------
+        // 3. Cancel the running job (it removes partial output)
+        // --------------------------------------------------------
+        else if ((HWND)lParam == g_hBtnCancel &&
+            HIWORD(wParam) == BN_CLICKED && g_Job)
+        {
+            g_Job->cancel();
+            EnableWindow(g_hBtnCancel, FALSE);
+            AppendLogText(L"Cancelling...\r\n");
+        }
         break;
 
     case WM_DESTROY:
         // --------------------------------------------------------
-        // Cleanup and exit message loop
+        // Cleanup and exit message loop; a running job is
+        // cancelled and waited for
         // --------------------------------------------------------
+        if (g_Job) {
+            g_Job->cancel();
+            g_Job.reset();
+        }
         PostQuitMessage(0);
         hFont = (HFONT)SendMessageW(g_hLog, WM_GETFONT, 0, 0);
         DeleteObject(hFont);
@@ -905,13 +577,82 @@ int WINAPI wWinMain(
 )
 {
     // ------------------------------------------------------------
-    // 1. Initialize common controls (progress bar class)
+    // 1. Parse optional command line switches
+    //    -threads N : extraction worker threads (1 = serial)
+    //    -pwrite    : pack with positioned writes instead of a
+    //                 mapped view
+    //    -incremental : only read files changed since the last
+    //                 incremental pack into the same WAD
+    //    -dedup     : store identical file contents once
+    //    -hardlink  : hard-link shared entries on extraction
+    //    -copy S    : copy strategy (auto, write, kernel, prealloc,
+    //                 stream)
+    //    -checksums : read packed WADs back, store <wad>.sum
+    //    -verify    : verify dropped WADs instead of extracting
+    //    -layout F  : place packed data in the order of trace F
+    //    -align N   : start every packed payload on N bytes
+    //    -wad64     : pack in the WAD64 format (past 4 GB)
+    //    -compress  : pack a compressed WAD (LZ4 blocks)
+    //    -mapwindow MB : map WADs this many MB at a time (0 = the
+    //                 whole file)
+    //    -hugepages : ask for huge pages on mapped data
+    //    -telemetry F / -chrome-trace F : write the telemetry
+    //                 summary / Chrome trace of each dropped item
+    //    -log L     : errors, summary (no per-file lines) or files
+    // ------------------------------------------------------------
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv) {
+        for (int i = 1; i < argc; ++i) {
+            if (_wcsicmp(argv[i], L"-threads") == 0 && i + 1 < argc)
+                g_WorkerThreads = (unsigned)_wtoi(argv[++i]);
+            else if (_wcsicmp(argv[i], L"-pwrite") == 0)
+                g_PackUseMapping = false;
+            else if (_wcsicmp(argv[i], L"-incremental") == 0)
+                g_PackIncremental = true;
+            else if (_wcsicmp(argv[i], L"-dedup") == 0)
+                g_PackDedup = true;
+            else if (_wcsicmp(argv[i], L"-hardlink") == 0)
+                g_ExtractHardLinks = true;
+            else if (_wcsicmp(argv[i], L"-copy") == 0 && i + 1 < argc)
+                ParseCopyStrategy(ToUtf8(argv[++i]), g_CopyStrategy);
+            else if (_wcsicmp(argv[i], L"-checksums") == 0)
+                g_PackChecksums = true;
+            else if (_wcsicmp(argv[i], L"-verify") == 0)
+                g_VerifyDrops = true;
+            else if (_wcsicmp(argv[i], L"-layout") == 0 && i + 1 < argc)
+                g_PackLayout = argv[++i];
+            else if (_wcsicmp(argv[i], L"-align") == 0 && i + 1 < argc)
+                g_PackAlignment = (uint32_t)_wtoi(argv[++i]);
+            else if (_wcsicmp(argv[i], L"-wad64") == 0)
+                g_PackFormat = WadFormat::Wad64;
+            else if (_wcsicmp(argv[i], L"-compress") == 0)
+                g_PackFormat = WadFormat::Compressed;
+            else if (_wcsicmp(argv[i], L"-mapwindow") == 0 && i + 1 < argc)
+                g_MapOptions.window = (size_t)_wtoi(argv[++i]) * 1024 * 1024;
+            else if (_wcsicmp(argv[i], L"-hugepages") == 0)
+                g_MapOptions.hugePages = true;
+            else if (_wcsicmp(argv[i], L"-telemetry") == 0 && i + 1 < argc)
+                g_TelemetryPath = argv[++i];
+            else if (_wcsicmp(argv[i], L"-chrome-trace") == 0 && i + 1 < argc)
+                g_ChromeTracePath = argv[++i];
+            else if (_wcsicmp(argv[i], L"-log") == 0 && i + 1 < argc) {
+                LogLevel level;
+                if (ParseLogLevel(ToUtf8(argv[++i]), level))
+                    SetLogLevel(level);
+            }
+        }
+        LocalFree(argv);
+    }
+
+    // ------------------------------------------------------------
+    // 2. Initialize common controls (progress bar class)
     // ------------------------------------------------------------
     INITCOMMONCONTROLSEX icc{ sizeof(icc), ICC_PROGRESS_CLASS };
     InitCommonControlsEx(&icc);
 
     // ------------------------------------------------------------
-    // 2. Register the main window class
+    // 3. Register the main window class
     // ------------------------------------------------------------
     const wchar_t CLASS_NAME[] = L"WADDragDropWnd";
 
@@ -924,7 +665,7 @@ int WINAPI wWinMain(
     RegisterClassW(&wc);
 
     // ------------------------------------------------------------
-    // 3. Create the main window with fixed size and no maximize box
+    // 4. Create the main window with fixed size and no maximize box
     // ------------------------------------------------------------
     HWND hwnd = CreateWindowExW(
         0, CLASS_NAME, L"OpenWAD",
@@ -936,7 +677,7 @@ int WINAPI wWinMain(
     ShowWindow(hwnd, nCmdShow);
 
     // ------------------------------------------------------------
-    // 4. Standard message loop
+    // 5. Standard message loop
     // ------------------------------------------------------------
     MSG msg;
     while (GetMessageW(&msg, nullptr, 0, 0)) {
@@ -0,0 +1,560 @@
+﻿/*
+===========================================
+OpenWAD benchmark driver
+===========================================
+Generates a synthetic source folder, then times pack, extract,
+list, lookup and validate against it and prints one JSON document with
+files/s, MB/s, peak RSS and per-thread-count scaling.
+
+  openwad-bench [--dir <work dir>] [--files N] [--dist tiny|huge|mixed]
+                [--depth D] [--fanout F] [--seed S]
+                [--threads 1,2,4,8] [--repeat R] [--regen] [--keep]
+                [--copy auto,write,kernel,prealloc,stream] [--io auto|sync|uring]
+
+The corpus is kept in <work dir>/corpus and reused while its
+parameters match (see corpus.txt), --regen forces a rebuild.
+===========================================
+*/
+#include "wad_format.h"
+#include "wad_extract.h"
+#include "wad_pack.h"
+#include "wad_reader.h"
+#include "copy_engine.h"
+#include "batch_io.h"
+#include "mapped_file.h"
+#include "platform.h"
+#include "logger.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// ------------------------------------------------------------
+// Corpus parameters
+// ------------------------------------------------------------
+struct CorpusSpec {
+    uint64_t files = 10000;        // Number of files to generate
+    std::string dist = "mixed";    // Size distribution: tiny, huge, mixed
+    unsigned depth = 3;            // Directory levels below the corpus root
+    unsigned fanout = 8;           // Sub-directories per level
+    uint64_t seed = 1;             // Seed for sizes and contents
+};
+
+// ------------------------------------------------------------
+// One timed operation
+// ------------------------------------------------------------
+struct BenchResult {
+    std::string op;                // pack / extract / list / lookup / validate
+    unsigned threads = 1;          // Worker threads used
+    std::string copy = "auto";     // Copy strategy (pack / extract)
+    double seconds = 0;            // Median wall time over the repeats
+    uint64_t files = 0;            // Entries processed
+    uint64_t bytes = 0;            // Payload bytes processed
+    uint64_t peakRss = 0;          // Peak resident bytes during the operation
+    bool ok = false;               // Operation reported success
+};
+
+// ------------------------------------------------------------
+// SplitMix64: small, fast and good enough for synthetic data
+// ------------------------------------------------------------
+static uint64_t SplitMix64(uint64_t& state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// ------------------------------------------------------------
+// Log-uniform size in [lo, hi]
+// ------------------------------------------------------------
+static uint64_t LogUniform(uint64_t& rng, double lo, double hi)
+{
+    double u = (double)(SplitMix64(rng) >> 11) / (double)(1ull << 53);
+    return (uint64_t)std::exp(std::log(lo) + u * (std::log(hi) - std::log(lo)));
+}
+
+// ------------------------------------------------------------
+// Size of file 'index'; depends only on the seed and the index
+// so the corpus is identical whatever the generator threads do
+//  - tiny:  64 B .. 16 KB
+//  - huge:  16 MB .. 256 MB
+//  - mixed: 90% tiny, 9% 16 KB .. 1 MB, 1% 1 MB .. 64 MB
+// ------------------------------------------------------------
+static uint64_t FileSize(const CorpusSpec& spec, uint64_t index)
+{
+    uint64_t rng = spec.seed * 0x100000001B3ull ^ (index * 0x9E3779B97F4A7C15ull);
+    SplitMix64(rng);
+
+    if (spec.dist == "tiny")
+        return LogUniform(rng, 64, 16 * 1024);
+    if (spec.dist == "huge")
+        return LogUniform(rng, 16.0 * 1024 * 1024, 256.0 * 1024 * 1024);
+
+    uint64_t pick = SplitMix64(rng) % 100;
+    if (pick < 90) return LogUniform(rng, 64, 16 * 1024);
+    if (pick < 99) return LogUniform(rng, 16 * 1024, 1024 * 1024);
+    return LogUniform(rng, 1024.0 * 1024, 64.0 * 1024 * 1024);
+}
+
+// ------------------------------------------------------------
+// Relative directory of file 'index': one level per digit of
+// the index in base 'fanout'
+// ------------------------------------------------------------
+static std::string FileDir(const CorpusSpec& spec, uint64_t index)
+{
+    std::string dir;
+    uint64_t v = index;
+    for (unsigned level = 0; level < spec.depth; ++level) {
+        dir += 'd';
+        dir += std::to_string(v % spec.fanout);
+        dir += '/';
+        v /= spec.fanout;
+    }
+    return dir;
+}
+
+static std::string SpecText(const CorpusSpec& spec)
+{
+    return "files=" + std::to_string(spec.files) + " dist=" + spec.dist +
+        " depth=" + std::to_string(spec.depth) + " fanout=" + std::to_string(spec.fanout) +
+        " seed=" + std::to_string(spec.seed) + "\n";
+}
+
+// ------------------------------------------------------------
+// Write the corpus (in parallel) unless a matching one exists.
+// Returns the total payload size.
+// ------------------------------------------------------------
+static bool GenerateCorpus(const CorpusSpec& spec, const std::filesystem::path& root,
+    bool regen, uint64_t& totalBytes)
+{
+    totalBytes = 0;
+    for (uint64_t i = 0; i < spec.files; ++i)
+        totalBytes += FileSize(spec, i);
+
+    std::filesystem::path stamp = root.parent_path() / "corpus.txt";
+    if (!regen && std::filesystem::is_directory(root)) {
+        std::ifstream in(stamp);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        if (ss.str() == SpecText(spec)) {
+            fprintf(stderr, "openwad-bench: reusing corpus in %s\n", root.string().c_str());
+            return true;
+        }
+    }
+
+    fprintf(stderr, "openwad-bench: generating %llu files (%.1f MB)...\n",
+        (unsigned long long)spec.files, totalBytes / (1024.0 * 1024.0));
+
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+    std::filesystem::remove(stamp, ec);
+
+    // ------------------------------------------------------------
+    // 1. Create every directory of the tree up front
+    // ------------------------------------------------------------
+    uint64_t leafDirs = 1;
+    for (unsigned level = 0; level < spec.depth; ++level)
+        leafDirs *= spec.fanout;
+    for (uint64_t i = 0; i < std::min<uint64_t>(leafDirs, spec.files); ++i) {
+        std::filesystem::create_directories(root / FileDir(spec, i), ec);
+        if (ec) {
+            fprintf(stderr, "openwad-bench: cannot create %s\n", (root / FileDir(spec, i)).string().c_str());
+            return false;
+        }
+    }
+
+    // ------------------------------------------------------------
+    // 2. Write the files in slices on the pool
+    // ------------------------------------------------------------
+    std::atomic<bool> failed{ false };
+    {
+        ThreadPool pool;
+        const uint64_t kSlice = 512;
+        for (uint64_t first = 0; first < spec.files; first += kSlice) {
+            uint64_t last = std::min(spec.files, first + kSlice);
+            pool.submit([&, first, last] {
+                std::vector<uint8_t> buf;
+                for (uint64_t i = first; i < last; ++i) {
+                    uint64_t size = FileSize(spec, i);
+                    uint64_t rng = spec.seed ^ (i << 20);
+
+                    std::filesystem::path path = root / FileDir(spec, i) / ('f' + std::to_string(i) + ".bin");
+                    FileHandle out;
+                    if (!out.create(path)) {
+                        failed = true;
+                        return;
+                    }
+
+                    buf.resize((size_t)std::min<uint64_t>(size, 1024 * 1024));
+                    for (uint64_t done = 0; done < size;) {
+                        size_t n = (size_t)std::min<uint64_t>(size - done, buf.size());
+                        for (size_t k = 0; k + 8 <= n; k += 8) {
+                            uint64_t v = SplitMix64(rng);
+                            memcpy(&buf[k], &v, 8);
+                        }
+                        if (!out.writeAt(buf.data(), done, n)) {
+                            failed = true;
+                            return;
+                        }
+                        done += n;
+                    }
+                }
+            });
+        }
+    }
+    if (failed) {
+        fprintf(stderr, "openwad-bench: failed to write corpus\n");
+        return false;
+    }
+
+    std::ofstream(stamp) << SpecText(spec);
+    return true;
+}
+
+// ------------------------------------------------------------
+// list: map the WAD, validate the table and decode every name
+// ------------------------------------------------------------
+static bool ListOp(const std::filesystem::path& wadPath, uint64_t& files)
+{
+    MappedFile mf;
+    WadView wad;
+    const wchar_t* error = nullptr;
+    if (!mf.open(wadPath) || !OpenWadView(mf.base, mf.size, wad, &error))
+        return false;
+
+    size_t chars = 0;
+    for (uint32_t i = 0; i < wad.fileCount; ++i) {
+        chars += ToWideFromAnsi(wad.entryName(i)).size();
+    }
+    files = wad.fileCount;
+    return chars > 0 || wad.fileCount == 0;
+}
+
+// ------------------------------------------------------------
+// lookup: open a WadReader and fetch every entry by name in a
+// shuffled order, touching the first byte of each
+// ------------------------------------------------------------
+static bool LookupOp(const std::filesystem::path& wadPath, uint64_t seed, uint64_t& files, uint64_t& bytes)
+{
+    WadReader reader;
+    if (!reader.open(wadPath))
+        return false;
+
+    std::vector<std::string> names;
+    names.reserve(reader.count());
+    for (uint32_t i = 0; i < reader.count(); ++i)
+        names.emplace_back(reader.name(i));
+
+    uint64_t rng = seed;
+    for (size_t i = names.size(); i > 1; --i)
+        std::swap(names[i - 1], names[(size_t)(SplitMix64(rng) % i)]);
+
+    uint64_t sum = 0;
+    files = 0;
+    bytes = 0;
+    std::vector<uint8_t> buffer;
+    for (const std::string& n : names) {
+        std::span<const uint8_t> data;
+        int64_t index = reader.find(n);
+        if (index < 0 || !reader.read((uint32_t)index, buffer, data))
+            return false;
+        if (!data.empty())
+            sum += data[0];
+        files++;
+        bytes += data.size();
+    }
+    return sum != ~0ull;
+}
+
+// ------------------------------------------------------------
+// validate: compare every entry of the WAD byte for byte with
+// its source file
+// ------------------------------------------------------------
+static bool ValidateOp(const std::filesystem::path& wadPath, const std::filesystem::path& root,
+    uint64_t& files, uint64_t& bytes)
+{
+    WadReader reader;
+    if (!reader.open(wadPath))
+        return false;
+
+    std::vector<uint8_t> buf(1024 * 1024);
+    std::vector<uint8_t> decoded;
+    files = 0;
+    bytes = 0;
+    for (uint32_t i = 0; i < reader.count(); ++i) {
+        std::wstring nameW = ToWideFromAnsi(reader.name(i));
+
+        FileHandle in;
+        uint64_t size = 0;
+        std::span<const uint8_t> data;
+        if (!in.openRead(root / WadNameToPath(nameW)) || !in.getSize(size) ||
+            !reader.read(i, decoded, data) || size != data.size())
+            return false;
+
+        const uint8_t* src = data.data();
+        for (uint64_t done = 0; done < size;) {
+            size_t got = 0;
+            if (!in.read(buf.data(), buf.size(), got) || got == 0 ||
+                memcmp(buf.data(), src + done, got) != 0)
+                return false;
+            done += got;
+        }
+        files++;
+        bytes += size;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Run 'fn' 'repeat' times and keep the median wall time and the
+// highest peak RSS
+// ------------------------------------------------------------
+template <class Fn>
+static BenchResult Measure(const std::string& op, unsigned threads, unsigned repeat, Fn fn)
+{
+    BenchResult r;
+    r.op = op;
+    r.threads = threads;
+    r.ok = true;
+
+    std::vector<double> times;
+    for (unsigned k = 0; k < repeat; ++k) {
+        ResetPeakMemory();
+        Stopwatch sw;
+        r.ok = fn(r) && r.ok;
+        times.push_back(sw.seconds());
+        r.peakRss = std::max(r.peakRss, GetMemoryStats().peakResident);
+    }
+    std::sort(times.begin(), times.end());
+    r.seconds = times[times.size() / 2];
+    return r;
+}
+
+static std::string JsonEscape(const std::string& s)
+{
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if ((unsigned char)c < 0x20) { char b[8]; snprintf(b, 8, "\\u%04x", c); out += b; }
+        else out += c;
+    }
+    return out;
+}
+
+static void PrintJson(const CorpusSpec& spec, uint64_t corpusBytes, IoBackend io, const std::vector<BenchResult>& results)
+{
+    printf("{\n");
+    printf("  \"corpus\": {\"files\": %llu, \"bytes\": %llu, \"dist\": \"%s\", \"depth\": %u, \"fanout\": %u, \"seed\": %llu},\n",
+        (unsigned long long)spec.files, (unsigned long long)corpusBytes, JsonEscape(spec.dist).c_str(),
+        spec.depth, spec.fanout, (unsigned long long)spec.seed);
+    printf("  \"hardware_threads\": %u,\n", ThreadPool::DefaultThreadCount());
+    printf("  \"io_backend\": \"%s\",\n", io != IoBackend::Sync && IsUringAvailable() ? "uring" : "sync");
+
+    const CopyEngineInfo& ce = GetCopyEngineInfo();
+    printf("  \"copy_engine\": {\"memcpy_gb_per_s\": %.2f, \"stream_gb_per_s\": %.2f, \"prefer_stream\": %s},\n",
+        ce.memcpyGBs, ce.streamGBs, ce.preferStream ? "true" : "false");
+    printf("  \"results\": [\n");
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+
+        // --------------------------------------------------------
+        // Scaling: speed-up against the same operation's first
+        // (lowest) thread count with the same copy strategy
+        // --------------------------------------------------------
+        double baseline = r.seconds;
+        for (const BenchResult& b : results) {
+            if (b.op == r.op && b.copy == r.copy) {
+                baseline = b.seconds;
+                break;
+            }
+        }
+        double s = r.seconds > 0 ? r.seconds : 1e-9;
+
+        printf("    {\"op\": \"%s\", \"threads\": %u, \"copy\": \"%s\", \"ok\": %s, \"seconds\": %.6f, "
+            "\"files\": %llu, \"bytes\": %llu, \"files_per_s\": %.1f, \"mb_per_s\": %.2f, "
+            "\"peak_rss_mb\": %.1f, \"speedup\": %.3f}%s\n",
+            JsonEscape(r.op).c_str(), r.threads, JsonEscape(r.copy).c_str(), r.ok ? "true" : "false", r.seconds,
+            (unsigned long long)r.files, (unsigned long long)r.bytes,
+            r.files / s, r.bytes / (1024.0 * 1024.0) / s,
+            r.peakRss / (1024.0 * 1024.0), baseline / s,
+            i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static void PrintUsage()
+{
+    fputs(
+        "usage: openwad-bench [--dir <work dir>] [--files N] [--dist tiny|huge|mixed]\n"
+        "                     [--depth D] [--fanout F] [--seed S]\n"
+        "                     [--threads 1,2,4,8] [--repeat R] [--regen] [--keep]\n"
+        "                     [--copy auto,write,kernel,prealloc,stream] [--io auto|sync|uring]\n",
+        stderr);
+}
+
+int main(int argc, char** argv)
+{
+    CorpusSpec spec;
+    std::filesystem::path workDir = "owbench";
+    std::vector<unsigned> threadCounts = { 1, ThreadPool::DefaultThreadCount() };
+    std::vector<std::string> copyNames = { "auto" };
+    IoBackend ioBackend = IoBackend::Auto;
+    unsigned repeat = 1;
+    bool regen = false;
+    bool keep = false;
+
+    // ------------------------------------------------------------
+    // 1. Parse options
+    // ------------------------------------------------------------
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (a == "--dir" && hasValue) workDir = argv[++i];
+        else if (a == "--files" && hasValue) spec.files = strtoull(argv[++i], nullptr, 10);
+        else if (a == "--dist" && hasValue) spec.dist = argv[++i];
+        else if (a == "--depth" && hasValue) spec.depth = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (a == "--fanout" && hasValue) spec.fanout = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (a == "--seed" && hasValue) spec.seed = strtoull(argv[++i], nullptr, 10);
+        else if (a == "--repeat" && hasValue) repeat = std::max(1u, (unsigned)strtoul(argv[++i], nullptr, 10));
+        else if (a == "--regen") regen = true;
+        else if (a == "--keep") keep = true;
+        else if (a == "--copy" && hasValue) {
+            copyNames.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                CopyStrategy strategy;
+                if (!ParseCopyStrategy(item, strategy)) {
+                    PrintUsage();
+                    return 2;
+                }
+                copyNames.push_back(item);
+            }
+        }
+        else if (a == "--io" && hasValue) {
+            if (!ParseIoBackend(argv[++i], ioBackend)) {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if (a == "--threads" && hasValue) {
+            threadCounts.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ','))
+                if (unsigned n = (unsigned)strtoul(item.c_str(), nullptr, 10))
+                    threadCounts.push_back(n);
+        }
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (spec.files == 0 || spec.fanout == 0 || threadCounts.empty() ||
+        (spec.dist != "tiny" && spec.dist != "huge" && spec.dist != "mixed")) {
+        PrintUsage();
+        return 2;
+    }
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    // ------------------------------------------------------------
+    // 2. Silence the engine; the benchmark overwrites its own
+    //    outputs without asking
+    // ------------------------------------------------------------
+    LogSink sink;
+    sink.error = [](const std::wstring& msg) {
+        fprintf(stderr, "openwad-bench: %s\n", ToUtf8(msg).c_str());
+    };
+    sink.confirmOverwrite = [](const std::wstring&) { return true; };
+    SetLogSink(std::move(sink));
+
+    std::error_code ec;
+    std::filesystem::create_directories(workDir, ec);
+    std::filesystem::path corpus = workDir / "corpus";
+    std::filesystem::path wadPath = workDir / "corpus.wad";
+    std::filesystem::path outDir = workDir / "extract";
+
+    uint64_t corpusBytes = 0;
+    if (!GenerateCorpus(spec, corpus, regen, corpusBytes))
+        return 1;
+
+    // ------------------------------------------------------------
+    // 3. Time every operation
+    // ------------------------------------------------------------
+    std::vector<BenchResult> results;
+
+    for (unsigned t : threadCounts) {
+        fprintf(stderr, "openwad-bench: pack, %u threads\n", t);
+        results.push_back(Measure("pack", t, repeat, [&](BenchResult& r) {
+            PackOptions options;
+            options.threads = t;
+            options.outPath = wadPath;
+            options.ioBackend = ioBackend;
+            r.files = spec.files;
+            r.bytes = corpusBytes;
+            return PackFolder(corpus, options);
+        }));
+    }
+
+    for (const std::string& copy : copyNames) {
+        CopyStrategy strategy = CopyStrategy::Auto;
+        ParseCopyStrategy(copy, strategy);
+
+        for (unsigned t : threadCounts) {
+            fprintf(stderr, "openwad-bench: extract, %u threads, copy %s\n", t, copy.c_str());
+            BenchResult br = Measure("extract", t, repeat, [&](BenchResult& r) {
+                std::error_code rmEc;
+                std::filesystem::remove_all(outDir, rmEc);
+
+                ExtractOptions options;
+                options.threads = t;
+                options.outDir = outDir;
+                options.copyStrategy = strategy;
+                options.ioBackend = ioBackend;
+                r.files = spec.files;
+                r.bytes = corpusBytes;
+                return ExtractWad(wadPath, options);
+            });
+            br.copy = copy;
+            results.push_back(br);
+        }
+    }
+
+    fprintf(stderr, "openwad-bench: list\n");
+    results.push_back(Measure("list", 1, repeat, [&](BenchResult& r) {
+        return ListOp(wadPath, r.files);
+    }));
+
+    fprintf(stderr, "openwad-bench: lookup\n");
+    results.push_back(Measure("lookup", 1, repeat, [&](BenchResult& r) {
+        return LookupOp(wadPath, spec.seed, r.files, r.bytes);
+    }));
+
+    fprintf(stderr, "openwad-bench: validate\n");
+    results.push_back(Measure("validate", 1, repeat, [&](BenchResult& r) {
+        return ValidateOp(wadPath, corpus, r.files, r.bytes);
+    }));
+
+    if (!keep) {
+        std::filesystem::remove_all(outDir, ec);
+        std::filesystem::remove(wadPath, ec);
+    }
+
+    PrintJson(spec, corpusBytes, ioBackend, results);
+
+    for (const BenchResult& r : results)
+        if (!r.ok) return 1;
+    return 0;
+}
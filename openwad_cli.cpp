@@ -0,0 +1,708 @@
+﻿/*
+===========================================
+OpenWAD command line driver
+===========================================
+Scriptable front end for the WAD engine:
+
+  openwad-cli pack    <folder> [-o <file.wad> | -o -] [--threads N] [--pwrite]
+                      [--manifest <list.txt>] [--incremental] [--dedup]
+                      [--copy <strategy>] [--io <backend>] [--checksums]
+                      [--layout <trace.txt>] [--align N] [--wad64 | --compress] [-f]
+  openwad-cli extract <file.wad | -> [-o <dir>] [--threads N] [--copy <strategy>]
+                      [--io <backend>] [-f]
+                      [--filter <pattern>]... [--filter-list <list.txt>]
+                      [--hardlink]
+  openwad-cli verify  <file.wad> [--threads N] [--write-sums]
+  openwad-cli diff    <base.wad> <target.wad> [-o <patch.wad>] [--threads N] [-f]
+  openwad-cli apply   <base.wad> <patch.wad> [-o <out.wad>] [--threads N]
+                      [--copy <strategy>] [-f]
+  pack / extract / verify / diff / apply also take [--map-window MB]
+  [--huge-pages].
+  openwad-cli batch   [<pattern>]... [--list <jobs.txt>] [--jobs N]
+                      [--per-device N] [--threads N] [--verify]
+                      [--report <report.json>] [pack / extract options] [-f]
+  openwad-cli list    <file.wad>
+  openwad-cli ls      <file.wad> [<dir>]
+  openwad-cli cat     <file.wad> <entry name>
+
+Any command takes [--telemetry <summary.json>] [--chrome-trace <trace.json>]
+[--log <level>].
+
+WadReader users (including cat) record an access trace for
+--layout when OPENWAD_TRACE_DIR names a directory.
+
+Log output goes to stdout (stderr while a WAD is packed to
+stdout), errors to stderr.
+Exit code: 0 = success, 1 = failure, 2 = usage error,
+3 = cancelled (Ctrl+C; partial output is removed).
+===========================================
+*/
+#include "wad_format.h"
+#include "wad_extract.h"
+#include "wad_pack.h"
+#include "wad_reader.h"
+#include "wad_trie.h"
+#include "wad_verify.h"
+#include "wad_patch.h"
+#include "mapped_file.h"
+#include "platform.h"
+#include "logger.h"
+#include "telemetry.h"
+#include "job.h"
+#include "batch.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+static bool g_Force = false;        // -f: overwrite existing output without asking
+static bool g_StatusShown = false;  // A progress status line is on the terminal
+static FILE* g_LogStream = stdout;  // Log output (stderr while stdout carries a WAD)
+
+// ------------------------------------------------------------
+// True when stderr is a terminal (progress status is shown)
+// ------------------------------------------------------------
+static bool StderrIsTerminal()
+{
+#ifdef _WIN32
+    return _isatty(_fileno(stderr)) != 0;
+#else
+    return isatty(fileno(stderr)) != 0;
+#endif
+}
+
+// ------------------------------------------------------------
+// Erase the progress status line before other output
+// ------------------------------------------------------------
+static void ClearStatus()
+{
+    if (g_StatusShown) {
+        fputs("\r\033[K", stderr);
+        g_StatusShown = false;
+    }
+}
+
+// ------------------------------------------------------------
+// Write wide log text to a stdio stream as UTF-8, dropping the
+// '\r' of the GUI's "\r\n" line endings
+// ------------------------------------------------------------
+static void WriteText(FILE* f, const std::wstring& text)
+{
+    std::string s = ToUtf8(text);
+    s.erase(std::remove(s.begin(), s.end(), '\r'), s.end());
+    fwrite(s.data(), 1, s.size(), f);
+}
+
+static void PrintUsage()
+{
+    fputs(
+        "usage:\n"
+        "  openwad-cli pack    <folder> [-o <file.wad> | -o -] [--threads N] [--pwrite]\n"
+        "                      [--manifest <list.txt>] [--incremental] [--dedup]\n"
+        "                      [--copy <strategy>] [--io <backend>] [--checksums]\n"
+        "                      [--layout <trace.txt>] [--align N] [--wad64 | --compress] [-f]\n"
+        "  openwad-cli extract <file.wad | -> [-o <dir>] [--threads N] [--copy <strategy>]\n"
+        "                      [--io <backend>] [-f]\n"
+        "                      [--filter <pattern>]... [--filter-list <list.txt>]\n"
+        "                      [--hardlink]\n"
+        "  openwad-cli verify  <file.wad> [--threads N] [--write-sums]\n"
+        "  openwad-cli diff    <base.wad> <target.wad> [-o <patch.wad>] [--threads N] [-f]\n"
+        "  openwad-cli apply   <base.wad> <patch.wad> [-o <out.wad>] [--threads N]\n"
+        "                      [--copy <strategy>] [-f]\n"
+        "                      (pack / extract / verify / diff / apply: [--map-window MB]\n"
+        "                      [--huge-pages])\n"
+        "  openwad-cli batch   [<pattern>]... [--list <jobs.txt>] [--jobs N]\n"
+        "                      [--per-device N] [--threads N] [--verify]\n"
+        "                      [--report <report.json>] [pack / extract options] [-f]\n"
+        "  openwad-cli list    <file.wad>\n"
+        "  openwad-cli ls      <file.wad> [<dir>]\n"
+        "  openwad-cli cat     <file.wad> <entry name>\n"
+        "\n"
+        "  any command:        [--telemetry <summary.json>] [--chrome-trace <trace.json>]\n"
+        "                      [--log <level>]\n"
+        "\n"
+        "options:\n"
+        "  -o <path>     output WAD (pack), directory (extract), patch WAD (diff,\n"
+        "                default <target>.patch.wad) or rebuilt WAD (apply,\n"
+        "                default: replace <base.wad>)\n"
+        "  -             pack -o -: write the WAD to stdout; extract -: read it\n"
+        "                from stdin (-o <dir> needed), both front to back for\n"
+        "                pipes (no compressed WADs, dedup, incremental mode or\n"
+        "                checksums)\n"
+        "  -f            overwrite existing output\n"
+        "  --threads N   worker threads: extraction writers / pack readers\n"
+        "                (0 = one per core, 1 = serial extraction); batch: size\n"
+        "                of the worker pool shared by all items\n"
+        "  --pwrite      pack with positioned writes instead of a mapped view\n"
+        "  --manifest F  pack the files listed in F (one path per line, relative\n"
+        "                to <folder>) instead of walking the folder\n"
+        "  --incremental only read files changed since the last incremental pack\n"
+        "                into the same WAD (tracked in <file.wad>.idx)\n"
+        "  --dedup       store byte-identical files once, entries share the data\n"
+        "  --filter P    extract only entries matching P: '*' and '?' within a\n"
+        "                component, '**' for any depth, a directory selects\n"
+        "                everything below it (case-insensitive, '/' or '\\')\n"
+        "  --filter-list F\n"
+        "                extract the entries / patterns listed in F (one per line)\n"
+        "  --hardlink    hard-link entries that share their data instead of\n"
+        "                writing them again\n"
+        "  --copy S      how data is copied: auto (by size and a memory benchmark),\n"
+        "                write, kernel (copy_file_range / sendfile), prealloc\n"
+        "                (reserve space, large aligned writes), stream\n"
+        "                (cache-bypassing stores into a mapped view)\n"
+        "  --io B        small-file I/O: auto, sync (one call sequence per file)\n"
+        "                or uring (batched through io_uring, Linux)\n"
+        "  --checksums   read the packed WAD back against its sources and store\n"
+        "                per-entry checksums in <file.wad>.sum (without it, an old\n"
+        "                <file.wad>.sum is removed)\n"
+        "  --write-sums  (re)write <file.wad>.sum from the verified contents\n"
+        "  --layout F    place the data of the entries in F first: an access trace\n"
+        "                (recorded with OPENWAD_TRACE_DIR=<dir>) or a hot-list of\n"
+        "                entry names, one per line\n"
+        "  --align N     start every payload on an N byte boundary (e.g. 4096)\n"
+        "  --wad64       write the WAD64 format (64-bit offsets, past 4 GB; only\n"
+        "                OpenWAD reads it). Classic WADs are refused past 4 GB\n"
+        "  --compress    write a compressed WAD (LZ4 blocks, compressed and\n"
+        "                decoded in parallel; only OpenWAD reads it)\n"
+        "  --map-window MB\n"
+        "                map WAD data this many MB at a time per worker (default\n"
+        "                64; 0 = map the whole file), bounding address space and\n"
+        "                resident memory on huge WADs\n"
+        "  --huge-pages  ask for transparent huge pages on mapped data (Linux,\n"
+        "                best effort)\n"
+        "  --telemetry F write phase times, byte counters, I/O latency histograms\n"
+        "                and peak memory of the run to F (JSON)\n"
+        "  --chrome-trace F\n"
+        "                write every phase span per thread to F (trace-event JSON\n"
+        "                for chrome://tracing or Perfetto)\n"
+        "  --log L       errors, summary (no per-file lines, fastest) or files\n"
+        "                (default: one line per packed / extracted file)\n"
+        "\n"
+        "batch:\n"
+        "  <pattern>     folders and .wad files matching e.g. 'mods/*' ('*' and\n"
+        "                '?' in the last component): folders are packed, WADs\n"
+        "                extracted next to themselves\n"
+        "  --list F      job list, one item per line: 'pack <folder> [<out.wad>]',\n"
+        "                'extract <file.wad> [<dir>]' or 'verify <file.wad>'\n"
+        "                (quote paths with spaces, '#' starts a comment)\n"
+        "  --jobs N      items running at once (default: one per core); the\n"
+        "                largest items start first\n"
+        "  --per-device N\n"
+        "                items reading or writing one storage device at once\n"
+        "                (default 2)\n"
+        "  --verify      verify matched WADs instead of extracting them\n"
+        "  --report F    write per-item results and throughput to F (JSON)\n",
+        stderr);
+}
+
+// ------------------------------------------------------------
+// Print the entry table of a WAD: offset, size and name per
+// line, tab separated
+// ------------------------------------------------------------
+static bool ListWad(const std::filesystem::path& wadPath)
+{
+    MappedFile mf;
+    if (!mf.open(wadPath)) {
+        ShowError(L"Failed to memory-map WAD file.");
+        return false;
+    }
+
+    WadView wad;
+    const wchar_t* error = nullptr;
+    if (!OpenWadView(mf.base, mf.size, wad, &error)) {
+        ShowError(error);
+        return false;
+    }
+
+    std::string line;
+    for (uint32_t i = 0; i < wad.fileCount; ++i) {
+        line = std::to_string(wad.entryOffset(i)) + "\t" + std::to_string(wad.entrySize(i)) + "\t" +
+            ToUtf8(ToWideFromAnsi(wad.entryName(i))) + "\n";
+        fwrite(line.data(), 1, line.size(), stdout);
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Print one directory of a WAD: sub-directories (with a
+// trailing '\', total size and entry count), then entries
+// ------------------------------------------------------------
+static bool ListDir(const std::filesystem::path& wadPath, const std::string& dirUtf8)
+{
+    WadReader reader;
+    const wchar_t* error = nullptr;
+    if (!reader.open(wadPath, &error)) {
+        ShowError(error);
+        return false;
+    }
+
+    WadTrie trie;
+    trie.build(reader.view());
+
+    std::vector<WadDirEntry> items;
+    if (!trie.list(ToAnsiFromWide(FromUtf8(dirUtf8)), items)) {
+        ShowError((L"Directory not found: " + FromUtf8(dirUtf8)).c_str());
+        return false;
+    }
+
+    std::string line;
+    for (const WadDirEntry& e : items) {
+        line = std::to_string(e.bytes) + "\t";
+        if (e.isDir)
+            line += std::to_string(e.files) + "\t" + ToUtf8(ToWideFromAnsi(e.name)) + "\\\n";
+        else
+            line += "-\t" + ToUtf8(ToWideFromAnsi(e.name)) + "\n";
+        fwrite(line.data(), 1, line.size(), stdout);
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Write the data of one entry to stdout. The name is matched
+// case-insensitively, '/' and '\' are interchangeable.
+// ------------------------------------------------------------
+static bool CatEntry(const std::filesystem::path& wadPath, const std::string& nameUtf8)
+{
+    WadReader reader;
+    const wchar_t* error = nullptr;
+    if (!reader.open(wadPath, &error)) {
+        ShowError(error);
+        return false;
+    }
+
+    int64_t index = reader.find(FromUtf8(nameUtf8));
+    if (index < 0) {
+        ShowError((L"Entry not found: " + FromUtf8(nameUtf8)).c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::vector<uint8_t> buffer;
+    std::span<const uint8_t> data;
+    if (!reader.read((uint32_t)index, buffer, data)) {
+        ShowError(L"Corrupt entry data.");
+        return false;
+    }
+    if (fwrite(data.data(), 1, data.size(), stdout) != data.size()) {
+        ShowError(L"Failed to write entry data.");
+        return false;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Console output shared by the log sink (commands run on this
+// thread) and the job event handler
+// ------------------------------------------------------------
+static void ConsoleAppend(const std::wstring& text)
+{
+    ClearStatus();
+    WriteText(g_LogStream, text);
+    fflush(g_LogStream);
+}
+
+static void ConsoleStatus(const std::wstring& text)
+{
+    ClearStatus();
+    if (text.empty())
+        return;
+    WriteText(stderr, text);
+    fflush(stderr);
+    g_StatusShown = true;
+}
+
+static void ConsoleError(const std::wstring& msg)
+{
+    ClearStatus();
+    fflush(g_LogStream);
+    WriteText(stderr, L"openwad-cli: " + msg + L"\n");
+}
+
+static bool ConsoleConfirm(const std::wstring& target)
+{
+    ClearStatus();
+    fflush(g_LogStream);
+    if (!g_Force)
+        WriteText(stderr, L"openwad-cli: output exists, use -f to overwrite: " + target + L"\n");
+    return g_Force;
+}
+
+static void InstallConsoleSink()
+{
+    LogSink sink;
+    sink.append = ConsoleAppend;
+    if (StderrIsTerminal())
+        sink.status = ConsoleStatus;
+    sink.error = ConsoleError;
+    sink.confirmOverwrite = ConsoleConfirm;
+    SetLogSink(std::move(sink));
+}
+
+// ------------------------------------------------------------
+// Ctrl+C asks the running job to stop; a second one ends the
+// process the usual way
+// ------------------------------------------------------------
+static volatile sig_atomic_t g_Interrupted = 0;
+
+static void OnInterrupt(int)
+{
+    g_Interrupted = 1;
+    signal(SIGINT, SIG_DFL);
+}
+
+// ------------------------------------------------------------
+// Run an engine operation as a job and print its events on this
+// thread until it finishes. 'cancelled' reports a Ctrl+C.
+// ------------------------------------------------------------
+static bool RunJob(Job::Work work, bool& cancelled)
+{
+    g_Interrupted = 0;
+    signal(SIGINT, OnInterrupt);
+
+    bool showStatus = StderrIsTerminal();
+    bool finished = false;
+    std::shared_ptr<Job> job = Job::Start([&work](const CancelFlag& cancel) {
+        TelemetryThreadName("job");
+        return work(cancel);
+    });
+
+    auto handler = [&](const JobEvent& e) {
+        switch (e.kind) {
+        case JobEventKind::Log:      ConsoleAppend(e.text); break;
+        case JobEventKind::Status:   if (showStatus) ConsoleStatus(e.text); break;
+        case JobEventKind::Error:    ConsoleError(e.text); break;
+        case JobEventKind::Confirm:  job->answer(ConsoleConfirm(e.text)); break;
+        case JobEventKind::Finished: finished = true; break;
+        default: break;
+        }
+    };
+
+    while (!finished) {
+        job->waitEvents(std::chrono::milliseconds(kLogPumpMs));
+        if (g_Interrupted && !job->cancelRequested()) {
+            ConsoleError(L"cancelling...");
+            job->cancel();
+        }
+        job->dispatch(handler);
+    }
+
+    signal(SIGINT, SIG_DFL);
+    InstallConsoleSink();   // The job cleared the sink when it ended
+    cancelled = job->cancelRequested();
+    return job->succeeded();
+}
+
+static int RunCli(const std::vector<std::string>& args)
+{
+    if (args.size() < 2) {
+        PrintUsage();
+        return 2;
+    }
+
+    const std::string& command = args[0];
+    std::filesystem::path input = PathFromUtf8(args[1]);
+    std::vector<std::filesystem::path> patterns;   // batch: every argument before the options
+
+    ExtractOptions extractOptions;
+    PackOptions packOptions;
+    VerifyOptions verifyOptions;
+    PatchOptions patchOptions;
+    std::filesystem::path outPath;
+    std::filesystem::path secondPath;   // diff: target WAD, apply: patch WAD
+    std::filesystem::path telemetryPath;
+    std::filesystem::path chromeTracePath;
+    LogLevel logLevel = LogLevel::Files;
+    std::string entryName;
+    size_t firstOption = 2;
+
+    if (command == "ls" && args.size() >= 3 && args[2][0] != '-') {
+        entryName = args[2];
+        firstOption = 3;
+    }
+    if (command == "cat") {
+        if (args.size() < 3) {
+            PrintUsage();
+            return 2;
+        }
+        entryName = args[2];
+        firstOption = 3;
+    }
+    if (command == "diff" || command == "apply") {
+        if (args.size() < 3) {
+            PrintUsage();
+            return 2;
+        }
+        secondPath = PathFromUtf8(args[2]);
+        firstOption = 3;
+    }
+    if (command == "batch") {
+        for (firstOption = 1; firstOption < args.size() && args[firstOption][0] != '-'; ++firstOption)
+            patterns.push_back(PathFromUtf8(args[firstOption]));
+    }
+
+    BatchOptions batchOptions;
+    BatchOp batchWadOp = BatchOp::Extract;
+    std::filesystem::path batchList;
+    std::filesystem::path reportPath;
+
+    // ------------------------------------------------------------
+    // 1. Parse options following the command and its input
+    // ------------------------------------------------------------
+    for (size_t i = firstOption; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "-o" && i + 1 < args.size()) {
+            outPath = PathFromUtf8(args[++i]);
+        }
+        else if (a == "-f" || a == "--force") {
+            g_Force = true;
+        }
+        else if (a == "--threads" && i + 1 < args.size()) {
+            extractOptions.threads = (unsigned)strtoul(args[++i].c_str(), nullptr, 10);
+            packOptions.threads = extractOptions.threads;
+            verifyOptions.threads = extractOptions.threads;
+            patchOptions.threads = extractOptions.threads;
+            batchOptions.threads = extractOptions.threads;
+        }
+        else if (a == "--jobs" && i + 1 < args.size()) {
+            batchOptions.jobs = (unsigned)strtoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (a == "--per-device" && i + 1 < args.size()) {
+            batchOptions.perDevice = (unsigned)strtoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (a == "--list" && i + 1 < args.size()) {
+            batchList = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--verify") {
+            batchWadOp = BatchOp::Verify;
+        }
+        else if (a == "--report" && i + 1 < args.size()) {
+            reportPath = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--pwrite") {
+            packOptions.useMapping = false;
+        }
+        else if (a == "--manifest" && i + 1 < args.size()) {
+            packOptions.manifestPath = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--incremental") {
+            packOptions.incremental = true;
+        }
+        else if (a == "--dedup") {
+            packOptions.dedup = true;
+        }
+        else if (a == "--layout" && i + 1 < args.size()) {
+            packOptions.layoutPath = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--align" && i + 1 < args.size()) {
+            packOptions.alignment = (uint32_t)strtoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (a == "--wad64") {
+            packOptions.format = WadFormat::Wad64;
+        }
+        else if (a == "--compress") {
+            packOptions.format = WadFormat::Compressed;
+        }
+        else if (a == "--map-window" && i + 1 < args.size()) {
+            extractOptions.map.window = (size_t)strtoull(args[++i].c_str(), nullptr, 10) * 1024 * 1024;
+            packOptions.map.window = extractOptions.map.window;
+            verifyOptions.map.window = extractOptions.map.window;
+            patchOptions.map.window = extractOptions.map.window;
+        }
+        else if (a == "--huge-pages") {
+            extractOptions.map.hugePages = true;
+            packOptions.map.hugePages = true;
+            verifyOptions.map.hugePages = true;
+            patchOptions.map.hugePages = true;
+        }
+        else if (a == "--checksums") {
+            packOptions.checksums = true;
+        }
+        else if (a == "--write-sums") {
+            verifyOptions.writeChecksums = true;
+        }
+        else if (a == "--hardlink") {
+            extractOptions.hardLinkDuplicates = true;
+        }
+        else if (a == "--copy" && i + 1 < args.size() &&
+                 ParseCopyStrategy(args[i + 1], extractOptions.copyStrategy)) {
+            packOptions.copyStrategy = extractOptions.copyStrategy;
+            patchOptions.copyStrategy = extractOptions.copyStrategy;
+            ++i;
+        }
+        else if (a == "--io" && i + 1 < args.size() &&
+                 ParseIoBackend(args[i + 1], extractOptions.ioBackend)) {
+            packOptions.ioBackend = extractOptions.ioBackend;
+            ++i;
+        }
+        else if (a == "--filter" && i + 1 < args.size()) {
+            extractOptions.filters.push_back(FromUtf8(args[++i]));
+        }
+        else if (a == "--filter-list" && i + 1 < args.size()) {
+            extractOptions.filterList = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--telemetry" && i + 1 < args.size()) {
+            telemetryPath = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--chrome-trace" && i + 1 < args.size()) {
+            chromeTracePath = PathFromUtf8(args[++i]);
+        }
+        else if (a == "--log" && i + 1 < args.size() && ParseLogLevel(args[i + 1], logLevel)) {
+            ++i;
+        }
+        else {
+            fprintf(stderr, "unknown option: %s\n", a.c_str());
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (command == "batch" && (!outPath.empty() || !packOptions.manifestPath.empty())) {
+        fputs("batch: -o and --manifest are set per item in the job list\n", stderr);
+        PrintUsage();
+        return 2;
+    }
+
+    // ------------------------------------------------------------
+    // 2. Route engine output to the console (progress status on
+    //    stderr when it is a terminal; the log too when stdout
+    //    carries the packed WAD)
+    // ------------------------------------------------------------
+    if (command == "pack" && outPath == "-")
+        g_LogStream = stderr;
+    SetLogLevel(logLevel);
+    InstallConsoleSink();
+
+    // ------------------------------------------------------------
+    // 3. Run the command (recording telemetry when asked to);
+    //    pack / extract / verify / diff / apply run as jobs that
+    //    Ctrl+C cancels
+    // ------------------------------------------------------------
+    bool telemetry = !telemetryPath.empty() || !chromeTracePath.empty();
+    if (telemetry)
+        StartTelemetry(!chromeTracePath.empty());
+
+    bool ok;
+    bool cancelled = false;
+    if (command == "pack") {
+        packOptions.toStdout = outPath == "-";
+        if (!packOptions.toStdout)
+            packOptions.outPath = outPath;
+        ok = RunJob([&](const CancelFlag& cancel) {
+            packOptions.cancel = &cancel;
+            return PackFolder(input, packOptions);
+        }, cancelled);
+    }
+    else if (command == "extract") {
+        extractOptions.outDir = outPath;
+        extractOptions.fromStdin = input == "-";
+        ok = RunJob([&](const CancelFlag& cancel) {
+            extractOptions.cancel = &cancel;
+            return ExtractWad(input, extractOptions);
+        }, cancelled);
+    }
+    else if (command == "verify") {
+        ok = RunJob([&](const CancelFlag& cancel) {
+            verifyOptions.cancel = &cancel;
+            return VerifyWad(input, verifyOptions);
+        }, cancelled);
+    }
+    else if (command == "diff" || command == "apply") {
+        patchOptions.outPath = outPath;
+        ok = RunJob([&](const CancelFlag& cancel) {
+            patchOptions.cancel = &cancel;
+            return command == "diff" ? DiffWads(input, secondPath, patchOptions)
+                                     : ApplyPatch(input, secondPath, patchOptions);
+        }, cancelled);
+    }
+    else if (command == "batch") {
+        // --------------------------------------------------------
+        // Collect the items of the job list and the patterns,
+        // then run them side by side
+        // --------------------------------------------------------
+        std::vector<BatchItem> items;
+        std::wstring error;
+        ok = batchList.empty() || ReadBatchList(batchList, items, error);
+        if (!ok)
+            ShowError(error.c_str());
+        for (const std::filesystem::path& p : patterns) {
+            if (ok && ExpandBatchPattern(p, batchWadOp, items) == 0)
+                Log(L"Nothing matches: " + PathToDisplay(p));
+        }
+        if (ok && items.empty()) {
+            ShowError(L"No items to run.");
+            ok = false;
+        }
+
+        if (ok) {
+            BatchReport report;
+            batchOptions.pack = packOptions;
+            batchOptions.extract = extractOptions;
+            batchOptions.verify = verifyOptions;
+            ok = RunJob([&](const CancelFlag& cancel) {
+                batchOptions.cancel = &cancel;
+                bool done = RunBatch(items, batchOptions, report);
+                LogBatchReport(report);
+                return done;
+            }, cancelled);
+
+            if (!reportPath.empty() && !WriteBatchReportJson(report, reportPath))
+                ShowError(L"Failed to write batch report.");
+        }
+    }
+    else if (command == "list") {
+        ok = ListWad(input);
+    }
+    else if (command == "ls") {
+        ok = ListDir(input, entryName);
+    }
+    else if (command == "cat") {
+        ok = CatEntry(input, entryName);
+    }
+    else {
+        fprintf(stderr, "unknown command: %s\n", command.c_str());
+        PrintUsage();
+        return 2;
+    }
+
+    if (telemetry) {
+        StopTelemetry();
+        if (!telemetryPath.empty() && !WriteTelemetryJson(telemetryPath))
+            ShowError(L"Failed to write telemetry summary.");
+        if (!chromeTracePath.empty() && !WriteChromeTrace(chromeTracePath))
+            ShowError(L"Failed to write Chrome trace.");
+    }
+
+    fflush(stdout);
+    if (cancelled)
+        return 3;
+    return ok ? 0 : 1;
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t** argv)
+{
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+        args.push_back(ToUtf8(argv[i]));
+    return RunCli(args);
+}
+#else
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    return RunCli(args);
+}
+#endif
@@ -0,0 +1,88 @@
+﻿#include "pack_index.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+
+static const char kPackIndexMagic[] = "OpenWAD pack index 1";
+
+std::filesystem::path PackIndexPath(const std::filesystem::path& wadPath)
+{
+    std::filesystem::path p = wadPath;
+    p += ".idx";
+    return p;
+}
+
+// ------------------------------------------------------------
+// Split off the next tab separated field of 'line'
+// ------------------------------------------------------------
+static bool NextField(std::string_view& line, std::string_view& field)
+{
+    size_t tab = line.find('\t');
+    if (tab == std::string_view::npos)
+        return false;
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+bool ReadPackIndex(const std::filesystem::path& path, PackIndex& index)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    // ------------------------------------------------------------
+    // 1. Magic line, then "<wad size>\t<wad mtime>"
+    // ------------------------------------------------------------
+    std::string line;
+    if (!std::getline(in, line) || line != kPackIndexMagic)
+        return false;
+    if (!std::getline(in, line))
+        return false;
+
+    char* end = nullptr;
+    index.wadSize = strtoull(line.c_str(), &end, 10);
+    if (*end != '\t')
+        return false;
+    index.wadMtime = strtoll(end + 1, &end, 10);
+    if (*end != '\0')
+        return false;
+
+    // ------------------------------------------------------------
+    // 2. "<size>\t<mtime>\t<hash hex>\t<relative path>" per entry
+    // ------------------------------------------------------------
+    index.entries.clear();
+    while (std::getline(in, line)) {
+        std::string_view rest = line;
+        std::string_view sizeText, mtimeText, hashText;
+        if (!NextField(rest, sizeText) || !NextField(rest, mtimeText) || !NextField(rest, hashText))
+            return false;
+
+        PackIndexEntry e;
+        e.size = strtoull(std::string(sizeText).c_str(), nullptr, 10);
+        e.mtime = strtoll(std::string(mtimeText).c_str(), nullptr, 10);
+        e.hash = strtoull(std::string(hashText).c_str(), nullptr, 16);
+        e.relPathW = FromUtf8(rest);
+        index.entries.push_back(std::move(e));
+    }
+    return true;
+}
+
+bool WritePackIndex(const std::filesystem::path& path, const PackIndex& index)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    out << kPackIndexMagic << '\n';
+    out << index.wadSize << '\t' << index.wadMtime << '\n';
+
+    char hashText[24];
+    for (const PackIndexEntry& e : index.entries) {
+        snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)e.hash);
+        out << e.size << '\t' << e.mtime << '\t' << hashText << '\t' << ToUtf8(e.relPathW) << '\n';
+    }
+    return (bool)out.flush();
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// Source file behind one WAD entry, as recorded at pack time
+// ------------------------------------------------------------
+struct PackIndexEntry {
+    std::wstring relPathW;   // Path relative to the packed folder, '\' separated
+    uint64_t size = 0;       // Source size
+    int64_t mtime = 0;       // Source last write time (GetFileInfo ticks, 0 = unknown)
+    uint64_t hash = 0;       // XXH64 of the contents
+};
+
+// ------------------------------------------------------------
+// Sidecar written next to a WAD by incremental packing. It is
+// only trusted while the WAD still has the recorded size and
+// write time, i.e. nobody touched the WAD since.
+// ------------------------------------------------------------
+struct PackIndex {
+    uint64_t wadSize = 0;                  // Size of the WAD when written
+    int64_t wadMtime = 0;                  // Write time of the WAD when written
+    std::vector<PackIndexEntry> entries;   // One per table entry, in table order
+};
+
+// ------------------------------------------------------------
+// <file.wad> -> <file.wad>.idx
+// ------------------------------------------------------------
+std::filesystem::path PackIndexPath(const std::filesystem::path& wadPath);
+
+// ------------------------------------------------------------
+// Read / write the sidecar (UTF-8 text, one tab separated line
+// per entry). Both return false on any I/O or format error.
+// ------------------------------------------------------------
+bool ReadPackIndex(const std::filesystem::path& path, PackIndex& index);
+bool WritePackIndex(const std::filesystem::path& path, const PackIndex& index);
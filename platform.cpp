@@ -0,0 +1,752 @@
+﻿#include "platform.h"
+#include "telemetry.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef _WIN32
+
+// ------------------------------------------------------------
+// Convert an ANSI (CP_ACP) string view to a UTF-16 std::wstring
+// ------------------------------------------------------------
+std::wstring ToWideFromAnsi(std::string_view s)
+{
+    if (s.empty()) return L"";
+
+    int needed = MultiByteToWideChar(CP_ACP, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring out(needed, L'\0');
+    MultiByteToWideChar(CP_ACP, 0, s.data(), (int)s.size(), out.data(), needed);
+    return out;
+}
+
+// ------------------------------------------------------------
+// Convert a UTF-16 std::wstring to an ANSI (CP_ACP) std::string
+// ------------------------------------------------------------
+std::string ToAnsiFromWide(const std::wstring& s) {
+    if (s.empty()) return "";
+    int len = WideCharToMultiByte(CP_ACP, 0, s.c_str(), (int)s.size(), nullptr, 0, nullptr, nullptr);
+    std::string out(len, '\0');
+    WideCharToMultiByte(CP_ACP, 0, s.c_str(), (int)s.size(), out.data(), len, nullptr, nullptr);
+    return out;
+}
+
+std::string ToUtf8(const std::wstring& s)
+{
+    if (s.empty()) return "";
+    int len = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0, nullptr, nullptr);
+    std::string out(len, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, s.c_str(), (int)s.size(), out.data(), len, nullptr, nullptr);
+    return out;
+}
+
+std::wstring FromUtf8(std::string_view s)
+{
+    if (s.empty()) return L"";
+    int needed = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring out(needed, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), out.data(), needed);
+    return out;
+}
+
+std::filesystem::path PathFromUtf8(const std::string& s)
+{
+    return std::filesystem::path(FromUtf8(s));
+}
+
+std::wstring PathToDisplay(const std::filesystem::path& path)
+{
+    return path.native();
+}
+
+bool GetEnvPath(const char* name, std::filesystem::path& out)
+{
+    std::wstring nameW = FromUtf8(name);
+    DWORD n = GetEnvironmentVariableW(nameW.c_str(), nullptr, 0);
+    if (n <= 1)
+        return false;
+    std::wstring value(n, L'\0');
+    n = GetEnvironmentVariableW(nameW.c_str(), value.data(), n);
+    value.resize(n);
+    out = value;
+    return !value.empty();
+}
+
+std::filesystem::path WadNameToPath(const std::wstring& nameW)
+{
+    return std::filesystem::path(nameW);
+}
+
+void FoldPathCase(std::filesystem::path::string_type& path)
+{
+    FoldPathCase(path.data(), path.size());
+}
+
+void FoldPathCase(NativeChar* path, size_t size)
+{
+    if (size)
+        CharLowerBuffW(path, (DWORD)size);
+}
+
+MemoryStats GetMemoryStats()
+{
+    MemoryStats ms;
+    PROCESS_MEMORY_COUNTERS pmc{};
+    pmc.cb = sizeof(pmc);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        ms.peakResident = pmc.PeakWorkingSetSize;
+        ms.peakPrivate = pmc.PeakPagefileUsage;
+        ms.pageFaults = pmc.PageFaultCount;
+    }
+    return ms;
+}
+
+// ------------------------------------------------------------
+// The Win32 peak working set cannot be reset
+// ------------------------------------------------------------
+void ResetPeakMemory()
+{
+}
+
+bool GetFileInfo(const std::filesystem::directory_entry& entry, uint64_t& size, int64_t& mtime)
+{
+    std::error_code ec;
+    size = entry.file_size(ec);
+    if (ec)
+        return false;
+    mtime = (int64_t)entry.last_write_time(ec).time_since_epoch().count();
+    return !ec;
+}
+
+// ------------------------------------------------------------
+// Volume serial number of the volume mounted at or above 'path'
+// ------------------------------------------------------------
+static bool QueryDeviceId(const std::filesystem::path& path, uint64_t& id)
+{
+    wchar_t volume[MAX_PATH];
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH))
+        return false;
+    DWORD serial = 0;
+    if (!GetVolumeInformationW(volume, nullptr, 0, &serial, nullptr, nullptr, nullptr, 0))
+        return false;
+    id = serial;
+    return true;
+}
+
+bool FileHandle::openRead(const std::filesystem::path& path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) h = nullptr;
+    return h != nullptr;
+}
+
+bool FileHandle::create(const std::filesystem::path& path)
+{
+    return create(path.c_str());
+}
+
+bool FileHandle::create(const NativeChar* path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    h = CreateFileW(path, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) h = nullptr;
+    return h != nullptr;
+}
+
+bool FileHandle::openWrite(const std::filesystem::path& path)
+{
+    return openWrite(path.c_str());
+}
+
+bool FileHandle::openWrite(const NativeChar* path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    h = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) h = nullptr;
+    return h != nullptr;
+}
+
+// ------------------------------------------------------------
+// Duplicate a standard handle so that close() leaves the
+// process's own one alone
+// ------------------------------------------------------------
+static void* DuplicateStdHandle(DWORD which)
+{
+    HANDLE handle = GetStdHandle(which);
+    HANDLE dup = nullptr;
+    if (handle == INVALID_HANDLE_VALUE || handle == nullptr ||
+        !DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &dup, 0, FALSE, DUPLICATE_SAME_ACCESS))
+        return nullptr;
+    return dup;
+}
+
+bool FileHandle::openStdin()
+{
+    close();
+    h = DuplicateStdHandle(STD_INPUT_HANDLE);
+    return h != nullptr;
+}
+
+bool FileHandle::openStdout()
+{
+    close();
+    h = DuplicateStdHandle(STD_OUTPUT_HANDLE);
+    return h != nullptr;
+}
+
+bool FileHandle::isOpen() const { return h != nullptr; }
+
+bool FileHandle::read(void* dst, size_t size, size_t& got)
+{
+    TelemetryTimer timer(TelemetryHistogram::Read);
+    DWORD want = (DWORD)std::min<size_t>(size, 1u << 30);
+    DWORD n = 0;
+    got = 0;
+    if (!ReadFile(h, dst, want, &n, nullptr))
+        return false;
+    got = n;
+    return true;
+}
+
+bool FileHandle::readAt(void* dst, size_t size, uint64_t offset, size_t& got)
+{
+    TelemetryTimer timer(TelemetryHistogram::Read);
+    OVERLAPPED ov{};
+    ov.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+
+    DWORD want = (DWORD)std::min<size_t>(size, 1u << 30);
+    DWORD n = 0;
+    got = 0;
+    if (!ReadFile(h, dst, want, &n, &ov))
+        return GetLastError() == ERROR_HANDLE_EOF;
+    got = n;
+    return true;
+}
+
+bool FileHandle::write(const void* src, size_t size)
+{
+    TelemetryTimer timer(TelemetryHistogram::Write);
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    while (size > 0) {
+        DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+        DWORD written = 0;
+        if (!WriteFile(h, p, chunk, &written, nullptr) || written == 0)
+            return false;
+        p += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool FileHandle::writeAt(const void* src, uint64_t offset, size_t size)
+{
+    TelemetryTimer timer(TelemetryHistogram::Write);
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    while (size > 0) {
+        DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+
+        OVERLAPPED ov{};
+        ov.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD written = 0;
+        if (!WriteFile(h, p, chunk, &written, &ov) || written != chunk)
+            return false;
+
+        p += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool FileHandle::setSize(uint64_t size)
+{
+    LARGE_INTEGER li;
+    li.QuadPart = (LONGLONG)size;
+    return SetFilePointerEx(h, li, nullptr, FILE_BEGIN) && SetEndOfFile(h);
+}
+
+bool FileHandle::preallocate(uint64_t size)
+{
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    return SetFileInformationByHandle(h, FileAllocationInfo, &info, sizeof(info)) != FALSE;
+}
+
+bool FileHandle::getSize(uint64_t& size) const
+{
+    LARGE_INTEGER li{};
+    if (!GetFileSizeEx(h, &li))
+        return false;
+    size = (uint64_t)li.QuadPart;
+    return true;
+}
+
+void FileHandle::close()
+{
+    if (h) CloseHandle(h);
+    h = nullptr;
+}
+
+bool FileHandle::createAt(const DirHandle&, const NativeChar* path)
+{
+    return create(path);
+}
+
+bool FileHandle::openWriteAt(const DirHandle&, const NativeChar* path)
+{
+    return openWrite(path);
+}
+
+size_t OpenFileLimit()
+{
+    return SIZE_MAX;
+}
+
+bool DirHandle::open(const NativeChar* path)
+{
+    DWORD attr = GetFileAttributesW(path);
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool DirHandle::makeAt(const DirHandle&, const NativeChar* path, bool& created)
+{
+    created = CreateDirectoryW(path, nullptr) != 0;
+    return created || (GetLastError() == ERROR_ALREADY_EXISTS && open(path));
+}
+
+bool DirHandle::isOpen() const { return false; }
+void DirHandle::close() {}
+
+#else // POSIX
+
+// ------------------------------------------------------------
+// WAD names are Windows ANSI; without a code page table the
+// closest portable mapping is Latin-1 (byte value = code point)
+// ------------------------------------------------------------
+std::wstring ToWideFromAnsi(std::string_view s)
+{
+    std::wstring out(s.size(), L'\0');
+    for (size_t i = 0; i < s.size(); ++i)
+        out[i] = (wchar_t)(unsigned char)s[i];
+    return out;
+}
+
+std::string ToAnsiFromWide(const std::wstring& s)
+{
+    std::string out(s.size(), '\0');
+    for (size_t i = 0; i < s.size(); ++i)
+        out[i] = (s[i] >= 0 && s[i] <= 0xFF) ? (char)s[i] : '?';
+    return out;
+}
+
+std::string ToUtf8(const std::wstring& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (wchar_t wc : s) {
+        uint32_t c = (uint32_t)wc;
+        if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = 0xFFFD;
+
+        if (c < 0x80) {
+            out += (char)c;
+        }
+        else if (c < 0x800) {
+            out += (char)(0xC0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+            out += (char)(0xE0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | (c >> 18));
+            out += (char)(0x80 | ((c >> 12) & 0x3F));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+std::wstring FromUtf8(std::string_view s)
+{
+    std::wstring out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size();) {
+        unsigned char b = (unsigned char)s[i];
+        uint32_t c;
+        size_t n;
+        if (b < 0x80)              { c = b;        n = 1; }
+        else if ((b >> 5) == 0x6)  { c = b & 0x1F; n = 2; }
+        else if ((b >> 4) == 0xE)  { c = b & 0x0F; n = 3; }
+        else if ((b >> 3) == 0x1E) { c = b & 0x07; n = 4; }
+        else                       { out += (wchar_t)0xFFFD; ++i; continue; }
+
+        if (i + n > s.size()) {
+            out += (wchar_t)0xFFFD;
+            break;
+        }
+        bool valid = true;
+        for (size_t k = 1; k < n; ++k) {
+            unsigned char cb = (unsigned char)s[i + k];
+            if ((cb & 0xC0) != 0x80) { valid = false; break; }
+            c = (c << 6) | (cb & 0x3F);
+        }
+        if (!valid) {
+            out += (wchar_t)0xFFFD;
+            ++i;
+            continue;
+        }
+        out += (wchar_t)c;
+        i += n;
+    }
+    return out;
+}
+
+std::filesystem::path PathFromUtf8(const std::string& s)
+{
+    return std::filesystem::path(s);
+}
+
+std::wstring PathToDisplay(const std::filesystem::path& path)
+{
+    return FromUtf8(path.native());
+}
+
+bool GetEnvPath(const char* name, std::filesystem::path& out)
+{
+    const char* value = getenv(name);
+    if (!value || !*value)
+        return false;
+    out = value;
+    return true;
+}
+
+std::filesystem::path WadNameToPath(const std::wstring& nameW)
+{
+    std::wstring n = nameW;
+    std::replace(n.begin(), n.end(), L'\\', L'/');
+    return std::filesystem::path(ToUtf8(n));
+}
+
+void FoldPathCase(std::filesystem::path::string_type&)
+{
+}
+
+void FoldPathCase(NativeChar*, size_t)
+{
+}
+
+// ------------------------------------------------------------
+// Prefer VmHWM from /proc (resettable through clear_refs) and
+// fall back to the lifetime ru_maxrss elsewhere
+// ------------------------------------------------------------
+MemoryStats GetMemoryStats()
+{
+    MemoryStats ms;
+    struct rusage ru {};
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        ms.peakResident = (uint64_t)ru.ru_maxrss * 1024;   // Linux reports KB
+        ms.pageFaults = (uint64_t)ru.ru_minflt + (uint64_t)ru.ru_majflt;
+    }
+
+    if (FILE* f = fopen("/proc/self/status", "r")) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            unsigned long long kb = 0;
+            if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) {
+                ms.peakResident = kb * 1024;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return ms;
+}
+
+// ------------------------------------------------------------
+// Writing "5" to clear_refs resets VmHWM to the current RSS
+// (Linux 4.0+); silently unavailable elsewhere
+// ------------------------------------------------------------
+void ResetPeakMemory()
+{
+    if (FILE* f = fopen("/proc/self/clear_refs", "w")) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+// ------------------------------------------------------------
+// One stat() for both values (directory_entry caches neither
+// on POSIX)
+// ------------------------------------------------------------
+bool GetFileInfo(const std::filesystem::directory_entry& entry, uint64_t& size, int64_t& mtime)
+{
+    struct stat st;
+    if (::stat(entry.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    size = (uint64_t)st.st_size;
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// ------------------------------------------------------------
+// st_dev of the file system holding 'path'
+// ------------------------------------------------------------
+static bool QueryDeviceId(const std::filesystem::path& path, uint64_t& id)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+        return false;
+    id = (uint64_t)st.st_dev;
+    return true;
+}
+
+bool FileHandle::openRead(const std::filesystem::path& path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd >= 0;
+}
+
+bool FileHandle::create(const std::filesystem::path& path)
+{
+    return create(path.c_str());
+}
+
+bool FileHandle::create(const NativeChar* path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    return fd >= 0;
+}
+
+bool FileHandle::openWrite(const std::filesystem::path& path)
+{
+    return openWrite(path.c_str());
+}
+
+bool FileHandle::openWrite(const NativeChar* path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    fd = ::open(path, O_WRONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+bool FileHandle::openStdin()
+{
+    close();
+    fd = ::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    return fd >= 0;
+}
+
+bool FileHandle::openStdout()
+{
+    close();
+    fd = ::fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    return fd >= 0;
+}
+
+bool FileHandle::isOpen() const { return fd >= 0; }
+
+bool FileHandle::read(void* dst, size_t size, size_t& got)
+{
+    TelemetryTimer timer(TelemetryHistogram::Read);
+    got = 0;
+    for (;;) {
+        ssize_t n = ::read(fd, dst, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        got = (size_t)n;
+        return true;
+    }
+}
+
+bool FileHandle::readAt(void* dst, size_t size, uint64_t offset, size_t& got)
+{
+    TelemetryTimer timer(TelemetryHistogram::Read);
+    got = 0;
+    for (;;) {
+        ssize_t n = ::pread(fd, dst, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        got = (size_t)n;
+        return true;
+    }
+}
+
+bool FileHandle::write(const void* src, size_t size)
+{
+    TelemetryTimer timer(TelemetryHistogram::Write);
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool FileHandle::writeAt(const void* src, uint64_t offset, size_t size)
+{
+    TelemetryTimer timer(TelemetryHistogram::Write);
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        offset += (uint64_t)n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool FileHandle::setSize(uint64_t size)
+{
+    return ::ftruncate(fd, (off_t)size) == 0;
+}
+
+bool FileHandle::preallocate(uint64_t size)
+{
+#ifdef __linux__
+    int r;
+    do {
+        r = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+    } while (r != 0 && errno == EINTR);
+    return r == 0;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
+bool FileHandle::getSize(uint64_t& size) const
+{
+    struct stat st {};
+    if (::fstat(fd, &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+    return true;
+}
+
+void FileHandle::close()
+{
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+bool FileHandle::createAt(const DirHandle& dir, const NativeChar* path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    fd = ::openat(dir.isOpen() ? dir.fd : AT_FDCWD, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    return fd >= 0;
+}
+
+bool FileHandle::openWriteAt(const DirHandle& dir, const NativeChar* path)
+{
+    TelemetryTimer timer(TelemetryHistogram::Open);
+    close();
+    fd = ::openat(dir.isOpen() ? dir.fd : AT_FDCWD, path, O_WRONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+size_t OpenFileLimit()
+{
+    struct rlimit rl {};
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0)
+        return 1024;
+    return rl.rlim_cur == RLIM_INFINITY ? SIZE_MAX : (size_t)rl.rlim_cur;
+}
+
+bool DirHandle::open(const NativeChar* path)
+{
+    close();
+    fd = ::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+bool DirHandle::makeAt(const DirHandle& parent, const NativeChar* path, bool& created)
+{
+    close();
+    int at = parent.isOpen() ? parent.fd : AT_FDCWD;
+    created = ::mkdirat(at, path, 0777) == 0;
+    if (!created && errno != EEXIST)
+        return false;
+    fd = ::openat(at, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+bool DirHandle::isOpen() const { return fd >= 0; }
+
+void DirHandle::close()
+{
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+#endif
+
+bool GetFileInfo(const std::filesystem::path& path, uint64_t& size, int64_t& mtime)
+{
+    std::error_code ec;
+    std::filesystem::directory_entry entry(path, ec);
+    if (ec)
+        return false;
+    return GetFileInfo(entry, size, mtime);
+}
+
+bool GetDeviceId(const std::filesystem::path& path, uint64_t& id)
+{
+    std::error_code ec;
+    std::filesystem::path p = std::filesystem::absolute(path, ec);
+    if (ec)
+        return false;
+
+    for (;;) {
+        if (std::filesystem::exists(p, ec))
+            return QueryDeviceId(p, id);
+        if (!p.has_relative_path())
+            return false;
+        p = p.parent_path();
+    }
+}
+
+bool WriteWholeFile(const std::filesystem::path& path, const uint8_t* src, size_t size)
+{
+    FileHandle f;
+    if (!f.create(path))
+        return false;
+    return f.writeAt(src, 0, size);
+}
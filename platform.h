@@ -0,0 +1,245 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <chrono>
+
+// ------------------------------------------------------------
+// Platform layer: string conversion, file handles, process
+// statistics. Win32 and POSIX implementations live side by side
+// in platform.cpp.
+// ------------------------------------------------------------
+
+// ------------------------------------------------------------
+// Convert an ANSI (Windows: CP_ACP, POSIX: Latin-1) string to
+// UTF-16/UTF-32 std::wstring and back. WAD names are stored in
+// this encoding.
+// ------------------------------------------------------------
+std::wstring ToWideFromAnsi(std::string_view s);
+std::string ToAnsiFromWide(const std::wstring& s);
+
+// ------------------------------------------------------------
+// Convert between std::wstring and UTF-8 (console output and
+// command line arguments)
+// ------------------------------------------------------------
+std::string ToUtf8(const std::wstring& s);
+std::wstring FromUtf8(std::string_view s);
+
+// ------------------------------------------------------------
+// Build a path from a UTF-8 string (command line arguments)
+// ------------------------------------------------------------
+std::filesystem::path PathFromUtf8(const std::string& s);
+
+// ------------------------------------------------------------
+// Path as wide text for log output; never throws, undecodable
+// bytes are replaced
+// ------------------------------------------------------------
+std::wstring PathToDisplay(const std::filesystem::path& path);
+
+// ------------------------------------------------------------
+// Path held by an environment variable; false if it is unset
+// or empty
+// ------------------------------------------------------------
+bool GetEnvPath(const char* name, std::filesystem::path& out);
+
+// ------------------------------------------------------------
+// Character type of native paths (Windows: wchar_t, POSIX:
+// char); hot paths keep them as NUL-terminated strings
+// ------------------------------------------------------------
+using NativeChar = std::filesystem::path::value_type;
+using NativeStringView = std::basic_string_view<NativeChar>;
+
+// ------------------------------------------------------------
+// Turn a WAD entry name ("cars\\tex\\a.tga") into a relative
+// path using the native directory separator
+// ------------------------------------------------------------
+std::filesystem::path WadNameToPath(const std::wstring& nameW);
+
+// ------------------------------------------------------------
+// Fold a path to the file system's case rules so that two
+// paths naming the same file compare equal (Windows: lower
+// case, POSIX: unchanged)
+// ------------------------------------------------------------
+void FoldPathCase(std::filesystem::path::string_type& path);
+void FoldPathCase(NativeChar* path, size_t size);
+
+// ------------------------------------------------------------
+// Monotonic stopwatch started on construction
+// ------------------------------------------------------------
+struct Stopwatch {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+};
+
+// ------------------------------------------------------------
+// Process memory statistics (bytes / counts, 0 = unknown)
+// ------------------------------------------------------------
+struct MemoryStats {
+    uint64_t peakResident = 0;  // Peak working set / max RSS
+    uint64_t peakPrivate = 0;   // Peak private (commit) bytes
+    uint64_t pageFaults = 0;    // Page faults so far
+};
+
+MemoryStats GetMemoryStats();
+
+// ------------------------------------------------------------
+// Reset the peak resident counter so the next GetMemoryStats
+// reports the peak of the following work only (where supported)
+// ------------------------------------------------------------
+void ResetPeakMemory();
+
+// ------------------------------------------------------------
+// Size and last write time of a file (symlinks followed). The
+// time is an opaque tick count, only meaningful for equality
+// checks on the same platform. The directory_entry overload
+// uses the metadata cached by the directory listing where the
+// platform provides it (Windows).
+// ------------------------------------------------------------
+bool GetFileInfo(const std::filesystem::directory_entry& entry, uint64_t& size, int64_t& mtime);
+bool GetFileInfo(const std::filesystem::path& path, uint64_t& size, int64_t& mtime);
+
+// ------------------------------------------------------------
+// Identify the storage device holding a path (POSIX: st_dev,
+// Windows: volume serial number). A path that does not exist
+// yet (an output) is looked up through its nearest existing
+// parent. False if no device can be determined.
+// ------------------------------------------------------------
+bool GetDeviceId(const std::filesystem::path& path, uint64_t& id);
+
+// ------------------------------------------------------------
+// Highest number of descriptors this process may hold open
+// (POSIX: the soft RLIMIT_NOFILE; Windows has no small limit)
+// ------------------------------------------------------------
+size_t OpenFileLimit();
+
+// ------------------------------------------------------------
+// An open directory that files and subdirectories can be
+// created relative to (openat / mkdirat), so the kernel does
+// not resolve the whole path again for each of them.
+// Windows keeps no handle (CreateFileW has no relative form):
+// isOpen() stays false there and callers pass full paths.
+// ------------------------------------------------------------
+struct DirHandle {
+#ifndef _WIN32
+    int fd = -1;                 // POSIX directory descriptor
+#endif
+
+    DirHandle() = default;
+    DirHandle(const DirHandle&) = delete;
+    DirHandle& operator=(const DirHandle&) = delete;
+    ~DirHandle() { close(); }
+
+    // --------------------------------------------------------
+    // Open an existing directory
+    // --------------------------------------------------------
+    bool open(const NativeChar* path);
+
+    // --------------------------------------------------------
+    // Create 'path' (relative to 'parent' when that is open)
+    // unless it exists, and open it. 'created' tells whether
+    // this call made the directory.
+    // --------------------------------------------------------
+    bool makeAt(const DirHandle& parent, const NativeChar* path, bool& created);
+
+    bool isOpen() const;
+    void close();
+};
+
+// ------------------------------------------------------------
+// RAII wrapper for a plain (unmapped) file used for streaming
+// reads and positioned writes
+// ------------------------------------------------------------
+struct FileHandle {
+#ifdef _WIN32
+    void* h = nullptr;           // Win32 file HANDLE
+#else
+    int fd = -1;                 // POSIX file descriptor
+#endif
+
+    FileHandle() = default;
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+    ~FileHandle() { close(); }
+
+    // --------------------------------------------------------
+    // Open an existing file for sequential reading
+    // --------------------------------------------------------
+    bool openRead(const std::filesystem::path& path);
+
+    // --------------------------------------------------------
+    // Create (or truncate) a file for writing
+    // --------------------------------------------------------
+    bool create(const std::filesystem::path& path);
+    bool create(const NativeChar* path);
+    bool createAt(const DirHandle& dir, const NativeChar* path);   // 'path' relative to an open 'dir'
+
+    // --------------------------------------------------------
+    // Open an existing file for writing without truncating it
+    // --------------------------------------------------------
+    bool openWrite(const std::filesystem::path& path);
+    bool openWrite(const NativeChar* path);
+    bool openWriteAt(const DirHandle& dir, const NativeChar* path);
+
+    // --------------------------------------------------------
+    // Take a handle of the process's standard input / output
+    // (a pipe, a terminal or a redirected file; binary, closed
+    // independently of the standard stream)
+    // --------------------------------------------------------
+    bool openStdin();
+    bool openStdout();
+
+    bool isOpen() const;
+
+    // --------------------------------------------------------
+    // Read up to 'size' bytes at the current position. 'got'
+    // receives the number of bytes read (0 at end of file).
+    // --------------------------------------------------------
+    bool read(void* dst, size_t size, size_t& got);
+
+    // --------------------------------------------------------
+    // Read up to 'size' bytes at the given file offset without
+    // moving the position; 'got' as for read()
+    // --------------------------------------------------------
+    bool readAt(void* dst, size_t size, uint64_t offset, size_t& got);
+
+    // --------------------------------------------------------
+    // Write 'size' bytes at the current position (works on
+    // pipes). Returns true when every byte was written.
+    // --------------------------------------------------------
+    bool write(const void* src, size_t size);
+
+    // --------------------------------------------------------
+    // Write 'size' bytes at the given file offset. Returns true
+    // when every byte was written.
+    // --------------------------------------------------------
+    bool writeAt(const void* src, uint64_t offset, size_t size);
+
+    // --------------------------------------------------------
+    // Set the file size (extends with zeros or truncates)
+    // --------------------------------------------------------
+    bool setSize(uint64_t size);
+
+    // --------------------------------------------------------
+    // Reserve disk space for 'size' bytes without changing the
+    // file size or zero-filling (Linux: fallocate KEEP_SIZE,
+    // Windows: allocation size). False if not supported.
+    // --------------------------------------------------------
+    bool preallocate(uint64_t size);
+
+    // --------------------------------------------------------
+    // Current file size, or false if it cannot be queried
+    // --------------------------------------------------------
+    bool getSize(uint64_t& size) const;
+
+    void close();
+};
+
+// ------------------------------------------------------------
+// Create (or truncate) a file and write its whole contents
+// ------------------------------------------------------------
+bool WriteWholeFile(const std::filesystem::path& path, const uint8_t* src, size_t size);
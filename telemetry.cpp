@@ -0,0 +1,274 @@
+﻿#include "telemetry.h"
+#include "platform.h"
+
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdio.h>
+
+std::atomic<bool> g_TelemetryOn{ false };
+
+static const char* const kPhaseNames[] = {
+    "scan", "dedup", "plan", "create_output", "read", "write", "copy_unchanged", "link", "hash",
+    "compress", "decompress",
+};
+static const char* const kCounterNames[] = {
+    "files_read", "bytes_read", "files_written", "bytes_written", "bytes_hashed",
+    "bytes_compressed",
+};
+static const char* const kHistogramNames[] = {
+    "open", "read", "write", "entry_write",
+};
+
+static const size_t kPhases = (size_t)TelemetryPhase::Count;
+static const size_t kCounters = (size_t)TelemetryCounter::Count;
+static const size_t kHistograms = (size_t)TelemetryHistogram::Count;
+static const size_t kBuckets = 64;   // Bucket b holds latencies in [2^(b-1), 2^b) ns
+
+static_assert(sizeof(kPhaseNames) / sizeof(kPhaseNames[0]) == kPhases);
+static_assert(sizeof(kCounterNames) / sizeof(kCounterNames[0]) == kCounters);
+static_assert(sizeof(kHistogramNames) / sizeof(kHistogramNames[0]) == kHistograms);
+
+// ------------------------------------------------------------
+// One recorded span (Chrome trace "complete" event)
+// ------------------------------------------------------------
+struct TelemetryEvent {
+    uint64_t startNs = 0;   // Since StartTelemetry
+    uint64_t durNs = 0;
+    uint8_t phase = 0;
+};
+
+// ------------------------------------------------------------
+// Spans of one thread. Only the owning thread appends; the
+// writers read the buffers once the run is over.
+// ------------------------------------------------------------
+struct TelemetryThread {
+    uint32_t tid = 0;                    // Row in the Chrome trace
+    uint64_t generation = 0;             // StartTelemetry call the buffer belongs to
+    std::string name;                    // Optional thread name
+    std::vector<TelemetryEvent> events;  // Recorded spans
+};
+
+struct TelemetryHistogramData {
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> sumNs{ 0 };
+    std::atomic<uint64_t> maxNs{ 0 };
+};
+
+static std::chrono::steady_clock::time_point g_T0;                 // Start of the run
+static double g_Elapsed = 0;                                       // Run length (set by StopTelemetry)
+static bool g_TraceEvents = false;                                 // Keep spans for the Chrome trace
+static std::atomic<uint64_t> g_PhaseNs[kPhases];                   // Busy time per phase
+static std::atomic<uint64_t> g_PhaseSpans[kPhases];                // Spans per phase
+static std::atomic<uint64_t> g_Counters[kCounters];                // Counter values
+static TelemetryHistogramData g_Histograms[kHistograms];           // Latency histograms
+static MemoryStats g_MemoryStart;                                  // Memory statistics at the start
+static MemoryStats g_MemoryEnd;                                    // ... and at the end
+
+static std::mutex g_ThreadsMutex;                                  // Guards g_Threads
+static std::vector<std::shared_ptr<TelemetryThread>> g_Threads;    // Span buffers of this run
+static std::atomic<uint64_t> g_Generation{ 0 };                    // Bumped by every StartTelemetry
+static thread_local std::shared_ptr<TelemetryThread> t_Thread;     // Buffer of the calling thread
+
+// ------------------------------------------------------------
+// Buffer of the calling thread for the current run; the first
+// call on a thread registers a fresh one
+// ------------------------------------------------------------
+static TelemetryThread& ThreadBuffer()
+{
+    uint64_t generation = g_Generation.load(std::memory_order_acquire);
+    if (!t_Thread || t_Thread->generation != generation) {
+        auto buffer = std::make_shared<TelemetryThread>();
+        buffer->generation = generation;
+        std::lock_guard<std::mutex> lock(g_ThreadsMutex);
+        buffer->tid = (uint32_t)g_Threads.size() + 1;
+        g_Threads.push_back(buffer);
+        t_Thread = std::move(buffer);
+    }
+    return *t_Thread;
+}
+
+void StartTelemetry(bool traceEvents)
+{
+    g_TelemetryOn.store(false);
+
+    for (size_t i = 0; i < kPhases; ++i) {
+        g_PhaseNs[i] = 0;
+        g_PhaseSpans[i] = 0;
+    }
+    for (size_t i = 0; i < kCounters; ++i)
+        g_Counters[i] = 0;
+    for (TelemetryHistogramData& h : g_Histograms) {
+        for (auto& b : h.buckets)
+            b = 0;
+        h.count = 0;
+        h.sumNs = 0;
+        h.maxNs = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_ThreadsMutex);
+        g_Threads.clear();
+    }
+    g_Generation.fetch_add(1, std::memory_order_acq_rel);
+
+    ResetPeakMemory();
+    g_MemoryStart = GetMemoryStats();
+    g_TraceEvents = traceEvents;
+    g_Elapsed = 0;
+    g_T0 = std::chrono::steady_clock::now();
+
+    g_TelemetryOn.store(true);
+}
+
+void StopTelemetry()
+{
+    if (!g_TelemetryOn.exchange(false))
+        return;
+    g_Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - g_T0).count();
+    g_MemoryEnd = GetMemoryStats();
+}
+
+void TelemetryAddSlow(TelemetryCounter counter, uint64_t n)
+{
+    g_Counters[(size_t)counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void TelemetryLatencySlow(TelemetryHistogram histogram, uint64_t ns)
+{
+    TelemetryHistogramData& h = g_Histograms[(size_t)histogram];
+    size_t bucket = std::min<size_t>((size_t)std::bit_width(ns), kBuckets - 1);
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sumNs.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t seen = h.maxNs.load(std::memory_order_relaxed);
+    while (ns > seen && !h.maxNs.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void TelemetrySpanSlow(TelemetryPhase phase, std::chrono::steady_clock::time_point t0,
+    std::chrono::steady_clock::time_point t1)
+{
+    uint64_t dur = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    g_PhaseNs[(size_t)phase].fetch_add(dur, std::memory_order_relaxed);
+    g_PhaseSpans[(size_t)phase].fetch_add(1, std::memory_order_relaxed);
+
+    if (g_TraceEvents) {
+        TelemetryEvent e;
+        e.startNs = t0 > g_T0 ? (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t0 - g_T0).count() : 0;
+        e.durNs = dur;
+        e.phase = (uint8_t)phase;
+        ThreadBuffer().events.push_back(e);
+    }
+}
+
+void TelemetryThreadName(const char* name)
+{
+    if (TelemetryEnabled() && g_TraceEvents)
+        ThreadBuffer().name = name;
+}
+
+// ------------------------------------------------------------
+// Upper bound of the bucket holding the given quantile
+// ------------------------------------------------------------
+static uint64_t HistogramQuantileNs(const TelemetryHistogramData& h, double q)
+{
+    uint64_t count = h.count.load();
+    if (count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (double)(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+        seen += h.buckets[b].load();
+        if (seen >= rank)
+            return std::min<uint64_t>(b == 0 ? 0 : (1ull << std::min<size_t>(b, 63)), h.maxNs.load());
+    }
+    return h.maxNs.load();
+}
+
+bool WriteTelemetryJson(const std::filesystem::path& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "{\n  \"elapsed_s\": %.6f,\n  \"phases\": {\n", g_Elapsed);
+    out << buf;
+    for (size_t i = 0; i < kPhases; ++i) {
+        snprintf(buf, sizeof(buf), "    \"%s\": {\"busy_s\": %.6f, \"spans\": %llu}%s\n",
+            kPhaseNames[i], g_PhaseNs[i].load() / 1e9, (unsigned long long)g_PhaseSpans[i].load(),
+            i + 1 < kPhases ? "," : "");
+        out << buf;
+    }
+
+    out << "  },\n  \"counters\": {\n";
+    for (size_t i = 0; i < kCounters; ++i) {
+        snprintf(buf, sizeof(buf), "    \"%s\": %llu%s\n",
+            kCounterNames[i], (unsigned long long)g_Counters[i].load(), i + 1 < kCounters ? "," : "");
+        out << buf;
+    }
+
+    out << "  },\n  \"latency_us\": {\n";
+    for (size_t i = 0; i < kHistograms; ++i) {
+        const TelemetryHistogramData& h = g_Histograms[i];
+        uint64_t count = h.count.load();
+        snprintf(buf, sizeof(buf),
+            "    \"%s\": {\"count\": %llu, \"mean\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f, \"log2_ns_buckets\": [",
+            kHistogramNames[i], (unsigned long long)count,
+            count ? h.sumNs.load() / 1e3 / (double)count : 0.0,
+            HistogramQuantileNs(h, 0.50) / 1e3, HistogramQuantileNs(h, 0.90) / 1e3,
+            HistogramQuantileNs(h, 0.99) / 1e3, h.maxNs.load() / 1e3);
+        out << buf;
+
+        size_t last = 0;
+        for (size_t b = 0; b < kBuckets; ++b) {
+            if (h.buckets[b].load() != 0)
+                last = b + 1;
+        }
+        for (size_t b = 0; b < last; ++b)
+            out << (b ? ", " : "") << h.buckets[b].load();
+        out << "]}" << (i + 1 < kHistograms ? "," : "") << '\n';
+    }
+
+    snprintf(buf, sizeof(buf),
+        "  },\n  \"memory\": {\"peak_rss_bytes\": %llu, \"peak_private_bytes\": %llu, \"page_faults\": %llu}\n}\n",
+        (unsigned long long)g_MemoryEnd.peakResident, (unsigned long long)g_MemoryEnd.peakPrivate,
+        (unsigned long long)(g_MemoryEnd.pageFaults - g_MemoryStart.pageFaults));
+    out << buf;
+    return (bool)out.flush();
+}
+
+bool WriteChromeTrace(const std::filesystem::path& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(g_ThreadsMutex);
+
+    char buf[256];
+    bool first = true;
+    out << "{\"traceEvents\": [\n";
+    for (const auto& t : g_Threads) {
+        std::string name = t->name.empty() ? "thread " + std::to_string(t->tid) : t->name;
+        snprintf(buf, sizeof(buf),
+            "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+            first ? "" : ",\n", t->tid, name.c_str());
+        out << buf;
+        first = false;
+
+        for (const TelemetryEvent& e : t->events) {
+            snprintf(buf, sizeof(buf),
+                ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                kPhaseNames[e.phase], t->tid, e.startNs / 1e3, e.durNs / 1e3);
+            out << buf;
+        }
+    }
+    out << "\n]}\n";
+    return (bool)out.flush();
+}
@@ -0,0 +1,149 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// Built-in instrumentation for pack / extract / verify runs:
+//  - phase timers (busy time and span count per phase)
+//  - byte and file counters
+//  - log2 latency histograms for per-file operations
+//  - peak RSS / page faults at the end of the run
+// Off by default; when off, every hook costs one relaxed load.
+// When on, counters and histograms are single relaxed atomic
+// adds; span events for the Chrome trace go to a per-thread
+// buffer (no lock after the thread's first span).
+// ------------------------------------------------------------
+
+enum class TelemetryPhase {
+    Scan,            // Folder walk / manifest
+    Dedup,           // Duplicate detection
+    Plan,            // Layout, table, extraction plan
+    CreateOutput,    // Creating / sizing / mapping the output
+    Read,            // Reading source files
+    Write,           // Writing data to the output
+    CopyUnchanged,   // Copying entries from the previous WAD
+    Link,            // Hard links
+    Hash,            // Hashing entries (verify, read-back)
+    Compress,        // Compressing blocks (compressed WADs)
+    Decompress,      // Decoding blocks (compressed WADs)
+    Count
+};
+
+enum class TelemetryCounter {
+    FilesRead,
+    BytesRead,
+    FilesWritten,
+    BytesWritten,
+    BytesHashed,
+    BytesCompressed, // Stored size of compressed blocks
+    Count
+};
+
+enum class TelemetryHistogram {
+    Open,            // FileHandle open / create
+    Read,            // FileHandle read
+    Write,           // FileHandle positioned write
+    EntryWrite,      // One extracted entry, open to close
+    Count
+};
+
+// ------------------------------------------------------------
+// Reset all data and switch recording on. 'traceEvents' also
+// keeps every span for WriteChromeTrace.
+// ------------------------------------------------------------
+void StartTelemetry(bool traceEvents);
+
+// ------------------------------------------------------------
+// Switch recording off (the data stays for the writers below)
+// ------------------------------------------------------------
+void StopTelemetry();
+
+// ------------------------------------------------------------
+// Write the JSON summary / the Chrome trace-event file (one
+// row per thread, open in chrome://tracing or Perfetto)
+// ------------------------------------------------------------
+bool WriteTelemetryJson(const std::filesystem::path& path);
+bool WriteChromeTrace(const std::filesystem::path& path);
+
+// ------------------------------------------------------------
+// Hooks for the engines
+// ------------------------------------------------------------
+extern std::atomic<bool> g_TelemetryOn;
+
+inline bool TelemetryEnabled()
+{
+    return g_TelemetryOn.load(std::memory_order_relaxed);
+}
+
+void TelemetryAddSlow(TelemetryCounter counter, uint64_t n);
+void TelemetryLatencySlow(TelemetryHistogram histogram, uint64_t ns);
+void TelemetrySpanSlow(TelemetryPhase phase, std::chrono::steady_clock::time_point t0,
+    std::chrono::steady_clock::time_point t1);
+
+inline void TelemetryAdd(TelemetryCounter counter, uint64_t n)
+{
+    if (TelemetryEnabled())
+        TelemetryAddSlow(counter, n);
+}
+
+// ------------------------------------------------------------
+// Name the calling thread in the Chrome trace ("reader", ...)
+// ------------------------------------------------------------
+void TelemetryThreadName(const char* name);
+
+// ------------------------------------------------------------
+// RAII phase timer: one span of 'phase' on the calling thread,
+// ended by end() or the destructor
+// ------------------------------------------------------------
+class TelemetrySpan {
+public:
+    explicit TelemetrySpan(TelemetryPhase phase) : m_phase(phase), m_on(TelemetryEnabled())
+    {
+        if (m_on)
+            m_t0 = std::chrono::steady_clock::now();
+    }
+    ~TelemetrySpan() { end(); }
+
+    void end()
+    {
+        if (m_on)
+            TelemetrySpanSlow(m_phase, m_t0, std::chrono::steady_clock::now());
+        m_on = false;
+    }
+    TelemetrySpan(const TelemetrySpan&) = delete;
+    TelemetrySpan& operator=(const TelemetrySpan&) = delete;
+
+private:
+    TelemetryPhase m_phase;
+    bool m_on;
+    std::chrono::steady_clock::time_point m_t0;
+};
+
+// ------------------------------------------------------------
+// RAII latency sample for one operation
+// ------------------------------------------------------------
+class TelemetryTimer {
+public:
+    explicit TelemetryTimer(TelemetryHistogram histogram) : m_histogram(histogram), m_on(TelemetryEnabled())
+    {
+        if (m_on)
+            m_t0 = std::chrono::steady_clock::now();
+    }
+    ~TelemetryTimer()
+    {
+        if (m_on) {
+            TelemetryLatencySlow(m_histogram, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_t0).count());
+        }
+    }
+    TelemetryTimer(const TelemetryTimer&) = delete;
+    TelemetryTimer& operator=(const TelemetryTimer&) = delete;
+
+private:
+    TelemetryHistogram m_histogram;
+    bool m_on;
+    std::chrono::steady_clock::time_point m_t0;
+};
@@ -0,0 +1,247 @@
+﻿#pragma once
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+// ------------------------------------------------------------
+// Work-stealing thread pool
+//  - every worker owns a task deque
+//  - the owner pops from the front, idle workers steal from
+//    the back of another worker's deque
+//  - tasks submitted from a worker go to that worker's deque,
+//    tasks submitted from outside are spread round-robin
+// ------------------------------------------------------------
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    // --------------------------------------------------------
+    // Start the requested number of workers (0 = one per core)
+    // --------------------------------------------------------
+    explicit ThreadPool(unsigned threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = DefaultThreadCount();
+
+        m_queues.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i)
+            m_queues.push_back(std::make_unique<WorkerQueue>());
+
+        m_threads.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i)
+            m_threads.emplace_back([this, i] { WorkerLoop(i); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // --------------------------------------------------------
+    // Drain outstanding tasks and join all workers
+    // --------------------------------------------------------
+    ~ThreadPool()
+    {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_stop = true;
+        }
+        m_wakeCv.notify_all();
+        for (auto& t : m_threads)
+            t.join();
+    }
+
+    unsigned size() const { return (unsigned)m_threads.size(); }
+
+    // --------------------------------------------------------
+    // Number of hardware threads, never less than one
+    // --------------------------------------------------------
+    static unsigned DefaultThreadCount()
+    {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+    // --------------------------------------------------------
+    // Queue a task for execution on any worker
+    // --------------------------------------------------------
+    void submit(Task task)
+    {
+        size_t q = (t_workerIndex >= 0 && t_owner == this)
+            ? (size_t)t_workerIndex
+            : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+        m_pending.fetch_add(1, std::memory_order_acq_rel);
+        {
+            std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+            m_queues[q]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            ++m_wakeSeq;
+        }
+        m_wakeCv.notify_one();
+    }
+
+    // --------------------------------------------------------
+    // Block until every submitted task has finished
+    // --------------------------------------------------------
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_doneMutex);
+        m_doneCv.wait(lock, [this] { return m_pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    // --------------------------------------------------------
+    // Wait up to 'timeout' for all tasks to finish. Returns
+    // true when the pool is idle (lets the caller poll progress)
+    // --------------------------------------------------------
+    bool waitFor(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_doneMutex);
+        return m_doneCv.wait_for(lock, timeout,
+            [this] { return m_pending.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // --------------------------------------------------------
+    // Take the next task: own queue first (front), then steal
+    // from the back of the other workers' queues
+    // --------------------------------------------------------
+    bool TryTake(unsigned self, Task& out)
+    {
+        {
+            WorkerQueue& own = *m_queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                out = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+
+        size_t n = m_queues.size();
+        for (size_t k = 1; k < n; ++k) {
+            WorkerQueue& victim = *m_queues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                out = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(unsigned index)
+    {
+        t_workerIndex = (int)index;
+        t_owner = this;
+
+        for (;;) {
+            uint64_t seq;
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                seq = m_wakeSeq;
+            }
+
+            Task task;
+            if (TryTake(index, task)) {
+                task();
+                task = nullptr;
+
+                if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    std::lock_guard<std::mutex> lock(m_doneMutex);
+                    m_doneCv.notify_all();
+                }
+                continue;
+            }
+
+            // ------------------------------------------------
+            // Nothing to run or steal: sleep until a new task
+            // is submitted (or the pool shuts down)
+            // ------------------------------------------------
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCv.wait(lock, [&] { return m_stop || m_wakeSeq != seq; });
+            if (m_stop)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;  // One deque per worker
+    std::vector<std::thread> m_threads;                  // Worker threads
+    std::atomic<size_t> m_nextQueue{ 0 };                // Round-robin cursor for external submits
+    std::atomic<size_t> m_pending{ 0 };                  // Submitted but not yet finished tasks
+
+    std::mutex m_wakeMutex;                              // Guards m_wakeSeq / m_stop
+    std::condition_variable m_wakeCv;                    // Wakes idle workers
+    uint64_t m_wakeSeq = 0;                              // Bumped on every submit
+    bool m_stop = false;                                 // Set once on shutdown
+
+    std::mutex m_doneMutex;                              // Guards completion waits
+    std::condition_variable m_doneCv;                    // Signalled when m_pending hits zero
+
+    static inline thread_local int t_workerIndex = -1;          // Index of the current worker
+    static inline thread_local const ThreadPool* t_owner = nullptr;  // Pool owning the current worker
+};
+
+// ------------------------------------------------------------
+// The tasks one caller submitted to a (shared) pool: several
+// operations can feed the same workers and each one waits only
+// for its own tasks. Must not be waited on from a worker of the
+// same pool.
+// ------------------------------------------------------------
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool) : m_pool(pool) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup() { wait(); }
+
+    void submit(ThreadPool::Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_doneMutex);
+            ++m_pending;
+        }
+        m_pool.submit([this, task = std::move(task)] {
+            task();
+            // Count down under the lock: the waiter may destroy
+            // the group as soon as it sees zero
+            std::lock_guard<std::mutex> lock(m_doneMutex);
+            if (--m_pending == 0)
+                m_doneCv.notify_all();
+        });
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_doneMutex);
+        m_doneCv.wait(lock, [this] { return m_pending == 0; });
+    }
+
+    bool waitFor(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_doneMutex);
+        return m_doneCv.wait_for(lock, timeout, [this] { return m_pending == 0; });
+    }
+
+private:
+    ThreadPool& m_pool;
+    size_t m_pending = 0;                    // Submitted but not yet finished tasks
+    std::mutex m_doneMutex;                  // Guards m_pending
+    std::condition_variable m_doneCv;        // Signalled when m_pending hits zero
+};
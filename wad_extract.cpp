@@ -0,0 +1,1071 @@
+﻿#include "wad_extract.h"
+#include "wad_format.h"
+#include "wad_trie.h"
+#include "wad_names.h"
+#include "mapped_file.h"
+#include "copy_engine.h"
+#include "batch_io.h"
+#include "platform.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "bounded_queue.h"
+#include "telemetry.h"
+#include "job.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <string.h>
+
+// ------------------------------------------------------------
+// One WAD entry scheduled for extraction
+// ------------------------------------------------------------
+struct ExtractEntry {
+    const NativeChar* outPath = nullptr;  // Full output path on disk (in the plan's name arena)
+    const NativeChar* fileName = nullptr; // Last component of outPath
+    std::string_view name;         // Entry name as stored in the table (for logging)
+    size_t dir = 0;                // Output directory (ExtractTree::dirs)
+    uint32_t index = 0;            // Table index of the entry
+    uint64_t offset = 0;           // Entry data offset in the WAD
+    uint64_t size = 0;             // Entry data size in bytes
+    int64_t linkTo = -1;           // Planned entry to hard-link to instead of writing
+};
+
+// ------------------------------------------------------------
+// A unit of work for the extraction pool: a contiguous run of
+// planned entries whose total size is roughly kExtractBatchBytes
+// (a single entry larger than that forms its own batch; in a
+// compressed WAD it is cut into block ranges of that size, which
+// decode in parallel into the pre-sized file)
+// ------------------------------------------------------------
+struct ExtractBatch {
+    size_t first = 0;         // Index of the first entry in the batch
+    size_t count = 0;         // Number of entries in the batch
+    uint64_t bytes = 0;       // Total payload bytes in the batch
+    uint64_t firstBlock = 0;  // Block range of one entry (compressed WADs) ...
+    uint64_t blockCount = 0;  // ... or 0 for whole entries
+};
+
+static const uint64_t kExtractBatchBytes = 4ull * 1024 * 1024;  // Target bytes per batch
+static const size_t   kExtractBatchFiles = 256;                 // Max entries per batch
+
+// ------------------------------------------------------------
+// One directory of the output tree (index 0 is the output
+// directory itself); paths are NUL-terminated strings in the
+// plan's name arena
+// ------------------------------------------------------------
+struct ExtractDir {
+    NativeStringView path;              // Full path
+    const NativeChar* name = nullptr;   // Last component of path
+    size_t parent = 0;                  // Parent directory
+    size_t firstChild = SIZE_MAX;       // First subdirectory
+    size_t nextSibling = SIZE_MAX;      // Next subdirectory of the same parent
+    size_t files = 0;                   // Planned entries directly inside
+    bool ok = false;                    // Exists (created or found)
+    bool created = false;               // Made by this run (removed on cancel)
+};
+
+// ------------------------------------------------------------
+// The output tree and a handle per directory. Files are opened
+// relative to their directory's handle; a handle stays open
+// only for directories that receive files, while the budget of
+// descriptors lasts (the others are reached by full path).
+// ------------------------------------------------------------
+struct ExtractTree {
+    std::vector<ExtractDir> dirs;
+    std::vector<DirHandle> handles;
+    std::atomic<int64_t> budget{ 0 };   // Directory handles that may still stay open
+};
+
+static const size_t kExtractTreeParallelDirs = 64;   // Smaller trees are created on one thread
+static const size_t kExtractStreamBytes = 1024 * 1024;   // Read size from a stream
+
+// ------------------------------------------------------------
+// A WAD read front to back from standard input: the header +
+// table are kept, the data is consumed as it goes by
+// ------------------------------------------------------------
+struct WadStream {
+    FileHandle in;
+    std::vector<uint8_t> head;   // Header + table
+    uint64_t pos = 0;            // Stream offset of the next byte
+};
+
+// ------------------------------------------------------------
+// Read exactly 'size' bytes from the stream (false at an early
+// end or on a read error)
+// ------------------------------------------------------------
+static bool ReadStream(WadStream& s, void* dst, size_t size)
+{
+    uint8_t* p = static_cast<uint8_t*>(dst);
+    while (size > 0) {
+        size_t got = 0;
+        if (!s.in.read(p, size, got) || got == 0)
+            return false;
+        p += got;
+        size -= got;
+        s.pos += got;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Read and drop stream bytes up to 'offset' (UINT64_MAX: to
+// the end of the stream)
+// ------------------------------------------------------------
+static bool SkipStream(WadStream& s, uint64_t offset, std::vector<uint8_t>& scratch)
+{
+    while (s.pos < offset) {
+        size_t got = 0;
+        size_t want = (size_t)std::min<uint64_t>(offset - s.pos, scratch.size());
+        if (!s.in.read(scratch.data(), want, got) || got == 0)
+            return offset == UINT64_MAX;
+        s.pos += got;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Take standard input and read the header + table from it: the
+// header first, which gives the table size, then the table,
+// read in growing steps so a corrupt count fails at the end of
+// the stream instead of reserving memory for it
+// ------------------------------------------------------------
+static bool OpenWadStream(WadStream& s, WadView& wad, const wchar_t** error)
+{
+    *error = L"Invalid WAD file.";
+    if (!s.in.openStdin()) {
+        *error = L"Failed to read standard input.";
+        return false;
+    }
+
+    s.head.resize(sizeof(WadHeader));
+    if (!ReadStream(s, s.head.data(), s.head.size()))
+        return false;
+
+    const uint32_t first = reinterpret_cast<const WadHeader*>(s.head.data())->fileCount;
+    uint64_t headBytes = WadTableBytes(WadFormat::Classic, first);
+    if (first == kWadLzMagic) {
+        *error = L"Compressed WADs cannot be read from a stream.";
+        return false;
+    }
+    if (first == kWad64Magic) {
+        s.head.resize(sizeof(Wad64Header));
+        if (!ReadStream(s, s.head.data() + sizeof(WadHeader), sizeof(Wad64Header) - sizeof(WadHeader)))
+            return false;
+        headBytes = WadTableBytes(WadFormat::Wad64, reinterpret_cast<const Wad64Header*>(s.head.data())->fileCount);
+    }
+
+    while (s.head.size() < headBytes) {
+        size_t have = s.head.size();
+        size_t step = (size_t)std::min<uint64_t>(headBytes - have, std::max<size_t>(have, kExtractStreamBytes));
+        s.head.resize(have + step);
+        if (!ReadStream(s, s.head.data() + have, step)) {
+            *error = L"Invalid WAD: header/table exceeds file size.";
+            return false;
+        }
+    }
+
+    return OpenWadHead(s.head.data(), s.head.size(), wad, error);
+}
+
+// ------------------------------------------------------------
+// Index of the tree directory for 'path' (a prefix of an output
+// path), adding it and any missing ancestors. Empty and "."
+// components resolve to their parent.
+// ------------------------------------------------------------
+static size_t AddOutputDir(ExtractTree& tree, NameIndex<NativeChar>& byPath, NameArena& arena, NativeStringView path)
+{
+    if (path.size() <= tree.dirs[0].path.size())
+        return 0;
+    if (const size_t* d = byPath.find(path))
+        return *d;
+
+    size_t up = ParentPathLength(path);
+    size_t parent = AddOutputDir(tree, byPath, arena, path.substr(0, up));
+    NativeStringView name = path.substr(up == 0 ? 0 : up + 1);
+    if (name.empty() || (name.size() == 1 && name[0] == '.')) {
+        byPath.tryEmplace(path, parent);
+        return parent;
+    }
+
+    // 'path' is a prefix of a longer string: keep a terminated copy
+    NativeChar* copy = arena.alloc<NativeChar>(path.size() + 1);
+    std::copy(path.begin(), path.end(), copy);
+    copy[path.size()] = 0;
+
+    ExtractDir dir;
+    dir.path = NativeStringView(copy, path.size());
+    dir.name = copy + (name.data() - path.data());
+    dir.parent = parent;
+    dir.nextSibling = tree.dirs[parent].firstChild;
+
+    size_t index = tree.dirs.size();
+    tree.dirs[parent].firstChild = index;
+    tree.dirs.push_back(dir);
+    byPath.tryEmplace(dir.path, index);
+    return index;
+}
+
+// ------------------------------------------------------------
+// Create directory 'd' relative to its parent's handle, then
+// its subtree, depth first
+// ------------------------------------------------------------
+static void CreateDirSubtree(ExtractTree& tree, size_t d)
+{
+    ExtractDir& dir = tree.dirs[d];
+    const DirHandle& parent = tree.handles[dir.parent];
+    DirHandle& handle = tree.handles[d];
+
+    bool created = false;
+    dir.ok = handle.makeAt(parent, parent.isOpen() ? dir.name : dir.path.data(), created);
+    if (!dir.ok) {
+        // Out of descriptors (or no relative form): by full path, without a handle
+        std::error_code ec;
+        std::filesystem::path p(dir.path);
+        created = std::filesystem::create_directories(p, ec) || created;
+        dir.ok = !ec && std::filesystem::is_directory(p, ec);
+    }
+    dir.created = created;
+    if (!dir.ok)
+        return;
+
+    for (size_t c = dir.firstChild; c != SIZE_MAX; c = tree.dirs[c].nextSibling)
+        CreateDirSubtree(tree, c);
+
+    if (dir.files == 0 || tree.budget.fetch_sub(1) <= 0)
+        handle.close();
+}
+
+// ------------------------------------------------------------
+// Path to open an entry's file with: relative to its directory
+// where that is held open, else the full path
+// ------------------------------------------------------------
+static const NativeChar* EntryOpenPath(const ExtractTree& tree, const ExtractEntry& e)
+{
+    return tree.handles[e.dir].isOpen() ? e.fileName : e.outPath;
+}
+
+// ------------------------------------------------------------
+// Replace 'target' with a hard link to 'existing'
+// ------------------------------------------------------------
+static bool ReplaceWithHardLink(const std::filesystem::path& existing, const std::filesystem::path& target)
+{
+    std::error_code ec;
+    std::filesystem::remove(target, ec);
+    std::filesystem::create_hard_link(existing, target, ec);
+    return !ec;
+}
+
+// ------------------------------------------------------------
+// Undo a cancelled extraction: remove the files this run wrote
+// (or started to write), then the directories it created, from
+// the deepest up, as long as they are empty. Returns the number
+// of files removed.
+// ------------------------------------------------------------
+static size_t RemovePartialOutput(const std::vector<ExtractEntry>& entries, const std::vector<uint8_t>& touched,
+    std::vector<std::filesystem::path> newDirs, const std::filesystem::path& outDir, bool removeOutDir)
+{
+    std::error_code ec;
+    size_t removed = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (touched[i] && std::filesystem::remove(entries[i].outPath, ec))
+            removed++;
+    }
+
+    std::sort(newDirs.begin(), newDirs.end(), [](const auto& a, const auto& b) {
+        return a.native().size() > b.native().size();
+    });
+    for (const auto& dir : newDirs) {
+        for (std::filesystem::path d = dir; d != outDir && d.has_relative_path(); d = d.parent_path()) {
+            if (!std::filesystem::remove(d, ec))
+                break;   // Not empty (or already gone)
+        }
+    }
+    if (removeOutDir)
+        std::filesystem::remove(outDir, ec);
+    return removed;
+}
+
+// ------------------------------------------------------------
+// Read a filter list: one entry name or pattern per line
+// (UTF-8, '#' starts a comment line)
+// ------------------------------------------------------------
+static bool ReadFilterList(const std::filesystem::path& listPath, std::vector<std::wstring>& filters)
+{
+    std::ifstream in(listPath, std::ios::binary);
+    if (!in)
+        return false;
+
+    std::string line;
+    bool first = true;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (first && line.size() >= 3 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            line.erase(0, 3);
+        first = false;
+        if (line.empty() || line[0] == '#')
+            continue;
+        filters.push_back(FromUtf8(line));
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Resolve the filters through a directory trie of the WAD and
+// return the selected table indices in table order
+// ------------------------------------------------------------
+static std::vector<uint32_t> SelectEntries(const WadView& wad, const std::vector<std::wstring>& filters)
+{
+    WadTrie trie;
+    trie.build(wad);
+
+    std::vector<uint32_t> selected;
+    for (const std::wstring& f : filters) {
+        if (!trie.match(ToAnsiFromWide(f), selected))
+            LogBuffered(L"No entries match: " + f);
+    }
+
+    std::sort(selected.begin(), selected.end());
+    selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+    return selected;
+}
+
+// ------------------------------------------------------------
+// Compressed WADs: decode blocks [first, first + count) of an
+// entry into its output file at their offsets
+// ------------------------------------------------------------
+static bool WriteDecodedBlocks(FileHandle& out, MappedWindow& window, const WadView& wad,
+    uint32_t index, uint64_t first, uint64_t count)
+{
+    thread_local std::vector<uint8_t> scratch;
+    return DecodeWadBlocks(window, wad, index, first, count, scratch,
+        [&out](const uint8_t* data, size_t size, uint64_t offset) { return out.writeAt(data, offset, size); });
+}
+
+// ------------------------------------------------------------
+// Queue read-ahead for the data of a run of planned entries,
+// merging entries that (nearly) touch in the WAD into one
+// request, so the copies that follow rarely wait on a fault
+// ------------------------------------------------------------
+static void PrefetchRun(MappedWindow& window, const std::vector<ExtractEntry>& entries,
+    size_t first, size_t count)
+{
+    const uint64_t kMergeGap = 64 * 1024;
+
+    uint64_t start = 0;
+    uint64_t end = 0;
+    for (size_t i = first; i < first + count; ++i) {
+        const ExtractEntry& e = entries[i];
+        if (e.linkTo >= 0 || e.size == 0)
+            continue;
+        if (end > start && e.offset >= start && e.offset <= end + kMergeGap) {
+            end = std::max(end, e.offset + e.size);
+            continue;
+        }
+        window.prefetch(start, end - start);
+        start = e.offset;
+        end = e.offset + e.size;
+    }
+    window.prefetch(start, end - start);
+}
+
+// ------------------------------------------------------------
+// Stream mode: write the planned entries (links aside) from the
+// WAD data arriving on the stream, in offset order
+//  - gaps between entries are read and dropped
+//  - entries whose ranges overlap (shared data of dedup packs,
+//    a range inside another) form a group; an entry that
+//    overlaps no other is a group of its own
+//  - a group's span goes through one read buffer a chunk at a
+//    time, each chunk written into every member it covers, so
+//    memory stays at one buffer whatever the group's size
+// The rest of the stream is drained, so the writer feeding the
+// pipe does not fail. Returns false when the stream ended early.
+// ------------------------------------------------------------
+static bool StreamEntries(WadStream& stream, const std::vector<ExtractEntry>& entries, const ExtractTree& tree,
+    std::vector<uint8_t>& failed, std::vector<uint8_t>& touched, const std::atomic<bool>* cancel)
+{
+    TelemetrySpan span(TelemetryPhase::Write);
+
+    std::vector<size_t> order;
+    order.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].linkTo < 0)
+            order.push_back(i);
+    }
+    // Empty entries need no data: they go first
+    std::stable_sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+        const ExtractEntry& x = entries[a];
+        const ExtractEntry& y = entries[b];
+        return x.size != 0 && y.size != 0 ? x.offset < y.offset : x.size < y.size;
+    });
+
+    auto finish = [&](size_t i, bool ok) {
+        if (!ok) {
+            failed[i] = 1;
+            return;
+        }
+        TelemetryAdd(TelemetryCounter::FilesWritten, 1);
+        TelemetryAdd(TelemetryCounter::BytesWritten, entries[i].size);
+    };
+
+    std::vector<uint8_t> buffer(kExtractStreamBytes);
+    size_t next = 0;
+    bool ended = false;
+
+    while (next < order.size() && !IsCancelled(cancel)) {
+        const ExtractEntry& e = entries[order[next]];
+
+        // --------------------------------------------------------
+        // The group: this entry and those starting inside the
+        // ranges collected so far
+        // --------------------------------------------------------
+        uint64_t end = e.offset + e.size;
+        size_t last = next + 1;
+        while (last < order.size() && e.size > 0 && entries[order[last]].offset < end) {
+            end = std::max(end, entries[order[last]].offset + entries[order[last]].size);
+            last++;
+        }
+
+        if (e.size > 0 && !SkipStream(stream, e.offset, buffer)) {
+            ended = true;
+            break;
+        }
+
+        // --------------------------------------------------------
+        // Open every member, then pass the group's span through
+        // one buffer a chunk at a time, writing each chunk into
+        // the members it covers
+        // --------------------------------------------------------
+        TelemetryTimer timer(TelemetryHistogram::EntryWrite);
+        size_t members = last - next;
+        std::vector<FileHandle> outs(members);
+        std::vector<uint8_t> ok(members, 0);
+        for (size_t k = 0; k < members; ++k) {
+            const ExtractEntry& g = entries[order[next + k]];
+            touched[order[next + k]] = 1;
+            ok[k] = outs[k].createAt(tree.handles[g.dir], EntryOpenPath(tree, g));
+        }
+
+        for (uint64_t pos = e.offset; pos < end; ) {
+            size_t n = (size_t)std::min<uint64_t>(end - pos, buffer.size());
+            if (!ReadStream(stream, buffer.data(), n)) {
+                ended = true;
+                break;
+            }
+            for (size_t k = 0; k < members; ++k) {
+                const ExtractEntry& g = entries[order[next + k]];
+                if (g.offset >= pos + n)
+                    break;   // Members are in offset order
+                uint64_t from = std::max(pos, g.offset);
+                uint64_t to = std::min(pos + n, g.offset + g.size);
+                if (from >= to)
+                    continue;
+                if (ok[k])
+                    ok[k] = outs[k].writeAt(buffer.data() + (from - pos), from - g.offset, (size_t)(to - from));
+                AddProgress(to - from);
+            }
+            pos += n;
+            if (IsCancelled(cancel))
+                break;
+        }
+        if (ended)
+            break;
+        for (size_t k = 0; k < members; ++k)
+            finish(order[next + k], ok[k] != 0);
+
+        next = last;
+        PumpProgress();
+    }
+
+    if (ended) {
+        for (; next < order.size(); ++next)
+            failed[order[next]] = 1;
+        return false;
+    }
+    if (!IsCancelled(cancel))
+        SkipStream(stream, UINT64_MAX, buffer);
+    return true;
+}
+
+bool ExtractWad(const std::filesystem::path& wadPath, const ExtractOptions& options)
+{
+    Stopwatch timer;
+
+    Log(L"Reading WAD header");
+    SetProgress(0);
+
+    // ------------------------------------------------------------
+    // 1. Open and memory-map the WAD file for read-only access
+    //    (with a window: the table only, entry data is mapped a
+    //    window at a time by each writer); from standard input,
+    //    read just the header + table, the data follows later
+    // 2. Validate header, table and every entry's data range
+    // ------------------------------------------------------------
+    const bool streamed = options.fromStdin;
+    if (streamed && options.outDir.empty()) {
+        ShowError(L"Extracting from standard input needs an output directory.");
+        return false;
+    }
+
+    MappedFile mf;
+    WadStream stream;
+    WadView wad;
+    const wchar_t* error = nullptr;
+    if (streamed ? !OpenWadStream(stream, wad, &error) : !OpenWadFile(wadPath, options.map, mf, wad, &error)) {
+        ShowError(error);
+        return false;
+    }
+
+    Log(std::to_wstring(wad.fileCount) + L" files found" +
+        (wad.format == WadFormat::Wad64 ? L" (WAD64)" : wad.compressed() ? L" (compressed)" : L""));
+
+    // ------------------------------------------------------------
+    // 3. Apply the entry filters, if any
+    // ------------------------------------------------------------
+    std::vector<std::wstring> filters = options.filters;
+    if (!options.filterList.empty() && !ReadFilterList(options.filterList, filters)) {
+        ShowError(L"Failed to read filter list.");
+        return false;
+    }
+
+    bool filtered = !filters.empty();
+    std::vector<uint32_t> selected;
+    if (filtered) {
+        selected = SelectEntries(wad, filters);
+        AppendBufferedLog();
+        if (selected.empty()) {
+            ShowError(L"No entries match the filters.");
+            return false;
+        }
+        Log(std::to_wstring(selected.size()) + L" of " + std::to_wstring(wad.fileCount) + L" files selected");
+    }
+    size_t planCount = filtered ? selected.size() : wad.fileCount;
+
+    // ------------------------------------------------------------
+    // 4. Determine and prepare the output directory:
+    //    <wad directory>\<wad file name without extension>
+    // ------------------------------------------------------------
+    std::filesystem::path outDir = options.outDir;
+    if (outDir.empty())
+        outDir = wadPath.parent_path() / wadPath.stem();
+
+    bool createdOutDir = false;
+    if (std::filesystem::exists(outDir)) {
+        if (!ConfirmOverwrite(PathToDisplay(outDir))) {
+            Log(L"Extraction cancelled");
+            return false;
+        }
+    }
+    else {
+        std::error_code ec;
+        std::filesystem::create_directories(outDir, ec);
+        if (ec) {
+            ShowError(L"Failed to create output directory.");
+            return false;
+        }
+        createdOutDir = true;
+    }
+
+    Log(L"Extracting...");
+
+    // ------------------------------------------------------------
+    // 5. Plan the extraction on this thread:
+    //    - skip entries whose name would leave the output folder
+    //      ("..", a root or drive prefix; counted as failed)
+    //    - decode names and build output paths in a name arena
+    //      (no heap allocation per entry)
+    //    - collect the directory tree
+    //    - when several entries map to the same file, keep only
+    //      the last one (the serial path overwrote earlier ones,
+    //      concurrent writers must not race on the same file)
+    // ------------------------------------------------------------
+    TelemetrySpan planSpan(TelemetryPhase::Plan);
+    NameArena names;
+    const NativeStringView outDirNative = outDir.native();
+
+    ExtractTree tree;
+    tree.dirs.push_back(ExtractDir{ outDirNative });
+    NameIndex<NativeChar> dirByPath;
+    NativeStringView lastParent;
+    size_t lastDir = 0;
+
+    std::vector<ExtractEntry> entries;
+    entries.reserve(planCount);
+
+    NameIndex<NativeChar> entryByPath;
+    entryByPath.reserve(planCount);
+    size_t unsafe = 0;
+
+    for (size_t k = 0; k < planCount; ++k) {
+        if ((k & 4095) == 0 && IsCancelled(options.cancel))
+            break;
+
+        uint32_t index = (uint32_t)(filtered ? selected[k] : k);
+        std::string_view name = wad.entryName(index);
+        if (!IsSafeWadName(name)) {
+            LogBuffered(L"Unsafe entry name, skipped: " + ToWideFromAnsi(name));
+            unsafe++;
+            continue;
+        }
+        NativeStringView outPath = JoinWadName(names, outDirNative, name);
+        NativeStringView parent = outPath.substr(0, ParentPathLength(outPath));
+
+        // Entries of one directory usually follow each other
+        if (parent != lastParent) {
+            lastDir = AddOutputDir(tree, dirByPath, names, parent);
+            lastParent = parent;
+        }
+        tree.dirs[lastDir].files++;
+
+        if (LogLevelEnabled(LogLevel::Files))
+            LogBuffered(L"Extracting: " + ToWideFromAnsi(name));
+
+        ExtractEntry e;
+        e.outPath = outPath.data();
+        e.fileName = outPath.data() + parent.size() + 1;
+        e.name = name;
+        e.dir = lastDir;
+        e.index = index;
+        e.offset = wad.entryOffset(index);
+        e.size = wad.entrySize(index);
+
+        // --------------------------------------------------------
+        // Fold the key to the file system's case rules so that
+        // "A\B.txt" and "a\b.TXT" are treated as the same file
+        // on Windows (a folded copy in the arena; POSIX keys are
+        // the paths themselves)
+        // --------------------------------------------------------
+        NativeStringView key = outPath;
+#ifdef _WIN32
+        NativeChar* folded = names.alloc<NativeChar>(outPath.size());
+        std::copy(outPath.begin(), outPath.end(), folded);
+        FoldPathCase(folded, outPath.size());
+        key = NativeStringView(folded, outPath.size());
+#endif
+
+        auto [slot, inserted] = entryByPath.tryEmplace(key, entries.size());
+        if (inserted) {
+            entries.push_back(e);
+        }
+        else {
+            entries[slot] = e;
+        }
+    }
+
+    unsigned threads = options.pool ? options.pool->size()
+        : options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+
+    // ------------------------------------------------------------
+    // Create the tree up front, one task per top-level subtree:
+    //  - each directory is made relative to its parent's handle
+    //  - handles stay open for directories that receive files,
+    //    within half the descriptor limit (minus what the
+    //    writers may hold: a batch of open files per thread)
+    //  - entries whose directory could not be made are dropped
+    // ------------------------------------------------------------
+    tree.handles = std::vector<DirHandle>(tree.dirs.size());
+    tree.handles[0].open(outDir.c_str());
+    tree.dirs[0].ok = true;
+    tree.budget = (int64_t)std::min<size_t>(OpenFileLimit(), (size_t)1 << 30) / 2 -
+        (int64_t)threads * (int64_t)kExtractBatchFiles;
+
+    if (threads > 1 && tree.dirs.size() >= kExtractTreeParallelDirs) {
+        std::optional<ThreadPool> ownPool;
+        TaskGroup group(options.pool ? *options.pool : ownPool.emplace(threads));
+        for (size_t c = tree.dirs[0].firstChild; c != SIZE_MAX; c = tree.dirs[c].nextSibling)
+            group.submit([&tree, c] { CreateDirSubtree(tree, c); });
+        group.wait();
+    }
+    else {
+        for (size_t c = tree.dirs[0].firstChild; c != SIZE_MAX; c = tree.dirs[c].nextSibling)
+            CreateDirSubtree(tree, c);
+    }
+
+    std::vector<std::filesystem::path> newDirs;   // Created by this run (removed on cancel)
+    for (size_t d = 1; d < tree.dirs.size(); ++d) {
+        const ExtractDir& dir = tree.dirs[d];
+        if (dir.created)
+            newDirs.emplace_back(dir.path);
+        if (!dir.ok && tree.dirs[dir.parent].ok)
+            LogBuffered(L"Failed to create directory: " + PathToDisplay(std::filesystem::path(dir.path)));
+    }
+    size_t dropped = std::erase_if(entries, [&tree](const ExtractEntry& e) { return !tree.dirs[e.dir].ok; });
+
+    // Files are opened relative to their directory where it is held open
+    auto openPath = [&tree](const ExtractEntry& e) { return EntryOpenPath(tree, e); };
+
+    // ------------------------------------------------------------
+    // Hard-link mode: an entry sharing its data range with an
+    // earlier planned entry (a deduplicated pack) becomes a link
+    // to that entry's file instead of a second copy
+    // ------------------------------------------------------------
+    size_t linkCount = 0;
+    if (options.hardLinkDuplicates) {
+        std::unordered_map<WadRange, size_t, WadRangeHash> firstByRange;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            ExtractEntry& e = entries[i];
+            if (e.size == 0)
+                continue;
+            auto [it, inserted] = firstByRange.try_emplace(wad.entryRange(e.index), i);
+            if (!inserted) {
+                e.linkTo = (int64_t)it->second;
+                linkCount++;
+            }
+        }
+    }
+
+    uint64_t totalBytes = 0;
+    for (const auto& e : entries) {
+        if (e.linkTo < 0)
+            totalBytes += e.size;
+    }
+    planSpan.end();
+
+    // ------------------------------------------------------------
+    // 6. Extract the planned entries
+    //    - one thread: write them in table order on this thread
+    //    - each entry is written by the copy engine with the
+    //      requested (or size-based automatic) strategy; small
+    //      entries that resolve to plain writes are created in
+    //      batches through io_uring where available (open, write
+    //      and close for a whole batch in three submissions)
+    //    - otherwise: group entries into batches of roughly equal
+    //      byte size and hand them to a work-stealing pool,
+    //      largest batches first, while this thread reports
+    //      byte-based progress
+    //    - then create the hard links, once their targets exist
+    //    - cancelled: stop at the next entry and remove the files
+    //      and directories written so far
+    // ------------------------------------------------------------
+    BeginProgress(totalBytes);
+    std::vector<uint8_t> failed(entries.size(), 0);
+    std::vector<uint8_t> touched(entries.size(), 0);   // Output file created (removed on cancel)
+
+    auto writeEntry = [&options, &wad, &tree, &openPath](MappedWindow& window, const ExtractEntry& e) {
+        TelemetryTimer timer(TelemetryHistogram::EntryWrite);
+        if (wad.compressed()) {
+            FileHandle out;
+            if (!out.createAt(tree.handles[e.dir], openPath(e)) ||
+                !WriteDecodedBlocks(out, window, wad, e.index, 0, wad.entryBlockCount(e.index)))
+                return false;
+        }
+        else if (!CopyRangeToNewFile(tree.handles[e.dir], openPath(e), window, e.offset, e.size,
+            options.copyStrategy))
+            return false;
+        TelemetryAdd(TelemetryCounter::FilesWritten, 1);
+        TelemetryAdd(TelemetryCounter::BytesWritten, e.size);
+        return true;
+    };
+
+    if (streamed)
+        threads = 1;   // One pass over the stream
+    if (threads > entries.size())
+        threads = (unsigned)std::max<size_t>(entries.size(), 1);
+
+    // ------------------------------------------------------------
+    // Ring writes take the data straight from the mapping, so
+    // they are for uncompressed, mapped WADs only
+    // ------------------------------------------------------------
+    bool batching = options.ioBackend != IoBackend::Sync && IsUringAvailable() && !wad.compressed() && !streamed;
+    if (options.ioBackend == IoBackend::Uring && !batching)
+        Log(streamed ? L"Reading a stream, using synchronous I/O"
+            : wad.compressed() ? L"Compressed WAD, using synchronous I/O"
+                               : L"io_uring is not available, using synchronous I/O");
+
+    // ------------------------------------------------------------
+    // Write a run of planned entries: batchable ones through the
+    // ring (when one is given), the rest one by one. The run's
+    // data is read through its own map window and queued for
+    // read-ahead up front; pending ring writes are submitted
+    // before the window moves away from their data.
+    // ------------------------------------------------------------
+    auto writeRun = [&](size_t first, size_t count, BatchIo* io) {
+        TelemetrySpan span(TelemetryPhase::Write);
+        MappedWindow window(mf);
+        std::vector<BatchFileOp> ops;
+        std::vector<size_t> opEntry;
+
+        if (!wad.compressed())
+            PrefetchRun(window, entries, first, count);
+
+        auto submit = [&]() {
+            if (ops.empty())
+                return;
+            io->writeFiles(ops.data(), ops.size());
+            for (size_t k = 0; k < ops.size(); ++k) {
+                if (ops[k].retry) {
+                    // The ring failed (and closed): write this one without it
+                    if (!writeEntry(window, entries[opEntry[k]]))
+                        failed[opEntry[k]] = 1;
+                }
+                else if (!ops[k].ok || ops[k].done != ops[k].size) {
+                    failed[opEntry[k]] = 1;
+                }
+                else {
+                    TelemetryAdd(TelemetryCounter::FilesWritten, 1);
+                    TelemetryAdd(TelemetryCounter::BytesWritten, ops[k].size);
+                }
+                AddProgress(ops[k].size);
+            }
+            ops.clear();
+            opEntry.clear();
+        };
+
+        for (size_t i = first; i < first + count && !IsCancelled(options.cancel); ++i) {
+            const ExtractEntry& e = entries[i];
+            if (e.linkTo >= 0)
+                continue;
+            touched[i] = 1;
+            if (io && io->isOpen() && ResolveCopyStrategy(options.copyStrategy, e.size) == CopyStrategy::Write &&
+                e.size <= window.windowBytes()) {
+                if (!window.covers(e.offset, (size_t)e.size))
+                    submit();
+                BatchFileOp op;
+                op.path = openPath(e);
+                op.dir = &tree.handles[e.dir];
+                op.src = window.view(e.offset, (size_t)e.size);
+                op.size = (size_t)e.size;
+                if (!op.src) {
+                    failed[i] = 1;
+                    AddProgress(e.size);
+                    continue;
+                }
+                ops.push_back(op);
+                opEntry.push_back(i);
+                continue;
+            }
+            if (!window.covers(e.offset, (size_t)e.size))
+                submit();
+            if (!writeEntry(window, e))
+                failed[i] = 1;
+            AddProgress(e.size);
+        }
+        submit();
+    };
+
+    bool streamEnded = false;
+    if (streamed) {
+        streamEnded = !StreamEntries(stream, entries, tree, failed, touched, options.cancel);
+    }
+    else if (threads <= 1) {
+        BatchIo io;
+        if (batching)
+            io.open(options.ioBackend);
+
+        for (size_t i = 0; i < entries.size() && !IsCancelled(options.cancel); i += kBatchIoDepth) {
+            size_t count = std::min<size_t>(entries.size() - i, kBatchIoDepth);
+            writeRun(i, count, &io);
+            PumpProgress();
+        }
+    }
+    else {
+        // --------------------------------------------------------
+        // Compressed WADs: cut large entries into block ranges.
+        // Their files are created at full size here, the workers
+        // fill in the ranges.
+        // --------------------------------------------------------
+        std::vector<ExtractBatch> batches;
+        std::vector<uint8_t> split(entries.size(), 0);
+        if (wad.compressed()) {
+            uint64_t blocksPerBatch = std::max<uint64_t>(kExtractBatchBytes / wad.blockBytes, 1);
+            for (size_t i = 0; i < entries.size() && !IsCancelled(options.cancel); ++i) {
+                const ExtractEntry& e = entries[i];
+                uint64_t blocks = e.linkTo < 0 ? wad.entryBlockCount(e.index) : 0;
+                if (blocks <= blocksPerBatch)
+                    continue;
+
+                split[i] = 1;
+                touched[i] = 1;
+                FileHandle out;
+                if (!out.createAt(tree.handles[e.dir], openPath(e)) || !out.setSize(e.size)) {
+                    failed[i] = 1;
+                    AddProgress(e.size);
+                    continue;
+                }
+                for (uint64_t k = 0; k < blocks; k += blocksPerBatch) {
+                    ExtractBatch b;
+                    b.first = i;
+                    b.count = 1;
+                    b.firstBlock = k;
+                    b.blockCount = std::min(blocks - k, blocksPerBatch);
+                    b.bytes = std::min<uint64_t>(e.size - k * wad.blockBytes, b.blockCount * wad.blockBytes);
+                    batches.push_back(b);
+                }
+            }
+        }
+
+        ExtractBatch cur;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (split[i]) {
+                if (cur.count > 0)
+                    batches.push_back(cur);   // Runs must not span a split entry
+                cur = ExtractBatch{};
+                continue;
+            }
+            if (cur.count > 0 &&
+                (cur.bytes + entries[i].size > kExtractBatchBytes || cur.count >= kExtractBatchFiles)) {
+                batches.push_back(cur);
+                cur = ExtractBatch{};
+            }
+            if (cur.count == 0)
+                cur.first = i;
+            cur.count++;
+            if (entries[i].linkTo < 0)
+                cur.bytes += entries[i].size;
+        }
+        if (cur.count > 0)
+            batches.push_back(cur);
+
+        std::stable_sort(batches.begin(), batches.end(),
+            [](const ExtractBatch& a, const ExtractBatch& b) { return a.bytes > b.bytes; });
+
+        // --------------------------------------------------------
+        // A block range of a split entry: open the sized file and
+        // decode the range into it (failures are collected per
+        // range, several workers share the entry)
+        // --------------------------------------------------------
+        std::vector<uint8_t> rangeFailed(batches.size(), 0);
+        auto writeRange = [&](size_t k) {
+            TelemetrySpan span(TelemetryPhase::Write);
+            const ExtractBatch& b = batches[k];
+            const ExtractEntry& e = entries[b.first];
+            MappedWindow window(mf);
+            FileHandle out;
+            if (!IsCancelled(options.cancel) &&
+                (!out.openWriteAt(tree.handles[e.dir], openPath(e)) ||
+                 !WriteDecodedBlocks(out, window, wad, e.index, b.firstBlock, b.blockCount)))
+                rangeFailed[k] = 1;
+            TelemetryAdd(TelemetryCounter::BytesWritten, b.bytes);
+            AddProgress(b.bytes);
+        };
+
+        // --------------------------------------------------------
+        // One ring per worker, handed out per batch
+        // --------------------------------------------------------
+        std::vector<std::unique_ptr<BatchIo>> rings(threads);
+        BoundedQueue<BatchIo*> freeRings{ threads };
+        for (auto& ring : rings) {
+            ring = std::make_unique<BatchIo>();
+            if (batching)
+                ring->open(options.ioBackend);
+            freeRings.push(ring.get());
+        }
+
+        std::optional<ThreadPool> ownPool;
+        TaskGroup group(options.pool ? *options.pool : ownPool.emplace(threads));
+        for (size_t k = 0; k < batches.size(); ++k) {
+            const ExtractBatch& b = batches[k];
+            if (b.blockCount > 0) {
+                if (!failed[b.first])
+                    group.submit([&writeRange, k] {
+                        TelemetryThreadName("worker");
+                        writeRange(k);
+                    });
+                continue;
+            }
+            group.submit([&freeRings, &writeRun, b] {
+                TelemetryThreadName("worker");
+                BatchIo* io = nullptr;
+                freeRings.pop(io);
+                writeRun(b.first, b.count, io);
+                freeRings.push(io);
+            });
+        }
+
+        while (!group.waitFor(std::chrono::milliseconds(kLogPumpMs)))
+            PumpProgress();
+
+        for (size_t k = 0; k < batches.size(); ++k) {
+            if (rangeFailed[k])
+                failed[batches[k].first] = 1;
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (split[i] && !failed[i])
+                TelemetryAdd(TelemetryCounter::FilesWritten, 1);
+        }
+    }
+
+    // ------------------------------------------------------------
+    // Links fall back to a normal write when the file system has
+    // no hard links (FAT) or the first copy failed; a stream has
+    // moved past the data, so there the first copy is copied
+    // ------------------------------------------------------------
+    TelemetrySpan linkSpan(TelemetryPhase::Link);
+    MappedWindow linkWindow(mf);
+    size_t linked = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const ExtractEntry& e = entries[i];
+        if (e.linkTo < 0)
+            continue;
+        if (IsCancelled(options.cancel))
+            break;
+        touched[i] = 1;
+        if (!failed[e.linkTo] && ReplaceWithHardLink(entries[e.linkTo].outPath, e.outPath)) {
+            linked++;
+        }
+        else if (streamed) {
+            std::error_code ec;
+            if (failed[e.linkTo] || !std::filesystem::copy_file(entries[e.linkTo].outPath, e.outPath,
+                    std::filesystem::copy_options::overwrite_existing, ec))
+                failed[i] = 1;
+        }
+        else if (!writeEntry(linkWindow, e)) {
+            failed[i] = 1;
+        }
+    }
+    if (linkCount > 0)
+        Log(std::to_wstring(linked) + L" of " + std::to_wstring(linkCount) + L" duplicate files hard-linked");
+    linkSpan.end();
+
+    if (IsCancelled(options.cancel)) {
+        EndProgress();
+        size_t removed = RemovePartialOutput(entries, touched, std::move(newDirs), outDir, createdOutDir);
+        Log(L"Extraction cancelled, " + std::to_wstring(removed) + L" written files removed");
+        return false;
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (failed[i])
+            LogBuffered(L"Failed to write: " + ToWideFromAnsi(entries[i].name));
+    }
+    EndProgress();
+
+    if (streamEnded) {
+        ShowError(L"The WAD stream ended before all entry data.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // Entries that were not written (or had no directory to go
+    // to, or an unsafe name) make the extraction a failure
+    // ------------------------------------------------------------
+    size_t failures = unsafe + dropped + (size_t)std::count(failed.begin(), failed.end(), 1);
+    if (failures > 0) {
+        Log(std::to_wstring(failures) + L" of " + std::to_wstring(planCount) + L" entries failed");
+        ShowError(L"Extraction incomplete: some entries could not be written.");
+        return false;
+    }
+
+    SetProgress(100);
+    Log(L"Extraction complete");
+
+    // ------------------------------------------------------------
+    // 7. Measure and log total extraction time and throughput
+    // ------------------------------------------------------------
+    double elapsed = timer.seconds();
+
+    Log(L"Time taken: " + FormatSeconds(elapsed));
+    Log(L"Throughput: " + FormatThroughput(totalBytes, entries.size(), elapsed) +
+        L" (" + std::to_wstring(threads) + (threads == 1 ? L" thread" : L" threads") +
+        (batching ? L", io_uring)" : L")"));
+
+    return true;
+}
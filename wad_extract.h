@@ -0,0 +1,40 @@
+﻿#pragma once
+#include "copy_engine.h"
+#include "batch_io.h"
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// ------------------------------------------------------------
+// Extraction settings chosen by the front end
+// ------------------------------------------------------------
+struct ExtractOptions {
+    unsigned threads = 0;              // Worker threads (0 = one per core, 1 = serial)
+    ThreadPool* pool = nullptr;        // Shared workers to use instead (a batch; 'threads' ignored)
+    std::filesystem::path outDir;      // Output directory (empty = <wad dir>/<wad stem>)
+    bool fromStdin = false;            // Read the WAD front to back from standard input (needs outDir)
+    std::vector<std::wstring> filters; // Entry patterns to extract (empty = everything)
+    std::filesystem::path filterList;  // File with one entry name / pattern per line
+    bool hardLinkDuplicates = false;   // Hard-link entries that share a data range (dedup packs)
+    CopyStrategy copyStrategy = CopyStrategy::Auto;  // How entry data reaches the output files
+    IoBackend ioBackend = IoBackend::Auto;           // How small entries are written (batched or per file)
+    MapOptions map{ kMapWindowBytes, MapAccess::Sequential };  // How the WAD is mapped (window 0 = whole file)
+    const std::atomic<bool>* cancel = nullptr;       // Set by the front end to stop (written files are removed)
+};
+
+// ------------------------------------------------------------
+// Extract the entries of a WAD into a directory tree: every
+// entry, or those selected by 'filters' / 'filterList' (see
+// WadTrie::match for the pattern syntax). Entries keep their
+// full relative path below the output directory.
+// From standard input (a pipe) the header + table are read
+// first, then the entries are written in data order as their
+// bytes go by, through one buffer (entries sharing data receive
+// the same chunks). Compressed WADs cannot be extracted that way.
+// Returns true when every selected entry was written.
+// ------------------------------------------------------------
+bool ExtractWad(const std::filesystem::path& wadPath, const ExtractOptions& options);
@@ -0,0 +1,299 @@
+﻿#include "wad_format.h"
+#include "mapped_file.h"
+#include "lz_codec.h"
+#include "telemetry.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OPENWAD_SSE2_NAMES 1
+#endif
+
+static_assert(kWadNameBytes % 16 == 0, "name fields are scanned in 16 byte steps");
+
+size_t WadNameLength(const char* field)
+{
+#ifdef OPENWAD_SSE2_NAMES
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < kWadNameBytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(field + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if (mask)
+            return i + (size_t)std::countr_zero(mask);
+    }
+    return kWadNameBytes;
+#else
+    return strnlen(field, kWadNameBytes);
+#endif
+}
+
+void FoldWadNameBytes(const char* src, size_t size, char* dst)
+{
+    size_t i = 0;
+#ifdef OPENWAD_SSE2_NAMES
+    // ------------------------------------------------------------
+    // 'A'..'Z' gain 0x20; '/' is flipped to '\' with one XOR.
+    // Bytes >= 0x80 compare as negative and are left alone.
+    // ------------------------------------------------------------
+    const __m128i below = _mm_set1_epi8('A' - 1);
+    const __m128i above = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8('a' - 'A');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i flip = _mm_set1_epi8('/' ^ '\\');
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmpgt_epi8(above, v));
+        v = _mm_add_epi8(v, _mm_and_si128(upper, caseBit));
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(v, slash), flip));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+#endif
+    for (; i < size; ++i)
+        dst[i] = (char)FoldWadNameChar((uint8_t)src[i]);
+}
+
+void WriteWadHeader(uint8_t* buf, WadFormat format, uint32_t count, uint64_t blockCount)
+{
+    if (format == WadFormat::Compressed) {
+        WadLzHeader* header = reinterpret_cast<WadLzHeader*>(buf);
+        header->magic = kWadLzMagic;
+        header->fileCount = count;
+        header->codec = kWadLzCodecLz4;
+        header->blockBytes = kWadLzBlockBytes;
+        header->blockCount = blockCount;
+    }
+    else if (format == WadFormat::Wad64) {
+        Wad64Header* header = reinterpret_cast<Wad64Header*>(buf);
+        header->magic = kWad64Magic;
+        header->fileCount = count;
+    }
+    else {
+        reinterpret_cast<WadHeader*>(buf)->fileCount = count;
+    }
+}
+
+void WriteWadItem(uint8_t* buf, WadFormat format, uint32_t index,
+    std::string_view name, uint64_t dataOffset, uint64_t dataSize)
+{
+    size_t len = std::min(name.size(), kWadNameBytes - 1);
+
+    if (format == WadFormat::Compressed) {
+        WadLzItem& wi = reinterpret_cast<WadLzItem*>(buf + sizeof(WadLzHeader))[index];
+        memcpy(wi.name, name.data(), len);
+        wi.firstBlock = dataOffset;
+        wi.dataSize = dataSize;
+    }
+    else if (format == WadFormat::Wad64) {
+        Wad64Item& wi = reinterpret_cast<Wad64Item*>(buf + sizeof(Wad64Header))[index];
+        memcpy(wi.name, name.data(), len);
+        wi.dataOffset = dataOffset;
+        wi.dataSize = dataSize;
+    }
+    else {
+        WadItem& wi = reinterpret_cast<WadItem*>(buf + sizeof(WadHeader))[index];
+        memcpy(wi.name, name.data(), len);
+        wi.dataOffset = (uint32_t)dataOffset;
+        wi.dataSize = (uint32_t)dataSize;
+    }
+}
+
+void WriteWadBlock(uint8_t* buf, uint32_t count, uint64_t index, const WadLzBlock& block)
+{
+    WadLzBlock* blocks = reinterpret_cast<WadLzBlock*>(buf + sizeof(WadLzHeader) + count * sizeof(WadLzItem));
+    blocks[index] = block;
+}
+
+// ------------------------------------------------------------
+// Compressed WAD: every entry's blocks must exist, lie within
+// the image after the tables, and a block stored raw must hold
+// exactly its decoded size
+// ------------------------------------------------------------
+static bool ValidateBlocks(const WadView& v, const wchar_t** error)
+{
+    for (uint32_t i = 0; i < v.fileCount; ++i) {
+        uint64_t first = v.entryFirstBlock(i);
+        uint64_t count = v.entryBlockCount(i);
+        if (first > v.blockCount || count > v.blockCount - first) {
+            *error = L"Invalid WAD: corrupt offsets or sizes.";
+            return false;
+        }
+        for (uint64_t k = 0; k < count; ++k) {
+            const WadLzBlock& b = v.blocks[first + k];
+            if (b.storedSize > v.size || b.offset > v.size - b.storedSize || b.offset < v.tableBytes ||
+                ((b.flags & kWadLzBlockRaw) && b.storedSize != v.blockSize(i, k))) {
+                *error = L"Invalid WAD: corrupt offsets or sizes.";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Validate the header + table in the first 'size' bytes of an
+// image of 'imageSize' bytes (the two differ for a stream)
+// ------------------------------------------------------------
+static bool ValidateWad(const uint8_t* base, size_t size, uint64_t imageSize, WadView& view, const wchar_t** error)
+{
+    // ------------------------------------------------------------
+    // 1. Basic header size check to ensure a valid WAD header is
+    //    present; the WAD64 / WDLZ markers select the 64-bit and
+    //    the compressed layouts
+    // ------------------------------------------------------------
+    if (!base || size < sizeof(WadHeader)) {
+        *error = L"Invalid WAD file.";
+        return false;
+    }
+
+    WadView v;
+    const uint32_t first = reinterpret_cast<const WadHeader*>(base)->fileCount;
+    if (first == kWad64Magic) {
+        if (size < sizeof(Wad64Header)) {
+            *error = L"Invalid WAD file.";
+            return false;
+        }
+        v.format = WadFormat::Wad64;
+        v.fileCount = reinterpret_cast<const Wad64Header*>(base)->fileCount;
+        v.table64 = reinterpret_cast<const Wad64Item*>(base + sizeof(Wad64Header));
+    }
+    else if (first == kWadLzMagic) {
+        if (size < sizeof(WadLzHeader)) {
+            *error = L"Invalid WAD file.";
+            return false;
+        }
+        const WadLzHeader* header = reinterpret_cast<const WadLzHeader*>(base);
+        if (header->codec != kWadLzCodecLz4 || header->blockBytes == 0 || header->blockBytes > kWadLzMaxBlockBytes) {
+            *error = L"Unsupported compressed WAD.";
+            return false;
+        }
+        if (header->blockCount > size / sizeof(WadLzBlock)) {
+            *error = L"Invalid WAD: header/table exceeds file size.";
+            return false;
+        }
+        v.format = WadFormat::Compressed;
+        v.fileCount = header->fileCount;
+        v.blockCount = header->blockCount;
+        v.blockBytes = header->blockBytes;
+        v.tableLz = reinterpret_cast<const WadLzItem*>(base + sizeof(WadLzHeader));
+        v.blocks = reinterpret_cast<const WadLzBlock*>(v.tableLz + v.fileCount);
+    }
+    else {
+        v.fileCount = first;
+        v.table = reinterpret_cast<const WadItem*>(base + sizeof(WadHeader));
+    }
+
+    // ------------------------------------------------------------
+    // 2. Validate that the header + table region fits inside the file
+    // ------------------------------------------------------------
+    uint64_t tableBytes = WadTableBytes(v.format, v.fileCount, v.blockCount);
+    if (tableBytes > size) {
+        *error = L"Invalid WAD: header/table exceeds file size.";
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 3. Validate each entry's data range (a WAD64 size is checked
+    //    on its own first, so start + size cannot wrap); compressed
+    //    entries are checked block by block
+    // ------------------------------------------------------------
+    v.base = base;
+    v.size = size;
+    v.tableBytes = tableBytes;
+    if (v.compressed() && !ValidateBlocks(v, error))
+        return false;
+
+    for (uint32_t i = 0; i < v.fileCount && !v.compressed(); ++i) {
+        uint64_t start = v.entryOffset(i);
+        uint64_t bytes = v.entrySize(i);
+        if (bytes > imageSize || start > imageSize - bytes || start < tableBytes) {
+            *error = L"Invalid WAD: corrupt offsets or sizes.";
+            return false;
+        }
+    }
+
+    view = v;
+    return true;
+}
+
+bool OpenWadView(const uint8_t* base, size_t size, WadView& view, const wchar_t** error)
+{
+    return ValidateWad(base, size, size, view, error);
+}
+
+bool OpenWadHead(const uint8_t* base, size_t size, WadView& view, const wchar_t** error)
+{
+    if (base && size >= sizeof(WadHeader) && reinterpret_cast<const WadHeader*>(base)->fileCount == kWadLzMagic) {
+        *error = L"Compressed WADs cannot be read from a stream.";
+        return false;
+    }
+    return ValidateWad(base, size, UINT64_MAX, view, error);
+}
+
+uint64_t WadHeadBytes(const uint8_t* base, size_t size)
+{
+    if (size >= sizeof(WadLzHeader) && reinterpret_cast<const WadLzHeader*>(base)->magic == kWadLzMagic) {
+        const WadLzHeader* header = reinterpret_cast<const WadLzHeader*>(base);
+        if (header->blockCount <= size / sizeof(WadLzBlock))
+            return WadTableBytes(WadFormat::Compressed, header->fileCount, header->blockCount);
+    }
+    else if (size >= sizeof(Wad64Header)) {
+        const Wad64Header* header = reinterpret_cast<const Wad64Header*>(base);
+        return header->magic == kWad64Magic
+            ? WadTableBytes(WadFormat::Wad64, header->fileCount)
+            : WadTableBytes(WadFormat::Classic, header->magic);
+    }
+    return sizeof(WadHeader);
+}
+
+bool OpenWadFile(const std::filesystem::path& path, const MapOptions& map, MappedFile& file,
+    WadView& view, const wchar_t** error)
+{
+    if (!file.open(path, map)) {
+        *error = L"Failed to memory-map WAD file.";
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // Header + table size from the entry (and block) count;
+    // OpenWadView rejects a table that does not fit the file
+    // ------------------------------------------------------------
+    uint64_t tableBytes = WadHeadBytes(file.base, file.size);
+    if (tableBytes <= file.size && !file.mapHead((size_t)tableBytes)) {
+        *error = L"Failed to memory-map WAD file.";
+        return false;
+    }
+    file.prefetch(0, (size_t)std::min<uint64_t>(tableBytes, file.mapped));
+
+    return OpenWadView(file.base, file.size, view, error);
+}
+
+bool DecodeWadBlocks(MappedWindow& src, const WadView& wad, uint32_t i, uint64_t first, uint64_t count,
+    std::vector<uint8_t>& scratch, const WadBlockSink& sink)
+{
+    const WadLzBlock* blocks = wad.blocks + wad.entryFirstBlock(i);
+    for (uint64_t k = first; k < first + count; ++k) {
+        const WadLzBlock& b = blocks[k];
+        size_t size = wad.blockSize(i, k);
+
+        const uint8_t* stored = src.view(b.offset, b.storedSize);
+        if (!stored)
+            return false;
+        if (k + 1 < first + count)
+            src.prefetch(blocks[k + 1].offset, blocks[k + 1].storedSize);
+
+        const uint8_t* data = stored;
+        if (!(b.flags & kWadLzBlockRaw)) {
+            TelemetrySpan span(TelemetryPhase::Decompress);
+            if (scratch.size() < size)
+                scratch.resize(size);
+            if (!LzDecompress(stored, b.storedSize, scratch.data(), size))
+                return false;
+            data = scratch.data();
+        }
+        if (!sink(data, size, k * wad.blockBytes))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,297 @@
+﻿#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string_view>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+struct MappedFile;
+struct MapOptions;
+class MappedWindow;
+
+// ------------------------------------------------------------
+// Classic WAD (GP4): entry count, then one 136 byte entry per
+// file with 32-bit data offsets and sizes
+// ------------------------------------------------------------
+#pragma pack(push, 1)
+struct WadHeader {
+    uint32_t fileCount;   // Number of entries in the WAD table
+};
+
+struct WadItem {
+    char     name[128];   // ANSI file name (relative path inside WAD)
+    uint32_t dataOffset;  // Offset of file data from start of WAD
+    uint32_t dataSize;    // Size of file data in bytes
+};
+
+// ------------------------------------------------------------
+// WAD64: a marker in front of the entry count and 64-bit data
+// offsets and sizes, for archives past 4 GB. The marker read as
+// a classic count would need a table of over 100 GB, so the two
+// formats cannot be mistaken for each other.
+// ------------------------------------------------------------
+struct Wad64Header {
+    uint32_t magic;       // kWad64Magic
+    uint32_t fileCount;   // Number of entries in the WAD table
+};
+
+struct Wad64Item {
+    char     name[128];   // ANSI file name (relative path inside WAD)
+    uint64_t dataOffset;  // Offset of file data from start of WAD
+    uint64_t dataSize;    // Size of file data in bytes
+};
+
+// ------------------------------------------------------------
+// Compressed WAD: the data of each entry is cut into blocks of
+// 'blockBytes' (the last one shorter) that are compressed one
+// by one and stored anywhere in the data area. A block table
+// after the item table locates them, so blocks are written in
+// the order they finish and read back in parallel, in any
+// order. Incompressible blocks are stored as they are.
+// ------------------------------------------------------------
+struct WadLzHeader {
+    uint32_t magic;       // kWadLzMagic
+    uint32_t fileCount;   // Number of entries in the WAD table
+    uint32_t codec;       // Compression of the blocks (kWadLzCodecLz4)
+    uint32_t blockBytes;  // Decoded size of every block but an entry's last
+    uint64_t blockCount;  // Number of entries in the block table
+};
+
+struct WadLzItem {
+    char     name[128];   // ANSI file name (relative path inside WAD)
+    uint64_t firstBlock;  // Block table index of the first block of the data
+    uint64_t dataSize;    // Decoded size of file data in bytes
+};
+
+struct WadLzBlock {
+    uint64_t offset;      // Offset of the stored block from start of WAD
+    uint32_t storedSize;  // Stored (compressed) size in bytes
+    uint32_t flags;       // kWadLzBlockRaw: stored uncompressed
+};
+#pragma pack(pop)
+
+static const uint32_t kWad64Magic = 0x34364457;              // "WD64"
+static const uint32_t kWadLzMagic = 0x5A4C4457;              // "WDLZ"
+static const uint32_t kWadLzCodecLz4 = 1;                    // LZ4 block format (lz_codec.h)
+static const uint32_t kWadLzBlockRaw = 1;                    // WadLzBlock::flags
+static const uint32_t kWadLzBlockBytes = 1024 * 1024;        // Block size the packer writes
+static const uint32_t kWadLzMaxBlockBytes = 64 * 1024 * 1024; // Largest block size a reader accepts
+static const uint64_t kWadClassicMaxBytes = 0xFFFFFFFFull;   // Largest classic WAD image
+static const size_t kWadNameBytes = sizeof(WadItem::name);   // Name field incl. terminator
+
+// ------------------------------------------------------------
+// Length of a NUL-padded name field (kWadNameBytes readable
+// bytes; a full field has no terminator). Scans 16 bytes per
+// step where SSE2 is available.
+// ------------------------------------------------------------
+size_t WadNameLength(const char* field);
+
+enum class WadFormat {
+    Classic,    // GP4 compatible (default)
+    Wad64,      // 64-bit offsets and sizes
+    Compressed, // 64-bit sizes, data in compressed blocks
+};
+
+// ------------------------------------------------------------
+// Header + table size of a WAD with 'count' entries (and, for
+// a compressed WAD, 'blockCount' blocks)
+// ------------------------------------------------------------
+inline uint64_t WadTableBytes(WadFormat format, uint64_t count, uint64_t blockCount = 0)
+{
+    switch (format) {
+    case WadFormat::Wad64:
+        return sizeof(Wad64Header) + count * sizeof(Wad64Item);
+    case WadFormat::Compressed:
+        return sizeof(WadLzHeader) + count * sizeof(WadLzItem) + blockCount * sizeof(WadLzBlock);
+    default:
+        return sizeof(WadHeader) + count * sizeof(WadItem);
+    }
+}
+
+// ------------------------------------------------------------
+// Blocks holding 'size' bytes of entry data
+// ------------------------------------------------------------
+inline uint64_t WadBlocksFor(uint64_t size, uint32_t blockBytes)
+{
+    return size / blockBytes + (size % blockBytes != 0);
+}
+
+// ------------------------------------------------------------
+// Fill the header / one entry / one block of a zeroed header +
+// table buffer (WadTableBytes in size). Names longer than the
+// field are cut; classic offsets and sizes must fit in 32 bits.
+// A compressed entry's 'dataOffset' is its first block index.
+// ------------------------------------------------------------
+void WriteWadHeader(uint8_t* buf, WadFormat format, uint32_t count, uint64_t blockCount = 0);
+void WriteWadItem(uint8_t* buf, WadFormat format, uint32_t index,
+    std::string_view name, uint64_t dataOffset, uint64_t dataSize);
+void WriteWadBlock(uint8_t* buf, uint32_t count, uint64_t index, const WadLzBlock& block);
+
+// ------------------------------------------------------------
+// Data range of an entry as a hash key (entries of dedup packs
+// share one range)
+// ------------------------------------------------------------
+struct WadRange {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+
+    bool operator==(const WadRange&) const = default;
+};
+
+struct WadRangeHash {
+    size_t operator()(const WadRange& r) const
+    {
+        return (size_t)((r.offset * 0x9E3779B97F4A7C15ull) ^ r.size);
+    }
+};
+
+// ------------------------------------------------------------
+// Validated view over a WAD image in memory. Entry fields are
+// read through the accessors, which cover every format.
+// ------------------------------------------------------------
+struct WadView {
+    const uint8_t* base = nullptr;     // Start of the WAD image
+    size_t size = 0;                   // Size of the WAD image in bytes
+    WadFormat format = WadFormat::Classic;
+    const WadItem* table = nullptr;    // First entry of the item table (classic)
+    const Wad64Item* table64 = nullptr;  // First entry of the item table (WAD64)
+    const WadLzItem* tableLz = nullptr;  // First entry of the item table (compressed)
+    const WadLzBlock* blocks = nullptr;  // Block table (compressed)
+    uint64_t blockCount = 0;           // Entries in the block table
+    uint32_t blockBytes = 0;           // Decoded size of a full block
+    uint32_t fileCount = 0;            // Number of entries in the table
+    uint64_t tableBytes = 0;           // Size of header + item table (+ block table)
+
+    bool compressed() const { return tableLz != nullptr; }
+
+    std::string_view entryName(uint32_t i) const
+    {
+        const char* name = tableLz ? tableLz[i].name : table64 ? table64[i].name : table[i].name;
+        return std::string_view(name, WadNameLength(name));
+    }
+
+    // --------------------------------------------------------
+    // Where the stored data starts (compressed: the first
+    // block; an empty entry reports the end of the table)
+    // --------------------------------------------------------
+    uint64_t entryOffset(uint32_t i) const
+    {
+        if (tableLz)
+            return entryBlockCount(i) ? blocks[tableLz[i].firstBlock].offset : tableBytes;
+        return table64 ? table64[i].dataOffset : table[i].dataOffset;
+    }
+
+    // --------------------------------------------------------
+    // Size of the entry's data (decoded, for compressed WADs)
+    // --------------------------------------------------------
+    uint64_t entrySize(uint32_t i) const
+    {
+        return tableLz ? tableLz[i].dataSize : table64 ? table64[i].dataSize : table[i].dataSize;
+    }
+
+    // --------------------------------------------------------
+    // Identity of the stored data: entries of dedup packs share
+    // it (offset and size, or first block and size)
+    // --------------------------------------------------------
+    WadRange entryRange(uint32_t i) const
+    {
+        if (tableLz)
+            return WadRange{ tableLz[i].firstBlock, tableLz[i].dataSize };
+        return WadRange{ entryOffset(i), entrySize(i) };
+    }
+
+    // --------------------------------------------------------
+    // Uncompressed formats: the data inside the image
+    // --------------------------------------------------------
+    const uint8_t* entryData(uint32_t i) const
+    {
+        return base + entryOffset(i);
+    }
+
+    // --------------------------------------------------------
+    // Compressed format: the entry's blocks and their decoded
+    // sizes (block 'k' counts from the entry's first block)
+    // --------------------------------------------------------
+    uint64_t entryFirstBlock(uint32_t i) const { return tableLz[i].firstBlock; }
+    uint64_t entryBlockCount(uint32_t i) const { return WadBlocksFor(tableLz[i].dataSize, blockBytes); }
+
+    size_t blockSize(uint32_t i, uint64_t k) const
+    {
+        uint64_t left = tableLz[i].dataSize - k * blockBytes;
+        return (size_t)(left < blockBytes ? left : blockBytes);
+    }
+};
+
+// ------------------------------------------------------------
+// Validate a WAD image (any format) and fill 'view':
+//  - a valid WAD header must be present
+//  - the header + table region must fit inside the image
+//  - every entry's data (every block of it, when compressed)
+//    must lie within the image, after the header + table region
+// On failure returns false and points 'error' at a message.
+// ------------------------------------------------------------
+bool OpenWadView(const uint8_t* base, size_t size, WadView& view, const wchar_t** error);
+
+// ------------------------------------------------------------
+// Validate the header + table of a WAD read from a stream,
+// before any of its data has arrived: 'base' holds exactly the
+// header + table ('size' bytes), entries must start after them
+// and must not run past the largest possible image. Compressed
+// WADs place their blocks anywhere and are refused.
+// On failure returns false and points 'error' at a message.
+// ------------------------------------------------------------
+bool OpenWadHead(const uint8_t* base, size_t size, WadView& view, const wchar_t** error);
+
+// ------------------------------------------------------------
+// Header + table size announced by the header at the start of
+// an image of 'size' bytes (any format; not validated, a header
+// too short to tell yields sizeof(WadHeader))
+// ------------------------------------------------------------
+uint64_t WadHeadBytes(const uint8_t* base, size_t size);
+
+// ------------------------------------------------------------
+// Compressed WADs: pass the decoded data of blocks [first,
+// first + count) of entry 'i' to 'sink' (data, size, offset in
+// the entry), in order. Blocks stored raw are passed straight
+// from the mapping (no copy); the others are decoded into
+// 'scratch'. Reads go through 'src', with the next block
+// prefetched while one is decoded. Returns false on a corrupt
+// block or when 'sink' returns false.
+// ------------------------------------------------------------
+using WadBlockSink = std::function<bool(const uint8_t* data, size_t size, uint64_t offset)>;
+
+bool DecodeWadBlocks(MappedWindow& src, const WadView& wad, uint32_t i, uint64_t first, uint64_t count,
+    std::vector<uint8_t>& scratch, const WadBlockSink& sink);
+
+// ------------------------------------------------------------
+// Lookup form of a WAD name character: ASCII lower case and
+// '/' -> '\'. Names that fold to the same string address the
+// same entry.
+// ------------------------------------------------------------
+inline uint8_t FoldWadNameChar(uint8_t c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return (uint8_t)(c + ('a' - 'A'));
+    if (c == '/')
+        return '\\';
+    return c;
+}
+
+// ------------------------------------------------------------
+// FoldWadNameChar over 'size' bytes of 'src' into 'dst' (may be
+// the same buffer), 16 bytes per step where SSE2 is available
+// ------------------------------------------------------------
+void FoldWadNameBytes(const char* src, size_t size, char* dst);
+
+// ------------------------------------------------------------
+// Map a WAD file with 'map' and validate it. In windowed mode
+// only the header + table stay mapped at view.base (the head is
+// grown to hold a large table), so entry data has to be read
+// through a MappedWindow, not entryData(). The table region is
+// prefetched before it is walked.
+// On failure returns false and points 'error' at a message.
+// ------------------------------------------------------------
+bool OpenWadFile(const std::filesystem::path& path, const MapOptions& map, MappedFile& file,
+    WadView& view, const wchar_t** error);
@@ -0,0 +1,192 @@
+﻿#include "wad_names.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OPENWAD_SSE2_NAMES 1
+#endif
+
+#ifdef _WIN32
+static const NativeChar kNativeSeparator = L'\\';
+static const char kForeignSeparator = '/';
+static bool IsNativeSeparator(NativeChar c) { return c == L'\\' || c == L'/'; }
+#else
+static const NativeChar kNativeSeparator = '/';
+static const char kForeignSeparator = '\\';
+static bool IsNativeSeparator(NativeChar c) { return c == '/'; }
+#endif
+
+void* NameArena::allocBytes(size_t bytes, size_t align)
+{
+    size_t pad = (align - (m_used & (align - 1))) & (align - 1);
+    if (!m_chunk || m_used + pad + bytes > m_capacity) {
+        // ----------------------------------------------------
+        // Start a new chunk; an oversized request gets a chunk
+        // of its own size
+        // ----------------------------------------------------
+        m_capacity = std::max(m_chunkBytes, bytes);
+        m_chunks.push_back(std::make_unique<uint8_t[]>(m_capacity));
+        m_chunk = m_chunks.back().get();
+        m_used = 0;
+        m_reserved += m_capacity;
+        pad = 0;
+    }
+
+    void* p = m_chunk + m_used + pad;
+    m_used += pad + bytes;
+    return p;
+}
+
+void NameArena::trim(const void* end)
+{
+    const uint8_t* e = static_cast<const uint8_t*>(end);
+    if (m_chunk && e >= m_chunk && e <= m_chunk + m_used)
+        m_used = (size_t)(e - m_chunk);
+}
+
+// ------------------------------------------------------------
+// Decode a WAD name into 'dst' (room for 2 * name.size() units)
+// and return the number of units written
+// ------------------------------------------------------------
+static size_t DecodeWadName(std::string_view name, NativeChar* dst)
+{
+    size_t i = 0;
+
+#ifdef OPENWAD_SSE2_NAMES
+    // ------------------------------------------------------------
+    // 1. ASCII runs: flip the foreign separator with one XOR and
+    //    store (widened on Windows); stop at the first 16 bytes
+    //    holding a byte >= 0x80
+    // ------------------------------------------------------------
+    const __m128i foreign = _mm_set1_epi8(kForeignSeparator);
+    const __m128i flip = _mm_set1_epi8((char)(kForeignSeparator ^ (char)kNativeSeparator));
+    for (; i + 16 <= name.size(); i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(name.data() + i));
+        if (_mm_movemask_epi8(v))
+            break;
+        v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(v, foreign), flip));
+#ifdef _WIN32
+        const __m128i zero = _mm_setzero_si128();
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+#else
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+#endif
+    }
+#endif
+
+    // ------------------------------------------------------------
+    // 2. The rest byte by byte: ASCII as is, anything else
+    //    through the code page (Windows) or as Latin-1 in UTF-8
+    //    (POSIX)
+    // ------------------------------------------------------------
+    size_t out = i;
+#ifdef _WIN32
+    size_t ascii = i;
+    while (ascii < name.size() && (uint8_t)name[ascii] < 0x80)
+        ascii++;
+    if (ascii < name.size()) {
+        // Bytes before 'i' are all ASCII, so 'i' is never inside
+        // a double-byte character
+        int n = MultiByteToWideChar(CP_ACP, 0, name.data() + i, (int)(name.size() - i),
+            dst + i, (int)(name.size() - i));
+        out = i + (size_t)std::max(n, 0);
+        std::replace(dst + i, dst + out, L'/', L'\\');
+        return out;
+    }
+    for (; i < name.size(); ++i)
+        dst[out++] = name[i] == kForeignSeparator ? kNativeSeparator : (NativeChar)name[i];
+#else
+    for (; i < name.size(); ++i) {
+        uint8_t c = (uint8_t)name[i];
+        if (c < 0x80) {
+            dst[out++] = c == (uint8_t)kForeignSeparator ? kNativeSeparator : (char)c;
+        }
+        else {
+            dst[out++] = (char)(0xC0 | (c >> 6));
+            dst[out++] = (char)(0x80 | (c & 0x3F));
+        }
+    }
+#endif
+    return out;
+}
+
+NativeStringView JoinWadName(NameArena& arena, NativeStringView dir, std::string_view name)
+{
+    NativeChar* out = arena.alloc<NativeChar>(dir.size() + 1 + name.size() * 2 + 1);
+    NativeChar* p = std::copy(dir.begin(), dir.end(), out);
+    if (!dir.empty() && !IsNativeSeparator(dir.back()))
+        *p++ = kNativeSeparator;
+
+    p += DecodeWadName(name, p);
+    *p = 0;
+    arena.trim(p + 1);
+    return NativeStringView(out, (size_t)(p - out));
+}
+
+bool IsSafeWadName(std::string_view name)
+{
+    size_t start = 0;
+    for (size_t i = 0; i <= name.size(); ++i) {
+        if (i < name.size() && name[i] != '\\' && name[i] != '/')
+            continue;
+
+        std::string_view part = name.substr(start, i - start);
+#ifdef _WIN32
+        // Windows drops trailing dots and spaces: ". ." or "..." is ".."
+        while (!part.empty() && (part.back() == '.' || part.back() == ' '))
+            part.remove_suffix(1);
+#endif
+        if (part.empty() || part == "." || part == "..")
+            return false;
+        if (start == 0 && part.find(':') != std::string_view::npos)
+            return false;   // Drive prefix ("C:") or an alternate data stream of the root
+        start = i + 1;
+    }
+    return true;
+}
+
+size_t ParentPathLength(NativeStringView path)
+{
+    for (size_t i = path.size(); i > 0; --i) {
+        if (IsNativeSeparator(path[i - 1]))
+            return i - 1;
+    }
+    return 0;
+}
+
+std::string_view EncodeWadName(NameArena& arena, std::wstring_view nameW)
+{
+#ifdef _WIN32
+    const size_t cap = nameW.size() * 3;   // Largest code page sequence per UTF-16 unit
+#else
+    const size_t cap = nameW.size();
+#endif
+    char* out = arena.alloc<char>(cap);
+
+    size_t i = 0;
+    for (; i < nameW.size() && (uint32_t)nameW[i] < 0x80; ++i)
+        out[i] = (char)nameW[i];
+
+    size_t size = i;
+    if (i < nameW.size()) {
+#ifdef _WIN32
+        int n = WideCharToMultiByte(CP_ACP, 0, nameW.data() + i, (int)(nameW.size() - i),
+            out + i, (int)(cap - i), nullptr, nullptr);
+        size = i + (size_t)std::max(n, 0);
+#else
+        for (; i < nameW.size(); ++i)
+            out[i] = (nameW[i] >= 0 && nameW[i] <= 0xFF) ? (char)nameW[i] : '?';
+        size = i;
+#endif
+    }
+
+    arena.trim(out + size);
+    return std::string_view(out, size);
+}
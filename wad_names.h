@@ -0,0 +1,175 @@
+﻿#pragma once
+#include "platform.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// ------------------------------------------------------------
+// Name layer shared by extraction and packing: WAD names are
+// decoded into native paths (and encoded back) inside a per-
+// operation arena, so that planning thousands of entries does
+// not cost a heap allocation per entry.
+// ------------------------------------------------------------
+
+static const size_t kNameArenaChunkBytes = 1024 * 1024;   // Arena growth step
+
+// ------------------------------------------------------------
+// Bump allocator for the strings of one operation. Memory is
+// released all at once when the arena is destroyed; pointers
+// stay valid until then.
+// ------------------------------------------------------------
+class NameArena {
+public:
+    explicit NameArena(size_t chunkBytes = kNameArenaChunkBytes) : m_chunkBytes(chunkBytes) {}
+    NameArena(const NameArena&) = delete;
+    NameArena& operator=(const NameArena&) = delete;
+
+    // --------------------------------------------------------
+    // Uninitialised room for 'count' objects of T
+    // --------------------------------------------------------
+    template <class T>
+    T* alloc(size_t count)
+    {
+        return static_cast<T*>(allocBytes(count * sizeof(T), alignof(T)));
+    }
+
+    // --------------------------------------------------------
+    // Return the unused tail of the most recent allocation:
+    // everything from 'end' on is handed out again
+    // --------------------------------------------------------
+    void trim(const void* end);
+
+    uint64_t bytesReserved() const { return m_reserved; }
+
+private:
+    void* allocBytes(size_t bytes, size_t align);
+
+    std::vector<std::unique_ptr<uint8_t[]>> m_chunks;
+    uint8_t* m_chunk = nullptr;   // Chunk being filled
+    size_t m_used = 0;            // Bytes handed out from m_chunk
+    size_t m_capacity = 0;        // Size of m_chunk
+    size_t m_chunkBytes;          // Default chunk size
+    uint64_t m_reserved = 0;      // Total bytes of all chunks
+};
+
+// ------------------------------------------------------------
+// Open-addressing map from a string to an index. Keys are not
+// copied: they must outlive the index (arena strings, a mapped
+// table) and have a non-null data pointer.
+// ------------------------------------------------------------
+template <class Char>
+class NameIndex {
+public:
+    using View = std::basic_string_view<Char>;
+
+    // --------------------------------------------------------
+    // Size the table for 'count' keys without a rehash
+    // --------------------------------------------------------
+    void reserve(size_t count)
+    {
+        size_t slots = 16;
+        while (slots < count * 2)
+            slots *= 2;
+        if (slots > m_slots.size())
+            rehash(slots);
+    }
+
+    // --------------------------------------------------------
+    // Insert key -> value unless the key is present. Returns
+    // the stored value and whether it was inserted.
+    // --------------------------------------------------------
+    std::pair<size_t&, bool> tryEmplace(View key, size_t value)
+    {
+        if ((m_count + 1) * 2 > m_slots.size())
+            rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+
+        size_t hash = std::hash<View>{}(key);
+        for (size_t i = hash & (m_slots.size() - 1);; i = (i + 1) & (m_slots.size() - 1)) {
+            Slot& s = m_slots[i];
+            if (!s.data) {
+                s = Slot{ key.data(), key.size(), hash, value };
+                m_count++;
+                return { s.value, true };
+            }
+            if (s.hash == hash && View(s.data, s.size) == key)
+                return { s.value, false };
+        }
+    }
+
+    // --------------------------------------------------------
+    // Value stored for 'key', or nullptr
+    // --------------------------------------------------------
+    const size_t* find(View key) const
+    {
+        if (m_slots.empty())
+            return nullptr;
+        size_t hash = std::hash<View>{}(key);
+        for (size_t i = hash & (m_slots.size() - 1);; i = (i + 1) & (m_slots.size() - 1)) {
+            const Slot& s = m_slots[i];
+            if (!s.data)
+                return nullptr;
+            if (s.hash == hash && View(s.data, s.size) == key)
+                return &s.value;
+        }
+    }
+
+    size_t size() const { return m_count; }
+
+private:
+    struct Slot {
+        const Char* data = nullptr;  // Key characters (nullptr = empty slot)
+        size_t size = 0;             // Key length
+        size_t hash = 0;             // Hash of the key
+        size_t value = 0;            // Mapped value
+    };
+
+    void rehash(size_t slots)
+    {
+        std::vector<Slot> old(slots);
+        old.swap(m_slots);
+        for (const Slot& s : old) {
+            if (!s.data)
+                continue;
+            size_t i = s.hash & (slots - 1);
+            while (m_slots[i].data)
+                i = (i + 1) & (slots - 1);
+            m_slots[i] = s;
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_count = 0;
+};
+
+// ------------------------------------------------------------
+// Build "<dir><separator><name>" in the arena as a NUL-
+// terminated native path: the WAD name is decoded the way
+// ToWideFromAnsi + WadNameToPath would, and both '\' and '/'
+// become the native separator. ASCII names (the usual case)
+// are converted 16 bytes per step where SSE2 is available.
+// ------------------------------------------------------------
+NativeStringView JoinWadName(NameArena& arena, NativeStringView dir, std::string_view name);
+
+// ------------------------------------------------------------
+// True when a WAD name stays inside the folder it is joined to:
+// no empty, "." or ".." component (either separator), no root
+// or drive prefix. Extraction skips entries failing this, so a
+// crafted table cannot write outside the output folder.
+// ------------------------------------------------------------
+bool IsSafeWadName(std::string_view name);
+
+// ------------------------------------------------------------
+// Length of the parent directory of a path built by
+// JoinWadName (the position of its last separator; 0 if none)
+// ------------------------------------------------------------
+size_t ParentPathLength(NativeStringView path);
+
+// ------------------------------------------------------------
+// Encode a '\' separated relative path for a WAD name field
+// the way ToAnsiFromWide would, into the arena (not NUL-
+// terminated; WriteWadItem cuts it to the field)
+// ------------------------------------------------------------
+std::string_view EncodeWadName(NameArena& arena, std::wstring_view nameW);
@@ -0,0 +1,1781 @@
+﻿#include "wad_pack.h"
+#include "wad_format.h"
+#include "mapped_file.h"
+#include "copy_engine.h"
+#include "batch_io.h"
+#include "platform.h"
+#include "logger.h"
+#include "checksum.h"
+#include "pack_index.h"
+#include "wad_verify.h"
+#include "wad_trace.h"
+#include "telemetry.h"
+#include "job.h"
+#include "wad_trie.h"
+#include "wad_names.h"
+#include "lz_codec.h"
+
+#include "dir_scan.h"
+#include "bounded_queue.h"
+#include "thread_pool.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <unordered_map>
+#include <numeric>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+// ------------------------------------------------------------
+// Scan stage -> read stage: one source file to read
+// ------------------------------------------------------------
+struct ReadJob {
+    size_t id = 0;                   // Discovery id of the file (ScannedFile::id)
+    std::filesystem::path fullPath;  // Full path to the source file on disk
+    uint64_t size = 0;               // Scanned file size
+};
+
+// ------------------------------------------------------------
+// Read stage -> write stage: one filled buffer from the pool.
+// Files are read while the scan is still running, before their
+// place in the data area is known, so a block is addressed by
+// file id + offset inside the file. For a compressed WAD the
+// reader compresses the block in place (one pool buffer is one
+// WAD block).
+// ------------------------------------------------------------
+struct DataBlock {
+    uint8_t* data = nullptr;         // Pool buffer holding the bytes
+    size_t length = 0;               // Number of valid bytes in the buffer
+    size_t rawLength = 0;            // Bytes of the file the buffer stands for
+    bool compressed = false;         // 'data' holds an LZ block
+    size_t id = 0;                   // Discovery id of the file
+    uint64_t fileOffset = 0;         // Offset of the bytes inside the file
+};
+
+static const size_t kPackBlockBytes = 1024 * 1024;         // Size of one pool buffer
+static_assert(kPackBlockBytes == kWadLzBlockBytes, "a pool buffer holds one compressed WAD block");
+static const size_t kPackBlockCount = 32;                  // Pool buffers in flight (bounds memory)
+static const size_t kPackTrimBytes = 64ull * 1024 * 1024;  // Mapped bytes written between working set trims
+static const size_t kPackCopyBytes = 8ull * 1024 * 1024;   // Chunk size when copying from the previous WAD
+
+// ------------------------------------------------------------
+// Previous output of an incremental pack: the old WAD (mapped)
+// and its sidecar, checked against each other
+// ------------------------------------------------------------
+struct PackBase {
+    MappedFile wad;                                      // Old WAD image
+    WadView view;                                        // Its validated table
+    PackIndex index;                                     // Sidecar, one entry per table entry
+    std::unordered_map<std::wstring, uint32_t> byPath;   // Source path -> table index
+
+    // --------------------------------------------------------
+    // Table index of the old entry that still holds the
+    // contents of 'f' (same size and write time), or -1
+    // --------------------------------------------------------
+    int64_t find(const ScannedFile& f) const
+    {
+        auto it = byPath.find(f.relPathW);
+        if (it == byPath.end())
+            return -1;
+        const PackIndexEntry& e = index.entries[it->second];
+        if (e.mtime == 0 || e.size != f.size || e.mtime != f.mtime)
+            return -1;
+        return it->second;
+    }
+};
+
+// ------------------------------------------------------------
+// Open the previous WAD and its sidecar. Fails (and the pack
+// falls back to reading everything) when either is missing,
+// they no longer describe each other or the WAD is compressed.
+// ------------------------------------------------------------
+static bool LoadPackBase(const std::filesystem::path& wadPath, const MapOptions& map, PackBase& prev)
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (!GetFileInfo(wadPath, size, mtime) || !ReadPackIndex(PackIndexPath(wadPath), prev.index))
+        return false;
+    if (prev.index.wadSize != size || prev.index.wadMtime != mtime)
+        return false;
+
+    const wchar_t* error = nullptr;
+    if (!OpenWadFile(wadPath, map, prev.wad, prev.view, &error) || prev.view.compressed())
+        return false;   // Compressed data cannot be copied range by range
+    if (prev.index.entries.size() != prev.view.fileCount)
+        return false;
+
+    prev.byPath.reserve(prev.view.fileCount);
+    for (uint32_t i = 0; i < prev.view.fileCount; ++i) {
+        if (prev.index.entries[i].size != prev.view.entrySize(i))
+            return false;
+        prev.byPath[prev.index.entries[i].relPathW] = i;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// State shared by the scan, read and write stages
+// ------------------------------------------------------------
+struct PackPipeline {
+    // --------------------------------------------------------
+    // The scan -> read queue is unbounded on purpose: the write
+    // stage needs the complete layout before it can place any
+    // data, so a blocked scanner would deadlock the pipeline.
+    // Back-pressure is applied by the fixed buffer pool between
+    // the read and write stages instead.
+    // --------------------------------------------------------
+    BoundedQueue<ReadJob> readQueue{ SIZE_MAX };
+    BoundedQueue<DataBlock> writeQueue{ kPackBlockCount };
+    BoundedQueue<uint8_t*> freeBlocks{ kPackBlockCount };
+    std::vector<std::unique_ptr<uint8_t[]>> blockMemory;
+
+    ScanResult scan;                           // Filled by the scan stage
+    bool manifestFailed = false;               // The manifest could not be read
+    std::atomic<bool> abort{ false };          // Stop reading (output could not be created, cancelled)
+    const std::atomic<bool>* cancel = nullptr; // Front end cancel request (PackOptions::cancel)
+    MapOptions map;                            // How WADs are mapped (PackOptions::map)
+    std::atomic<unsigned> readersLeft{ 0 };    // Readers still running
+    std::atomic<bool> writeFailed{ false };    // A write to the output failed
+    std::mutex doneMutex;                      // Guards writerDone
+    std::condition_variable doneCv;            // Signalled when the write stage finishes
+    bool writerDone = false;                   // Write stage finished
+
+    std::mutex failMutex;                      // Guards failed
+    std::vector<size_t> failed;                // Items that changed or could not be read
+
+    const PackBase* prev = nullptr;            // Previous WAD (incremental mode with a usable base)
+    bool deferReads = false;                   // Main thread queues the reads after the scan (dedup mode)
+    CopyStrategy copyStrategy = CopyStrategy::Auto;  // Requested copy strategy
+    bool streamStores = false;                 // Fill the mapped output with streaming stores
+    IoBackend ioBackend = IoBackend::Auto;     // Requested I/O backend
+    bool batching = false;                     // Readers batch small files through io_uring
+    bool hashing = false;                      // Hash contents while reading (incremental mode)
+    bool compress = false;                     // Readers compress, the writer appends (compressed WAD)
+    std::mutex hashMutex;                      // Guards hashById
+    std::unordered_map<size_t, uint64_t> hashById;  // XXH64 of every file read, by id
+
+    // --------------------------------------------------------
+    // Layout hand-off from the main thread to the write stage
+    // --------------------------------------------------------
+    std::mutex layoutMutex;
+    std::condition_variable layoutCv;
+    int layoutState = 0;                       // 0 = pending, 1 = ready, 2 = failed
+    std::vector<uint64_t> offsetById;          // File offset of each file's data, by id
+    std::vector<uint64_t> firstBlockById;      // Compressed WAD: block table index of each file's data
+    std::vector<WadLzBlock> blocks;            // Compressed WAD: block table, filled by the writer
+    uint64_t appendOffset = 0;                 // Compressed WAD: end of the data written so far
+    MappedOutput* mout = nullptr;              // Mapped output (mapped mode)
+    FileHandle* out = nullptr;                 // Output file (pwrite mode)
+
+    // --------------------------------------------------------
+    // Stage timings (nanoseconds of busy time)
+    // --------------------------------------------------------
+    std::atomic<uint64_t> scanNs{ 0 };
+    std::atomic<uint64_t> readNs{ 0 };
+    std::atomic<uint64_t> writeNs{ 0 };
+
+    void markFailed(size_t id)
+    {
+        std::lock_guard<std::mutex> lock(failMutex);
+        failed.push_back(id);
+    }
+
+    void publishLayout(int state)
+    {
+        {
+            std::lock_guard<std::mutex> lock(layoutMutex);
+            layoutState = state;
+        }
+        layoutCv.notify_all();
+    }
+};
+
+static uint64_t ElapsedNs(std::chrono::steady_clock::time_point t0)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+// ------------------------------------------------------------
+// Scan stage: list the folder in parallel (or read the
+// manifest) and queue every file for reading as soon as it is
+// found
+// ------------------------------------------------------------
+static void ScanStage(PackPipeline& pp, const std::filesystem::path& base,
+    const PackOptions& options, unsigned threads)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    TelemetryThreadName("scanner");
+    TelemetrySpan span(TelemetryPhase::Scan);
+
+    ScanCallback onFile = [&pp](const ScannedFile& f) {
+        if (pp.deferReads)
+            return;   // Duplicates must be known before anything is read
+        if (pp.prev && pp.prev->find(f) >= 0)
+            return;   // Unchanged: copied from the previous WAD instead
+
+        ReadJob job;
+        job.id = f.id;
+        job.fullPath = f.fullPath;
+        job.size = f.size;
+        pp.readQueue.push(std::move(job));
+    };
+
+    if (!options.manifestPath.empty())
+        pp.manifestFailed = !ScanManifest(options.manifestPath, base, threads, onFile, pp.scan);
+    else
+        ScanFolder(base, threads, onFile, pp.scan);
+
+    if (!pp.deferReads)
+        pp.readQueue.close();
+    pp.scanNs = ElapsedNs(t0);
+}
+
+// ------------------------------------------------------------
+// Compressed WAD: compress a filled block in place. A block
+// that does not shrink is kept as it is (stored raw).
+// ------------------------------------------------------------
+static void CompressBlock(DataBlock& block)
+{
+    TelemetrySpan span(TelemetryPhase::Compress);
+    thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < LzCompressBound(kPackBlockBytes))
+        scratch.resize(LzCompressBound(kPackBlockBytes));
+
+    size_t stored = LzCompress(block.data, block.length, scratch.data(), block.length - 1);
+    if (stored > 0) {
+        memcpy(block.data, scratch.data(), stored);
+        block.length = stored;
+        block.compressed = true;
+    }
+    TelemetryAdd(TelemetryCounter::BytesCompressed, block.length);
+}
+
+// ------------------------------------------------------------
+// Read one source file block by block into pool buffers and
+// pass them on to the write stage. Waiting for a free buffer is
+// the back-pressure from the write stage.
+// ------------------------------------------------------------
+static void ReadWholeFile(PackPipeline& pp, const ReadJob& job, uint64_t& busyNs)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    TelemetrySpan span(TelemetryPhase::Read);
+
+    FileHandle in;
+    Xxh64 hasher;
+    uint64_t done = 0;
+    bool ok = in.openRead(job.fullPath);
+
+    while (ok && done < job.size) {
+        if (pp.abort.load(std::memory_order_relaxed)) {
+            ok = false;   // Cancelled or the output failed: stop within one block
+            break;
+        }
+        uint8_t* buf = nullptr;
+
+        busyNs += ElapsedNs(t0);
+        bool gotBlock = pp.freeBlocks.pop(buf);
+        t0 = std::chrono::steady_clock::now();
+        if (!gotBlock) {
+            ok = false;
+            break;
+        }
+
+        // ------------------------------------------------------------
+        // Fill the whole buffer: a compressed block must hold all
+        // of its bytes. A file that shrank since the scan leaves a
+        // short block, zero-filled for a compressed WAD.
+        // ------------------------------------------------------------
+        size_t want = (size_t)std::min<uint64_t>(job.size - done, kPackBlockBytes);
+        size_t got = 0;
+        bool filled = true;
+        while (got < want) {
+            size_t n = 0;
+            if (!in.read(buf + got, want - got, n) || n == 0) {
+                filled = false;
+                break;
+            }
+            got += n;
+        }
+        if (got == 0) {
+            pp.freeBlocks.push(buf);
+            ok = false;
+            break;
+        }
+        if (!filled && pp.compress) {
+            memset(buf + got, 0, want - got);
+            got = want;
+        }
+
+        if (pp.hashing)
+            hasher.update(buf, got);
+
+        DataBlock block;
+        block.data = buf;
+        block.length = got;
+        block.rawLength = got;
+        block.id = job.id;
+        block.fileOffset = done;
+        if (pp.compress)
+            CompressBlock(block);
+
+        busyNs += ElapsedNs(t0);
+        pp.writeQueue.push(block);
+        t0 = std::chrono::steady_clock::now();
+
+        done += got;
+        if (!filled) {
+            ok = false;
+            break;
+        }
+    }
+
+    // --------------------------------------------------------
+    // The file grew since the scan: only the scanned size fits
+    // into the slot reserved for it. A short read leaves the
+    // rest of the slot zero (the output is created zeroed).
+    // --------------------------------------------------------
+    uint64_t nowSize = 0;
+    if (ok && in.getSize(nowSize) && nowSize != job.size)
+        ok = false;
+    if (!ok) {
+        pp.markFailed(job.id);
+    }
+    else {
+        TelemetryAdd(TelemetryCounter::FilesRead, 1);
+        TelemetryAdd(TelemetryCounter::BytesRead, done);
+        if (pp.hashing) {
+            std::lock_guard<std::mutex> lock(pp.hashMutex);
+            pp.hashById[job.id] = hasher.digest();
+        }
+    }
+
+    busyNs += ElapsedNs(t0);
+}
+
+// ------------------------------------------------------------
+// Read a batch of small files (each fits one pool buffer)
+// through the ring: 'job' and whatever small jobs are queued
+// right now, as many as there are free buffers. Each file is
+// read with one byte of spare room, so a file that grew since
+// the scan shows up as a long read. Returns true when a job
+// that did not fit the batch was left in 'job'.
+// ------------------------------------------------------------
+static bool ReadSmallFiles(PackPipeline& pp, BatchIo& io, ReadJob& job, uint64_t& busyNs)
+{
+    uint8_t* buf = nullptr;
+    if (!pp.freeBlocks.pop(buf)) {
+        pp.markFailed(job.id);
+        return false;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    TelemetrySpan span(TelemetryPhase::Read);
+
+    std::vector<ReadJob> jobs;
+    std::vector<uint8_t*> bufs;
+    jobs.push_back(std::move(job));
+    bufs.push_back(buf);
+
+    bool carry = false;
+    while (jobs.size() < kBatchIoDepth) {
+        ReadJob next;
+        if (!pp.readQueue.tryPop(next))
+            break;
+        if (next.size >= kPackBlockBytes || !pp.freeBlocks.tryPop(buf)) {
+            job = std::move(next);
+            carry = true;
+            break;
+        }
+        jobs.push_back(std::move(next));
+        bufs.push_back(buf);
+    }
+
+    std::vector<BatchFileOp> ops(jobs.size());
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        ops[k].path = jobs[k].fullPath.c_str();
+        ops[k].dst = bufs[k];
+        ops[k].size = (size_t)jobs[k].size + 1;
+    }
+    io.readFiles(ops.data(), ops.size());
+
+    std::vector<size_t> retry;   // The ring failed (and closed) before these were read
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        if (ops[k].retry) {
+            pp.freeBlocks.push(bufs[k]);
+            retry.push_back(k);
+            continue;
+        }
+        bool ok = ops[k].ok && ops[k].done == jobs[k].size;
+        if (!ok) {
+            pp.markFailed(jobs[k].id);
+        }
+        else {
+            TelemetryAdd(TelemetryCounter::FilesRead, 1);
+            TelemetryAdd(TelemetryCounter::BytesRead, jobs[k].size);
+            if (pp.hashing) {
+                std::lock_guard<std::mutex> lock(pp.hashMutex);
+                pp.hashById[jobs[k].id] = HashXxh64(bufs[k], (size_t)jobs[k].size);
+            }
+        }
+
+        if (!ok || jobs[k].size == 0) {
+            pp.freeBlocks.push(bufs[k]);
+            continue;
+        }
+
+        DataBlock block;
+        block.data = bufs[k];
+        block.length = (size_t)jobs[k].size;
+        block.rawLength = block.length;
+        block.id = jobs[k].id;
+        block.fileOffset = 0;
+        if (pp.compress)
+            CompressBlock(block);
+
+        busyNs += ElapsedNs(t0);
+        pp.writeQueue.push(block);
+        t0 = std::chrono::steady_clock::now();
+    }
+
+    busyNs += ElapsedNs(t0);
+    for (size_t k : retry)
+        ReadWholeFile(pp, jobs[k], busyNs);
+    return carry;
+}
+
+// ------------------------------------------------------------
+// Read stage: take the queued files one by one, or in batches
+// of small files when the reader has an io_uring ring
+// ------------------------------------------------------------
+static void ReadStage(PackPipeline& pp)
+{
+    uint64_t busyNs = 0;
+    TelemetryThreadName("reader");
+
+    BatchIo io;
+    if (pp.batching)
+        io.open(pp.ioBackend);
+
+    ReadJob job;
+    bool haveJob = false;
+    for (;;) {
+        if (!haveJob && !pp.readQueue.pop(job))
+            break;
+        haveJob = false;
+
+        if (pp.abort.load(std::memory_order_relaxed))
+            continue;   // Drain the queue without reading
+
+        if (io.isOpen() && job.size < kPackBlockBytes)
+            haveJob = ReadSmallFiles(pp, io, job, busyNs);
+        else
+            ReadWholeFile(pp, job, busyNs);
+    }
+
+    pp.readNs += busyNs;
+
+    if (pp.readersLeft.fetch_sub(1) == 1)
+        pp.writeQueue.close();
+}
+
+// ------------------------------------------------------------
+// Write stage: wait for the layout, then place every block at
+// its final offset (memcpy into the mapped view, or a positioned
+// write) and return the buffer to the pool. Compressed blocks
+// are appended in arrival order and entered in the block table.
+// ------------------------------------------------------------
+static void WriteStage(PackPipeline& pp)
+{
+    TelemetryThreadName("writer");
+    {
+        std::unique_lock<std::mutex> lock(pp.layoutMutex);
+        pp.layoutCv.wait(lock, [&pp] { return pp.layoutState != 0; });
+    }
+    bool ready = pp.layoutState == 1;
+
+    uint64_t busyNs = 0;
+    uint64_t untrimmed = 0;
+    uint64_t trimLo = UINT64_MAX, trimHi = 0;
+
+    DataBlock block;
+    while (pp.writeQueue.pop(block)) {
+        auto t0 = std::chrono::steady_clock::now();
+        TelemetrySpan span(TelemetryPhase::Write);
+
+        if (ready && !pp.abort.load(std::memory_order_relaxed)) {
+            uint64_t pos = pp.offsetById[block.id] + block.fileOffset;
+
+            if (pp.compress) {
+                WadLzBlock& entry = pp.blocks[pp.firstBlockById[block.id] + block.fileOffset / kPackBlockBytes];
+                entry.offset = pp.appendOffset;
+                entry.storedSize = (uint32_t)block.length;
+                entry.flags = block.compressed ? 0 : kWadLzBlockRaw;
+                pp.appendOffset += block.length;
+                if (!pp.out->writeAt(block.data, entry.offset, block.length)) {
+                    pp.writeFailed = true;
+                    pp.abort = true;
+                }
+            }
+            else if (pp.mout) {
+                CopyBytes(pp.mout->base + pos, block.data, block.length, pp.streamStores);
+
+                // ------------------------------------------------
+                // Blocks arrive out of order, so release the whole
+                // extent written since the last trim. Releasing a
+                // page that is not written yet is harmless: the
+                // mapping is shared, nothing is discarded.
+                // ------------------------------------------------
+                trimLo = std::min(trimLo, pos);
+                trimHi = std::max(trimHi, pos + block.length);
+                untrimmed += block.length;
+                if (untrimmed >= kPackTrimBytes) {
+                    pp.mout->release((size_t)trimLo, (size_t)(trimHi - trimLo));
+                    untrimmed = 0;
+                    trimLo = UINT64_MAX;
+                    trimHi = 0;
+                }
+            }
+            else if (!pp.out->writeAt(block.data, pos, block.length)) {
+                pp.writeFailed = true;
+                pp.abort = true;
+            }
+        }
+
+        AddProgress(block.rawLength);
+        TelemetryAdd(TelemetryCounter::BytesWritten, block.length);
+        pp.freeBlocks.push(block.data);
+
+        busyNs += ElapsedNs(t0);
+    }
+
+    pp.writeNs = busyNs;
+    {
+        std::lock_guard<std::mutex> lock(pp.doneMutex);
+        pp.writerDone = true;
+    }
+    pp.doneCv.notify_all();
+}
+
+// ------------------------------------------------------------
+// True when two files have the same contents (both readable)
+// ------------------------------------------------------------
+static bool SameFileContents(const std::filesystem::path& a, const std::filesystem::path& b, uint64_t size)
+{
+    FileHandle fa, fb;
+    if (!fa.openRead(a) || !fb.openRead(b))
+        return false;
+
+    const size_t kChunk = 256 * 1024;
+    std::vector<uint8_t> bufA(kChunk), bufB(kChunk);
+    for (uint64_t done = 0; done < size;) {
+        size_t want = (size_t)std::min<uint64_t>(size - done, kChunk);
+        size_t gotA = 0, gotB = 0;
+        if (!fa.read(bufA.data(), want, gotA) || !fb.read(bufB.data(), want, gotB) ||
+            gotA != want || gotB != want || memcmp(bufA.data(), bufB.data(), want) != 0)
+            return false;
+        done += want;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Dedup mode: find files with identical contents
+//  - only files sharing their size with another file are
+//    candidates; those are hashed (XXH64) on the pool, or take
+//    the hash from the sidecar when the incremental base says
+//    they are unchanged
+//  - equal size + hash is confirmed byte for byte before an
+//    item is pointed at another one
+// dupOf[i] receives the position of the first item (table
+// order) with the same contents, or -1. Returns the number of
+// duplicate items.
+// ------------------------------------------------------------
+static size_t FindDuplicates(PackPipeline& pp, const std::vector<ScannedFile>& items,
+    unsigned threads, std::vector<int64_t>& dupOf)
+{
+    TelemetrySpan span(TelemetryPhase::Dedup);
+    dupOf.assign(items.size(), -1);
+
+    // ------------------------------------------------------------
+    // 1. Candidates: sizes that occur more than once
+    // ------------------------------------------------------------
+    std::unordered_map<uint64_t, uint32_t> sizeCount;
+    for (const ScannedFile& f : items) {
+        if (f.size > 0)
+            sizeCount[f.size]++;
+    }
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i].size > 0 && sizeCount[items[i].size] > 1)
+            candidates.push_back(i);
+    }
+    if (candidates.empty())
+        return 0;
+
+    // ------------------------------------------------------------
+    // 2. Hash the candidates in parallel
+    // ------------------------------------------------------------
+    std::vector<uint64_t> hash(items.size(), 0);
+    std::vector<uint8_t> hashed(items.size(), 0);
+    {
+        ThreadPool pool(threads);
+        const size_t kSlice = 64;
+        for (size_t first = 0; first < candidates.size(); first += kSlice) {
+            size_t last = std::min(candidates.size(), first + kSlice);
+            pool.submit([&, first, last] {
+                std::vector<uint8_t> buf(kPackBlockBytes);
+                for (size_t k = first; k < last && !IsCancelled(pp.cancel); ++k) {
+                    size_t i = candidates[k];
+                    if (pp.prev) {
+                        int64_t old = pp.prev->find(items[i]);
+                        if (old >= 0) {
+                            hash[i] = pp.prev->index.entries[old].hash;
+                            hashed[i] = 1;
+                            continue;
+                        }
+                    }
+
+                    FileHandle in;
+                    if (!in.openRead(items[i].fullPath))
+                        continue;
+                    Xxh64 h;
+                    uint64_t done = 0;
+                    size_t got = 0;
+                    while (done < items[i].size && in.read(buf.data(), buf.size(), got) && got > 0) {
+                        h.update(buf.data(), got);
+                        done += got;
+                    }
+                    if (done == items[i].size) {
+                        hash[i] = h.digest();
+                        hashed[i] = 1;
+                    }
+                }
+            });
+        }
+    }
+
+    if (IsCancelled(pp.cancel))
+        return 0;
+
+    // ------------------------------------------------------------
+    // 3. Group by (size, hash) in table order and confirm every
+    //    member against the group's distinct contents so far
+    //    (a hash collision starts a new distinct contents)
+    // ------------------------------------------------------------
+    struct KeyHash {
+        size_t operator()(const std::pair<uint64_t, uint64_t>& k) const {
+            return (size_t)(k.first * 0x9E3779B97F4A7C15ull ^ k.second);
+        }
+    };
+    std::unordered_map<std::pair<uint64_t, uint64_t>, std::vector<size_t>, KeyHash> groups;
+    for (size_t i : candidates) {
+        if (hashed[i])
+            groups[{ items[i].size, hash[i] }].push_back(i);
+    }
+
+    {
+        ThreadPool pool(threads);
+        for (auto& g : groups) {
+            if (g.second.size() < 2)
+                continue;
+            const std::vector<size_t>* members = &g.second;
+            pool.submit([&items, &dupOf, members] {
+                std::vector<size_t> distinct;
+                for (size_t m : *members) {
+                    for (size_t c : distinct) {
+                        if (SameFileContents(items[c].fullPath, items[m].fullPath, items[m].size)) {
+                            dupOf[m] = (int64_t)c;
+                            break;
+                        }
+                    }
+                    if (dupOf[m] < 0)
+                        distinct.push_back(m);
+                }
+            });
+        }
+    }
+
+    // ------------------------------------------------------------
+    // 4. Keep the hashes for the sidecar (incremental mode)
+    // ------------------------------------------------------------
+    size_t dupCount = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (hashed[i])
+            pp.hashById[items[i].id] = hash[i];
+        if (dupOf[i] >= 0)
+            dupCount++;
+    }
+    return dupCount;
+}
+
+// ------------------------------------------------------------
+// Checksum mode: hash the finished WAD and compare every entry
+// with the hash of the source bytes read for it (or recorded
+// for it by the previous pack), then store the checksums.
+// Entries whose source changed while packing are not compared.
+// ------------------------------------------------------------
+static bool ReadBackChecksums(const std::filesystem::path& outPath, PackPipeline& pp, const PackBase& prev,
+    const std::vector<ScannedFile>& items, const std::vector<int64_t>& reuse,
+    const std::vector<int64_t>& dupOf, const std::vector<uint8_t>& failed, unsigned threads)
+{
+    Log(L"Reading back...");
+
+    MappedFile mf;
+    WadView wad;
+    const wchar_t* error = nullptr;
+    if (!OpenWadFile(outPath, pp.map, mf, wad, &error) || wad.fileCount != items.size()) {
+        ShowError(L"Failed to read back the WAD file.");
+        return false;
+    }
+
+    WadChecksums sums;
+    HashWadEntries(mf, wad, threads, sums, nullptr, pp.cancel);
+    if (IsCancelled(pp.cancel)) {
+        Log(L"Read-back cancelled, no checksums written");
+        return false;
+    }
+
+    std::vector<uint64_t> expected(items.size(), 0);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (dupOf[i] >= 0)
+            expected[i] = expected[dupOf[i]];
+        else if (reuse[i] >= 0)
+            expected[i] = prev.index.entries[reuse[i]].hash;
+        else
+            expected[i] = pp.hashById[items[i].id];
+
+        if (!failed[items[i].id] && expected[i] != sums.entries[i]) {
+            LogBuffered(L"Read-back mismatch: " + items[i].relPathW);
+            mismatches++;
+        }
+    }
+    AppendBufferedLog();
+
+    if (mismatches > 0) {
+        ShowError(L"The written WAD does not match its sources.");
+        return false;
+    }
+
+    if (!WriteChecksums(ChecksumPath(outPath), sums))
+        Log(L"Failed to write checksum file");
+    else
+        Log(L"Read-back verified, checksums written");
+    return true;
+}
+
+// ------------------------------------------------------------
+// Copy the entries reused from the previous WAD into the new
+// one. Neighbouring entries that are also neighbours in the old
+// WAD are merged into one range, so an unchanged stretch of the
+// data area becomes a few large copies. Runs on the calling
+// thread next to the write stage (the ranges never overlap).
+// ------------------------------------------------------------
+static void CopyUnchangedEntries(PackPipeline& pp, const PackBase& prev,
+    const std::vector<ScannedFile>& items, const std::vector<uint64_t>& dataOffset,
+    const std::vector<int64_t>& reuse)
+{
+    TelemetrySpan span(TelemetryPhase::CopyUnchanged);
+
+    struct Range {
+        uint64_t src = 0;   // Offset in the old WAD
+        uint64_t dst = 0;   // Offset in the new WAD
+        uint64_t size = 0;  // Length in bytes
+    };
+
+    std::vector<Range> ranges;
+    for (size_t i = 0; i < reuse.size(); ++i) {
+        if (reuse[i] < 0 || items[i].size == 0)
+            continue;
+
+        Range r;
+        r.src = prev.view.entryOffset((uint32_t)reuse[i]);
+        r.dst = dataOffset[i];
+        r.size = items[i].size;
+
+        if (!ranges.empty()) {
+            Range& last = ranges.back();
+            if (last.src + last.size == r.src && last.dst + last.size == r.dst) {
+                last.size += r.size;
+                continue;
+            }
+        }
+        ranges.push_back(r);
+    }
+
+    // ------------------------------------------------------------
+    // The old WAD is read through a map window; the chunk after
+    // the current one is queued for read-ahead before copying
+    // ------------------------------------------------------------
+    MappedWindow window(prev.wad);
+    const size_t chunk = std::min(kPackCopyBytes, window.windowBytes());
+
+    for (size_t k = 0; k < ranges.size(); ++k) {
+        const Range& r = ranges[k];
+        for (uint64_t done = 0; done < r.size;) {
+            if (IsCancelled(pp.cancel))
+                pp.abort = true;
+            if (pp.abort.load(std::memory_order_relaxed))
+                return;
+
+            size_t n = (size_t)std::min<uint64_t>(r.size - done, chunk);
+            uint64_t dst = r.dst + done;
+
+            if (done + n < r.size)
+                window.prefetch(r.src + done + n, std::min<uint64_t>(r.size - done - n, chunk));
+            else if (k + 1 < ranges.size())
+                window.prefetch(ranges[k + 1].src, std::min<uint64_t>(ranges[k + 1].size, chunk));
+
+            if (pp.mout) {
+                const uint8_t* src = window.view(r.src + done, n);
+                if (!src) {
+                    pp.writeFailed = true;
+                    pp.abort = true;
+                    return;
+                }
+                CopyBytes(pp.mout->base + dst, src, n, pp.streamStores);
+                pp.mout->release((size_t)dst, n);
+            }
+            else if (!CopyRangeToFile(*pp.out, dst, window, r.src + done, n, pp.copyStrategy)) {
+                pp.writeFailed = true;
+                pp.abort = true;
+                return;
+            }
+
+            done += n;
+            TelemetryAdd(TelemetryCounter::BytesWritten, n);
+            AddProgress(n);
+            PumpProgress();
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Compressed WAD: once the write stage is done, store the
+// blocks no reader delivered (files that shrank or could not be
+// read read back as zeros), then write header, table and block
+// table in front of the data
+// ------------------------------------------------------------
+static bool FinishCompressedWad(PackPipeline& pp, const std::vector<ScannedFile>& items,
+    const std::vector<int64_t>& dupOf, std::vector<uint8_t>& tableBuf)
+{
+    std::vector<uint8_t> zeros(kPackBlockBytes, 0);
+    std::vector<uint8_t> stored(LzCompressBound(kPackBlockBytes));
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (dupOf[i] >= 0)
+            continue;
+        uint64_t first = pp.firstBlockById[items[i].id];
+        uint64_t count = WadBlocksFor(items[i].size, kWadLzBlockBytes);
+        for (uint64_t k = 0; k < count; ++k) {
+            WadLzBlock& entry = pp.blocks[first + k];
+            if (entry.storedSize != 0)
+                continue;
+            size_t size = (size_t)std::min<uint64_t>(items[i].size - k * kPackBlockBytes, kPackBlockBytes);
+            size_t n = LzCompress(zeros.data(), size, stored.data(), stored.size());
+            entry.offset = pp.appendOffset;
+            entry.storedSize = (uint32_t)n;
+            entry.flags = 0;
+            pp.appendOffset += n;
+            if (!pp.out->writeAt(stored.data(), entry.offset, n))
+                return false;
+        }
+    }
+
+    for (uint64_t b = 0; b < pp.blocks.size(); ++b)
+        WriteWadBlock(tableBuf.data(), (uint32_t)items.size(), b, pp.blocks[b]);
+    return pp.out->writeAt(tableBuf.data(), 0, tableBuf.size());
+}
+
+// ------------------------------------------------------------
+// Where the data of each item goes (see step 6 of PackFolder)
+// ------------------------------------------------------------
+struct DataPlan {
+    NameArena names;                          // Holds wadNames
+    std::vector<std::string_view> wadNames;   // Table name of each item
+    std::vector<size_t> order;                // Items in data area order
+    std::vector<uint64_t> offset;             // Data offset of each item (duplicates: 0)
+    uint64_t totalBytes = 0;                  // Payload bytes, stored once per distinct contents
+    uint64_t totalSize = 0;                   // Size of the whole WAD
+};
+
+// ------------------------------------------------------------
+// Encode the table names and lay out the data area after a
+// header + table of 'tableBytes': layout order first, then
+// scan order, each payload on an 'alignment' boundary
+// ------------------------------------------------------------
+static void PlanDataArea(const std::vector<ScannedFile>& items, const std::vector<int64_t>& dupOf,
+    const std::vector<std::string>& layoutNames, uint64_t alignment, uint64_t tableBytes, DataPlan& plan)
+{
+    // Table names, encoded once into an arena (used by the layout and the table)
+    plan.wadNames.resize(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+        plan.wadNames[i] = EncodeWadName(plan.names, items[i].relPathW);
+
+    plan.order.resize(items.size());
+    std::iota(plan.order.begin(), plan.order.end(), 0);
+
+    if (!layoutNames.empty()) {
+        NameIndex<char> rankByName;
+        rankByName.reserve(layoutNames.size());
+        for (size_t k = 0; k < layoutNames.size(); ++k)
+            rankByName.tryEmplace(layoutNames[k], k);
+
+        std::vector<size_t> rank(items.size(), SIZE_MAX);
+        size_t placed = 0;
+        std::string folded;   // Reused: grows to the longest name only
+        for (size_t i = 0; i < items.size(); ++i) {
+            folded.resize(plan.wadNames[i].size());
+            FoldWadNameBytes(plan.wadNames[i].data(), plan.wadNames[i].size(), folded.data());
+            if (const size_t* k = rankByName.find(folded)) {
+                rank[i] = *k;
+                placed++;
+            }
+        }
+        std::stable_sort(plan.order.begin(), plan.order.end(),
+            [&rank](size_t a, size_t b) { return rank[a] < rank[b]; });
+
+        Log(L"Layout: " + std::to_wstring(placed) + L" of " + std::to_wstring(items.size()) +
+            L" files placed in layout order");
+    }
+
+    uint64_t offset = tableBytes;
+    plan.offset.assign(items.size(), 0);
+    for (size_t i : plan.order) {
+        if (dupOf[i] >= 0)
+            continue;
+        if (items[i].size > 0)
+            offset = (offset + alignment - 1) & ~(alignment - 1);
+        plan.offset[i] = offset;
+        offset += items[i].size;
+        plan.totalBytes += items[i].size;
+    }
+
+    plan.totalSize = offset;
+    if (alignment > 1)
+        Log(L"Alignment: " + FormatBytes(plan.totalSize - tableBytes - plan.totalBytes) + L" of padding");
+}
+
+// ------------------------------------------------------------
+// Stream pack: a piece of the data area, read by one reader
+// into one pool buffer
+// ------------------------------------------------------------
+struct StreamChunk {
+    size_t item = 0;          // Item whose data this is
+    uint64_t fileOffset = 0;  // Offset inside the source file
+    size_t size = 0;          // Bytes of the file
+    uint64_t pad = 0;         // Zero bytes written in front (alignment)
+};
+
+// ------------------------------------------------------------
+// Pack to standard output (a pipe), never seeking:
+//  - scan the folder, plan the data area and write the header +
+//    table as soon as the sizes are known
+//  - then the payloads, in data order: readers fill a ring of
+//    pool buffers ahead of this thread, which writes them out
+//    strictly in order (a reader waits while its buffer is
+//    still a full ring ahead of the writer)
+//  - a file that shrank is padded with zeros, so the offsets in
+//    the table stay true; it is reported like a changed file
+// Dedup, incremental mode and checksums need the finished file
+// and do not apply; compressed WADs store their block table in
+// front of data whose size is only known at the end.
+// ------------------------------------------------------------
+static bool PackFolderToStream(const std::filesystem::path& base, const PackOptions& options,
+    const std::vector<std::string>& layoutNames, uint64_t alignment, const Stopwatch& timer)
+{
+    if (options.format == WadFormat::Compressed) {
+        ShowError(L"Compressed WADs cannot be written to a stream.");
+        return false;
+    }
+    if (options.incremental || options.dedup || options.checksums)
+        Log(L"Writing to a stream: incremental mode, dedup and checksums ignored");
+
+    // ------------------------------------------------------------
+    // 1. Scan the folder (or read the manifest)
+    // ------------------------------------------------------------
+    unsigned readers = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    ScanResult scan;
+    {
+        TelemetrySpan span(TelemetryPhase::Scan);
+        if (!options.manifestPath.empty()) {
+            if (!ScanManifest(options.manifestPath, base, readers, ScanCallback(), scan)) {
+                ShowError(L"Failed to read manifest file.");
+                return false;
+            }
+        }
+        else {
+            ScanFolder(base, readers, ScanCallback(), scan);
+        }
+    }
+    if (IsCancelled(options.cancel)) {
+        Log(L"Packing cancelled");
+        return false;
+    }
+
+    for (const auto& p : scan.skipped)
+        Log(L"Skipping unreadable path: " + p);
+    if (scan.incomplete)
+        Log(L"Folder scan incomplete: a directory could not be listed");
+
+    const std::vector<ScannedFile>& items = scan.files;
+    if (items.empty()) {
+        Log(L"Folder contains no files.");
+        return false;
+    }
+    Log(std::to_wstring(items.size()) + L" files found");
+
+    // ------------------------------------------------------------
+    // 2. Plan the data area and build header + table
+    // ------------------------------------------------------------
+    TelemetrySpan planSpan(TelemetryPhase::Plan);
+    size_t tableBytes = (size_t)WadTableBytes(options.format, items.size());
+    std::vector<int64_t> dupOf(items.size(), -1);
+    DataPlan plan;
+    PlanDataArea(items, dupOf, layoutNames, alignment, tableBytes, plan);
+
+    if (options.format == WadFormat::Classic && plan.totalSize > kWadClassicMaxBytes) {
+        Log(L"The WAD would be " + FormatBytes(plan.totalSize) + L", classic WADs end at 4 GB");
+        ShowError(L"Too large for a classic WAD: pack in the WAD64 format instead.");
+        return false;
+    }
+
+    std::vector<uint8_t> tableBuf(tableBytes, 0);
+    WriteWadHeader(tableBuf.data(), options.format, (uint32_t)items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+        WriteWadItem(tableBuf.data(), options.format, (uint32_t)i, plan.wadNames[i], plan.offset[i], items[i].size);
+
+    std::vector<StreamChunk> chunks;
+    uint64_t cursor = tableBytes;
+    for (size_t i : plan.order) {
+        for (uint64_t done = 0; done < items[i].size; done += kPackBlockBytes) {
+            StreamChunk c;
+            c.item = i;
+            c.fileOffset = done;
+            c.size = (size_t)std::min<uint64_t>(items[i].size - done, kPackBlockBytes);
+            c.pad = done == 0 ? plan.offset[i] - cursor : 0;
+            chunks.push_back(c);
+        }
+        if (items[i].size > 0)
+            cursor = plan.offset[i] + items[i].size;
+    }
+    planSpan.end();
+
+    // ------------------------------------------------------------
+    // 3. Write the header + table
+    // ------------------------------------------------------------
+    FileHandle out;
+    if (!out.openStdout() || !out.write(tableBuf.data(), tableBuf.size())) {
+        ShowError(L"Failed to write WAD stream.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 4. Readers claim chunks in order and fill ring slot
+    //    k % kPackBlockCount once the writer has emptied it
+    // ------------------------------------------------------------
+    std::vector<std::unique_ptr<uint8_t[]>> slots;
+    for (size_t k = 0; k < kPackBlockCount; ++k)
+        slots.push_back(std::make_unique_for_overwrite<uint8_t[]>(kPackBlockBytes));
+    std::vector<uint8_t> ready(kPackBlockCount, 0);
+
+    std::mutex ringMutex;
+    std::condition_variable ringCv;
+    size_t written = 0;                  // Chunks written out (guarded by ringMutex)
+    std::atomic<size_t> nextChunk{ 0 };
+    std::atomic<bool> abort{ false };
+    std::atomic<uint64_t> readNs{ 0 };
+    std::vector<size_t> failed;          // Items that changed or could not be read (guarded by ringMutex)
+
+    auto readStage = [&] {
+        TelemetryThreadName("reader");
+        uint64_t busyNs = 0;
+        FileHandle in;
+        size_t openItem = SIZE_MAX;
+        bool openOk = false;
+
+        for (;;) {
+            size_t k = nextChunk.fetch_add(1);
+            if (k >= chunks.size())
+                break;
+            {
+                std::unique_lock<std::mutex> lock(ringMutex);
+                ringCv.wait(lock, [&] { return k < written + kPackBlockCount || abort; });
+                if (abort)
+                    break;
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            TelemetrySpan span(TelemetryPhase::Read);
+            const StreamChunk& c = chunks[k];
+            const ScannedFile& f = items[c.item];
+            if (c.item != openItem) {
+                openItem = c.item;
+                openOk = in.openRead(f.fullPath);
+            }
+
+            uint8_t* buf = slots[k % kPackBlockCount].get();
+            size_t got = 0;
+            bool ok = openOk;
+            while (ok && got < c.size) {
+                size_t n = 0;
+                ok = in.readAt(buf + got, c.size - got, c.fileOffset + got, n) && n > 0;
+                got += n;
+            }
+            memset(buf + got, 0, c.size - got);
+
+            // The file grew since the scan: only the scanned size fits
+            bool lastChunk = c.fileOffset + c.size == f.size;
+            uint64_t nowSize = 0;
+            if (ok && lastChunk && in.getSize(nowSize) && nowSize != f.size)
+                ok = false;
+            if (ok && lastChunk)
+                TelemetryAdd(TelemetryCounter::FilesRead, 1);
+            TelemetryAdd(TelemetryCounter::BytesRead, got);
+            busyNs += ElapsedNs(t0);
+
+            {
+                std::lock_guard<std::mutex> lock(ringMutex);
+                ready[k % kPackBlockCount] = 1;
+                if (!ok && (failed.empty() || failed.back() != c.item))
+                    failed.push_back(c.item);
+            }
+            ringCv.notify_all();
+        }
+        readNs += busyNs;
+    };
+
+    std::vector<std::thread> readerThreads;
+    for (unsigned i = 0; i < readers && i < chunks.size(); ++i)
+        readerThreads.emplace_back(readStage);
+
+    // ------------------------------------------------------------
+    // 5. Write the chunks in order on this thread, reporting
+    //    byte-based progress while waiting
+    // ------------------------------------------------------------
+    Log(L"Packing...");
+    BeginProgress(plan.totalBytes);
+    std::vector<uint8_t> zeros;
+    bool writeFailed = false;
+    uint64_t writeNs = 0;
+
+    for (size_t k = 0; k < chunks.size() && !writeFailed; ++k) {
+        {
+            std::unique_lock<std::mutex> lock(ringMutex);
+            while (!ringCv.wait_for(lock, std::chrono::milliseconds(kLogPumpMs),
+                [&] { return ready[k % kPackBlockCount] != 0; }))
+            {
+                lock.unlock();
+                PumpProgress();
+                lock.lock();
+                if (IsCancelled(options.cancel))
+                    break;
+            }
+        }
+        if (IsCancelled(options.cancel))
+            break;
+
+        auto t0 = std::chrono::steady_clock::now();
+        TelemetrySpan span(TelemetryPhase::Write);
+        const StreamChunk& c = chunks[k];
+        for (uint64_t left = c.pad; left > 0 && !writeFailed; ) {
+            size_t n = (size_t)std::min<uint64_t>(left, kPackBlockBytes);
+            zeros.resize(std::max(zeros.size(), n), 0);
+            writeFailed = !out.write(zeros.data(), n);
+            left -= n;
+        }
+        writeFailed = writeFailed || !out.write(slots[k % kPackBlockCount].get(), c.size);
+        TelemetryAdd(TelemetryCounter::BytesWritten, c.pad + c.size);
+        AddProgress(c.size);
+        writeNs += ElapsedNs(t0);
+
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            ready[k % kPackBlockCount] = 0;
+            written++;
+        }
+        ringCv.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        abort = true;
+    }
+    ringCv.notify_all();
+    for (auto& t : readerThreads) t.join();
+    EndProgress();
+    out.close();
+
+    // ------------------------------------------------------------
+    // 6. Done: a stream cannot be taken back, so a cancelled or
+    //    failed pack leaves it cut short
+    // ------------------------------------------------------------
+    if (IsCancelled(options.cancel)) {
+        Log(L"Packing cancelled, the WAD stream is incomplete");
+        return false;
+    }
+
+    std::sort(failed.begin(), failed.end());
+    failed.erase(std::unique(failed.begin(), failed.end()), failed.end());
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (LogLevelEnabled(LogLevel::Files))
+            LogBuffered(L"Packing: " + items[i].relPathW);
+        if (std::binary_search(failed.begin(), failed.end(), i))
+            LogBuffered(L"File changed or unreadable while packing: " + items[i].relPathW);
+    }
+    AppendBufferedLog();
+
+    if (writeFailed) {
+        ShowError(L"Failed to write WAD stream.");
+        return false;
+    }
+
+    SetProgress(100);
+    Log(L"Packing complete.");
+
+    double elapsed = timer.seconds();
+
+    wchar_t stages[160];
+    swprintf(stages, 160, L"Stage times: read %.3f s (%u %ls), write %.3f s",
+        readNs.load() / 1e9, readers, readers == 1 ? L"thread" : L"threads", writeNs / 1e9);
+
+    Log(L"Time taken: " + FormatSeconds(elapsed));
+    Log(stages);
+    Log(L"Throughput: " + FormatThroughput(plan.totalBytes, items.size(), elapsed));
+    Log(L"Memory after: " + FormatPeakMemory());
+    return true;
+}
+
+bool PackFolder(const std::filesystem::path& folderPath, const PackOptions& options)
+{
+    Stopwatch timer;
+
+    Log(L"Reading folder contents...");
+    Log(L"Memory before: " + FormatPeakMemory());
+    SetProgress(0);
+
+    const std::filesystem::path& base = folderPath;
+    if (!std::filesystem::is_directory(base)) {
+        ShowError(L"Path is not a directory.");
+        return false;
+    }
+
+    std::vector<std::string> layoutNames;
+    if (!options.layoutPath.empty() && !ReadLayoutOrder(options.layoutPath, layoutNames)) {
+        ShowError(L"Failed to read layout file.");
+        return false;
+    }
+    uint64_t alignment = options.alignment > 1 ? options.alignment : 1;
+    if ((alignment & (alignment - 1)) != 0) {
+        ShowError(L"Alignment must be a power of two.");
+        return false;
+    }
+
+    if (options.toStdout)
+        return PackFolderToStream(base, options, layoutNames, alignment, timer);
+
+    // ------------------------------------------------------------
+    // A compressed WAD is written front to back in the order the
+    // blocks finish: it has no data layout to keep or reuse
+    // ------------------------------------------------------------
+    bool compress = options.format == WadFormat::Compressed;
+    bool incremental = options.incremental && !compress;
+    if (compress) {
+        if (options.incremental)
+            Log(L"Compressed WADs are always packed in full (incremental mode ignored)");
+        if (!layoutNames.empty() || alignment > 1)
+            Log(L"Compressed WADs have no data layout (layout / alignment ignored)");
+        layoutNames.clear();
+        alignment = 1;
+    }
+
+    // ------------------------------------------------------------
+    // 1. Determine output path
+    //    - use the base folder name with a .wad extension
+    // ------------------------------------------------------------
+    std::filesystem::path outPath = options.outPath;
+    if (outPath.empty()) {
+        outPath = base;
+        if (!outPath.has_filename())
+            outPath = outPath.parent_path();
+        outPath.replace_extension(L".wad");
+    }
+
+    // ------------------------------------------------------------
+    // 2. Incremental mode: open the previous WAD and its sidecar.
+    //    Updating that WAD is the point, so it is not an
+    //    overwrite to confirm.
+    // ------------------------------------------------------------
+    PackBase prev;
+    bool havePrev = incremental && LoadPackBase(outPath, options.map, prev);
+    if (incremental && !havePrev) {
+        prev.wad.close();
+        prev.index = PackIndex{};
+        prev.byPath.clear();
+        Log(L"No usable previous WAD / index, packing everything");
+    }
+
+    if (!havePrev && std::filesystem::exists(outPath)) {
+        if (!ConfirmOverwrite(PathToDisplay(outPath))) {
+            Log(L"Cancelled creating WAD");
+            return false;
+        }
+    }
+
+    // ------------------------------------------------------------
+    // 3. Start the pipeline
+    //    - scan stage:  parallel folder walk (or manifest)
+    //    - read stage:  'threads' readers filling pool buffers
+    //    - write stage: one thread placing buffers in the output
+    // ------------------------------------------------------------
+    PackPipeline pp;
+    pp.blockMemory.reserve(kPackBlockCount);
+    for (size_t i = 0; i < kPackBlockCount; ++i) {
+        pp.blockMemory.push_back(std::make_unique_for_overwrite<uint8_t[]>(kPackBlockBytes));
+        pp.freeBlocks.push(pp.blockMemory.back().get());
+    }
+
+    unsigned readers = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    pp.readersLeft = readers;
+    pp.prev = havePrev ? &prev : nullptr;
+    pp.hashing = incremental || options.checksums;
+    pp.compress = compress;
+    pp.deferReads = options.dedup;
+    pp.cancel = options.cancel;
+    pp.map = options.map;
+    pp.ioBackend = options.ioBackend;
+    pp.batching = options.ioBackend != IoBackend::Sync && IsUringAvailable();
+    if (options.ioBackend == IoBackend::Uring && !pp.batching)
+        Log(L"io_uring is not available, using synchronous I/O");
+
+    std::thread scanner(ScanStage, std::ref(pp), std::cref(base), std::cref(options), readers);
+    std::vector<std::thread> readerThreads;
+    for (unsigned i = 0; i < readers; ++i)
+        readerThreads.emplace_back(ReadStage, std::ref(pp));
+    std::thread writer(WriteStage, std::ref(pp));
+
+    // ------------------------------------------------------------
+    // 4. Wait for the scan to finish; reads are already running
+    // ------------------------------------------------------------
+    scanner.join();
+
+    std::vector<ScannedFile>& items = pp.scan.files;
+
+    auto stopPipeline = [&] {
+        pp.abort = true;
+        pp.readQueue.close();
+        pp.publishLayout(2);
+        for (auto& t : readerThreads) t.join();
+        writer.join();
+    };
+
+    if (pp.manifestFailed) {
+        stopPipeline();
+        ShowError(L"Failed to read manifest file.");
+        return false;
+    }
+    if (IsCancelled(options.cancel)) {
+        stopPipeline();
+        Log(L"Packing cancelled");
+        return false;
+    }
+
+    for (const auto& p : pp.scan.skipped)
+        Log(L"Skipping unreadable path: " + p);
+    if (pp.scan.incomplete)
+        Log(L"Folder scan incomplete: a directory could not be listed");
+
+    if (items.empty()) {
+        stopPipeline();
+        Log(L"Folder contains no files.");
+        return false;
+    }
+    Log(std::to_wstring(items.size()) + L" files found");
+    Log(L"Collecting files completed");
+
+    // ------------------------------------------------------------
+    // 5. Dedup mode: point files with identical contents at one
+    //    copy of the data, then queue the reads the scan held back
+    //    (neither duplicates nor entries reused from the previous
+    //    WAD are read)
+    // ------------------------------------------------------------
+    std::vector<int64_t> dupOf(items.size(), -1);
+    uint64_t savedBytes = 0;
+
+    if (options.dedup) {
+        size_t dupCount = FindDuplicates(pp, items, readers, dupOf);
+        if (IsCancelled(options.cancel)) {
+            stopPipeline();
+            Log(L"Packing cancelled");
+            return false;
+        }
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (dupOf[i] >= 0) {
+                savedBytes += items[i].size;
+                continue;
+            }
+            if (pp.prev && pp.prev->find(items[i]) >= 0)
+                continue;
+
+            ReadJob job;
+            job.id = items[i].id;
+            job.fullPath = items[i].fullPath;
+            job.size = items[i].size;
+            pp.readQueue.push(std::move(job));
+        }
+        pp.readQueue.close();
+
+        Log(L"Dedup: " + std::to_wstring(dupCount) + L" duplicate files, " +
+            FormatBytes(savedBytes) + L" saved");
+    }
+
+    // ------------------------------------------------------------
+    // 6. Plan the data area
+    //    - order: scan order, or that of the layout file (trace /
+    //      hot-list): listed entries first, in list order, then
+    //      the rest in scan order; the table stays in scan order
+    //    - each payload starts on a multiple of the alignment
+    //      (zero padding in between, empty entries take no room)
+    //    - all file data (sizes from the scan), stored once per
+    //      distinct contents in dedup mode
+    //    - a classic WAD must end below 4 GB (32-bit offsets and
+    //      sizes); past that only the WAD64 format can hold it
+    //    - a compressed WAD also holds one block table entry per
+    //      started block of distinct contents; its data is
+    //      appended after the tables as the blocks come in
+    // ------------------------------------------------------------
+    TelemetrySpan planSpan(TelemetryPhase::Plan);
+    uint64_t blockCount = 0;
+    for (size_t i = 0; i < items.size() && compress; ++i) {
+        if (dupOf[i] < 0)
+            blockCount += WadBlocksFor(items[i].size, kWadLzBlockBytes);
+    }
+    size_t tableBytes = (size_t)WadTableBytes(options.format, items.size(), blockCount);
+
+    DataPlan plan;
+    PlanDataArea(items, dupOf, layoutNames, alignment, tableBytes, plan);
+    std::vector<uint64_t>& dataOffset = plan.offset;
+    uint64_t totalBytes = plan.totalBytes;
+    uint64_t totalSize = plan.totalSize;
+
+    if (options.format == WadFormat::Classic && totalSize > kWadClassicMaxBytes) {
+        stopPipeline();
+        Log(L"The WAD would be " + FormatBytes(totalSize) + L", classic WADs end at 4 GB");
+        ShowError(L"Too large for a classic WAD: pack in the WAD64 format instead.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 7. Build header + table in memory (classic, WAD64 or
+    //    compressed)
+    //    - fill the header
+    //    - build the table with names, offsets, sizes, in the
+    //      final scan order; a duplicate shares the range of the
+    //      item it duplicates
+    //    - record where each file id lands for the write stage
+    //      (compressed: its first block; the block table itself
+    //      is filled in by the write stage)
+    // ------------------------------------------------------------
+    std::vector<uint8_t> tableBuf(tableBytes, 0);
+    WriteWadHeader(tableBuf.data(), options.format, (uint32_t)items.size(), blockCount);
+
+    pp.offsetById.assign(items.size(), 0);
+    pp.firstBlockById.assign(items.size(), 0);
+    pp.blocks.assign(blockCount, WadLzBlock{});
+    pp.appendOffset = tableBytes;
+    uint64_t nextBlock = 0;
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (dupOf[i] >= 0) {
+            dataOffset[i] = dataOffset[dupOf[i]];
+            pp.firstBlockById[items[i].id] = pp.firstBlockById[items[dupOf[i]].id];
+        }
+        else {
+            pp.offsetById[items[i].id] = dataOffset[i];
+            pp.firstBlockById[items[i].id] = nextBlock;
+            if (compress)
+                nextBlock += WadBlocksFor(items[i].size, kWadLzBlockBytes);
+        }
+
+        WriteWadItem(tableBuf.data(), options.format, (uint32_t)i, plan.wadNames[i],
+            compress ? pp.firstBlockById[items[i].id] : dataOffset[i], items[i].size);
+    }
+
+    // ------------------------------------------------------------
+    // 8. Incremental mode: match items with the previous WAD
+    //    - reuse[i] = old table index holding item i, or -1
+    //    - the old WAD can be updated in place when the new
+    //      header + table are byte-identical to the old ones
+    //      (same names, sizes and offsets); otherwise a new WAD
+    //      is written next to it and renamed over it at the end
+    // ------------------------------------------------------------
+    std::vector<int64_t> reuse(items.size(), -1);
+    size_t reusedCount = 0;
+    size_t readCount = 0;
+    uint64_t reusedBytes = 0;
+    bool inPlace = false;
+
+    if (havePrev) {
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (dupOf[i] >= 0)
+                continue;   // No data of its own
+            reuse[i] = prev.find(items[i]);
+            if (reuse[i] >= 0) {
+                reusedCount++;
+                reusedBytes += items[i].size;
+            }
+            else {
+                readCount++;
+            }
+        }
+        inPlace = prev.wad.size == totalSize && prev.view.tableBytes == tableBytes &&
+            memcmp(prev.wad.base, tableBuf.data(), tableBytes) == 0;
+
+        Log(L"Incremental: " + std::to_wstring(reusedCount) + L" unchanged, " +
+            std::to_wstring(readCount) + L" to read, " +
+            (inPlace ? L"updating the WAD in place" : L"rewriting the WAD"));
+    }
+
+    std::filesystem::path writePath = outPath;
+    if (havePrev && !inPlace)
+        writePath += ".tmp";
+    planSpan.end();
+
+    // ------------------------------------------------------------
+    // Copy strategy: streaming stores into the mapped output for
+    // WADs far larger than the CPU caches (the data is not read
+    // back); unchanged entries go through the kernel in pwrite
+    // mode where available
+    // ------------------------------------------------------------
+    pp.copyStrategy = options.copyStrategy;
+    pp.streamStores = options.copyStrategy == CopyStrategy::NonTemporal ||
+        (options.copyStrategy == CopyStrategy::Auto && totalBytes >= kCopyHugeBytes &&
+         GetCopyEngineInfo().preferStream);
+
+    // ------------------------------------------------------------
+    // 9. Create the output file, write header + table and release
+    //    the write stage
+    //    - in place: open the old WAD for positioned writes, the
+    //      table and unchanged data stay as they are
+    //    - mapped mode (default): memory-map the sized file
+    //    - pwrite mode: sized file written at offsets
+    //    - compressed: the size is known only at the end, so the
+    //      data is appended with positioned writes and the tables
+    //      follow once the write stage is done
+    // ------------------------------------------------------------
+    TelemetrySpan createSpan(TelemetryPhase::CreateOutput);
+    MappedOutput mout;
+    FileHandle out;
+
+    if (inPlace) {
+        prev.wad.close();   // A read-only mapping would deny write access on Windows
+        if (!out.openWrite(outPath)) {
+            stopPipeline();
+            ShowError(L"Failed to open WAD file for update.");
+            return false;
+        }
+        pp.out = &out;
+    }
+    else if (options.useMapping && !compress) {
+        if (!mout.create(writePath, (size_t)totalSize, options.map)) {
+            stopPipeline();
+            ShowError(L"Failed to create memory-mapped WAD file.");
+            return false;
+        }
+        memcpy(mout.base, tableBuf.data(), tableBytes);
+        pp.mout = &mout;
+    }
+    else {
+        // --------------------------------------------------------
+        // Reserve the space before sizing the file so the data
+        // area is allocated in one piece (best effort)
+        // --------------------------------------------------------
+        bool reserve = !compress && (options.copyStrategy == CopyStrategy::Auto ||
+            options.copyStrategy == CopyStrategy::Preallocate);
+        bool created = out.create(writePath);
+        if (created && reserve)
+            out.preallocate(totalSize);
+
+        if (!created || (!compress &&
+            (!out.setSize(totalSize) || !out.writeAt(tableBuf.data(), 0, tableBytes))))
+        {
+            stopPipeline();
+            ShowError(L"Failed to create WAD file.");
+            return false;
+        }
+        pp.out = &out;
+    }
+
+    createSpan.end();
+    pp.publishLayout(1);
+
+    // ------------------------------------------------------------
+    // 10. Copy the unchanged entries while the readers and the
+    //    writer handle the changed ones, then report byte-based
+    //    progress until the write stage is done
+    // ------------------------------------------------------------
+    Log(L"Packing...");
+    BeginProgress(totalBytes);
+    if (inPlace)
+        AddProgress(reusedBytes);
+
+    if (havePrev && !inPlace)
+        CopyUnchangedEntries(pp, prev, items, dataOffset, reuse);
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pp.doneMutex);
+            if (pp.doneCv.wait_for(lock, std::chrono::milliseconds(kLogPumpMs), [&pp] { return pp.writerDone; }))
+                break;
+        }
+        if (IsCancelled(options.cancel))
+            pp.abort = true;   // Readers drain their queue, the writer drops its blocks
+        PumpProgress();
+    }
+    EndProgress();
+    for (auto& t : readerThreads) t.join();
+    writer.join();
+
+    if (compress && !pp.writeFailed && !IsCancelled(options.cancel)) {
+        if (!FinishCompressedWad(pp, items, dupOf, tableBuf))
+            pp.writeFailed = true;
+        else
+            Log(L"Compressed: " + FormatBytes(totalBytes) + L" of data stored in " +
+                FormatBytes(pp.appendOffset - tableBytes));
+    }
+
+    // ------------------------------------------------------------
+    // 11. Done
+    //    - unmap / close file; when cancelled remove the partial
+    //      output, else move a rewritten WAD into place
+    //    - drop the old checksum sidecar: it describes the WAD
+    //      from before (a same-size repack keeps its table hash)
+    //    - flush buffered log
+    //    - incremental mode: record the sources in the sidecar
+    //    - checksum mode: read the WAD back and store checksums
+    //    - log elapsed time, stage times and peak memory
+    // ------------------------------------------------------------
+    mout.close();
+    out.close();
+    prev.wad.close();
+
+    // --------------------------------------------------------
+    // An update in place cannot be rolled back; without its
+    // sidecars the WAD is rebuilt from scratch by the next pack
+    // --------------------------------------------------------
+    if (IsCancelled(options.cancel)) {
+        std::error_code ec;
+        if (inPlace) {
+            std::filesystem::remove(PackIndexPath(outPath), ec);
+            std::filesystem::remove(ChecksumPath(outPath), ec);
+            Log(L"Packing cancelled, the WAD is partially updated (the next pack rebuilds it)");
+        }
+        else {
+            std::filesystem::remove(writePath, ec);
+            Log(L"Packing cancelled, partial output removed");
+        }
+        return false;
+    }
+
+    if (writePath != outPath) {
+        std::error_code ec;
+        if (!pp.writeFailed)
+            std::filesystem::rename(writePath, outPath, ec);
+        if (pp.writeFailed || ec) {
+            std::filesystem::remove(writePath, ec);
+            ShowError(L"Failed to replace the previous WAD file.");
+            return false;
+        }
+    }
+
+    {
+        std::error_code ec;
+        std::filesystem::remove(ChecksumPath(outPath), ec);
+    }
+
+    std::vector<uint8_t> failed(items.size(), 0);
+    for (size_t id : pp.failed)
+        failed[id] = 1;
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (LogLevelEnabled(LogLevel::Files))
+            LogBuffered(L"Packing: " + items[i].relPathW);
+        if (failed[items[i].id])
+            LogBuffered(L"File changed or unreadable while packing: " + items[i].relPathW);
+    }
+    AppendBufferedLog();
+
+    if (pp.writeFailed) {
+        ShowError(L"Failed to write WAD file.");
+        return false;
+    }
+
+    if (incremental) {
+        PackIndex index;
+        index.entries.resize(items.size());
+        size_t sameContent = 0;
+
+        for (size_t i = 0; i < items.size(); ++i) {
+            PackIndexEntry& e = index.entries[i];
+            e.relPathW = items[i].relPathW;
+            e.size = items[i].size;
+            e.mtime = items[i].mtime;
+
+            if (reuse[i] >= 0) {
+                e.hash = prev.index.entries[reuse[i]].hash;
+            }
+            else if (failed[items[i].id]) {
+                e.mtime = 0;   // Never trust this entry on the next run
+            }
+            else {
+                e.hash = pp.hashById[items[i].id];
+
+                // ------------------------------------------------
+                // Read again although the contents did not change
+                // (only the write time did)
+                // ------------------------------------------------
+                auto it = prev.byPath.find(e.relPathW);
+                if (it != prev.byPath.end() && prev.index.entries[it->second].hash == e.hash &&
+                    prev.index.entries[it->second].size == e.size)
+                    sameContent++;
+            }
+        }
+
+        if (sameContent > 0)
+            Log(std::to_wstring(sameContent) + L" re-read files had unchanged contents");
+
+        if (!GetFileInfo(outPath, index.wadSize, index.wadMtime) ||
+            !WritePackIndex(PackIndexPath(outPath), index))
+            Log(L"Failed to write pack index, the next incremental pack will read everything");
+    }
+
+    if (options.checksums && !ReadBackChecksums(outPath, pp, prev, items, reuse, dupOf, failed, readers))
+        return false;
+
+    SetProgress(100);
+    Log(L"Packing complete.");
+
+    double elapsed = timer.seconds();
+
+    wchar_t stages[160];
+    swprintf(stages, 160, L"Stage times: scan %.3f s, read %.3f s (%u %ls%ls), write %.3f s",
+        pp.scanNs.load() / 1e9, pp.readNs.load() / 1e9, readers,
+        readers == 1 ? L"thread" : L"threads", pp.batching ? L", io_uring" : L"", pp.writeNs.load() / 1e9);
+
+    Log(L"Time taken: " + FormatSeconds(elapsed));
+    Log(stages);
+    Log(L"Throughput: " + FormatThroughput(totalBytes, items.size(), elapsed));
+    Log(L"Memory after: " + FormatPeakMemory());
+
+    return true;
+}
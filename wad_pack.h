@@ -0,0 +1,57 @@
+﻿#pragma once
+#include "copy_engine.h"
+#include "batch_io.h"
+#include "wad_format.h"
+
+#include <atomic>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// Packing settings chosen by the front end
+// ------------------------------------------------------------
+struct PackOptions {
+    unsigned threads = 0;                 // Scanner / reader threads (0 = one per core)
+    bool useMapping = true;               // Write into a mapped view (false = positioned writes)
+    std::filesystem::path outPath;        // Output WAD (empty = <folder>.wad next to the folder)
+    bool toStdout = false;                // Write the WAD to standard output, front to back (outPath unused)
+    std::filesystem::path manifestPath;   // File list to pack instead of walking the folder
+    bool incremental = false;             // Reuse unchanged entries of the existing output WAD
+    bool dedup = false;                   // Store identical file contents only once
+    CopyStrategy copyStrategy = CopyStrategy::Auto;  // How data reaches the output
+    IoBackend ioBackend = IoBackend::Auto;           // How small source files are read (batched or per file)
+    bool checksums = false;               // Read the WAD back, check it, write <wad>.sum
+    std::filesystem::path layoutPath;     // Access trace or hot-list ordering the data area
+    uint32_t alignment = 0;               // Payload alignment in bytes (0 / 1 = packed, else a power of two)
+    WadFormat format = WadFormat::Classic;  // Classic (GP4, up to 4 GB) or WAD64
+    MapOptions map{ kMapWindowBytes, MapAccess::Sequential };  // How the old / finished WAD is mapped (window 0 = whole file)
+    const std::atomic<bool>* cancel = nullptr;  // Set by the front end to stop (partial output is removed)
+};
+
+// ------------------------------------------------------------
+// Pack every regular file below a folder into a WAD.
+// Incremental mode keeps a <wad>.idx sidecar with the size,
+// write time and content hash of every source file. On the
+// next run files whose size and write time are unchanged are
+// not read again: when the table comes out identical only the
+// changed entries are rewritten inside the existing WAD,
+// otherwise a new WAD is built that copies the unchanged
+// entries range by range from the old one.
+// Dedup mode points entries with byte-identical contents at a
+// single data range (any WAD reader handles shared ranges).
+// A layout file (an access trace recorded by WadReader or a
+// hot-list of names) places the listed entries' data first, in
+// first-access order; an alignment pads every payload to start
+// on a page (or other power of two) boundary.
+// Checksum mode hashes the sources while reading them, reads
+// the finished WAD back against those hashes and stores the
+// per-entry checksums for VerifyWad; without it an existing
+// <wad>.sum is removed, as it no longer describes the WAD.
+// A classic WAD that would end past 4 GB is refused before
+// anything is written; the WAD64 format has no such limit.
+// To standard output (a pipe) the header + table go out as
+// soon as the scan has the sizes, then the payloads in data
+// order; dedup, incremental mode, checksums and compression do
+// not apply there.
+// Returns true when the WAD was written.
+// ------------------------------------------------------------
+bool PackFolder(const std::filesystem::path& folderPath, const PackOptions& options);
@@ -0,0 +1,760 @@
+﻿#include "wad_patch.h"
+#include "wad_format.h"
+#include "wad_trie.h"
+#include "wad_verify.h"
+#include "checksum.h"
+#include "platform.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "telemetry.h"
+#include "job.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char kPatchMagic[] = "OpenWAD patch 2";
+static const char kPatchTableName[] = ".openwad\\patch-table";        // Entry 0: target header + table
+static const char kPatchManifestName[] = ".openwad\\patch-manifest";  // Entry 1: the manifest
+static const uint32_t kPatchFirstData = 2;                            // First entry holding target data
+
+static const uint64_t kPatchCopyBytes = 16ull * 1024 * 1024;  // Bytes per copy task
+
+// ------------------------------------------------------------
+// Manifest operations, one per line
+// ------------------------------------------------------------
+static const char kPatchKeep = '=';     // Target entry = base entry <index> with data hash <hash>
+static const char kPatchAdded = '+';    // New entry, data in patch entry <index>
+static const char kPatchChanged = '*';  // Changed entry, data in patch entry <index>
+static const char kPatchRemoved = '-';  // Base entry <index> is not in the target
+
+// ------------------------------------------------------------
+// What the target WAD is made of (text, entry 1 of a patch):
+//   OpenWAD patch 2
+//   <base size>\t<base table hash hex>
+//   <target size>\t<target entry count>
+//   <op>\t<index>      one line per target entry, in table order
+//                      (kept: <op>\t<index>\t<data hash hex>)
+//   -\t<base index>    one line per removed base entry
+// ------------------------------------------------------------
+struct PatchManifest {
+    uint64_t baseSize = 0;
+    uint64_t baseTableHash = 0;       // XXH64 of the base header + table
+    uint64_t targetSize = 0;
+    std::vector<char> ops;            // Per target entry: keep / added / changed
+    std::vector<uint64_t> sources;    // Per target entry: base or patch entry index
+    std::vector<uint64_t> hashes;     // Per target entry: XXH64 of the kept base data (0 otherwise)
+    std::vector<uint64_t> removed;    // Base entries dropped by the target
+};
+
+static std::string FormatManifest(const PatchManifest& m)
+{
+    std::string text;
+    char line[80];
+    text += kPatchMagic;
+    text += '\n';
+    snprintf(line, sizeof(line), "%llu\t%016llx\n", (unsigned long long)m.baseSize, (unsigned long long)m.baseTableHash);
+    text += line;
+    snprintf(line, sizeof(line), "%llu\t%zu\n", (unsigned long long)m.targetSize, m.ops.size());
+    text += line;
+    for (size_t i = 0; i < m.ops.size(); ++i) {
+        if (m.ops[i] == kPatchKeep)
+            snprintf(line, sizeof(line), "%c\t%llu\t%016llx\n", m.ops[i], (unsigned long long)m.sources[i],
+                (unsigned long long)m.hashes[i]);
+        else
+            snprintf(line, sizeof(line), "%c\t%llu\n", m.ops[i], (unsigned long long)m.sources[i]);
+        text += line;
+    }
+    for (uint64_t b : m.removed) {
+        snprintf(line, sizeof(line), "%c\t%llu\n", kPatchRemoved, (unsigned long long)b);
+        text += line;
+    }
+    return text;
+}
+
+static bool ParseManifest(std::string_view text, PatchManifest& m)
+{
+    std::vector<std::string> lines;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos)
+            end = text.size();
+        lines.emplace_back(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    if (lines.size() < 3 || lines[0] != kPatchMagic)
+        return false;
+
+    // ------------------------------------------------------------
+    // 1. Base identity and target size / entry count
+    // ------------------------------------------------------------
+    char* end = nullptr;
+    m.baseSize = strtoull(lines[1].c_str(), &end, 10);
+    if (*end != '\t')
+        return false;
+    m.baseTableHash = strtoull(end + 1, &end, 16);
+    if (*end != '\0')
+        return false;
+
+    m.targetSize = strtoull(lines[2].c_str(), &end, 10);
+    if (*end != '\t')
+        return false;
+    uint64_t count = strtoull(end + 1, &end, 10);
+    if (*end != '\0' || count > lines.size() - 3)
+        return false;
+
+    // ------------------------------------------------------------
+    // 2. One operation per target entry, then the removed ones
+    // ------------------------------------------------------------
+    m.ops.clear();
+    m.sources.clear();
+    m.hashes.clear();
+    m.removed.clear();
+    for (size_t k = 3; k < lines.size(); ++k) {
+        const std::string& l = lines[k];
+        if (l.size() < 3 || l[1] != '\t')
+            return false;
+        uint64_t index = strtoull(l.c_str() + 2, &end, 10);
+        if (end == l.c_str() + 2)
+            return false;
+        uint64_t hash = 0;
+        if (l[0] == kPatchKeep) {
+            if (*end != '\t')
+                return false;
+            const char* hashText = end + 1;
+            hash = strtoull(hashText, &end, 16);
+            if (end == hashText)
+                return false;
+        }
+        if (*end != '\0')
+            return false;
+
+        bool entryLine = k - 3 < count;
+        if (entryLine && (l[0] == kPatchKeep || l[0] == kPatchAdded || l[0] == kPatchChanged)) {
+            m.ops.push_back(l[0]);
+            m.sources.push_back(index);
+            m.hashes.push_back(hash);
+        }
+        else if (!entryLine && l[0] == kPatchRemoved) {
+            m.removed.push_back(index);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// One range to copy from a source WAD into the output
+// ------------------------------------------------------------
+struct PatchCopy {
+    uint64_t src = 0;   // Offset in the source
+    uint64_t dst = 0;   // Offset in the output
+    uint64_t size = 0;  // Length in bytes
+};
+
+struct PatchSource {
+    const MappedFile* file = nullptr;
+    std::vector<PatchCopy> copies;
+};
+
+// ------------------------------------------------------------
+// Merge copies that are neighbours in both source and output
+// ------------------------------------------------------------
+static void MergeCopies(std::vector<PatchCopy>& copies)
+{
+    std::sort(copies.begin(), copies.end(),
+        [](const PatchCopy& a, const PatchCopy& b) { return a.dst < b.dst; });
+
+    size_t n = 0;
+    for (const PatchCopy& c : copies) {
+        if (n > 0 && copies[n - 1].src + copies[n - 1].size == c.src && copies[n - 1].dst + copies[n - 1].size == c.dst)
+            copies[n - 1].size += c.size;
+        else
+            copies[n++] = c;
+    }
+    copies.resize(n);
+}
+
+// ------------------------------------------------------------
+// Run the copies of every source on the pool in tasks of about
+// kPatchCopyBytes (large ranges are cut, small ones grouped).
+// Each task opens the output for itself and reads through its
+// own map window. This thread reports progress meanwhile.
+// Returns false when a copy failed.
+// ------------------------------------------------------------
+static bool RunCopies(const std::filesystem::path& outPath, const std::vector<PatchSource>& sources,
+    ThreadPool& pool, const PatchOptions& options)
+{
+    std::atomic<bool> failed{ false };
+    TaskGroup group(pool);
+
+    for (const PatchSource& s : sources) {
+        std::vector<PatchCopy> task;
+        uint64_t bytes = 0;
+
+        auto flush = [&] {
+            if (task.empty())
+                return;
+            group.submit([&outPath, &failed, &options, file = s.file, task = std::move(task)] {
+                TelemetryThreadName("worker");
+                TelemetrySpan span(TelemetryPhase::Write);
+                FileHandle out;
+                if (!out.openWrite(outPath)) {
+                    failed = true;
+                    return;
+                }
+                MappedWindow window(*file);
+                for (const PatchCopy& c : task) {
+                    if (failed.load(std::memory_order_relaxed) || IsCancelled(options.cancel))
+                        return;
+                    if (!CopyRangeToFile(out, c.dst, window, c.src, c.size, options.copyStrategy)) {
+                        failed = true;
+                        return;
+                    }
+                    TelemetryAdd(TelemetryCounter::BytesWritten, c.size);
+                    AddProgress(c.size);
+                }
+            });
+            task.clear();
+            bytes = 0;
+        };
+
+        for (const PatchCopy& c : s.copies) {
+            for (uint64_t done = 0; done < c.size;) {
+                uint64_t n = std::min(c.size - done, kPatchCopyBytes - bytes);
+                task.push_back(PatchCopy{ c.src + done, c.dst + done, n });
+                bytes += n;
+                done += n;
+                if (bytes >= kPatchCopyBytes)
+                    flush();
+            }
+        }
+        flush();
+    }
+
+    while (!group.waitFor(std::chrono::milliseconds(kLogPumpMs)))
+        PumpProgress();
+    return !failed;
+}
+
+// ------------------------------------------------------------
+// One kept base range and the hash it had when the patch was
+// made
+// ------------------------------------------------------------
+struct PatchCheck {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+};
+
+// ------------------------------------------------------------
+// Hash the kept base ranges on the pool in tasks of about
+// kPatchCopyBytes, each through its own map window, while this
+// thread reports progress. Returns false when a range could not
+// be read or no longer has its hash.
+// ------------------------------------------------------------
+static bool CheckBaseRanges(const MappedFile& file, const std::vector<PatchCheck>& checks,
+    ThreadPool& pool, const PatchOptions& options)
+{
+    std::atomic<bool> failed{ false };
+    TaskGroup group(pool);
+
+    for (size_t first = 0; first < checks.size();) {
+        size_t last = first;
+        uint64_t bytes = 0;
+        while (last < checks.size() && (last == first || bytes + checks[last].size <= kPatchCopyBytes))
+            bytes += checks[last++].size;
+
+        group.submit([&file, &checks, &failed, &options, first, last] {
+            TelemetryThreadName("worker");
+            TelemetrySpan span(TelemetryPhase::Hash);
+            MappedWindow window(file);
+            for (size_t k = first; k < last; ++k) {
+                if (failed.load(std::memory_order_relaxed) || IsCancelled(options.cancel))
+                    return;
+                const PatchCheck& c = checks[k];
+                uint64_t hash = 0;
+                if (!HashWadRange(window, c.offset, c.size, hash) || hash != c.hash) {
+                    failed = true;
+                    return;
+                }
+                TelemetryAdd(TelemetryCounter::BytesHashed, c.size);
+                AddProgress(c.size);
+            }
+        });
+        first = last;
+    }
+
+    while (!group.waitFor(std::chrono::milliseconds(kLogPumpMs)))
+        PumpProgress();
+    return !failed;
+}
+
+bool DiffWads(const std::filesystem::path& basePath, const std::filesystem::path& targetPath,
+    const PatchOptions& options)
+{
+    Stopwatch timer;
+
+    Log(L"Reading WAD headers");
+    SetProgress(0);
+
+    // ------------------------------------------------------------
+    // 1. Open and validate both WADs
+    // ------------------------------------------------------------
+    MappedFile baseFile, targetFile;
+    WadView base, target;
+    const wchar_t* error = nullptr;
+    if (!OpenWadFile(basePath, options.map, baseFile, base, &error) ||
+        !OpenWadFile(targetPath, options.map, targetFile, target, &error)) {
+        ShowError(error);
+        return false;
+    }
+    if (base.compressed() || target.compressed()) {
+        ShowError(L"Compressed WADs cannot be diffed.");
+        return false;
+    }
+    Log(std::to_wstring(base.fileCount) + L" base files, " + std::to_wstring(target.fileCount) + L" target files");
+
+    // ------------------------------------------------------------
+    // 2. Determine output path: <target stem>.patch.wad
+    // ------------------------------------------------------------
+    std::filesystem::path outPath = options.outPath;
+    if (outPath.empty()) {
+        outPath = targetPath;
+        outPath.replace_extension(L".patch.wad");
+    }
+    if (std::filesystem::exists(outPath) && !ConfirmOverwrite(PathToDisplay(outPath))) {
+        Log(L"Cancelled creating patch");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 3. Hash both WADs at once on one pool while this thread
+    //    reports progress (a .sum sidecar is not trusted here: a
+    //    same-size repack keeps the table it is keyed to)
+    // ------------------------------------------------------------
+    Log(L"Hashing...");
+    unsigned threads = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    ThreadPool pool(threads);
+
+    WadChecksums baseSums, targetSums;
+    std::atomic<uint64_t> bytesDone{ 0 };
+    std::atomic<size_t> unreadable{ 0 };
+    std::atomic<int> hashing{ 2 };
+    auto hashWad = [&](const MappedFile& file, const WadView& wad, WadChecksums& sums) {
+        unreadable += HashWadEntries(file, wad, threads, sums, &bytesDone, options.cancel, &pool);
+        hashing--;
+    };
+
+    BeginProgress((base.size - base.tableBytes) + (target.size - target.tableBytes));
+    std::thread baseHasher([&] { hashWad(baseFile, base, baseSums); });
+    std::thread targetHasher([&] { hashWad(targetFile, target, targetSums); });
+    uint64_t reported = 0;
+    auto reportHashed = [&] {
+        uint64_t done = bytesDone.load(std::memory_order_relaxed);
+        AddProgress(done - reported);
+        reported = done;
+    };
+    while (hashing > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kLogPumpMs / 2));
+        reportHashed();
+        PumpProgress();
+    }
+    baseHasher.join();
+    targetHasher.join();
+    reportHashed();
+    EndProgress();
+
+    if (IsCancelled(options.cancel)) {
+        Log(L"Diff cancelled");
+        return false;
+    }
+    if (unreadable > 0) {
+        ShowError(L"WAD data could not be read.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 4. Match target entries with base entries by name (the last
+    //    base entry of a name wins, as on extraction)
+    //    - same size and hash: kept from the base
+    //    - otherwise changed / added: the data goes into the
+    //      patch, once per distinct target data range
+    //    - base names missing from the target: removed
+    // ------------------------------------------------------------
+    TelemetrySpan planSpan(TelemetryPhase::Plan);
+    std::unordered_map<std::string, uint32_t> baseByName;
+    baseByName.reserve(base.fileCount);
+    for (uint32_t b = 0; b < base.fileCount; ++b)
+        baseByName[FoldWadName(base.entryName(b))] = b;
+
+    PatchManifest manifest;
+    manifest.baseSize = base.size;
+    manifest.baseTableHash = HashXxh64(base.base, (size_t)base.tableBytes);
+    manifest.targetSize = target.size;
+
+    std::unordered_set<std::string> targetNames;
+    targetNames.reserve(target.fileCount);
+    std::unordered_map<WadRange, uint64_t, WadRangeHash> patchByRange;
+    std::vector<uint32_t> patchEntries;   // Target entry providing each patch data entry
+    size_t kept = 0, added = 0, changed = 0;
+    uint64_t patchBytes = 0;
+
+    for (uint32_t i = 0; i < target.fileCount; ++i) {
+        std::string key = FoldWadName(target.entryName(i));
+        auto it = baseByName.find(key);
+        targetNames.insert(std::move(key));
+
+        char op = kPatchAdded;
+        if (it != baseByName.end()) {
+            uint32_t b = it->second;
+            if (base.entrySize(b) == target.entrySize(i) && baseSums.entries[b] == targetSums.entries[i]) {
+                manifest.ops.push_back(kPatchKeep);
+                manifest.sources.push_back(b);
+                manifest.hashes.push_back(baseSums.entries[b]);
+                kept++;
+                continue;
+            }
+            op = kPatchChanged;
+        }
+
+        auto [pit, inserted] = patchByRange.try_emplace(target.entryRange(i), kPatchFirstData + patchEntries.size());
+        if (inserted) {
+            patchEntries.push_back(i);
+            patchBytes += target.entrySize(i);
+        }
+        manifest.ops.push_back(op);
+        manifest.sources.push_back(pit->second);
+        manifest.hashes.push_back(0);
+        if (op == kPatchAdded)
+            added++;
+        else
+            changed++;
+
+        if (LogLevelEnabled(LogLevel::Files))
+            LogBuffered((op == kPatchAdded ? L"Added: " : L"Changed: ") + ToWideFromAnsi(target.entryName(i)));
+    }
+
+    for (uint32_t b = 0; b < base.fileCount; ++b) {
+        if (!targetNames.count(FoldWadName(base.entryName(b)))) {
+            manifest.removed.push_back(b);
+            if (LogLevelEnabled(LogLevel::Files))
+                LogBuffered(L"Removed: " + ToWideFromAnsi(base.entryName(b)));
+        }
+    }
+    AppendBufferedLog();
+
+    // ------------------------------------------------------------
+    // 5. Lay out the patch WAD: target table, manifest, then the
+    //    data (classic unless it would pass 4 GB)
+    // ------------------------------------------------------------
+    std::string manifestText = FormatManifest(manifest);
+    uint32_t patchCount = (uint32_t)(kPatchFirstData + patchEntries.size());
+    uint64_t payload = target.tableBytes + manifestText.size() + patchBytes;
+    WadFormat format = WadTableBytes(WadFormat::Classic, patchCount) + payload > kWadClassicMaxBytes
+        ? WadFormat::Wad64 : WadFormat::Classic;
+
+    size_t tableBytes = (size_t)WadTableBytes(format, patchCount);
+    std::vector<uint8_t> tableBuf(tableBytes, 0);
+    WriteWadHeader(tableBuf.data(), format, patchCount);
+
+    uint64_t offset = tableBytes;
+    WriteWadItem(tableBuf.data(), format, 0, kPatchTableName, offset, target.tableBytes);
+    offset += target.tableBytes;
+    WriteWadItem(tableBuf.data(), format, 1, kPatchManifestName, offset, manifestText.size());
+    offset += manifestText.size();
+
+    PatchSource fromTarget;
+    fromTarget.file = &targetFile;
+    for (size_t k = 0; k < patchEntries.size(); ++k) {
+        uint32_t i = patchEntries[k];
+        WriteWadItem(tableBuf.data(), format, (uint32_t)(kPatchFirstData + k), target.entryName(i),
+            offset, target.entrySize(i));
+        if (target.entrySize(i) > 0)
+            fromTarget.copies.push_back(PatchCopy{ target.entryOffset(i), offset, target.entrySize(i) });
+        offset += target.entrySize(i);
+    }
+    MergeCopies(fromTarget.copies);
+    planSpan.end();
+
+    // ------------------------------------------------------------
+    // 6. Write table, target table and manifest, then copy the
+    //    changed data in parallel
+    // ------------------------------------------------------------
+    TelemetrySpan createSpan(TelemetryPhase::CreateOutput);
+    FileHandle out;
+    bool created = out.create(outPath) &&
+        out.setSize(offset) &&
+        out.writeAt(tableBuf.data(), 0, tableBytes) &&
+        out.writeAt(target.base, tableBytes, (size_t)target.tableBytes) &&
+        out.writeAt(manifestText.data(), tableBytes + target.tableBytes, manifestText.size());
+    out.close();
+    createSpan.end();
+
+    std::error_code ec;
+    if (!created) {
+        std::filesystem::remove(outPath, ec);
+        ShowError(L"Failed to create patch file.");
+        return false;
+    }
+
+    Log(L"Writing patch...");
+    BeginProgress(patchBytes);
+    bool copied = RunCopies(outPath, { fromTarget }, pool, options);
+    EndProgress();
+
+    if (IsCancelled(options.cancel)) {
+        std::filesystem::remove(outPath, ec);
+        Log(L"Diff cancelled, partial patch removed");
+        return false;
+    }
+    if (!copied) {
+        std::filesystem::remove(outPath, ec);
+        ShowError(L"Failed to write patch file.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 7. Summary, time and throughput
+    // ------------------------------------------------------------
+    Log(std::to_wstring(kept) + L" unchanged, " + std::to_wstring(changed) + L" changed, " +
+        std::to_wstring(added) + L" added, " + std::to_wstring(manifest.removed.size()) + L" removed");
+    Log(L"Patch: " + FormatBytes(offset) + L" (" + FormatBytes(patchBytes) + L" of entry data)");
+    Log(L"Diff complete");
+
+    double elapsed = timer.seconds();
+    Log(L"Time taken: " + FormatSeconds(elapsed));
+    Log(L"Throughput: " + FormatThroughput(bytesDone.load(), base.fileCount + target.fileCount, elapsed));
+    return true;
+}
+
+bool ApplyPatch(const std::filesystem::path& basePath, const std::filesystem::path& patchPath,
+    const PatchOptions& options)
+{
+    Stopwatch timer;
+
+    Log(L"Reading patch");
+    SetProgress(0);
+
+    // ------------------------------------------------------------
+    // 1. Open the patch and read its target table and manifest
+    // ------------------------------------------------------------
+    MappedFile patchFile;
+    WadView patch;
+    const wchar_t* error = nullptr;
+    if (!OpenWadFile(patchPath, options.map, patchFile, patch, &error)) {
+        ShowError(error);
+        return false;
+    }
+    if (patch.compressed() || patch.fileCount < kPatchFirstData ||
+        patch.entryName(0) != kPatchTableName || patch.entryName(1) != kPatchManifestName) {
+        ShowError(L"Not an OpenWAD patch.");
+        return false;
+    }
+
+    std::vector<uint8_t> targetTable;
+    std::string manifestText;
+    {
+        MappedWindow window(patchFile);
+        const uint8_t* table = window.view(patch.entryOffset(0), (size_t)patch.entrySize(0));
+        if (table)
+            targetTable.assign(table, table + patch.entrySize(0));
+        const uint8_t* text = window.view(patch.entryOffset(1), (size_t)patch.entrySize(1));
+        if (text)
+            manifestText.assign(reinterpret_cast<const char*>(text), (size_t)patch.entrySize(1));
+        if (!table || !text) {
+            ShowError(L"Failed to read the patch.");
+            return false;
+        }
+    }
+
+    // ------------------------------------------------------------
+    // 2. Validate the target table against the target size (the
+    //    header must describe exactly the stored table) and the
+    //    manifest against it
+    // ------------------------------------------------------------
+    PatchManifest manifest;
+    WadView target;
+    if (!ParseManifest(manifestText, manifest) || manifest.targetSize > SIZE_MAX ||
+        WadHeadBytes(targetTable.data(), targetTable.size()) != targetTable.size() ||
+        !OpenWadView(targetTable.data(), (size_t)manifest.targetSize, target, &error) ||
+        target.compressed() || target.fileCount != manifest.ops.size()) {
+        ShowError(L"Corrupt patch: invalid target table or manifest.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 3. Open the base: it must be the WAD the patch was made from
+    // ------------------------------------------------------------
+    MappedFile baseFile;
+    WadView base;
+    if (!OpenWadFile(basePath, options.map, baseFile, base, &error)) {
+        ShowError(error);
+        return false;
+    }
+    if (base.size != manifest.baseSize ||
+        HashXxh64(base.base, (size_t)base.tableBytes) != manifest.baseTableHash) {
+        ShowError(L"The patch was made for a different base WAD.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 4. Plan one copy per distinct target data range: from the
+    //    base for kept entries, from the patch for the others;
+    //    each kept base range is checked against its hash first
+    // ------------------------------------------------------------
+    TelemetrySpan planSpan(TelemetryPhase::Plan);
+    PatchSource fromBase, fromPatch;
+    std::vector<PatchCheck> checks;
+    fromBase.file = &baseFile;
+    fromPatch.file = &patchFile;
+    uint64_t baseBytes = 0, patchBytes = 0;
+    size_t kept = 0, added = 0, changed = 0;
+
+    std::unordered_set<WadRange, WadRangeHash> seen;
+    for (uint32_t i = 0; i < target.fileCount; ++i) {
+        char op = manifest.ops[i];
+        uint64_t src = manifest.sources[i];
+        uint64_t size = target.entrySize(i);
+
+        bool fromBaseEntry = op == kPatchKeep;
+        bool valid = fromBaseEntry
+            ? src < base.fileCount && base.entrySize((uint32_t)src) == size
+            : src >= kPatchFirstData && src < patch.fileCount && patch.entrySize((uint32_t)src) == size;
+        if (!valid) {
+            ShowError(L"Corrupt patch: manifest does not match the tables.");
+            return false;
+        }
+        if (op == kPatchKeep)
+            kept++;
+        else if (op == kPatchAdded)
+            added++;
+        else
+            changed++;
+
+        if (size == 0)
+            continue;
+        if (fromBaseEntry)
+            checks.push_back(PatchCheck{ base.entryOffset((uint32_t)src), size, manifest.hashes[i] });
+        if (!seen.insert(target.entryRange(i)).second)
+            continue;
+        if (fromBaseEntry) {
+            fromBase.copies.push_back(PatchCopy{ base.entryOffset((uint32_t)src), target.entryOffset(i), size });
+            baseBytes += size;
+        }
+        else {
+            fromPatch.copies.push_back(PatchCopy{ patch.entryOffset((uint32_t)src), target.entryOffset(i), size });
+            patchBytes += size;
+        }
+    }
+    MergeCopies(fromBase.copies);
+    MergeCopies(fromPatch.copies);
+    std::sort(checks.begin(), checks.end(), [](const PatchCheck& a, const PatchCheck& b) {
+        return a.offset != b.offset ? a.offset < b.offset : a.hash < b.hash;
+    });
+    checks.erase(std::unique(checks.begin(), checks.end(), [](const PatchCheck& a, const PatchCheck& b) {
+        return a.offset == b.offset && a.size == b.size && a.hash == b.hash;
+    }), checks.end());
+    uint64_t checkBytes = 0;
+    for (const PatchCheck& c : checks)
+        checkBytes += c.size;
+    planSpan.end();
+
+    unsigned threads = options.threads ? options.threads : ThreadPool::DefaultThreadCount();
+    ThreadPool pool(threads);
+
+    Log(L"Checking the base...");
+    BeginProgress(checkBytes);
+    bool baseMatches = CheckBaseRanges(baseFile, checks, pool, options);
+    EndProgress();
+
+    if (IsCancelled(options.cancel)) {
+        Log(L"Applying cancelled");
+        return false;
+    }
+    if (!baseMatches) {
+        ShowError(L"The patch was made for a different base WAD.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 5. Determine the output: the base itself (replaced through
+    //    a temporary file) unless another path was given
+    // ------------------------------------------------------------
+    std::filesystem::path outPath = options.outPath.empty() ? basePath : options.outPath;
+    std::error_code ec;
+    bool replaceBase = std::filesystem::equivalent(outPath, basePath, ec);
+    std::filesystem::path writePath = outPath;
+    if (replaceBase) {
+        writePath += ".tmp";
+    }
+    else if (std::filesystem::exists(outPath) && !ConfirmOverwrite(PathToDisplay(outPath))) {
+        Log(L"Cancelled applying patch");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 6. Create the sized output with the target table, then
+    //    copy from base and patch in parallel
+    // ------------------------------------------------------------
+    TelemetrySpan createSpan(TelemetryPhase::CreateOutput);
+    FileHandle out;
+    bool created = out.create(writePath);
+    if (created && (options.copyStrategy == CopyStrategy::Auto || options.copyStrategy == CopyStrategy::Preallocate))
+        out.preallocate(manifest.targetSize);
+    created = created &&
+        out.setSize(manifest.targetSize) &&
+        out.writeAt(targetTable.data(), 0, targetTable.size());
+    out.close();
+    createSpan.end();
+
+    if (!created) {
+        std::filesystem::remove(writePath, ec);
+        ShowError(L"Failed to create WAD file.");
+        return false;
+    }
+
+    Log(L"Applying patch...");
+    BeginProgress(baseBytes + patchBytes);
+    bool copied = RunCopies(writePath, { fromBase, fromPatch }, pool, options);
+    EndProgress();
+
+    baseFile.close();   // A mapped base could not be replaced on Windows
+    patchFile.close();
+
+    if (IsCancelled(options.cancel)) {
+        std::filesystem::remove(writePath, ec);
+        Log(L"Applying cancelled, partial output removed");
+        return false;
+    }
+    if (copied && writePath != outPath)
+        std::filesystem::rename(writePath, outPath, ec);
+    if (!copied || ec) {
+        std::filesystem::remove(writePath, ec);
+        ShowError(L"Failed to write WAD file.");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 7. Summary, time and throughput
+    // ------------------------------------------------------------
+    Log(std::to_wstring(kept) + L" unchanged (" + FormatBytes(baseBytes) + L" copied from the base), " +
+        std::to_wstring(changed) + L" changed, " + std::to_wstring(added) + L" added, " +
+        std::to_wstring(manifest.removed.size()) + L" removed (" + FormatBytes(patchBytes) + L" from the patch)");
+    Log(L"Patch applied: " + PathToDisplay(outPath));
+
+    double elapsed = timer.seconds();
+    Log(L"Time taken: " + FormatSeconds(elapsed));
+    Log(L"Throughput: " + FormatThroughput(baseBytes + patchBytes, target.fileCount, elapsed));
+    return true;
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+#include "copy_engine.h"
+#include "mapped_file.h"
+
+#include <atomic>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// Patch settings chosen by the front end
+// ------------------------------------------------------------
+struct PatchOptions {
+    unsigned threads = 0;                 // Hashing / copying threads (0 = one per core)
+    std::filesystem::path outPath;        // diff: patch WAD (empty = <target stem>.patch.wad)
+                                          // apply: rebuilt WAD (empty = replace the base WAD)
+    CopyStrategy copyStrategy = CopyStrategy::Auto;  // How ranges reach the output
+    MapOptions map{ kMapWindowBytes, MapAccess::Sequential };  // How the WADs are mapped (window 0 = whole file)
+    const std::atomic<bool>* cancel = nullptr;  // Set by the front end to stop (partial output is removed)
+};
+
+// ------------------------------------------------------------
+// Write a patch WAD that turns 'basePath' into 'targetPath':
+//  - both WADs are hashed in parallel on one pool (always:
+//    a .sum sidecar is not used); unreadable data fails the diff
+//  - target entries are matched with base entries by name
+//    (ignoring case, '/' = '\'); same size and hash = unchanged
+//  - the patch is an ordinary WAD: entry 0 holds the target's
+//    header + table, entry 1 a manifest (what each target entry
+//    is made of, with the hash of kept base data, and which base
+//    entries were removed), then the data of the added and
+//    changed entries under their names
+// Only uncompressed WADs (classic / WAD64) can be diffed.
+// Returns true when the patch was written.
+// ------------------------------------------------------------
+bool DiffWads(const std::filesystem::path& basePath, const std::filesystem::path& targetPath,
+    const PatchOptions& options);
+
+// ------------------------------------------------------------
+// Rebuild the target WAD of a patch from its base: the target
+// table is written as stored, unchanged entries are range-copied
+// from the base (neighbouring entries merged into one copy) and
+// the others from the patch, in parallel. The base must be the
+// exact WAD the patch was made from (size and table hash, and
+// every kept range is hashed against the manifest before
+// anything is written).
+// Replacing the base itself goes through a temporary file.
+// Returns true when the target WAD was written.
+// ------------------------------------------------------------
+bool ApplyPatch(const std::filesystem::path& basePath, const std::filesystem::path& patchPath,
+    const PatchOptions& options);
@@ -0,0 +1,181 @@
+﻿#include "wad_reader.h"
+#include "platform.h"
+#include "lz_codec.h"
+
+#include <string.h>
+
+// ------------------------------------------------------------
+// FNV-1a over the folded name
+// ------------------------------------------------------------
+uint64_t WadReader::HashName(std::string_view name)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (char c : name) {
+        h ^= FoldWadNameChar((uint8_t)c);
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+bool WadReader::SameName(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (FoldWadNameChar((uint8_t)a[i]) != FoldWadNameChar((uint8_t)b[i]))
+            return false;
+    }
+    return true;
+}
+
+bool WadReader::open(const std::filesystem::path& path, const wchar_t** error)
+{
+    const wchar_t* message = nullptr;
+    close();
+
+    // ------------------------------------------------------------
+    // 1. Map and validate the WAD
+    // ------------------------------------------------------------
+    if (!m_file.open(path)) {
+        if (error) *error = L"Failed to memory-map WAD file.";
+        return false;
+    }
+    if (!OpenWadView(m_file.base, m_file.size, m_view, &message)) {
+        if (error) *error = message;
+        close();
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 2. Size the index for a load factor of at most 1/2
+    // ------------------------------------------------------------
+    uint64_t slotCount = 16;
+    while (slotCount < (uint64_t)m_view.fileCount * 2)
+        slotCount <<= 1;
+    m_slots.assign((size_t)slotCount, Slot{});
+    m_mask = slotCount - 1;
+
+    // ------------------------------------------------------------
+    // 3. Insert every entry with linear probing; a repeated name
+    //    takes over the slot of the earlier entry
+    // ------------------------------------------------------------
+    for (uint32_t i = 0; i < m_view.fileCount; ++i) {
+        std::string_view key = name(i);
+        uint64_t h = HashName(key);
+        uint32_t tag = (uint32_t)(h >> 32);
+
+        for (uint64_t pos = h & m_mask;; pos = (pos + 1) & m_mask) {
+            Slot& slot = m_slots[(size_t)pos];
+            if (slot.entry == 0) {
+                slot.hash = tag;
+                slot.entry = i + 1;
+                break;
+            }
+            if (slot.hash == tag && SameName(name(slot.entry - 1), key)) {
+                slot.entry = i + 1;
+                break;
+            }
+        }
+    }
+
+    // ------------------------------------------------------------
+    // 4. Trace on request of the environment
+    // ------------------------------------------------------------
+    std::filesystem::path traceDir;
+    if (GetEnvPath("OPENWAD_TRACE_DIR", traceDir)) {
+        std::filesystem::path tracePath = traceDir / path.filename();
+        tracePath += ".trace";
+        startTrace(tracePath);
+    }
+    return true;
+}
+
+void WadReader::startTrace(const std::filesystem::path& tracePath)
+{
+    m_trace = std::make_unique<WadAccessTrace>();
+    m_trace->start(m_view.fileCount);
+    m_tracePath = tracePath;
+}
+
+void WadReader::close()
+{
+    if (m_trace) {
+        m_trace->write(m_tracePath, m_view);
+        m_trace.reset();
+    }
+    m_slots.clear();
+    m_slots.shrink_to_fit();
+    m_mask = 0;
+    m_view = WadView{};
+    m_file.close();
+}
+
+std::string_view WadReader::name(uint32_t index) const
+{
+    return m_view.entryName(index);
+}
+
+std::span<const uint8_t> WadReader::data(uint32_t index) const
+{
+    if (m_trace)
+        m_trace->record(index);
+    if (m_view.compressed()) {
+        if (m_view.entryBlockCount(index) != 1 ||
+            !(m_view.blocks[m_view.entryFirstBlock(index)].flags & kWadLzBlockRaw))
+            return {};
+    }
+    return std::span<const uint8_t>(m_view.entryData(index), (size_t)m_view.entrySize(index));
+}
+
+bool WadReader::read(uint32_t index, std::vector<uint8_t>& buffer, std::span<const uint8_t>& out) const
+{
+    out = data(index);
+    if (out.size() == m_view.entrySize(index))
+        return true;
+
+    // ------------------------------------------------------------
+    // Compressed entry: decode block by block into the buffer
+    // ------------------------------------------------------------
+    size_t size = (size_t)m_view.entrySize(index);
+    buffer.resize(size);
+    const WadLzBlock* blocks = m_view.blocks + m_view.entryFirstBlock(index);
+    for (uint64_t k = 0; k < m_view.entryBlockCount(index); ++k) {
+        const uint8_t* src = m_view.base + blocks[k].offset;
+        uint8_t* dst = buffer.data() + k * m_view.blockBytes;
+        size_t n = m_view.blockSize(index, k);
+        if (blocks[k].flags & kWadLzBlockRaw)
+            memcpy(dst, src, n);
+        else if (!LzDecompress(src, blocks[k].storedSize, dst, n))
+            return false;
+    }
+    out = std::span<const uint8_t>(buffer.data(), size);
+    return true;
+}
+
+int64_t WadReader::find(std::string_view key) const
+{
+    if (m_slots.empty())
+        return -1;
+
+    uint64_t h = HashName(key);
+    uint32_t tag = (uint32_t)(h >> 32);
+
+    for (uint64_t pos = h & m_mask;; pos = (pos + 1) & m_mask) {
+        const Slot& slot = m_slots[(size_t)pos];
+        if (slot.entry == 0)
+            return -1;
+        if (slot.hash == tag && SameName(name(slot.entry - 1), key))
+            return (int64_t)slot.entry - 1;
+    }
+}
+
+int64_t WadReader::find(const std::wstring& nameW) const
+{
+    return find(ToAnsiFromWide(nameW));
+}
+
+bool WadReader::read(std::string_view key, std::vector<uint8_t>& buffer, std::span<const uint8_t>& out) const
+{
+    int64_t index = find(key);
+    return index >= 0 && read((uint32_t)index, buffer, out);
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+#include "wad_format.h"
+#include "mapped_file.h"
+#include "wad_trace.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <memory>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// Read-only random access to a WAD file
+//  - the file is memory-mapped and validated once in open()
+//  - names are indexed in an open-addressing hash table, so a
+//    lookup costs one hash and (usually) one name compare
+//  - lookups ignore ASCII case and treat '/' like '\'
+//  - returned spans point straight into the mapping and stay
+//    valid until close(); compressed WADs decode into a buffer
+//    of the caller (see read(index, buffer, out))
+//  - optionally records an access trace (see startTrace) for
+//    the pack layout stage
+// After open() the reader is never modified (trace recording is
+// atomic), so any number of threads may call its const members
+// concurrently.
+// ------------------------------------------------------------
+class WadReader {
+public:
+    WadReader() = default;
+    WadReader(const WadReader&) = delete;
+    WadReader& operator=(const WadReader&) = delete;
+    ~WadReader() { close(); }
+
+    // --------------------------------------------------------
+    // Map and validate the WAD, then build the name index.
+    // On failure returns false and points 'error' (if given) at
+    // a message. When the OPENWAD_TRACE_DIR environment variable
+    // names a directory, tracing starts right away into
+    // <dir>/<wad file name>.trace.
+    // --------------------------------------------------------
+    bool open(const std::filesystem::path& path, const wchar_t** error = nullptr);
+
+    // --------------------------------------------------------
+    // Write the trace (if tracing), drop the index and unmap
+    // the file
+    // --------------------------------------------------------
+    void close();
+
+    bool isOpen() const { return m_view.base != nullptr; }
+
+    // --------------------------------------------------------
+    // Record the first access time and access count of every
+    // entry read through data() / read() from now on; close()
+    // writes the trace to 'tracePath'
+    // --------------------------------------------------------
+    void startTrace(const std::filesystem::path& tracePath);
+
+    uint32_t count() const { return m_view.fileCount; }
+    const WadView& view() const { return m_view; }
+
+    // --------------------------------------------------------
+    // Name (ANSI, as stored) and data of table entry 'index'
+    // (0 .. count() - 1). In a compressed WAD data() is empty
+    // unless the entry is stored as a single raw block.
+    // --------------------------------------------------------
+    std::string_view name(uint32_t index) const;
+    std::span<const uint8_t> data(uint32_t index) const;
+
+    // --------------------------------------------------------
+    // Data of table entry 'index' in any WAD format: straight
+    // from the mapping where possible, else decoded into
+    // 'buffer' ('out' then points into it). False on a corrupt
+    // compressed block.
+    // --------------------------------------------------------
+    bool read(uint32_t index, std::vector<uint8_t>& buffer, std::span<const uint8_t>& out) const;
+
+    // --------------------------------------------------------
+    // Table index of the entry called 'name' (ANSI), or -1.
+    // When a name occurs more than once the last entry wins,
+    // matching what extraction leaves on disk.
+    // --------------------------------------------------------
+    int64_t find(std::string_view name) const;
+    int64_t find(const std::wstring& nameW) const;
+
+    // --------------------------------------------------------
+    // Data of the entry called 'name', as read(index, buffer,
+    // out); false if there is none or its data is corrupt
+    // --------------------------------------------------------
+    bool read(std::string_view name, std::vector<uint8_t>& buffer, std::span<const uint8_t>& out) const;
+
+private:
+    // --------------------------------------------------------
+    // One hash slot: the upper hash bits (to skip most name
+    // compares) and the entry index + 1 (0 = empty slot)
+    // --------------------------------------------------------
+    struct Slot {
+        uint32_t hash = 0;
+        uint32_t entry = 0;
+    };
+
+    static uint64_t HashName(std::string_view name);
+    static bool SameName(std::string_view a, std::string_view b);
+
+    MappedFile m_file;             // Mapping the spans point into
+    WadView m_view;                // Validated header / table
+    std::vector<Slot> m_slots;     // Open-addressing index, power of two size
+    uint64_t m_mask = 0;           // m_slots.size() - 1
+
+    std::unique_ptr<WadAccessTrace> m_trace;  // Access trace being recorded (or null)
+    std::filesystem::path m_tracePath;        // Where close() writes it
+};
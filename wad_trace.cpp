@@ -0,0 +1,128 @@
+﻿#include "wad_trace.h"
+#include "wad_trie.h"
+#include "platform.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char kTraceMagic[] = "OpenWAD trace 1";
+
+void WadAccessTrace::start(uint32_t entryCount)
+{
+    m_entryCount = entryCount;
+    m_first = std::make_unique<std::atomic<uint64_t>[]>(entryCount);
+    m_count = std::make_unique<std::atomic<uint32_t>[]>(entryCount);
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        m_first[i].store(0, std::memory_order_relaxed);
+        m_count[i].store(0, std::memory_order_relaxed);
+    }
+    m_t0 = std::chrono::steady_clock::now();
+}
+
+void WadAccessTrace::record(uint32_t index)
+{
+    if (index >= m_entryCount)
+        return;
+
+    // ------------------------------------------------------------
+    // Only the first access is timed: later ones just count, so
+    // the steady state costs one relaxed increment
+    // ------------------------------------------------------------
+    if (m_count[index].fetch_add(1, std::memory_order_relaxed) == 0) {
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_t0).count();
+        uint64_t expected = 0;
+        m_first[index].compare_exchange_strong(expected, ns + 1, std::memory_order_relaxed);
+    }
+}
+
+bool WadAccessTrace::write(const std::filesystem::path& path, const WadView& wad) const
+{
+    // ------------------------------------------------------------
+    // 1. Accessed entries, ordered by first access
+    // ------------------------------------------------------------
+    std::vector<uint32_t> accessed;
+    for (uint32_t i = 0; i < m_entryCount && i < wad.fileCount; ++i) {
+        if (m_first[i].load(std::memory_order_relaxed) != 0)
+            accessed.push_back(i);
+    }
+    std::stable_sort(accessed.begin(), accessed.end(), [this](uint32_t a, uint32_t b) {
+        return m_first[a].load(std::memory_order_relaxed) < m_first[b].load(std::memory_order_relaxed);
+    });
+
+    // ------------------------------------------------------------
+    // 2. Magic line, then one line per entry
+    // ------------------------------------------------------------
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    out << kTraceMagic << '\n';
+    for (uint32_t i : accessed) {
+        std::string_view name = wad.entryName(i);
+        out << (m_first[i].load(std::memory_order_relaxed) - 1) / 1000 << '\t'
+            << m_count[i].load(std::memory_order_relaxed) << '\t'
+            << ToUtf8(ToWideFromAnsi(name)) << '\n';
+    }
+    return (bool)out.flush();
+}
+
+bool ReadLayoutOrder(const std::filesystem::path& path, std::vector<std::string>& names)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    // ------------------------------------------------------------
+    // 1. A trace starts with the magic line, anything else is a
+    //    hot-list (UTF-8, optional BOM)
+    // ------------------------------------------------------------
+    std::string line;
+    bool first = true;
+    bool trace = false;
+    std::vector<std::pair<uint64_t, std::string>> timed;
+
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (first && line.size() >= 3 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            line.erase(0, 3);
+        if (first) {
+            first = false;
+            if (line == kTraceMagic) {
+                trace = true;
+                continue;
+            }
+        }
+        if (line.empty() || (!trace && line[0] == '#'))
+            continue;
+
+        // --------------------------------------------------------
+        // 2. Trace line: "<first access us>\t<count>\t<name>"
+        // --------------------------------------------------------
+        if (trace) {
+            size_t tab1 = line.find('\t');
+            size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+            if (tab2 == std::string::npos)
+                return false;
+            uint64_t us = strtoull(line.c_str(), nullptr, 10);
+            timed.emplace_back(us, FoldWadName(ToAnsiFromWide(FromUtf8(std::string_view(line).substr(tab2 + 1)))));
+            continue;
+        }
+        names.push_back(FoldWadName(ToAnsiFromWide(FromUtf8(line))));
+    }
+
+    // ------------------------------------------------------------
+    // 3. Traces may have been merged by hand: order by time
+    // ------------------------------------------------------------
+    if (trace) {
+        std::stable_sort(timed.begin(), timed.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& t : timed)
+            names.push_back(std::move(t.second));
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include "wad_format.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// ------------------------------------------------------------
+// Access trace of one WAD: when each entry was first read and
+// how often. Recording is lock-free (one atomic per entry), so
+// an instrumented reader can stay on in a running game.
+// ------------------------------------------------------------
+class WadAccessTrace {
+public:
+    // --------------------------------------------------------
+    // Forget earlier accesses and start the clock
+    // --------------------------------------------------------
+    void start(uint32_t entryCount);
+
+    // --------------------------------------------------------
+    // Note an access to table entry 'index' (any thread)
+    // --------------------------------------------------------
+    void record(uint32_t index);
+
+    // --------------------------------------------------------
+    // Write the accessed entries in first-access order:
+    // "<first access, microseconds>\t<access count>\t<name>"
+    // per line (UTF-8) after a magic line
+    // --------------------------------------------------------
+    bool write(const std::filesystem::path& path, const WadView& wad) const;
+
+private:
+    std::chrono::steady_clock::time_point m_t0;        // Clock origin
+    std::unique_ptr<std::atomic<uint64_t>[]> m_first;  // First access, ns since m_t0 + 1 (0 = never)
+    std::unique_ptr<std::atomic<uint32_t>[]> m_count;  // Accesses per entry
+    uint32_t m_entryCount = 0;
+};
+
+// ------------------------------------------------------------
+// Read a layout file for packing: either a trace written by
+// WadAccessTrace (entries in first-access order) or a hot-list
+// (one entry name per line, '#' starts a comment line). Returns
+// the ANSI names in the order their data should be placed,
+// folded with FoldWadName.
+// ------------------------------------------------------------
+bool ReadLayoutOrder(const std::filesystem::path& path, std::vector<std::string>& names);
@@ -0,0 +1,325 @@
+﻿#include "wad_trie.h"
+
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+std::string FoldWadName(std::string_view name)
+{
+    std::string out(name.size(), '\0');
+    FoldWadNameBytes(name.data(), name.size(), out.data());
+    return out;
+}
+
+bool GlobMatch(std::string_view pattern, std::string_view text)
+{
+    // ------------------------------------------------------------
+    // Greedy match with a single backtrack point: on mismatch,
+    // let the last '*' swallow one more character
+    // ------------------------------------------------------------
+    size_t p = 0, t = 0;
+    size_t starP = std::string_view::npos, starT = 0;
+
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        }
+        else if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starT = t;
+        }
+        else if (starP != std::string_view::npos) {
+            p = starP + 1;
+            t = ++starT;
+        }
+        else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+    return p == pattern.size();
+}
+
+// ------------------------------------------------------------
+// Split a folded name into its non-empty components
+// ------------------------------------------------------------
+static void SplitFolded(std::string_view folded, std::vector<std::string_view>& parts)
+{
+    parts.clear();
+    size_t start = 0;
+    for (size_t i = 0; i <= folded.size(); ++i) {
+        if (i == folded.size() || folded[i] == '\\') {
+            if (i > start)
+                parts.push_back(folded.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+}
+
+static bool HasWildcard(std::string_view part)
+{
+    return part.find_first_of("*?") != std::string_view::npos;
+}
+
+void WadTrie::clear()
+{
+    m_folded.clear();
+    m_nodes.clear();
+    m_dirLinks.clear();
+    m_fileLinks.clear();
+    m_view = WadView{};
+}
+
+void WadTrie::build(const WadView& view)
+{
+    clear();
+    m_view = view;
+
+    // ------------------------------------------------------------
+    // 1. Fold every name into one buffer (reserved up front so
+    //    views into it stay valid)
+    // ------------------------------------------------------------
+    std::vector<std::string_view> names(view.fileCount);
+    size_t total = 0;
+    for (uint32_t i = 0; i < view.fileCount; ++i) {
+        names[i] = view.entryName(i);
+        total += names[i].size();
+    }
+    m_folded.resize(total);
+    for (size_t i = 0, at = 0; i < names.size(); at += names[i].size(), ++i)
+        FoldWadNameBytes(names[i].data(), names[i].size(), m_folded.data() + at);
+
+    // ------------------------------------------------------------
+    // 2. Create a node per distinct directory prefix; a child
+    //    is always created after its parent
+    // ------------------------------------------------------------
+    std::vector<uint32_t> parentOf(1, 0);
+    std::unordered_map<std::string_view, uint32_t> nodeByPrefix;
+    m_nodes.emplace_back();
+
+    std::vector<uint32_t> fileParent;
+    fileParent.reserve(view.fileCount);
+    m_fileLinks.reserve(view.fileCount);
+
+    size_t pos = 0;
+    for (uint32_t i = 0; i < view.fileCount; ++i) {
+        std::string_view name = names[i];
+        std::string_view folded(m_folded.data() + pos, name.size());
+        pos += name.size();
+
+        uint32_t node = 0;
+        size_t start = 0;
+        for (size_t k = 0; k < folded.size(); ++k) {
+            if (folded[k] != '\\')
+                continue;
+            if (k > start) {
+                auto [it, inserted] = nodeByPrefix.try_emplace(folded.substr(0, k), (uint32_t)m_nodes.size());
+                if (inserted) {
+                    Node n;
+                    n.name = name.substr(start, k - start);
+                    n.key = folded.substr(start, k - start);
+                    m_nodes.push_back(n);
+                    parentOf.push_back(node);
+                }
+                node = it->second;
+            }
+            start = k + 1;
+        }
+
+        FileLink link;
+        link.key = folded.substr(start);
+        link.name = name.substr(start);
+        link.entry = i;
+        m_fileLinks.push_back(link);
+        fileParent.push_back(node);
+    }
+
+    // ------------------------------------------------------------
+    // 3. Group children by parent, sorted by key (entries with the
+    //    same key stay in table order)
+    // ------------------------------------------------------------
+    m_dirLinks.resize(m_nodes.size() - 1);
+    for (uint32_t i = 1; i < (uint32_t)m_nodes.size(); ++i)
+        m_dirLinks[i - 1] = i;
+    std::sort(m_dirLinks.begin(), m_dirLinks.end(), [&](uint32_t a, uint32_t b) {
+        if (parentOf[a] != parentOf[b])
+            return parentOf[a] < parentOf[b];
+        return m_nodes[a].key < m_nodes[b].key;
+    });
+    for (uint32_t k = 0; k < (uint32_t)m_dirLinks.size(); ++k) {
+        Node& parent = m_nodes[parentOf[m_dirLinks[k]]];
+        if (parent.dirCount++ == 0)
+            parent.firstDir = k;
+    }
+
+    std::vector<uint32_t> order(m_fileLinks.size());
+    for (uint32_t k = 0; k < (uint32_t)order.size(); ++k)
+        order[k] = k;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (fileParent[a] != fileParent[b])
+            return fileParent[a] < fileParent[b];
+        if (m_fileLinks[a].key != m_fileLinks[b].key)
+            return m_fileLinks[a].key < m_fileLinks[b].key;
+        return a < b;
+    });
+
+    std::vector<FileLink> sorted(order.size());
+    for (uint32_t k = 0; k < (uint32_t)order.size(); ++k) {
+        sorted[k] = m_fileLinks[order[k]];
+        Node& parent = m_nodes[fileParent[order[k]]];
+        if (parent.fileCount++ == 0)
+            parent.firstFile = k;
+        parent.totalFiles++;
+        parent.totalBytes += view.entrySize(sorted[k].entry);
+    }
+    m_fileLinks.swap(sorted);
+
+    // ------------------------------------------------------------
+    // 4. Roll the subtree totals up to the root
+    // ------------------------------------------------------------
+    for (size_t i = m_nodes.size() - 1; i > 0; --i) {
+        m_nodes[parentOf[i]].totalFiles += m_nodes[i].totalFiles;
+        m_nodes[parentOf[i]].totalBytes += m_nodes[i].totalBytes;
+    }
+}
+
+int64_t WadTrie::FindDir(uint32_t node, std::string_view key) const
+{
+    const Node& n = m_nodes[node];
+    auto first = m_dirLinks.begin() + n.firstDir;
+    auto last = first + n.dirCount;
+    auto it = std::lower_bound(first, last, key,
+        [&](uint32_t child, std::string_view k) { return m_nodes[child].key < k; });
+    if (it == last || m_nodes[*it].key != key)
+        return -1;
+    return *it;
+}
+
+void WadTrie::CollectSubtree(uint32_t node, std::vector<uint32_t>& out) const
+{
+    const Node& n = m_nodes[node];
+    for (uint32_t k = 0; k < n.fileCount; ++k)
+        out.push_back(m_fileLinks[n.firstFile + k].entry);
+    for (uint32_t k = 0; k < n.dirCount; ++k)
+        CollectSubtree(m_dirLinks[n.firstDir + k], out);
+}
+
+void WadTrie::MatchNode(uint32_t node, const std::vector<std::string_view>& parts, size_t part,
+    std::vector<uint32_t>& out) const
+{
+    // ------------------------------------------------------------
+    // Pattern used up on a directory: take the whole subtree
+    // ------------------------------------------------------------
+    if (part == parts.size()) {
+        CollectSubtree(node, out);
+        return;
+    }
+
+    const Node& n = m_nodes[node];
+    std::string_view p = parts[part];
+    bool last = part + 1 == parts.size();
+
+    // ------------------------------------------------------------
+    // '**': stay here, or descend into any sub-directory
+    // ------------------------------------------------------------
+    if (p == "**") {
+        if (last) {
+            CollectSubtree(node, out);
+            return;
+        }
+        MatchNode(node, parts, part + 1, out);
+        for (uint32_t k = 0; k < n.dirCount; ++k)
+            MatchNode(m_dirLinks[n.firstDir + k], parts, part, out);
+        return;
+    }
+
+    // ------------------------------------------------------------
+    // Literal component: binary search among the children
+    // ------------------------------------------------------------
+    if (!HasWildcard(p)) {
+        int64_t child = FindDir(node, p);
+        if (child >= 0)
+            MatchNode((uint32_t)child, parts, part + 1, out);
+
+        if (last) {
+            auto first = m_fileLinks.begin() + n.firstFile;
+            auto end = first + n.fileCount;
+            auto it = std::lower_bound(first, end, p,
+                [](const FileLink& f, std::string_view k) { return f.key < k; });
+            for (; it != end && it->key == p; ++it)
+                out.push_back(it->entry);
+        }
+        return;
+    }
+
+    // ------------------------------------------------------------
+    // Wildcard component: test the children of this node only
+    // ------------------------------------------------------------
+    for (uint32_t k = 0; k < n.dirCount; ++k) {
+        uint32_t child = m_dirLinks[n.firstDir + k];
+        if (GlobMatch(p, m_nodes[child].key))
+            MatchNode(child, parts, part + 1, out);
+    }
+    if (last) {
+        for (uint32_t k = 0; k < n.fileCount; ++k) {
+            const FileLink& f = m_fileLinks[n.firstFile + k];
+            if (GlobMatch(p, f.key))
+                out.push_back(f.entry);
+        }
+    }
+}
+
+bool WadTrie::match(std::string_view pattern, std::vector<uint32_t>& out) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    std::string folded = FoldWadName(pattern);
+    std::vector<std::string_view> parts;
+    SplitFolded(folded, parts);
+
+    size_t before = out.size();
+    MatchNode(0, parts, 0, out);
+    return out.size() > before;
+}
+
+bool WadTrie::list(std::string_view dir, std::vector<WadDirEntry>& out) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    std::string folded = FoldWadName(dir);
+    std::vector<std::string_view> parts;
+    SplitFolded(folded, parts);
+
+    uint32_t node = 0;
+    for (std::string_view p : parts) {
+        int64_t child = FindDir(node, p);
+        if (child < 0)
+            return false;
+        node = (uint32_t)child;
+    }
+
+    const Node& n = m_nodes[node];
+    for (uint32_t k = 0; k < n.dirCount; ++k) {
+        const Node& child = m_nodes[m_dirLinks[n.firstDir + k]];
+        WadDirEntry e;
+        e.name = child.name;
+        e.isDir = true;
+        e.bytes = child.totalBytes;
+        e.files = child.totalFiles;
+        out.push_back(e);
+    }
+    for (uint32_t k = 0; k < n.fileCount; ++k) {
+        const FileLink& f = m_fileLinks[n.firstFile + k];
+        WadDirEntry e;
+        e.name = f.name;
+        e.entry = f.entry;
+        e.bytes = m_view.entrySize(f.entry);
+        e.files = 1;
+        out.push_back(e);
+    }
+    return true;
+}
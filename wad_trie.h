@@ -0,0 +1,105 @@
+﻿#pragma once
+#include "wad_format.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ------------------------------------------------------------
+// One line of a WAD directory listing
+// ------------------------------------------------------------
+struct WadDirEntry {
+    std::string_view name;   // Path component as stored in the WAD (ANSI)
+    bool isDir = false;      // Sub-directory rather than an entry
+    uint32_t entry = 0;      // Table index (entries only)
+    uint64_t bytes = 0;      // Entry size, or total size below a directory
+    uint64_t files = 0;      // 1, or number of entries below a directory
+};
+
+// ------------------------------------------------------------
+// Directory tree over the entry names of a WAD
+//  - built once from the item table; every directory node
+//    keeps its sub-directories and entries sorted by folded
+//    name (ASCII lower case, '/' = '\') in flat arrays
+//  - patterns are resolved by walking the tree, so literal
+//    path components cost a binary search and only the nodes
+//    under the selection are visited
+// The trie references the names inside the WAD image, which
+// must stay mapped while the trie is in use. Const members are
+// safe to call from several threads.
+// ------------------------------------------------------------
+class WadTrie {
+public:
+    // --------------------------------------------------------
+    // Build the tree from a validated WAD view
+    // --------------------------------------------------------
+    void build(const WadView& view);
+
+    void clear();
+
+    // --------------------------------------------------------
+    // Append the table indices of the entries selected by
+    // 'pattern' (ANSI) to 'out'. Components are separated by
+    // '\' or '/' and may use:
+    //  - '*' (any run of characters) and '?' (one character)
+    //  - '**' as a whole component: any number of directories
+    // A pattern that ends on a directory selects everything
+    // below it ("cars\textures" = "cars\textures\**").
+    // 'out' is neither sorted nor free of duplicates. Returns
+    // true if anything matched.
+    // --------------------------------------------------------
+    bool match(std::string_view pattern, std::vector<uint32_t>& out) const;
+
+    // --------------------------------------------------------
+    // List the sub-directories, then the entries, directly
+    // inside 'dir' ("" = root). Returns false if 'dir' is not a
+    // directory of the WAD.
+    // --------------------------------------------------------
+    bool list(std::string_view dir, std::vector<WadDirEntry>& out) const;
+
+private:
+    // --------------------------------------------------------
+    // Directory node; children live in m_dirLinks and
+    // m_fileLinks as contiguous runs sorted by key
+    // --------------------------------------------------------
+    struct Node {
+        std::string_view name;    // Component as stored (first spelling seen)
+        std::string_view key;     // Folded component
+        uint32_t firstDir = 0;    // First child in m_dirLinks
+        uint32_t dirCount = 0;    // Number of sub-directories
+        uint32_t firstFile = 0;   // First entry in m_fileLinks
+        uint32_t fileCount = 0;   // Number of entries directly inside
+        uint64_t totalBytes = 0;  // Size of everything below
+        uint64_t totalFiles = 0;  // Entries below (recursive)
+    };
+
+    struct FileLink {
+        std::string_view key;     // Folded leaf name
+        std::string_view name;    // Leaf name as stored
+        uint32_t entry = 0;       // Table index
+    };
+
+    int64_t FindDir(uint32_t node, std::string_view key) const;
+    void MatchNode(uint32_t node, const std::vector<std::string_view>& parts, size_t part,
+        std::vector<uint32_t>& out) const;
+    void CollectSubtree(uint32_t node, std::vector<uint32_t>& out) const;
+
+    std::string m_folded;               // Folded copies of all names
+    std::vector<Node> m_nodes;          // Node 0 is the root
+    std::vector<uint32_t> m_dirLinks;   // Child node indices, grouped by parent
+    std::vector<FileLink> m_fileLinks;  // Entries, grouped by directory
+    WadView m_view;                     // The indexed WAD (entry sizes for listings)
+};
+
+// ------------------------------------------------------------
+// Fold a user supplied name or pattern to trie key form
+// ------------------------------------------------------------
+std::string FoldWadName(std::string_view name);
+
+// ------------------------------------------------------------
+// Match 'text' against a glob component ('*' and '?');
+// both are expected in folded form
+// ------------------------------------------------------------
+bool GlobMatch(std::string_view pattern, std::string_view text);
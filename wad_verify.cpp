@@ -0,0 +1,451 @@
+﻿#include "wad_verify.h"
+#include "mapped_file.h"
+#include "checksum.h"
+#include "platform.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "telemetry.h"
+#include "job.h"
+
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <optional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char kChecksumMagic[] = "OpenWAD checksums 1";
+
+static const uint64_t kHashBatchBytes = 4ull * 1024 * 1024;  // Target bytes per hashing task
+static const size_t   kHashBatchFiles = 256;                 // Max entries per hashing task
+
+std::filesystem::path ChecksumPath(const std::filesystem::path& wadPath)
+{
+    std::filesystem::path p = wadPath;
+    p += ".sum";
+    return p;
+}
+
+bool ReadChecksums(const std::filesystem::path& path, WadChecksums& sums)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    // ------------------------------------------------------------
+    // 1. Magic line, then "<file count>\t<table hash hex>"
+    // ------------------------------------------------------------
+    std::string line;
+    if (!std::getline(in, line) || line != kChecksumMagic)
+        return false;
+    if (!std::getline(in, line))
+        return false;
+
+    char* end = nullptr;
+    sums.fileCount = (uint32_t)strtoul(line.c_str(), &end, 10);
+    if (*end != '\t')
+        return false;
+    sums.tableHash = strtoull(end + 1, &end, 16);
+    if (*end != '\0')
+        return false;
+
+    // ------------------------------------------------------------
+    // 2. One hex hash per entry, in table order
+    // ------------------------------------------------------------
+    sums.entries.clear();
+    sums.entries.reserve(sums.fileCount);
+    while (std::getline(in, line)) {
+        sums.entries.push_back(strtoull(line.c_str(), &end, 16));
+        if (*end != '\0' || end == line.c_str())
+            return false;
+    }
+    return sums.entries.size() == sums.fileCount;
+}
+
+bool WriteChecksums(const std::filesystem::path& path, const WadChecksums& sums)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    char hashText[24];
+    snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)sums.tableHash);
+    out << kChecksumMagic << '\n';
+    out << sums.fileCount << '\t' << hashText << '\n';
+
+    for (uint64_t h : sums.entries) {
+        snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)h);
+        out << hashText << '\n';
+    }
+    return (bool)out.flush();
+}
+
+bool HashWadRange(MappedWindow& window, uint64_t offset, uint64_t size, uint64_t& hash)
+{
+    const size_t chunk = window.windowBytes();
+    if (size <= chunk) {
+        const uint8_t* data = window.view(offset, (size_t)size);
+        if (!data)
+            return false;
+        hash = HashXxh64(data, (size_t)size);
+        return true;
+    }
+
+    Xxh64 h;
+    for (uint64_t done = 0; done < size;) {
+        size_t n = (size_t)std::min<uint64_t>(size - done, chunk);
+        const uint8_t* data = window.view(offset + done, n);
+        if (!data)
+            return false;
+        if (done + n < size)
+            window.prefetch(offset + done + n, size - done - n);
+        h.update(data, n);
+        done += n;
+    }
+    hash = h.digest();
+    return true;
+}
+
+// ------------------------------------------------------------
+// XXH64 of a compressed entry's decoded data
+// ------------------------------------------------------------
+static bool HashBlocks(MappedWindow& window, const WadView& wad, uint32_t i, uint64_t& hash)
+{
+    thread_local std::vector<uint8_t> scratch;
+    Xxh64 h;
+    bool ok = DecodeWadBlocks(window, wad, i, 0, wad.entryBlockCount(i), scratch,
+        [&h](const uint8_t* data, size_t size, uint64_t) { h.update(data, size); return true; });
+    hash = h.digest();
+    return ok;
+}
+
+size_t HashWadEntries(const MappedFile& file, const WadView& wad, unsigned threads, WadChecksums& sums,
+    std::atomic<uint64_t>* bytesDone, const std::atomic<bool>* cancel, ThreadPool* pool,
+    std::vector<uint32_t>* unreadable)
+{
+    sums.fileCount = wad.fileCount;
+    sums.tableHash = HashXxh64(wad.base, (size_t)wad.tableBytes);
+    sums.entries.assign(wad.fileCount, 0);
+
+    // ------------------------------------------------------------
+    // 1. Hash each distinct data range once; entries sharing a
+    //    range (dedup packs) copy the hash afterwards
+    // ------------------------------------------------------------
+    std::vector<int64_t> sameAs(wad.fileCount, -1);
+    std::vector<uint8_t> failed(wad.fileCount, 0);   // Data could not be mapped / decoded
+    std::vector<uint32_t> units;
+    units.reserve(wad.fileCount);
+    {
+        std::unordered_map<WadRange, uint32_t, WadRangeHash> firstByRange;
+        firstByRange.reserve(wad.fileCount);
+        for (uint32_t i = 0; i < wad.fileCount; ++i) {
+            auto [it, inserted] = firstByRange.try_emplace(wad.entryRange(i), i);
+            if (inserted)
+                units.push_back(i);
+            else
+                sameAs[i] = it->second;
+        }
+    }
+
+    // ------------------------------------------------------------
+    // 2. Largest entries first, small ones grouped into tasks of
+    //    roughly kHashBatchBytes, on a work-stealing pool
+    // ------------------------------------------------------------
+    std::stable_sort(units.begin(), units.end(), [&wad](uint32_t a, uint32_t b) {
+        return wad.entrySize(a) > wad.entrySize(b);
+    });
+
+    // ------------------------------------------------------------
+    // Each task walks its entries in file order through its own
+    // map window, prefetching the next entry while hashing one
+    // ------------------------------------------------------------
+    auto hashRun = [&file, &wad, &sums, &units, &failed, bytesDone, cancel](size_t first, size_t last) {
+        TelemetrySpan span(TelemetryPhase::Hash);
+        std::sort(units.begin() + first, units.begin() + last, [&wad](uint32_t a, uint32_t b) {
+            return wad.entryOffset(a) < wad.entryOffset(b);
+        });
+
+        MappedWindow window(file);
+        for (size_t k = first; k < last && !IsCancelled(cancel); ++k) {
+            uint32_t i = units[k];
+            uint64_t size = wad.entrySize(i);
+            if (wad.compressed()) {
+                if (!HashBlocks(window, wad, i, sums.entries[i]))
+                    failed[i] = 1;
+            }
+            else {
+                if (k + 1 < last)
+                    window.prefetch(wad.entryOffset(units[k + 1]), wad.entrySize(units[k + 1]));
+                if (!HashWadRange(window, wad.entryOffset(i), size, sums.entries[i]))
+                    failed[i] = 1;
+            }
+            TelemetryAdd(TelemetryCounter::BytesHashed, size);
+            if (bytesDone)
+                bytesDone->fetch_add(size, std::memory_order_relaxed);
+        }
+    };
+
+    if (pool)
+        threads = pool->size();
+    else if (threads == 0)
+        threads = ThreadPool::DefaultThreadCount();
+
+    if (threads <= 1) {
+        hashRun(0, units.size());
+    }
+    else {
+        std::optional<ThreadPool> ownPool;
+        TaskGroup group(pool ? *pool : ownPool.emplace(threads));
+        size_t first = 0;
+        while (first < units.size()) {
+            size_t last = first;
+            uint64_t bytes = 0;
+            while (last < units.size() && last - first < kHashBatchFiles &&
+                   (last == first || bytes + wad.entrySize(units[last]) <= kHashBatchBytes)) {
+                bytes += wad.entrySize(units[last]);
+                last++;
+            }
+            group.submit([&hashRun, first, last] { hashRun(first, last); });
+            first = last;
+        }
+        group.wait();
+    }
+
+    size_t failures = 0;
+    for (uint32_t i = 0; i < wad.fileCount; ++i) {
+        if (sameAs[i] >= 0) {
+            sums.entries[i] = sums.entries[sameAs[i]];
+            failed[i] = failed[sameAs[i]];
+        }
+        if (failed[i]) {
+            sums.entries[i] = 0;
+            failures++;
+            if (unreadable)
+                unreadable->push_back(i);
+        }
+    }
+    return failures;
+}
+
+// ------------------------------------------------------------
+// Entry name as wide text for log output
+// ------------------------------------------------------------
+static std::wstring EntryName(const WadView& wad, uint32_t i)
+{
+    return ToWideFromAnsi(wad.entryName(i));
+}
+
+bool VerifyWad(const std::filesystem::path& wadPath, const VerifyOptions& options)
+{
+    Stopwatch timer;
+
+    Log(L"Reading WAD header");
+    SetProgress(0);
+
+    // ------------------------------------------------------------
+    // 1. Open and memory-map the WAD file for read-only access
+    //    (with a window: the table only)
+    // 2. Validate header, table and every entry's data range
+    // ------------------------------------------------------------
+    MappedFile mf;
+    WadView wad;
+    const wchar_t* error = nullptr;
+    if (!OpenWadFile(wadPath, options.map, mf, wad, &error)) {
+        ShowError(error);
+        return false;
+    }
+
+    Log(std::to_wstring(wad.fileCount) + L" files found" +
+        (wad.format == WadFormat::Wad64 ? L" (WAD64)" : wad.compressed() ? L" (compressed)" : L""));
+
+    // ------------------------------------------------------------
+    // 3. Walk the stored data in offset order (entry ranges, or
+    //    the blocks of a compressed WAD):
+    //    - identical ranges are shared (dedup), not an error; in
+    //      a compressed WAD entries share their whole block list
+    //    - a range starting inside an earlier one overlaps it
+    //    - whatever no range covers is unreferenced
+    // ------------------------------------------------------------
+    struct DataSpan {
+        uint64_t start = 0;
+        uint64_t end = 0;
+        uint32_t entry = 0;
+    };
+    std::vector<DataSpan> spans;
+    spans.reserve(wad.fileCount);
+
+    size_t shared = 0;
+    uint64_t decodedBytes = 0;   // Compressed WADs: data of the distinct entries
+    if (wad.compressed()) {
+        std::unordered_set<WadRange, WadRangeHash> seen;
+        for (uint32_t i = 0; i < wad.fileCount; ++i) {
+            if (wad.entrySize(i) == 0)
+                continue;
+            if (!seen.insert(wad.entryRange(i)).second) {
+                shared++;
+                continue;
+            }
+            decodedBytes += wad.entrySize(i);
+            const WadLzBlock* blocks = wad.blocks + wad.entryFirstBlock(i);
+            for (uint64_t k = 0; k < wad.entryBlockCount(i); ++k)
+                spans.push_back(DataSpan{ blocks[k].offset, blocks[k].offset + blocks[k].storedSize, i });
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < wad.fileCount; ++i) {
+            if (wad.entrySize(i) > 0)
+                spans.push_back(DataSpan{ wad.entryOffset(i), wad.entryOffset(i) + wad.entrySize(i), i });
+        }
+    }
+    std::sort(spans.begin(), spans.end(), [](const DataSpan& a, const DataSpan& b) {
+        return a.start != b.start ? a.start < b.start : a.end < b.end;
+    });
+
+    size_t overlaps = 0;
+    uint64_t covered = 0;
+    uint64_t reachEnd = wad.tableBytes;   // End of the furthest range so far
+    int64_t reachEntry = -1;              // Entry owning that range
+    const DataSpan* prev = nullptr;
+
+    for (const DataSpan& span : spans) {
+        if (prev && !wad.compressed() && prev->start == span.start && prev->end == span.end) {
+            shared++;
+            continue;
+        }
+        if (span.start < reachEnd && reachEntry >= 0) {
+            LogBuffered(L"Overlapping data: " + EntryName(wad, span.entry) + L" and " +
+                EntryName(wad, (uint32_t)reachEntry));
+            overlaps++;
+        }
+        if (span.end > reachEnd) {
+            covered += span.end - std::max(span.start, reachEnd);
+            reachEnd = span.end;
+            reachEntry = span.entry;
+        }
+        prev = &span;
+    }
+    AppendBufferedLog();
+
+    uint64_t unreferenced = (wad.size - wad.tableBytes) - covered;
+    if (shared > 0)
+        Log(std::to_wstring(shared) + L" entries share their data with another entry");
+    if (unreferenced > 0)
+        Log(std::to_wstring(unreferenced) + L" bytes of the data area not referenced by any entry");
+
+    // ------------------------------------------------------------
+    // 4. Hash every entry while this thread reports progress
+    // ------------------------------------------------------------
+    Log(L"Hashing...");
+
+    uint64_t uniqueBytes = wad.compressed() ? decodedBytes : covered;
+    std::atomic<uint64_t> bytesDone{ 0 };
+    WadChecksums sums;
+    std::atomic<bool> hashed{ false };
+    std::vector<uint32_t> unreadable;
+
+    BeginProgress(uniqueBytes);
+    std::thread hasher([&] {
+        HashWadEntries(mf, wad, options.threads, sums, &bytesDone, options.cancel, options.pool, &unreadable);
+        hashed = true;
+    });
+    uint64_t reported = 0;
+    auto reportHashed = [&] {
+        uint64_t done = bytesDone.load(std::memory_order_relaxed);
+        AddProgress(done - reported);
+        reported = done;
+    };
+    while (!hashed) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kLogPumpMs / 2));
+        reportHashed();
+        PumpProgress();
+    }
+    hasher.join();
+    reportHashed();
+    EndProgress();
+
+    if (IsCancelled(options.cancel)) {
+        Log(L"Verification cancelled");
+        return false;
+    }
+
+    // ------------------------------------------------------------
+    // 5. Compare against the sidecar. A sidecar written for a
+    //    different table (the WAD was rebuilt) is not used.
+    // ------------------------------------------------------------
+    std::filesystem::path sumPath = ChecksumPath(wadPath);
+    WadChecksums stored;
+    bool haveStored = ReadChecksums(sumPath, stored);
+    bool ok = overlaps == 0 && unreadable.empty();
+
+    // ------------------------------------------------------------
+    // Data that cannot be read or decoded is damage on its own,
+    // sidecar or not
+    // ------------------------------------------------------------
+    for (uint32_t i : unreadable)
+        LogBuffered(L"Unreadable data: " + EntryName(wad, i));
+    AppendBufferedLog();
+    if (!unreadable.empty())
+        Log(std::to_wstring(unreadable.size()) + L" of " + std::to_wstring(wad.fileCount) +
+            L" entries could not be read or decoded");
+
+    if (haveStored && (stored.fileCount != sums.fileCount || stored.tableHash != sums.tableHash)) {
+        Log(L"Checksum file does not belong to this WAD, ignoring it");
+        haveStored = false;
+    }
+
+    size_t mismatches = 0;
+    if (haveStored) {
+        for (uint32_t i = 0; i < wad.fileCount; ++i) {
+            if (stored.entries[i] != sums.entries[i] && !std::binary_search(unreadable.begin(), unreadable.end(), i)) {
+                LogBuffered(L"Checksum mismatch: " + EntryName(wad, i));
+                mismatches++;
+            }
+        }
+        AppendBufferedLog();
+
+        if (mismatches > 0) {
+            Log(std::to_wstring(mismatches) + L" of " + std::to_wstring(wad.fileCount) + L" entries are damaged");
+            ok = false;
+        }
+        else {
+            Log(L"All " + std::to_wstring(wad.fileCount) + L" entries match their checksums");
+        }
+    }
+    else if (!options.writeChecksums) {
+        Log(L"No checksum file, only the structure was checked");
+    }
+
+    // ------------------------------------------------------------
+    // 6. Write the sidecar on request (never once damage was
+    //    found: that would bless the damage)
+    // ------------------------------------------------------------
+    if (options.writeChecksums && ok) {
+        if (WriteChecksums(sumPath, sums))
+            Log(L"Checksums written: " + PathToDisplay(sumPath));
+        else
+            Log(L"Failed to write checksum file");
+    }
+    else if (options.writeChecksums) {
+        Log(L"Checksum file not written: the WAD is damaged");
+    }
+
+    if (overlaps > 0)
+        Log(std::to_wstring(overlaps) + L" entries overlap another entry's data");
+
+    SetProgress(100);
+    Log(ok ? L"Verification passed" : L"Verification FAILED");
+
+    // ------------------------------------------------------------
+    // 7. Measure and log total time and hashing throughput
+    // ------------------------------------------------------------
+    double elapsed = timer.seconds();
+    Log(L"Time taken: " + FormatSeconds(elapsed));
+    Log(L"Throughput: " + FormatThroughput(bytesDone.load(), wad.fileCount, elapsed));
+
+    return ok;
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+#include "wad_format.h"
+#include "mapped_file.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <filesystem>
+#include <vector>
+
+class ThreadPool;
+
+// ------------------------------------------------------------
+// Per-entry checksums of one WAD, kept in a sidecar next to it
+// (<file.wad>.sum) so the WAD itself stays readable by every
+// existing tool. The sidecar belongs to the WAD whose header +
+// table hash to 'tableHash'; it survives copying the WAD.
+// ------------------------------------------------------------
+struct WadChecksums {
+    uint32_t fileCount = 0;           // Entries in the table
+    uint64_t tableHash = 0;           // XXH64 of header + table
+    std::vector<uint64_t> entries;    // XXH64 of each entry's data, in table order
+};
+
+// ------------------------------------------------------------
+// <file.wad> -> <file.wad>.sum
+// ------------------------------------------------------------
+std::filesystem::path ChecksumPath(const std::filesystem::path& wadPath);
+
+// ------------------------------------------------------------
+// Read / write the sidecar (text, one hex hash per line). Both
+// return false on any I/O or format error.
+// ------------------------------------------------------------
+bool ReadChecksums(const std::filesystem::path& path, WadChecksums& sums);
+bool WriteChecksums(const std::filesystem::path& path, const WadChecksums& sums);
+
+// ------------------------------------------------------------
+// XXH64 of a data range read through a map window; ranges
+// larger than the window are streamed a window at a time.
+// Returns false when the range could not be mapped.
+// ------------------------------------------------------------
+bool HashWadRange(MappedWindow& window, uint64_t offset, uint64_t size, uint64_t& hash);
+
+// ------------------------------------------------------------
+// Hash every entry of a validated WAD in parallel ('threads'
+// workers, 0 = one per core, or the workers of a shared 'pool'),
+// reading the data through map windows over 'file'. Entries
+// sharing a data range are hashed once. 'bytesDone'
+// (optional) counts hashed bytes for progress reports; once
+// 'cancel' is set the remaining entries are skipped (their sums
+// are left at 0).
+// Returns the number of entries whose data could not be mapped
+// or decoded (sum 0); their table indices are appended to
+// 'unreadable' when given.
+// ------------------------------------------------------------
+size_t HashWadEntries(const MappedFile& file, const WadView& wad, unsigned threads, WadChecksums& sums,
+    std::atomic<uint64_t>* bytesDone = nullptr, const std::atomic<bool>* cancel = nullptr,
+    ThreadPool* pool = nullptr, std::vector<uint32_t>* unreadable = nullptr);
+
+// ------------------------------------------------------------
+// Verification settings chosen by the front end
+// ------------------------------------------------------------
+struct VerifyOptions {
+    unsigned threads = 0;         // Hashing threads (0 = one per core)
+    ThreadPool* pool = nullptr;   // Shared workers to use instead (a batch; 'threads' ignored)
+    bool writeChecksums = false;  // (Re)write the sidecar from the computed hashes
+    MapOptions map{ kMapWindowBytes, MapAccess::Sequential };  // How the WAD is mapped (window 0 = whole file)
+    const std::atomic<bool>* cancel = nullptr;  // Set by the front end to stop
+};
+
+// ------------------------------------------------------------
+// Check a WAD:
+//  - header, table and data ranges (as on extraction)
+//  - data ranges that partially overlap another entry's range
+//    (identical ranges are reported as shared, dedup packs
+//    create them on purpose)
+//  - every entry's data can be read (compressed: decoded)
+//  - every entry against the sidecar checksums, when present
+// Returns true when no problem was found; the sidecar is not
+// (re)written once one was.
+// ------------------------------------------------------------
+bool VerifyWad(const std::filesystem::path& wadPath, const VerifyOptions& options);